@@ -0,0 +1,11 @@
+# Two nodes with two rails each, loaded with
+#   NCCL_NET_PLUGIN=emul RCCL_NET_EMUL_PROFILE=example.profile NCCL_HOSTID=node0|node1
+# Device names should match the <net> nodes of NCCL_TOPO_FILE, if any.
+device mlx5_0 speed=200000
+device mlx5_1 speed=200000
+
+# First matching rule wins
+link node0 node1 rail=same latency=3 jitter=1 bw=23
+link node1 node0 rail=same latency=3 jitter=1 bw=23
+# Traffic between rails goes through the spine
+link * * rail=cross latency=5 jitter=2 bw=12 loss=0.0001 rto=500 reorder=0.01
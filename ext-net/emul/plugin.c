@@ -0,0 +1,538 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+// Network emulation plugin. Traffic between processes of one host goes over
+// loopback TCP sockets, and completions are delayed to model the links of a
+// multi-node system described in a profile file (see README.md). Run each
+// emulated node with its own NCCL_HOSTID so that RCCL uses the network
+// between them, and optionally NCCL_TOPO_FILE to attach the emulated NICs
+// (by name) to the GPUs of the modeled system.
+
+#include <nccl.h>
+#include <nccl_net.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define __hidden __attribute__ ((visibility("hidden")))
+
+static ncclDebugLogger_t logger;
+#define WARN(...) logger(NCCL_LOG_WARN, NCCL_ALL, __FILE__, __LINE__, __VA_ARGS__)
+#define INFO(FLAGS, ...) logger(NCCL_LOG_INFO, (FLAGS), __func__, __LINE__, __VA_ARGS__)
+
+#define EMUL_MAX_DEVS 16
+#define EMUL_MAX_LINKS 64
+#define EMUL_NAME_MAX 64
+
+enum { EMUL_RAIL_ANY, EMUL_RAIL_SAME, EMUL_RAIL_CROSS };
+
+struct emulDev {
+  char name[EMUL_NAME_MAX];
+  char* pciPath;
+  int speed;              // Mbps
+  double nsPerByte;       // from speed
+  uint64_t nextFree;      // end of the last serialization on this NIC
+  pthread_mutex_t lock;
+};
+
+// Parameters of the links matching (src, dst, rail)
+struct emulLink {
+  char src[EMUL_NAME_MAX];   // NCCL_HOSTID of the sender, or *
+  char dst[EMUL_NAME_MAX];   // NCCL_HOSTID of the receiver, or *
+  int rail;
+  double latency;            // us
+  double jitter;             // us, uniform in [0, jitter)
+  double nsPerByte;          // 0: only limited by the NICs
+  double loss;               // probability that a message is retransmitted once more
+  double rto;                // us, retransmission timeout
+  double reorder;            // probability that a message is held for one more latency
+};
+
+static struct emulDev devs[EMUL_MAX_DEVS];
+static int nDevs;
+static struct emulLink links[EMUL_MAX_LINKS];
+static int nLinks;
+static char localNode[EMUL_NAME_MAX];
+static uint64_t seed;
+
+static uint64_t clockNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+static int matchName(const char* pattern, const char* name) {
+  return strcmp(pattern, "*") == 0 || strcmp(pattern, name) == 0;
+}
+
+static int parseLine(char* line, int lineNum, const char* path) {
+  char* save;
+  char* word = strtok_r(line, " \t\n", &save);
+  if (word == NULL || word[0] == '#') return 0;
+  if (strcmp(word, "device") == 0) {
+    if (nDevs == EMUL_MAX_DEVS) goto error;
+    struct emulDev* dev = devs+nDevs;
+    char* name = strtok_r(NULL, " \t\n", &save);
+    if (name == NULL) goto error;
+    strncpy(dev->name, name, EMUL_NAME_MAX-1);
+    dev->speed = 100000;
+    while ((word = strtok_r(NULL, " \t\n", &save)) != NULL) {
+      if (strncmp(word, "speed=", 6) == 0) dev->speed = atoi(word+6);
+      else if (strncmp(word, "pci=", 4) == 0) dev->pciPath = strdup(word+4);
+      else goto error;
+    }
+    if (dev->speed <= 0) goto error;
+    nDevs++;
+  } else if (strcmp(word, "link") == 0) {
+    if (nLinks == EMUL_MAX_LINKS) goto error;
+    struct emulLink* link = links+nLinks;
+    char* src = strtok_r(NULL, " \t\n", &save);
+    char* dst = strtok_r(NULL, " \t\n", &save);
+    if (src == NULL || dst == NULL) goto error;
+    strncpy(link->src, src, EMUL_NAME_MAX-1);
+    strncpy(link->dst, dst, EMUL_NAME_MAX-1);
+    link->rto = 1000;
+    while ((word = strtok_r(NULL, " \t\n", &save)) != NULL) {
+      char* value = strchr(word, '=');
+      if (value == NULL) goto error;
+      *value++ = '\0';
+      if (strcmp(word, "rail") == 0) {
+        if (strcmp(value, "same") == 0) link->rail = EMUL_RAIL_SAME;
+        else if (strcmp(value, "cross") == 0) link->rail = EMUL_RAIL_CROSS;
+        else if (strcmp(value, "*") == 0) link->rail = EMUL_RAIL_ANY;
+        else goto error;
+      }
+      else if (strcmp(word, "latency") == 0) link->latency = atof(value);
+      else if (strcmp(word, "jitter") == 0) link->jitter = atof(value);
+      else if (strcmp(word, "bw") == 0) link->nsPerByte = atof(value) > 0 ? 1.0/atof(value) : 0; // GB/s
+      else if (strcmp(word, "loss") == 0) link->loss = atof(value);
+      else if (strcmp(word, "rto") == 0) link->rto = atof(value);
+      else if (strcmp(word, "reorder") == 0) link->reorder = atof(value);
+      else goto error;
+    }
+    if (link->loss < 0 || link->loss >= 1 || link->reorder < 0 || link->reorder > 1) goto error;
+    nLinks++;
+  } else {
+    goto error;
+  }
+  return 0;
+error:
+  WARN("NET/Emul : %s:%d : invalid or too many entries", path, lineNum);
+  return 1;
+}
+
+static ncclResult_t loadProfile(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    WARN("NET/Emul : could not open profile %s : %s", path, strerror(errno));
+    return ncclSystemError;
+  }
+  char line[1024];
+  int lineNum = 0, errors = 0;
+  while (fgets(line, sizeof(line), file)) errors += parseLine(line, ++lineNum, path);
+  fclose(file);
+  return errors ? ncclInvalidUsage : ncclSuccess;
+}
+
+__hidden ncclResult_t pluginInit(ncclDebugLogger_t logFunction) {
+  logger = logFunction;
+  const char* hostId = getenv("NCCL_HOSTID");
+  if (hostId) strncpy(localNode, hostId, EMUL_NAME_MAX-1);
+  else gethostname(localNode, EMUL_NAME_MAX-1);
+  const char* seedStr = getenv("RCCL_NET_EMUL_SEED");
+  seed = seedStr ? strtoull(seedStr, NULL, 0) : 0x9e3779b97f4a7c15ULL;
+  const char* profile = getenv("RCCL_NET_EMUL_PROFILE");
+  if (profile) {
+    ncclResult_t ret = loadProfile(profile);
+    if (ret != ncclSuccess) return ret;
+  }
+  if (nDevs == 0) {
+    strcpy(devs[0].name, "emul0");
+    devs[0].speed = 100000;
+    nDevs = 1;
+  }
+  for (int d=0; d<nDevs; d++) {
+    devs[d].nsPerByte = 8000.0/devs[d].speed;
+    pthread_mutex_init(&devs[d].lock, NULL);
+  }
+  INFO(NCCL_INIT|NCCL_NET, "NET/Emul : node %s, %d devices, %d link rules%s%s", localNode, nDevs, nLinks,
+      profile ? " from " : "", profile ? profile : "");
+  return ncclSuccess;
+}
+
+__hidden ncclResult_t pluginDevices(int* ndev) { *ndev = nDevs; return ncclSuccess; }
+
+static const struct emulLink* findLink(const char* dst, int sameRail) {
+  static const struct emulLink none = { "*", "*", EMUL_RAIL_ANY, 0, 0, 0, 0, 0, 0 };
+  for (int l=0; l<nLinks; l++) {
+    const struct emulLink* link = links+l;
+    if (!matchName(link->src, localNode) || !matchName(link->dst, dst)) continue;
+    if (link->rail == EMUL_RAIL_SAME && !sameRail) continue;
+    if (link->rail == EMUL_RAIL_CROSS && sameRail) continue;
+    return link;
+  }
+  return &none;
+}
+
+__hidden ncclResult_t pluginGetProperties(int dev, ncclNetProperties_v6_t* props) {
+  if (dev < 0 || dev >= nDevs) return ncclInternalError;
+  props->name = devs[dev].name;
+  props->pciPath = devs[dev].pciPath;
+  props->guid = dev;
+  props->ptrSupport = NCCL_PTR_HOST;
+  props->speed = devs[dev].speed;
+  props->port = 0;
+  props->latency = findLink("*", 1)->latency;
+  props->maxComms = 65536;
+  props->maxRecvs = 1;
+  return ncclSuccess;
+}
+
+#define EMUL_HANDLE_MAGIC 0x656d756c
+
+// The node name comes last, the handle can be packed up to its last non zero byte
+struct emulHandle {
+  uint32_t magic;
+  int dev;
+  struct sockaddr_in addr;
+  int connectFd;            // connect in progress (sender side only)
+  char node[EMUL_NAME_MAX];
+};
+
+struct emulListenComm {
+  int fd;
+  int dev;
+};
+
+// Header sent before each message
+struct emulHeader {
+  int size;
+  int tag;
+  uint64_t deliverAt;       // CLOCK_MONOTONIC is shared by all processes of the host
+};
+
+struct emulRequest {
+  struct emulComm* comm;
+  int used;
+  int send;
+  uint64_t seq;
+  char* data;
+  int size;                 // posted size, then received size
+  int tag;
+  struct emulHeader hdr;
+  size_t offset;            // bytes transferred, header included
+  uint64_t doneAt;          // completion time once transferred
+  int transferred;
+};
+
+struct emulComm {
+  int fd;
+  int dev;
+  const struct emulLink* link;
+  uint64_t nextFree;        // end of the last serialization on this link
+  uint64_t nextSeq, rng;
+  struct emulRequest reqs[NCCL_NET_MAX_REQUESTS];
+};
+
+static int socketInit(int fd) {
+  int one = 1;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) return -1;
+  return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+__hidden ncclResult_t pluginListen(int dev, void* opaqueHandle, void** listenComm) {
+  struct emulHandle* handle = (struct emulHandle*)opaqueHandle;
+  _Static_assert(sizeof(struct emulHandle) <= NCCL_NET_HANDLE_MAXSIZE, "emulHandle too large");
+  memset(handle, 0, sizeof(struct emulHandle));
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) goto error;
+  handle->addr.sin_family = AF_INET;
+  handle->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(handle->addr);
+  if (bind(fd, (struct sockaddr*)&handle->addr, len) != 0 || listen(fd, 16384) != 0 ||
+      getsockname(fd, (struct sockaddr*)&handle->addr, &len) != 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) goto error;
+  handle->magic = EMUL_HANDLE_MAGIC;
+  handle->dev = dev;
+  strcpy(handle->node, localNode);
+  handle->connectFd = -1;
+  struct emulListenComm* comm = (struct emulListenComm*)calloc(1, sizeof(struct emulListenComm));
+  if (comm == NULL) goto error;
+  comm->fd = fd;
+  comm->dev = dev;
+  *listenComm = comm;
+  return ncclSuccess;
+error:
+  WARN("NET/Emul : listen failed : %s", strerror(errno));
+  if (fd >= 0) close(fd);
+  return ncclSystemError;
+}
+
+static ncclResult_t newComm(int fd, int dev, struct emulComm** comm) {
+  if (socketInit(fd) != 0) {
+    WARN("NET/Emul : socket setup failed : %s", strerror(errno));
+    close(fd);
+    return ncclSystemError;
+  }
+  *comm = (struct emulComm*)calloc(1, sizeof(struct emulComm));
+  if (*comm == NULL) {
+    close(fd);
+    return ncclSystemError;
+  }
+  (*comm)->fd = fd;
+  (*comm)->dev = dev;
+  return ncclSuccess;
+}
+
+__hidden ncclResult_t pluginConnect(int dev, void* opaqueHandle, void** sendComm) {
+  struct emulHandle* handle = (struct emulHandle*)opaqueHandle;
+  *sendComm = NULL;
+  if (handle->magic != EMUL_HANDLE_MAGIC) {
+    WARN("NET/Emul : invalid handle");
+    return ncclInternalError;
+  }
+  if (handle->connectFd < 0) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) goto error;
+    if (connect(fd, (struct sockaddr*)&handle->addr, sizeof(handle->addr)) != 0 && errno != EINPROGRESS) {
+      close(fd);
+      goto error;
+    }
+    handle->connectFd = fd;
+  }
+  struct pollfd pfd = { handle->connectFd, POLLOUT, 0 };
+  if (poll(&pfd, 1, 0) == 0) return ncclSuccess;
+  int err = 0;
+  socklen_t len = sizeof(err);
+  getsockopt(handle->connectFd, SOL_SOCKET, SO_ERROR, &err, &len);
+  if (err) {
+    errno = err;
+    close(handle->connectFd);
+    handle->connectFd = -1;
+    goto error;
+  }
+  struct emulComm* comm;
+  if (newComm(handle->connectFd, dev, &comm) != ncclSuccess) return ncclSystemError;
+  comm->link = findLink(handle->node, dev == handle->dev);
+  comm->rng = seed ^ ((uint64_t)dev << 32) ^ ntohs(handle->addr.sin_port) ^ ((uint64_t)getpid() << 16);
+  if (comm->rng == 0) comm->rng = 1;
+  INFO(NCCL_NET, "NET/Emul : %s/%s -> %s/%d : latency %g us jitter %g us bw %g GB/s loss %g reorder %g",
+      localNode, devs[dev].name, handle->node, handle->dev, comm->link->latency, comm->link->jitter,
+      comm->link->nsPerByte ? 1.0/comm->link->nsPerByte : 0.0, comm->link->loss, comm->link->reorder);
+  *sendComm = comm;
+  return ncclSuccess;
+error:
+  WARN("NET/Emul : connect to %s failed : %s", handle->node, strerror(errno));
+  return ncclSystemError;
+}
+
+__hidden ncclResult_t pluginAccept(void* listenComm, void** recvComm) {
+  struct emulListenComm* lComm = (struct emulListenComm*)listenComm;
+  *recvComm = NULL;
+  int fd = accept(lComm->fd, NULL, NULL);
+  if (fd < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return ncclSuccess;
+    WARN("NET/Emul : accept failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  struct emulComm* comm;
+  if (newComm(fd, lComm->dev, &comm) != ncclSuccess) return ncclSystemError;
+  *recvComm = comm;
+  return ncclSuccess;
+}
+
+__hidden ncclResult_t pluginRegMr(void* comm, void* data, int size, int type, void** mhandle) {
+  if (type != NCCL_PTR_HOST) return ncclInternalError;
+  *mhandle = NULL;
+  return ncclSuccess;
+}
+__hidden ncclResult_t pluginRegMrDmaBuf(void* comm, void* data, size_t size, int type, uint64_t offset, int fd, void** mhandle) { return ncclInternalError; }
+__hidden ncclResult_t pluginDeregMr(void* comm, void* mhandle) { return ncclSuccess; }
+
+static double uniform(uint64_t* rng) {
+  uint64_t x = *rng;
+  x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+  *rng = x;
+  return (x >> 11) * (1.0/9007199254740992.0);
+}
+
+// Serializes size bytes on the NIC and on the link, and returns the time the
+// data has crossed the link
+static uint64_t emulSchedule(struct emulComm* comm, int size, uint64_t* sendDone) {
+  struct emulDev* dev = devs+comm->dev;
+  const struct emulLink* link = comm->link;
+  uint64_t now = clockNs();
+  pthread_mutex_lock(&dev->lock);
+  uint64_t start = now;
+  if (start < dev->nextFree) start = dev->nextFree;
+  if (start < comm->nextFree) start = comm->nextFree;
+  uint64_t devEnd = start + (uint64_t)(size*dev->nsPerByte);
+  dev->nextFree = devEnd;
+  pthread_mutex_unlock(&dev->lock);
+  uint64_t end = start + (uint64_t)(size*link->nsPerByte);
+  comm->nextFree = end;
+  if (end < devEnd) end = devEnd;
+  *sendDone = end;
+
+  double delay = link->latency + link->jitter*uniform(&comm->rng);
+  while (link->loss > 0 && uniform(&comm->rng) < link->loss) delay += link->rto;
+  // A held message lets the following ones complete first
+  if (link->reorder > 0 && uniform(&comm->rng) < link->reorder) delay += link->latency + link->jitter;
+  return end + (uint64_t)(delay*1000);
+}
+
+static ncclResult_t postRequest(struct emulComm* comm, int send, void* data, int size, int tag, void** request) {
+  *request = NULL;
+  for (int r=0; r<NCCL_NET_MAX_REQUESTS; r++) {
+    struct emulRequest* req = comm->reqs+r;
+    if (req->used) continue;
+    memset(req, 0, sizeof(struct emulRequest));
+    req->comm = comm;
+    req->used = 1;
+    req->send = send;
+    req->seq = comm->nextSeq++;
+    req->data = (char*)data;
+    req->size = size;
+    req->tag = tag;
+    if (send) {
+      req->hdr.size = size;
+      req->hdr.tag = tag;
+      req->hdr.deliverAt = emulSchedule(comm, size, &req->doneAt);
+    }
+    *request = req;
+    return ncclSuccess;
+  }
+  return ncclSuccess;
+}
+
+__hidden ncclResult_t pluginIsend(void* sendComm, void* data, int size, int tag, void* mhandle, void** request) {
+  return postRequest((struct emulComm*)sendComm, 1, data, size, tag, request);
+}
+
+__hidden ncclResult_t pluginIrecv(void* recvComm, int n, void** data, int* sizes, int* tags, void** mhandles, void** request) {
+  if (n != 1) return ncclInternalError;
+  return postRequest((struct emulComm*)recvComm, 0, data[0], sizes[0], tags[0], request);
+}
+
+__hidden ncclResult_t pluginIflush(void* recvComm, int n, void** data, int* sizes, void** mhandles, void** request) {
+  // Host memory only, nothing to flush
+  *request = NULL;
+  return ncclSuccess;
+}
+
+// Moves the bytes of a request through the socket; returns 1 once all bytes are transferred
+static ncclResult_t transfer(struct emulRequest* req, int* transferred) {
+  struct emulComm* comm = req->comm;
+  const size_t hdrSize = sizeof(struct emulHeader);
+  *transferred = 0;
+  while (1) {
+    // The size of a received message is known once its header is in
+    size_t total = hdrSize + (req->send || req->offset >= hdrSize ? req->hdr.size : 0);
+    if (req->offset >= hdrSize && req->offset == total) break;
+    char* ptr = req->offset < hdrSize ? (char*)&req->hdr + req->offset : req->data + (req->offset - hdrSize);
+    size_t len = req->offset < hdrSize ? hdrSize - req->offset : total - req->offset;
+    ssize_t n = req->send ? send(comm->fd, ptr, len, MSG_NOSIGNAL) : recv(comm->fd, ptr, len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return ncclSuccess;
+    if (n <= 0) {
+      WARN("NET/Emul : %s failed : %s", req->send ? "send" : "recv", n == 0 ? "connection closed" : strerror(errno));
+      return ncclSystemError;
+    }
+    req->offset += n;
+    if (!req->send && req->offset == hdrSize) {
+      if (req->hdr.size > req->size) {
+        WARN("NET/Emul : message of %d bytes exceeds posted receive of %d bytes", req->hdr.size, req->size);
+        return ncclInternalError;
+      }
+      if (req->hdr.tag != req->tag) {
+        WARN("NET/Emul : message tag %d does not match posted tag %d", req->hdr.tag, req->tag);
+        return ncclInternalError;
+      }
+      req->size = req->hdr.size;
+      req->doneAt = req->hdr.deliverAt;
+    }
+  }
+  *transferred = 1;
+  return ncclSuccess;
+}
+
+// Requests use the socket in the order they were posted
+static ncclResult_t progress(struct emulComm* comm) {
+  while (1) {
+    struct emulRequest* next = NULL;
+    for (int r=0; r<NCCL_NET_MAX_REQUESTS; r++) {
+      struct emulRequest* req = comm->reqs+r;
+      if (req->used && !req->transferred && (next == NULL || req->seq < next->seq)) next = req;
+    }
+    if (next == NULL) return ncclSuccess;
+    int transferred;
+    ncclResult_t ret = transfer(next, &transferred);
+    if (ret != ncclSuccess) return ret;
+    if (!transferred) return ncclSuccess;
+    next->transferred = 1;
+  }
+}
+
+__hidden ncclResult_t pluginTest(void* request, int* done, int* sizes) {
+  struct emulRequest* req = (struct emulRequest*)request;
+  *done = 0;
+  ncclResult_t ret = progress(req->comm);
+  if (ret != ncclSuccess) return ret;
+  if (req->transferred && clockNs() >= req->doneAt) {
+    *done = 1;
+    if (sizes) *sizes = req->size;
+    req->used = 0;
+  }
+  return ncclSuccess;
+}
+
+__hidden ncclResult_t pluginCloseSend(void* sendComm) {
+  struct emulComm* comm = (struct emulComm*)sendComm;
+  if (comm) {
+    close(comm->fd);
+    free(comm);
+  }
+  return ncclSuccess;
+}
+
+__hidden ncclResult_t pluginCloseRecv(void* recvComm) { return pluginCloseSend(recvComm); }
+
+__hidden ncclResult_t pluginCloseListen(void* listenComm) {
+  struct emulListenComm* comm = (struct emulListenComm*)listenComm;
+  if (comm) {
+    close(comm->fd);
+    free(comm);
+  }
+  return ncclSuccess;
+}
+
+ncclNet_v6_t NCCL_PLUGIN_SYMBOL = {
+  "Emul",
+  pluginInit,
+  pluginDevices,
+  pluginGetProperties,
+  pluginListen,
+  pluginConnect,
+  pluginAccept,
+  pluginRegMr,
+  pluginRegMrDmaBuf,
+  pluginDeregMr,
+  pluginIsend,
+  pluginIrecv,
+  pluginIflush,
+  pluginTest,
+  pluginCloseSend,
+  pluginCloseRecv,
+  pluginCloseListen
+};
@@ -90,6 +90,8 @@ static ncclResult_t setFilesLimit() {
   return ncclSuccess;
 }
 
+#define BOOTSTRAP_ROOT_CONNECT_BATCH 128
+
 static void *bootstrapRoot(void* args) {
   struct ncclSocket* listenSock = (struct ncclSocket*)args;
   ncclResult_t res = ncclSuccess;
@@ -136,16 +138,29 @@ static void *bootstrapRoot(void* args) {
   } while (c < nranks);
   TRACE(NCCL_INIT, "COLLECTED ALL %d HANDLES", nranks);
 
-  // Send the connect handle for the next rank in the AllGather ring
-  for (int r=0; r<nranks; ++r) {
-    int next = (r+1) % nranks;
-    struct ncclSocket sock;
-    sock.abortFlag = NULL;
-    sock.asyncFlag = 0;
-    memcpy(&sock.addr, rankAddressesRoot+r, sizeof(union ncclSocketAddress));
-    NCCLCHECKGOTO(ncclSocketConnect(&sock), res, out);
-    NCCLCHECKGOTO(bootstrapNetSend(&sock, rankAddresses+next, sizeof(union ncclSocketAddress)), res, out);
-    close(sock.fd);
+  // Send the connect handle for the next rank in the AllGather ring. Ranks
+  // are connected BOOTSTRAP_ROOT_CONNECT_BATCH at a time to overlap the
+  // connection round trips.
+  for (int r0=0; r0<nranks; r0 += BOOTSTRAP_ROOT_CONNECT_BATCH) {
+    struct ncclSocket socks[BOOTSTRAP_ROOT_CONNECT_BATCH];
+    struct ncclSocket* sockPtrs[BOOTSTRAP_ROOT_CONNECT_BATCH];
+    int n = std::min(nranks-r0, BOOTSTRAP_ROOT_CONNECT_BATCH);
+    for (int i=0; i<n; i++) {
+      socks[i].abortFlag = NULL;
+      socks[i].asyncFlag = 0;
+      memcpy(&socks[i].addr, rankAddressesRoot+r0+i, sizeof(union ncclSocketAddress));
+      sockPtrs[i] = socks+i;
+    }
+    NCCLCHECKGOTO(ncclSocketConnectMany(sockPtrs, n), res, out);
+    for (int i=0; i<n; i++) {
+      int next = (r0+i+1) % nranks;
+      res = bootstrapNetSend(socks+i, rankAddresses+next, sizeof(union ncclSocketAddress));
+      if (res != ncclSuccess) {
+        for (int j=i; j<n; j++) close(socks[j].fd);
+        goto out;
+      }
+      close(socks[i].fd);
+    }
   }
   TRACE(NCCL_INIT, "SENT OUT ALL %d HANDLES", nranks);
 
@@ -214,6 +229,34 @@ struct bootstrapState {
   volatile uint32_t *abortFlag;
 };
 
+// Connect the AllGather ring once ringSendSocket.addr is known, then exchange
+// bootstrap and proxy addresses with all ranks.
+static ncclResult_t bootstrapRingInit(struct ncclComm* comm, struct bootstrapState* state) {
+  int rank = state->rank;
+  int nranks = state->nranks;
+
+  NCCLCHECK(ncclSocketConnect(&state->ringSendSocket));
+  // Accept the connect request from the previous rank in the AllGather ring
+  NCCLCHECK(ncclSocketAccept(&state->ringRecvSocket, &state->listenSock));
+
+  // AllGather all listen handlers
+  NCCLCHECK(ncclCalloc(&state->peerCommAddresses, nranks));
+  memcpy(state->peerCommAddresses+rank, &state->listenSock.addr, sizeof(union ncclSocketAddress));
+  NCCLCHECK(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union ncclSocketAddress)));
+
+  // Create the service proxy
+  NCCLCHECK(ncclCalloc(&state->peerProxyAddresses, nranks));
+  struct ncclSocket* proxySocket;
+  NCCLCHECK(ncclCalloc(&proxySocket, 1));
+  proxySocket->abortFlag = NULL; // proxy is aborted through a message
+  memcpy(&proxySocket->addr, &bootstrapNetIfAddr, sizeof(union ncclSocketAddress));
+  NCCLCHECK(ncclSocketListen(proxySocket));
+  memcpy(state->peerProxyAddresses+rank, &proxySocket->addr, sizeof(union ncclSocketAddress));
+  NCCLCHECK(bootstrapAllGather(state, state->peerProxyAddresses, sizeof(union ncclSocketAddress)));
+  NCCLCHECK(ncclProxyInit(comm, proxySocket, state->peerProxyAddresses));
+  return ncclSuccess;
+}
+
 ncclResult_t bootstrapInit(ncclUniqueId * id, struct ncclComm* comm) {
   int rank = comm->rank;
   int nranks = comm->nRanks;
@@ -271,27 +314,41 @@ ncclResult_t bootstrapInit(ncclUniqueId * id, struct ncclComm* comm) {
   close(sock.fd);
   close(listenSockRoot.fd);
 
-  NCCLCHECK(ncclSocketConnect(&state->ringSendSocket));
-  // Accept the connect request from the previous rank in the AllGather ring
-  NCCLCHECK(ncclSocketAccept(&state->ringRecvSocket, &state->listenSock));
+  NCCLCHECK(bootstrapRingInit(comm, state));
 
-  // AllGather all listen handlers
-  NCCLCHECK(ncclCalloc(&state->peerCommAddresses, nranks));
-  memcpy(state->peerCommAddresses+rank, &state->listenSock.addr, sizeof(union ncclSocketAddress));
-  NCCLCHECK(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union ncclSocketAddress)));
+  TRACE(NCCL_INIT, "rank %d nranks %d virtualId %d", rank, nranks, virtualId);
 
-  // Create the service proxy
-  NCCLCHECK(ncclCalloc(&state->peerProxyAddresses, nranks));
-  struct ncclSocket* proxySocket;
-  NCCLCHECK(ncclCalloc(&proxySocket, 1));
-  proxySocket->abortFlag = NULL; // proxy is aborted through a message
-  memcpy(&proxySocket->addr, &bootstrapNetIfAddr, sizeof(union ncclSocketAddress));
-  NCCLCHECK(ncclSocketListen(proxySocket));
-  memcpy(state->peerProxyAddresses+rank, &proxySocket->addr, sizeof(union ncclSocketAddress));
-  NCCLCHECK(bootstrapAllGather(state, state->peerProxyAddresses, sizeof(union ncclSocketAddress)));
-  NCCLCHECK(ncclProxyInit(comm, proxySocket, state->peerProxyAddresses));
+  return ncclSuccess;
+}
 
-  TRACE(NCCL_INIT, "rank %d nranks %d virtualId %d", rank, nranks, virtualId);
+// Same as bootstrapInit, except that ring neighbors find each other through
+// the parent's bootstrap network instead of going through a root.
+ncclResult_t bootstrapSplit(struct ncclComm* comm, struct ncclComm* parent, int* parentRanks) {
+  int rank = comm->rank;
+  int nranks = comm->nRanks;
+  struct bootstrapState* state;
+  NCCLCHECK(ncclCalloc(&state, 1));
+  state->rank = rank;
+  state->nranks = nranks;
+  state->abortFlag = comm->abortFlag;
+  state->virtualId = comm->virtualId;
+  comm->bootstrap = state;
+
+  TRACE(NCCL_INIT, "rank %d nranks %d parent rank %d", rank, nranks, parent->rank);
+
+  // Create socket for other ranks to contact me
+  memcpy(&state->listenSock.addr, &bootstrapNetIfAddr, sizeof(union ncclSocketAddress));
+  NCCLCHECK(ncclSocketListen(&state->listenSock));
+
+  // Give my address to the previous rank and get the address of the next one
+  int prev = parentRanks[(rank-1+nranks)%nranks];
+  int next = parentRanks[(rank+1)%nranks];
+  NCCLCHECK(bootstrapSend(parent->bootstrap, prev, BOOTSTRAP_TAG_COMMSPLIT, &state->listenSock.addr, sizeof(union ncclSocketAddress)));
+  NCCLCHECK(bootstrapRecv(parent->bootstrap, next, BOOTSTRAP_TAG_COMMSPLIT, &state->ringSendSocket.addr, sizeof(union ncclSocketAddress)));
+
+  NCCLCHECK(bootstrapRingInit(comm, state));
+
+  TRACE(NCCL_INIT, "rank %d nranks %d parent rank %d - DONE", rank, nranks, parent->rank);
 
   return ncclSuccess;
 }
@@ -444,6 +501,53 @@ ncclResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int s
   }
 }
 
+ncclResult_t bootstrapRecvAny(void* commState, bootstrapMatchFn match, void* ctx, int* peer, int* tag) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  void* data;
+  int size;
+
+  // Search unexpected connections first
+  struct unexConn* elem = state->unexpectedConnections;
+  struct unexConn* prev = NULL;
+  while (elem) {
+    if (match(ctx, elem->peer, elem->tag, &data, &size)) {
+      if (prev == NULL) {
+        state->unexpectedConnections = elem->next;
+      } else {
+        prev->next = elem->next;
+      }
+      *peer = elem->peer;
+      *tag = elem->tag;
+      struct ncclSocket sock = elem->sock;
+      free(elem);
+      NCCLCHECK(bootstrapNetRecv(&sock, data, size));
+      close(sock.fd);
+      return ncclSuccess;
+    }
+    prev = elem;
+    elem = elem->next;
+  }
+
+  // Then look for new connections
+  struct ncclSocket sock;
+  sock.abortFlag = state->abortFlag;
+  while (1) {
+    NCCLCHECK(ncclSocketAccept(&sock, &state->listenSock));
+    int newPeer, newTag;
+    NCCLCHECK(bootstrapNetRecv(&sock, &newPeer, sizeof(int)));
+    NCCLCHECK(bootstrapNetRecv(&sock, &newTag, sizeof(int)));
+    if (match(ctx, newPeer, newTag, &data, &size)) {
+      *peer = newPeer;
+      *tag = newTag;
+      NCCLCHECK(bootstrapNetRecv(&sock, data, size));
+      close(sock.fd);
+      return ncclSuccess;
+    }
+    // Unexpected connection. Save for later.
+    NCCLCHECK(unexpectedEnqueue(state, newPeer, newTag, &sock));
+  }
+}
+
 ncclResult_t bootstrapClose(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   if (state->unexpectedConnections != NULL) {
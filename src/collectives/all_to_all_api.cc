@@ -8,6 +8,63 @@
 #include "enqueue.h"
 #include "collectives.h"
 #include "graph/topo.h"
+#include "alltoall_hier.h"
+#include "rccl_vars.h"
+#include <vector>
+
+RCCL_PARAM(AllToAllHier, "ALLTOALL_HIER", 0);
+RCCL_PARAM(AllToAllHierThreshold, "ALLTOALL_HIER_THRESHOLD", 65536);
+
+// The three stages of the hierarchical AllToAll are launched as separate groups,
+// which can't be done from within a user group. Ranks must all call AllToAll
+// either inside or outside of a group so that they take the same path.
+bool ncclAllToAllHierEnabled(struct ncclComm* comm, size_t pairBytes) {
+  return rcclParamAllToAllHier() && comm->nNodes > 1 && ncclGroupDepth == 0 &&
+    pairBytes > 0 && pairBytes <= (size_t)rcclParamAllToAllHierThreshold();
+}
+
+ncclResult_t ncclAllToAllHier(struct ncclComm* comm, const void* sendbuff, void* recvbuff, const size_t* matrix, size_t bytes,
+    const size_t* sendDispls, const size_t* recvDispls, hipStream_t stream) {
+  std::vector<int> nodeLocalRanks(comm->nNodes);
+  std::vector<int const*> localRankToRank(comm->nNodes);
+  for (int n=0; n<comm->nNodes; n++) {
+    nodeLocalRanks[n] = comm->nodeRanks[n].localRanks;
+    localRankToRank[n] = comm->nodeRanks[n].localRankToRank;
+  }
+  struct ncclA2aHierTopo topo = { comm->nRanks, comm->nNodes, comm->rankToNode, comm->rankToLocalRank,
+    nodeLocalRanks.data(), localRankToRank.data(), comm->a2aRelay };
+  std::vector<struct ncclA2aHierOp> ops(ncclA2aHierMaxOps(&topo, comm->rank));
+  struct ncclA2aHierPlan plan;
+  plan.ops = ops.data();
+  NCCLCHECK(ncclA2aHierSchedule(&topo, comm->rank, matrix, bytes, sendDispls, recvDispls, &plan));
+
+  size_t stageBytes = plan.stageBytes[0] + plan.stageBytes[1];
+  if (stageBytes > comm->a2aHierBuffSize) {
+    // hipFree waits for pending operations using the previous buffer
+    if (comm->a2aHierBuff) NCCLCHECK(ncclCudaFree(comm->a2aHierBuff));
+    comm->a2aHierBuff = NULL;
+    comm->a2aHierBuffSize = 0;
+    NCCLCHECK(ncclCudaCalloc(&comm->a2aHierBuff, stageBytes, comm->sideStream));
+    comm->a2aHierBuffSize = stageBytes;
+  }
+  char* buffs[ncclA2aHierNumBuffers] = { (char*)sendbuff, (char*)recvbuff, comm->a2aHierBuff, comm->a2aHierBuff+plan.stageBytes[0] };
+  TRACE(NCCL_COLL, "AllToAll hierarchical: %d ops, %d inter-node messages, %zu staging bytes", plan.nOps, plan.nNetOps, stageBytes);
+
+  // Stages must complete in order, each goes in its own group
+  for (int stage=0, i=0; stage<3; stage++) {
+    NCCLCHECK(ncclGroupStart());
+    for (; i<plan.nOps && ops[i].stage == stage; i++) {
+      char* buff = buffs[ops[i].buffer] + ops[i].offset;
+      if (ops[i].isSend) {
+        NCCLCHECK(ncclSend(buff, ops[i].bytes, ncclInt8, ops[i].peer, comm, stream));
+      } else {
+        NCCLCHECK(ncclRecv(buff, ops[i].bytes, ncclInt8, ops[i].peer, comm, stream));
+      }
+    }
+    NCCLCHECK(ncclGroupEnd());
+  }
+  return ncclSuccess;
+}
 
 NCCL_API(ncclResult_t, ncclAllToAll, const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype,
   ncclComm_t comm, hipStream_t stream);
@@ -26,6 +83,11 @@ ncclResult_t ncclAllToAll(const void* sendbuff, void* recvbuff, size_t count, nc
     int nRanks;
     NCCLCHECK(ncclCommCount(comm, &nRanks));
     if (count == 0) return ncclSuccess;
+    if (ncclAllToAllHierEnabled(comm, rankOffset)) {
+      std::vector<size_t> displs(nRanks);
+      for (int r=0; r<nRanks; r++) displs[r] = r*rankOffset;
+      return ncclAllToAllHier(comm, sendbuff, recvbuff, NULL, rankOffset, displs.data(), displs.data(), stream);
+    }
     NCCLCHECK(ncclGroupStart());
     for (int r=0; r<nRanks; r++) {
       NCCLCHECK(ncclSend(((char*)sendbuff)+r*rankOffset, count, datatype, r, comm, stream));
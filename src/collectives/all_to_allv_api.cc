@@ -1,12 +1,15 @@
 /*************************************************************************
  * Copyright (c) 2015-2019, NVIDIA CORPORATION. All rights reserved.
- * Modifications Copyright (c) 2019-2021 Advanced Micro Devices, Inc. All rights reserved.
+ * Modifications Copyright (c) 2019-2022 Advanced Micro Devices, Inc. All rights reserved.
  *
  * See LICENSE.txt for license information
  ************************************************************************/
 
 #include "enqueue.h"
 #include "collectives.h"
+#include "argcheck.h"
+#include "rccl_vars.h"
+#include <vector>
 
 NCCL_API(ncclResult_t, ncclAllToAllv, const void *sendbuff, const size_t sendcounts[], const size_t sdispls[],
     void *recvbuff, const size_t recvcounts[], const size_t rdispls[],
@@ -14,6 +17,12 @@ NCCL_API(ncclResult_t, ncclAllToAllv, const void *sendbuff, const size_t sendcou
 ncclResult_t ncclAllToAllv(const void *sendbuff, const size_t sendcounts[], const size_t sdispls[],
     void *recvbuff, const size_t recvcounts[], const size_t rdispls[],
     ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream) {
+  if (rcclParamAllToAllvSched()) {
+    struct ncclInfo info = { ncclFuncSendRecv, "AllToAllv",
+      sendbuff, recvbuff, 0, datatype, ncclSum, 0, comm, stream, /* Args */
+      1, 1 };
+    return ncclEnqueueAllToAllv(&info, sendcounts, sdispls, recvcounts, rdispls, NULL);
+  }
   int nRanks;
   NCCLCHECK(ncclCommCount(comm, &nRanks));
   NCCLCHECK(ncclGroupStart());
@@ -36,3 +45,40 @@ ncclResult_t ncclAllToAllv(const void *sendbuff, const size_t sendcounts[], cons
   NCCLCHECK(ncclGroupEnd());
   return ncclSuccess;
 }
+
+NCCL_API(ncclResult_t, ncclAllToAllvMatrix, const void *sendbuff, const size_t sdispls[],
+    void *recvbuff, const size_t rdispls[], const size_t countMatrix[],
+    ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream);
+ncclResult_t ncclAllToAllvMatrix(const void *sendbuff, const size_t sdispls[],
+    void *recvbuff, const size_t rdispls[], const size_t countMatrix[],
+    ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream) {
+  int nRanks, rank;
+  NCCLCHECK(PtrCheck(comm, "AllToAllvMatrix", "comm"));
+  NCCLCHECK(PtrCheck((void*)countMatrix, "AllToAllvMatrix", "countMatrix"));
+  NCCLCHECK(ncclCommCount(comm, &nRanks));
+  NCCLCHECK(ncclCommUserRank(comm, &rank));
+  std::vector<size_t> sendcounts(nRanks), recvcounts(nRanks);
+  for (int r=0; r<nRanks; r++) {
+    sendcounts[r] = countMatrix[(size_t)rank*nRanks+r];
+    recvcounts[r] = countMatrix[(size_t)r*nRanks+rank];
+  }
+  size_t typeSize = ncclTypeSize(datatype);
+  size_t total = 0;
+  for (size_t i=0; i<(size_t)nRanks*nRanks; i++) total += countMatrix[i];
+  if (ncclAllToAllHierEnabled(comm, total*typeSize/((size_t)nRanks*nRanks))) {
+    std::vector<size_t> matrix((size_t)nRanks*nRanks), sendDispls(nRanks), recvDispls(nRanks);
+    for (size_t i=0; i<matrix.size(); i++) matrix[i] = countMatrix[i]*typeSize;
+    for (int r=0; r<nRanks; r++) {
+      sendDispls[r] = sdispls[r]*typeSize;
+      recvDispls[r] = rdispls[r]*typeSize;
+    }
+    return ncclAllToAllHier(comm, sendbuff, recvbuff, matrix.data(), 0, sendDispls.data(), recvDispls.data(), stream);
+  }
+  if (!rcclParamAllToAllvSched()) {
+    return ncclAllToAllv(sendbuff, sendcounts.data(), sdispls, recvbuff, recvcounts.data(), rdispls, datatype, comm, stream);
+  }
+  struct ncclInfo info = { ncclFuncSendRecv, "AllToAllvMatrix",
+    sendbuff, recvbuff, 0, datatype, ncclSum, 0, comm, stream, /* Args */
+    1, 1 };
+  return ncclEnqueueAllToAllv(&info, sendcounts.data(), sdispls, recvcounts.data(), rdispls, countMatrix);
+}
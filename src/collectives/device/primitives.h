@@ -9,8 +9,12 @@
 #define NCCL_PRIMITIVES_H_
 
 #include <type_traits>
+#if defined(NCCL_HOST_PRIMS)
+#include "../host/common_host.h" // host reduction funcs and device state
+#else
 #include "reduce_kernel.h" // for reduction funcs
 #include "common.h"
+#endif
 
 #define NCCL_SPINS_BEFORE_CHECK_ABORT 1000000
 
@@ -124,6 +128,10 @@ struct FanSymmetric {
   __device__ int nsend() const { return n; }
 };
 
+#if defined(NCCL_HOST_PRIMS)
+// CPU backend: one implementation for all protocols on top of host FIFOs.
+#include "../host/prims_host.h"
+#else
 // The primitives class. Specialized per protocol in the other headers.
 template<typename T, typename RedOp, typename Fan, int Direct, typename Proto, int P2p>
 class Primitives;
@@ -155,4 +163,5 @@ struct PrimitivesWithoutDirect {
 #include "prims_simple.h"
 #include "prims_ll.h"
 #include "prims_ll128.h"
+#endif // NCCL_HOST_PRIMS
 #endif
@@ -0,0 +1,27 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#define NCCL_HOST_PRIMS
+#include "../device/all_gather.h"
+#include "host_comm.h"
+
+ncclResult_t ncclHostRunAllGather(int devRedOp, ncclDataType_t type, int algo, int proto, struct ncclWorkElem* args) {
+  // Like on the device, AllGather moves bytes (see ncclInfoSetDerived)
+  if (type != ncclInt8) return ncclInvalidUsage;
+  switch (algo*NCCL_NUM_PROTOCOLS+proto) {
+    case NCCL_ALGO_RING*NCCL_NUM_PROTOCOLS+NCCL_PROTO_LL:
+      RunWorkElement<ncclFuncAllGather, int8_t, FuncSum<int8_t>, NCCL_ALGO_RING, NCCL_PROTO_LL>().run(args);
+      return ncclSuccess;
+    case NCCL_ALGO_RING*NCCL_NUM_PROTOCOLS+NCCL_PROTO_LL128:
+      RunWorkElement<ncclFuncAllGather, int8_t, FuncSum<int8_t>, NCCL_ALGO_RING, NCCL_PROTO_LL128>().run(args);
+      return ncclSuccess;
+    case NCCL_ALGO_RING*NCCL_NUM_PROTOCOLS+NCCL_PROTO_SIMPLE:
+      RunWorkElement<ncclFuncAllGather, int8_t, FuncSum<int8_t>, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE>().run(args);
+      return ncclSuccess;
+    default:
+      return ncclInvalidUsage;
+  }
+}
@@ -0,0 +1,97 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_HOST_COMMON_H_
+#define NCCL_HOST_COMMON_H_
+
+// Host replacement for device/common.h. Included by device/primitives.h when
+// NCCL_HOST_PRIMS is defined, so that the algorithm headers (all_reduce.h,
+// all_gather.h, reduce_scatter.h, ...) compile unchanged for the CPU. Each
+// block of a kernel runs as nWarps host threads, one per warp; threadIdx.x is
+// the first thread of the warp.
+
+#include "collectives.h"
+#include "devcomm.h"
+#include "align.h"
+
+#undef __device__
+#define __device__
+#undef __forceinline__
+#define __forceinline__ inline __attribute__((always_inline))
+#define __syncwarp()
+
+#define COLL_UNROLL 2
+#define NCCL_MAX_DEV_ARITY (NCCL_MAX_TREE_ARITY-1)  // Using balanced tree instead of split tree
+
+struct ncclHostConns;
+
+struct ncclShmemData {
+  int channelId;
+  struct ncclDevComm comm;
+  struct ncclDevChannel channel;
+  struct ncclHostConns* conns; // FIFOs between ranks, see host_comm.h
+};
+
+// Per host thread state, set before running a work element
+extern thread_local struct ncclShmemData* ncclShmem;
+struct ncclHostThreadIdx { int x; };
+extern thread_local struct ncclHostThreadIdx ncclHostThread;
+#undef threadIdx
+#define threadIdx ncclHostThread
+
+template<typename X, typename Y>
+static inline auto min(X a, Y b) -> decltype(a+b) { return a < b ? a : b; }
+
+template<ncclFunc_t Fn, typename T, typename RedOp, int Algo, int Proto>
+struct RunWorkElement {
+  // Only the algorithms specialized in the *_host.cc files run on the host
+  void run(ncclWorkElem*) {
+  }
+};
+
+#include "reduce_host.h"
+
+template<ncclFunc_t Fn, typename T, int Algo, int Proto>
+static ncclResult_t ncclHostRunPostDiv(ncclWorkElem* args, std::false_type /*floating*/) {
+  RunWorkElement<Fn, T, FuncSumPostDiv<T>, Algo, Proto>().run(args);
+  return ncclSuccess;
+}
+template<ncclFunc_t Fn, typename T, int Algo, int Proto>
+static ncclResult_t ncclHostRunPostDiv(ncclWorkElem* args, std::true_type /*floating*/) {
+  return ncclInvalidUsage;
+}
+
+template<ncclFunc_t Fn, typename T, int Algo, int Proto>
+static ncclResult_t ncclHostRunOp(int devRedOp, ncclWorkElem* args) {
+  switch (devRedOp) {
+    case ncclDevSum: RunWorkElement<Fn, T, FuncSum<T>, Algo, Proto>().run(args); return ncclSuccess;
+    case ncclDevProd: RunWorkElement<Fn, T, FuncProd<T>, Algo, Proto>().run(args); return ncclSuccess;
+    case ncclDevMax: RunWorkElement<Fn, T, FuncMax<T>, Algo, Proto>().run(args); return ncclSuccess;
+    case ncclDevMin: RunWorkElement<Fn, T, FuncMin<T>, Algo, Proto>().run(args); return ncclSuccess;
+    case ncclDevPreMulSum: RunWorkElement<Fn, T, FuncPreMulSum<T>, Algo, Proto>().run(args); return ncclSuccess;
+    case ncclDevSumPostDiv: return ncclHostRunPostDiv<Fn, T, Algo, Proto>(args, IsFloatingPoint<T>());
+    default: return ncclInvalidArgument;
+  }
+}
+
+// Runs a work element on the calling thread, for the current ncclShmem/threadIdx
+template<ncclFunc_t Fn, int Algo, int Proto>
+static ncclResult_t ncclHostRunElem(int devRedOp, ncclDataType_t type, ncclWorkElem* args) {
+  switch (type) {
+    case ncclInt8: return ncclHostRunOp<Fn, int8_t, Algo, Proto>(devRedOp, args);
+    case ncclUint8: return ncclHostRunOp<Fn, uint8_t, Algo, Proto>(devRedOp, args);
+    case ncclInt32: return ncclHostRunOp<Fn, int32_t, Algo, Proto>(devRedOp, args);
+    case ncclUint32: return ncclHostRunOp<Fn, uint32_t, Algo, Proto>(devRedOp, args);
+    case ncclInt64: return ncclHostRunOp<Fn, int64_t, Algo, Proto>(devRedOp, args);
+    case ncclUint64: return ncclHostRunOp<Fn, uint64_t, Algo, Proto>(devRedOp, args);
+    case ncclFloat32: return ncclHostRunOp<Fn, float, Algo, Proto>(devRedOp, args);
+    case ncclFloat64: return ncclHostRunOp<Fn, double, Algo, Proto>(devRedOp, args);
+    case ncclBfloat16: return ncclHostRunOp<Fn, rccl_bfloat16, Algo, Proto>(devRedOp, args);
+    default: return ncclInvalidUsage; // half is device only
+  }
+}
+
+#endif
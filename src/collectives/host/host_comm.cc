@@ -0,0 +1,364 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "core.h"
+#include "trees.h"
+#include "host_comm.h"
+#include "common_host.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <sched.h>
+
+thread_local struct ncclShmemData* ncclShmem;
+thread_local struct ncclHostThreadIdx ncclHostThread;
+
+#define HOST_DEFAULT_NWARPS 4
+#define HOST_LL_BUFFSIZE (NCCL_LL_LINES_PER_THREAD*NCCL_LL_MAX_NTHREADS*NCCL_STEPS*sizeof(union ncclLLFifoLine))
+#define HOST_LL128_BUFFSIZE (NCCL_LL128_ELEMS_PER_THREAD*NCCL_LL128_MAX_NTHREADS*NCCL_STEPS*sizeof(uint64_t))
+#define HOST_BUFFSIZE (1 << 22)
+
+// Data bytes of one FIFO step, as seen by Proto::calcBytePerStep()
+static size_t stepBytes(int proto, int buffSize) {
+  switch (proto) {
+    case NCCL_PROTO_LL: return buffSize/NCCL_STEPS/2;
+    case NCCL_PROTO_LL128: return (buffSize/NCCL_STEPS)*NCCL_LL128_DATAELEMS/NCCL_LL128_LINEELEMS;
+    default: return buffSize/NCCL_STEPS;
+  }
+}
+
+static void setupRing(struct ncclHostComm* comm, int c, int rank, struct ncclRing* ring) {
+  int n = comm->nRanks;
+  // Odd channels go the other way round
+  int index = (c & 1) ? n-1-rank : rank;
+  int* userRanks = comm->userRanks + ((size_t)rank*comm->nChannels+c)*n;
+  for (int i=0; i<n; i++) {
+    int pos = (index+i)%n;
+    userRanks[i] = (c & 1) ? n-1-pos : pos;
+  }
+  ring->index = index;
+  ring->userRanks = userRanks;
+  ring->next = userRanks[1];
+  ring->prev = userRanks[n-1];
+}
+
+static void setupTree(int nRanks, int c, int rank, struct ncclTree* tree) {
+  int u[2], d0[2], d1[2], type[2];
+  ncclGetDtree(nRanks, rank, u, d0, d1, type, u+1, d0+1, d1+1, type+1);
+  int t = c & 1;
+  tree->up = u[t];
+  tree->down[0] = d0[t] != -1 ? d0[t] : d1[t];
+  tree->down[1] = d0[t] != -1 ? d1[t] : -1;
+  tree->down[2] = -1;
+}
+
+ncclResult_t ncclHostCommInit(struct ncclHostComm** comm, int nRanks, int nChannels, int const* buffSizes) {
+  if (nRanks < 2 || nChannels < 1 || nChannels > MAXCHANNELS) {
+    WARN("Host comm : invalid nRanks %d / nChannels %d", nRanks, nChannels);
+    return ncclInvalidArgument;
+  }
+  struct ncclHostComm* c = (struct ncclHostComm*)calloc(1, sizeof(struct ncclHostComm));
+  if (c == NULL) return ncclSystemError;
+  c->nRanks = nRanks;
+  c->nChannels = nChannels;
+  int defaults[NCCL_NUM_PROTOCOLS] = { HOST_LL_BUFFSIZE, HOST_LL128_BUFFSIZE, HOST_BUFFSIZE };
+  size_t slotBytes = 0;
+  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    c->buffSizes[p] = buffSizes && buffSizes[p] > 0 ? buffSizes[p] : defaults[p];
+    slotBytes = std::max(slotBytes, stepBytes(p, c->buffSizes[p]));
+  }
+  ALIGN_SIZE(slotBytes, 64);
+
+  c->channels = (struct ncclDevChannel*)calloc((size_t)nRanks*nChannels, sizeof(struct ncclDevChannel));
+  c->userRanks = (int*)malloc((size_t)nRanks*nChannels*nRanks*sizeof(int));
+  int* index = (int*)malloc((size_t)nChannels*nRanks*nRanks*sizeof(int));
+  ncclResult_t ret = ncclSuccess;
+  if (c->channels == NULL || c->userRanks == NULL || index == NULL) {
+    ret = ncclSystemError;
+    goto fail;
+  }
+
+  // Connect ring neighbors and tree parents / children, both ways for trees
+  for (size_t i=0; i<(size_t)nChannels*nRanks*nRanks; i++) index[i] = -1;
+  {
+    int nFifos = 0, maxDepth = 0;
+    for (int ch=0; ch<nChannels; ch++) {
+      int* chIndex = index + (size_t)ch*nRanks*nRanks;
+      for (int r=0; r<nRanks; r++) {
+        struct ncclDevChannel* channel = c->channels + (size_t)r*nChannels+ch;
+        setupRing(c, ch, r, &channel->ring);
+        setupTree(nRanks, ch, r, &channel->tree);
+        channel->binTree = channel->tree;
+        chIndex[r*nRanks+channel->ring.next] = 0;
+        if (channel->tree.up != -1) {
+          chIndex[r*nRanks+channel->tree.up] = 0;
+          chIndex[channel->tree.up*nRanks+r] = 0;
+        }
+      }
+      for (int i=0; i<nRanks*nRanks; i++) if (chIndex[i] == 0) chIndex[i] = nFifos++;
+      // Tree depth, from the parents
+      for (int r=0; r<nRanks; r++) {
+        int d = 0;
+        for (int p = c->channels[(size_t)r*nChannels+ch].tree.up; p != -1; p = c->channels[(size_t)p*nChannels+ch].tree.up) d++;
+        maxDepth = std::max(maxDepth, d+1);
+      }
+    }
+    // Like connectTrees, all ranks share the same depth, used for chunk sizes
+    for (size_t i=0; i<(size_t)nRanks*nChannels; i++) c->channels[i].tree.depth = c->channels[i].binTree.depth = maxDepth;
+
+    size_t indexBytes = offsetof(struct ncclHostConns, index) + (size_t)nChannels*nRanks*nRanks*sizeof(int);
+    size_t fifoOffset = alignUp(indexBytes, 64);
+    size_t dataOffset = alignUp(fifoOffset + nFifos*sizeof(struct ncclHostFifo), 4096);
+    size_t mapBytes = dataOffset + (size_t)nFifos*NCCL_STEPS*slotBytes;
+    void* map = mmap(NULL, mapBytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      WARN("Host comm : failed to map %zu bytes for %d FIFOs", mapBytes, nFifos);
+      ret = ncclSystemError;
+      goto fail;
+    }
+    struct ncclHostConns* conns = c->conns = (struct ncclHostConns*)map;
+    conns->nRanks = nRanks;
+    conns->nChannels = nChannels;
+    conns->slotBytes = slotBytes;
+    conns->mapBytes = mapBytes;
+    conns->fifoOffset = fifoOffset;
+    memcpy(conns->index, index, (size_t)nChannels*nRanks*nRanks*sizeof(int));
+    struct ncclHostFifo* fifos = (struct ncclHostFifo*)((char*)map+fifoOffset);
+    for (int f=0; f<nFifos; f++) fifos[f].dataOffset = dataOffset + (size_t)f*NCCL_STEPS*slotBytes;
+    INFO(NCCL_INIT, "Host comm : %d ranks, %d channels, %d FIFOs of %d x %zu bytes",
+        nRanks, nChannels, nFifos, NCCL_STEPS, slotBytes);
+  }
+  free(index);
+  *comm = c;
+  return ncclSuccess;
+
+fail:
+  free(index);
+  free(c->channels);
+  free(c->userRanks);
+  free(c);
+  return ret;
+}
+
+ncclResult_t ncclHostCommDestroy(struct ncclHostComm* comm) {
+  if (comm == NULL) return ncclSuccess;
+  if (comm->conns) munmap(comm->conns, comm->conns->mapBytes);
+  free(comm->channels);
+  free(comm->userRanks);
+  free(comm);
+  return ncclSuccess;
+}
+
+// Device reduction op and its argument, like hostToDevRedOp
+static ncclResult_t hostDevRedOp(ncclRedOp_t op, ncclDataType_t type, int nRanks, int* devOp, uint64_t* opArg) {
+  *opArg = 0;
+  switch (op) {
+    case ncclSum: *devOp = ncclDevSum; return ncclSuccess;
+    case ncclProd: *devOp = ncclDevProd; return ncclSuccess;
+    case ncclMax: *devOp = ncclDevMax; return ncclSuccess;
+    case ncclMin: *devOp = ncclDevMin; return ncclSuccess;
+    case ncclAvg: break;
+    default: return ncclInvalidArgument;
+  }
+  switch (type) {
+    case ncclInt8: case ncclInt32: case ncclInt64:
+    case ncclUint8: case ncclUint32: case ncclUint64:
+      *devOp = ncclDevSumPostDiv;
+      *opArg = nRanks;
+      return ncclSuccess;
+    case ncclFloat32: {
+      float f32 = float(1.0/nRanks);
+      memcpy(opArg, &f32, sizeof(f32));
+      break;
+    }
+    case ncclFloat64: {
+      double f64 = 1.0/nRanks;
+      memcpy(opArg, &f64, sizeof(f64));
+      break;
+    }
+    case ncclBfloat16: {
+      rccl_bfloat16 bf16 = (rccl_bfloat16)(float(1.0/nRanks));
+      memcpy(opArg, &bf16, sizeof(bf16));
+      break;
+    }
+    default:
+      return ncclInvalidUsage;
+  }
+  *devOp = ncclDevPreMulSum;
+  return ncclSuccess;
+}
+
+struct hostThreadArgs {
+  struct ncclShmemData* shmem;
+  struct ncclWorkElem* elem;
+  ncclFunc_t coll;
+  int devRedOp;
+  ncclDataType_t datatype;
+  int algorithm;
+  int protocol;
+  int tid;
+  ncclResult_t ret;
+  int* nDone;
+};
+
+static void* hostThreadMain(void* arg) {
+  struct hostThreadArgs* t = (struct hostThreadArgs*)arg;
+  ncclShmem = t->shmem;
+  ncclHostThread.x = t->tid;
+  switch (t->coll) {
+    case ncclFuncAllReduce: t->ret = ncclHostRunAllReduce(t->devRedOp, t->datatype, t->algorithm, t->protocol, t->elem); break;
+    case ncclFuncAllGather: t->ret = ncclHostRunAllGather(t->devRedOp, t->datatype, t->algorithm, t->protocol, t->elem); break;
+    case ncclFuncReduceScatter: t->ret = ncclHostRunReduceScatter(t->devRedOp, t->datatype, t->algorithm, t->protocol, t->elem); break;
+    default: t->ret = ncclInvalidUsage; break;
+  }
+  __atomic_fetch_add(t->nDone, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static uint64_t hostClockMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000ULL + ts.tv_nsec/1000000;
+}
+
+// Chunk size of each work element, as computeColl does
+static void setLastChunkSize(struct ncclHostComm* comm, int rank, struct ncclHostCollArgs const* args, size_t typeSize,
+    size_t nBytes, int nThreads, struct ncclWorkElem* work) {
+  int nChannels = comm->nChannels;
+  int stepSize = comm->buffSizes[args->protocol]/NCCL_STEPS;
+  int chunkSize = stepSize;
+  int nchunksPerLoop = args->algorithm == NCCL_ALGO_RING ? comm->nRanks : 1;
+  int depth = comm->channels[(size_t)rank*nChannels].tree.depth;
+  work->lastChunkSize = 0;
+  if (args->algorithm == NCCL_ALGO_TREE && args->protocol == NCCL_PROTO_SIMPLE) {
+    while (nBytes / (nChannels*chunkSize) < (size_t)depth*8 && chunkSize > 131072) chunkSize /= 2;
+    while (nBytes / (nChannels*chunkSize) < (size_t)depth*4 && chunkSize > 65536) chunkSize /= 2;
+    while (nBytes / (nChannels*chunkSize) < (size_t)depth && chunkSize > 32768) chunkSize /= 2;
+    work->lastChunkSize = chunkSize / typeSize;
+  } else if (args->protocol == NCCL_PROTO_LL) {
+    const ssize_t sliceSize = stepSize*sizeof(uint64_t)/sizeof(union ncclLLFifoLine);
+    const ssize_t loopSize = nChannels*nchunksPerLoop*sliceSize;
+    work->lastChunkSize = DIVUP((nBytes-(nBytes/loopSize)*loopSize), nChannels*nchunksPerLoop);
+    ALIGN_SIZE(work->lastChunkSize, nThreads*sizeof(uint64_t));
+    work->lastChunkSize /= typeSize;
+  } else if (args->algorithm == NCCL_ALGO_TREE && args->protocol == NCCL_PROTO_LL128) {
+    // Every rank is a node
+    float nstepsLL128 = 1+log2i(comm->nRanks);
+    while (nBytes / (nChannels*chunkSize) < nstepsLL128*64 && chunkSize > 131072) chunkSize /= 2;
+    while (nBytes / (nChannels*chunkSize) < nstepsLL128*16 && chunkSize > 32768) chunkSize /= 2;
+    work->lastChunkSize = chunkSize*NCCL_LL128_DATAELEMS/(NCCL_LL128_LINEELEMS*typeSize);
+  }
+}
+
+ncclResult_t ncclHostRunColl(struct ncclHostComm* comm, int rank, struct ncclHostCollArgs const* args) {
+  int nChannels = comm->nChannels;
+  int nWarps = args->nWarps ? args->nWarps : HOST_DEFAULT_NWARPS;
+  if (rank < 0 || rank >= comm->nRanks || nWarps < 1 || nWarps*WARP_SIZE > NCCL_MAX_NTHREADS ||
+      args->protocol < 0 || args->protocol >= NCCL_NUM_PROTOCOLS ||
+      (args->algorithm != NCCL_ALGO_RING && !(args->algorithm == NCCL_ALGO_TREE && args->coll == ncclFuncAllReduce))) {
+    WARN("Host comm : unsupported collective %d algorithm %d protocol %d nWarps %d", args->coll, args->algorithm, args->protocol, nWarps);
+    return ncclInvalidArgument;
+  }
+  if (__atomic_load_n(&comm->conns->abortFlag, __ATOMIC_RELAXED)) return ncclInvalidUsage;
+
+  int devRedOp;
+  uint64_t opArg;
+  NCCLCHECK(hostDevRedOp(args->op, args->datatype, comm->nRanks, &devRedOp, &opArg));
+  // Same as ncclInfoSetDerived
+  ncclDataType_t datatype = args->datatype;
+  size_t count = args->count;
+  size_t nBytes = count*ncclTypeSize(datatype);
+  if (args->coll == ncclFuncAllGather) {
+    count = nBytes;
+    datatype = ncclInt8;
+  }
+  if (args->coll == ncclFuncAllGather || args->coll == ncclFuncReduceScatter) nBytes *= comm->nRanks;
+
+  int nThreads = nChannels*nWarps;
+  struct ncclShmemData* shmem = (struct ncclShmemData*)calloc(nChannels, sizeof(struct ncclShmemData));
+  struct ncclWorkElem* elems = (struct ncclWorkElem*)calloc(nChannels, sizeof(struct ncclWorkElem));
+  struct hostThreadArgs* threadArgs = (struct hostThreadArgs*)calloc(nThreads, sizeof(struct hostThreadArgs));
+  pthread_t* threads = (pthread_t*)calloc(nThreads, sizeof(pthread_t));
+  int nDone = 0, nStarted = 0;
+  ncclResult_t ret = ncclSuccess;
+  if (shmem == NULL || elems == NULL || threadArgs == NULL || threads == NULL) {
+    ret = ncclSystemError;
+    goto exit;
+  }
+
+  for (int c=0; c<nChannels; c++) {
+    struct ncclShmemData* s = shmem+c;
+    s->channelId = c;
+    s->comm.rank = rank;
+    s->comm.nRanks = comm->nRanks;
+    for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) s->comm.buffSizes[p] = comm->buffSizes[p];
+    s->comm.abortFlag = &comm->conns->abortFlag;
+    s->channel = comm->channels[(size_t)rank*nChannels+c];
+    s->conns = comm->conns;
+
+    struct ncclWorkElem* e = elems+c;
+    e->isUsed = 1;
+    e->nWarps = nWarps;
+    e->bid = c;
+    e->nChannels = nChannels;
+    e->pad_0 = args->algorithm == NCCL_ALGO_TREE && args->treeSplit ? 1 : 0;
+    e->connIndex = 0;
+    e->sendbuff = args->sendbuff;
+    e->recvbuff = args->recvbuff;
+    e->count = count;
+    e->redOpArg = opArg;
+    setLastChunkSize(comm, rank, args, ncclTypeSize(datatype), nBytes, nWarps*WARP_SIZE, e);
+  }
+
+  for (int i=0; i<nThreads; i++) {
+    struct hostThreadArgs* t = threadArgs+i;
+    t->shmem = shmem + i/nWarps;
+    t->elem = elems + i/nWarps;
+    t->coll = args->coll;
+    t->devRedOp = devRedOp;
+    t->datatype = datatype;
+    t->algorithm = args->algorithm;
+    t->protocol = args->protocol;
+    t->tid = (i%nWarps)*WARP_SIZE;
+    t->nDone = &nDone;
+    if (pthread_create(threads+i, NULL, hostThreadMain, t) != 0) {
+      WARN("Host comm : failed to create thread %d", i);
+      __atomic_store_n(&comm->conns->abortFlag, 1, __ATOMIC_RELAXED);
+      ret = ncclSystemError;
+      break;
+    }
+    nStarted++;
+  }
+
+  // Abort all ranks when this one does not complete in time
+  if (comm->timeoutMs > 0) {
+    uint64_t deadline = hostClockMs() + comm->timeoutMs;
+    while (__atomic_load_n(&nDone, __ATOMIC_ACQUIRE) < nStarted) {
+      if (hostClockMs() > deadline) {
+        WARN("Host comm : rank %d timed out after %d ms, aborting", rank, comm->timeoutMs);
+        __atomic_store_n(&comm->conns->abortFlag, 1, __ATOMIC_RELAXED);
+        break;
+      }
+      sched_yield();
+    }
+  }
+  for (int i=0; i<nStarted; i++) {
+    pthread_join(threads[i], NULL);
+    if (ret == ncclSuccess) ret = threadArgs[i].ret;
+  }
+  if (ret == ncclSuccess) {
+    uint32_t abortFlag = __atomic_load_n(&comm->conns->abortFlag, __ATOMIC_RELAXED);
+    if (abortFlag == 2) WARN("Host comm : rank %d got mismatched chunk sizes or missing connections", rank);
+    if (abortFlag) ret = abortFlag == 2 ? ncclInternalError : ncclSystemError;
+  }
+
+exit:
+  free(shmem);
+  free(elems);
+  free(threadArgs);
+  free(threads);
+  return ret;
+}
@@ -0,0 +1,90 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_HOST_COMM_H_
+#define NCCL_HOST_COMM_H_
+
+// CPU execution backend. Runs the device collective algorithms on host
+// threads, with shared memory FIFOs standing in for the connections between
+// ranks, so that algorithms can be tested without a GPU. Ranks are threads of
+// one process, or processes forked after ncclHostCommInit since all FIFOs live
+// in a MAP_SHARED mapping.
+//
+// Channel c uses ring c in rank order (reversed for odd channels) and tree c%2
+// of the double binary tree. Each rank runs nChannels blocks of nWarps host
+// threads per collective.
+
+#include "nccl.h"
+#include "devcomm.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// One direction of a connection. Steps [head, tail) hold data.
+struct ncclHostFifo {
+  alignas(64) uint64_t tail; // written by the sender
+  alignas(64) uint64_t head; // written by the receiver
+  int sizes[NCCL_STEPS];     // bytes in each slot
+  size_t dataOffset;         // of the NCCL_STEPS slots, from the start of ncclHostConns
+};
+
+// Header of the shared mapping, followed by the FIFO index, the FIFOs and the slots
+struct ncclHostConns {
+  int nRanks;
+  int nChannels;
+  size_t slotBytes;
+  size_t mapBytes;
+  size_t fifoOffset;
+  uint32_t abortFlag; // 1: timeout, 2: protocol error
+  int index[1];       // [channel][from][to], FIFO number or -1
+};
+
+static inline struct ncclHostFifo* ncclHostConnsFifo(struct ncclHostConns* conns, int channel, int from, int to) {
+  int f = conns->index[((size_t)channel*conns->nRanks+from)*conns->nRanks+to];
+  return f < 0 ? NULL : (struct ncclHostFifo*)((char*)conns+conns->fifoOffset)+f;
+}
+
+static inline void* ncclHostFifoSlot(struct ncclHostConns* conns, struct ncclHostFifo* fifo, uint64_t step) {
+  return (char*)conns+fifo->dataOffset+(step%NCCL_STEPS)*conns->slotBytes;
+}
+
+struct ncclHostComm {
+  int nRanks;
+  int nChannels;
+  int buffSizes[NCCL_NUM_PROTOCOLS];
+  int timeoutMs;                   // 0 to wait forever
+  struct ncclHostConns* conns;
+  struct ncclDevChannel* channels; // [rank][channel]
+  int* userRanks;                  // [rank][channel][nRanks]
+};
+
+struct ncclHostCollArgs {
+  ncclFunc_t coll;     // AllReduce, AllGather or ReduceScatter
+  ncclDataType_t datatype;
+  ncclRedOp_t op;      // ncclSum, ncclProd, ncclMax, ncclMin or ncclAvg
+  int algorithm;       // NCCL_ALGO_RING or NCCL_ALGO_TREE (AllReduce only)
+  int protocol;
+  int nWarps;          // 0 for the default (4)
+  int treeSplit;       // TREE LL: split the block between reduce and broadcast
+  void const* sendbuff;
+  void* recvbuff;
+  size_t count;
+};
+
+// buffSizes may be NULL for the defaults
+ncclResult_t ncclHostCommInit(struct ncclHostComm** comm, int nRanks, int nChannels, int const* buffSizes);
+ncclResult_t ncclHostCommDestroy(struct ncclHostComm* comm);
+
+// Runs one collective as `rank`. All ranks must call it with the same
+// arguments (except the buffers); it returns once this rank is done.
+ncclResult_t ncclHostRunColl(struct ncclHostComm* comm, int rank, struct ncclHostCollArgs const* args);
+
+// Work element runners, one translation unit per collective. Return
+// ncclInvalidUsage for unsupported combinations.
+ncclResult_t ncclHostRunAllReduce(int devRedOp, ncclDataType_t type, int algo, int proto, struct ncclWorkElem* args);
+ncclResult_t ncclHostRunAllGather(int devRedOp, ncclDataType_t type, int algo, int proto, struct ncclWorkElem* args);
+ncclResult_t ncclHostRunReduceScatter(int devRedOp, ncclDataType_t type, int algo, int proto, struct ncclWorkElem* args);
+
+#endif
@@ -0,0 +1,190 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "host_reduce.h"
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// Software conversions, for the scalar variant and the tails of the F16C loops
+static inline float ncclHostHalfToFloat(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+  uint32_t u;
+  if (exp == 0x1f) {
+    u = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0); // Inf or quiet NaN
+  } else if (exp) {
+    u = sign | ((exp + 112) << 23) | (mant << 13);
+  } else {
+    float f = mant * (1.0f / 16777216.0f); // subnormal: mant * 2^-24, exact
+    memcpy(&u, &f, sizeof(u));
+    u |= sign;
+  }
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline uint16_t ncclHostFloatToHalf(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  uint16_t sign = (u >> 16) & 0x8000;
+  u &= 0x7fffffff;
+  if (u > 0x7f800000) return sign | 0x7e00 | ((u >> 13) & 0x3ff); // quiet NaN
+  if (u >= 0x477ff000) return sign | 0x7c00;                    // rounds to Inf
+  if (u < 0x38800000) {
+    // Subnormal or zero: adding 0.5 leaves the result in the low bits, with
+    // the FPU doing the rounding to nearest even.
+    float r;
+    memcpy(&r, &u, sizeof(r));
+    r += 0.5f;
+    memcpy(&u, &r, sizeof(u));
+    return sign | (uint16_t)(u - 0x3f000000);
+  }
+  u += 0xc8000fff + ((u >> 13) & 1); // rebias the exponent, round to nearest even
+  return sign | (uint16_t)(u >> 13);
+}
+
+// Functors shared by all variants, same semantics as the scalar loops of the
+// unit tests (T op= T)
+struct ncclHostOpSum {
+  template<typename T> T operator()(T x, T y) const { return x + y; }
+};
+struct ncclHostOpProd {
+  template<typename T> T operator()(T x, T y) const { return x * y; }
+};
+struct ncclHostOpMax {
+  template<typename T> T operator()(T x, T y) const { return (x < y) ? y : x; }
+};
+struct ncclHostOpMin {
+  template<typename T> T operator()(T x, T y) const { return (y < x) ? y : x; }
+};
+template<typename S>
+struct ncclHostOpScale {
+  S s;
+  ncclHostOpScale(S s): s(s) {}
+  template<typename T> T operator()(T x) const { return x * s; }
+};
+struct ncclHostOpDivide {
+  int d;
+  ncclHostOpDivide(int d): d(d) {}
+  template<typename T> T operator()(T x) const {
+    return divide(x, std::integral_constant<bool, std::is_integral<T>::value && sizeof(T) <= 4>());
+  }
+  template<typename T> T divide(T x, std::false_type) const { return x / d; }
+  // There is no SIMD integer division. Below 33 bits, the truncated double
+  // quotient is exact: its distance to the next integer is at least 2^-33 of
+  // its value, far above the rounding error.
+  template<typename T> T divide(T x, std::true_type) const {
+    typedef decltype(x / d) C;
+    return T(C((double)C(x) / (double)C(d)));
+  }
+};
+
+#define NCCL_HOST_REDUCE_NS ncclHostReduceScalar
+#define NCCL_HOST_REDUCE_TARGET
+#define NCCL_HOST_REDUCE_F16C 0
+#include "host_reduce_impl.h"
+#undef NCCL_HOST_REDUCE_NS
+#undef NCCL_HOST_REDUCE_TARGET
+#undef NCCL_HOST_REDUCE_F16C
+
+#if defined(__x86_64__)
+#define NCCL_HOST_REDUCE_NS ncclHostReduceAvx2
+#define NCCL_HOST_REDUCE_TARGET __attribute__((target("avx2,f16c")))
+#define NCCL_HOST_REDUCE_F16C 1
+#include "host_reduce_impl.h"
+#undef NCCL_HOST_REDUCE_NS
+#undef NCCL_HOST_REDUCE_TARGET
+#undef NCCL_HOST_REDUCE_F16C
+
+#define NCCL_HOST_REDUCE_NS ncclHostReduceAvx512
+#define NCCL_HOST_REDUCE_TARGET __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl,avx2,f16c")))
+#define NCCL_HOST_REDUCE_F16C 1
+#include "host_reduce_impl.h"
+#undef NCCL_HOST_REDUCE_NS
+#undef NCCL_HOST_REDUCE_TARGET
+#undef NCCL_HOST_REDUCE_F16C
+#endif
+
+struct ncclHostReduceFuncs {
+  ncclResult_t (*reduce)(void*, void const*, void const*, size_t, ncclDataType_t, ncclRedOp_t);
+  ncclResult_t (*scale)(void*, size_t, ncclDataType_t, void const*);
+  ncclResult_t (*divide)(void*, size_t, ncclDataType_t, int);
+};
+
+static const ncclHostReduceFuncs funcs[ncclHostIsaNum] = {
+  { ncclHostReduceScalar::hostReduce, ncclHostReduceScalar::hostScale, ncclHostReduceScalar::hostDivide },
+#if defined(__x86_64__)
+  { ncclHostReduceAvx2::hostReduce, ncclHostReduceAvx2::hostScale, ncclHostReduceAvx2::hostDivide },
+  { ncclHostReduceAvx512::hostReduce, ncclHostReduceAvx512::hostScale, ncclHostReduceAvx512::hostDivide },
+#else
+  { ncclHostReduceScalar::hostReduce, ncclHostReduceScalar::hostScale, ncclHostReduceScalar::hostDivide },
+  { ncclHostReduceScalar::hostReduce, ncclHostReduceScalar::hostScale, ncclHostReduceScalar::hostDivide },
+#endif
+};
+
+ncclHostIsa ncclHostIsaDetect() {
+#if defined(__x86_64__)
+  static const ncclHostIsa detected = []() {
+    __builtin_cpu_init();
+    unsigned int eax, ebx, ecx, edx;
+    bool f16c = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C);
+    if (!f16c || !__builtin_cpu_supports("avx2")) return ncclHostIsaScalar;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) return ncclHostIsaAvx512;
+    return ncclHostIsaAvx2;
+  }();
+  return detected;
+#else
+  return ncclHostIsaScalar;
+#endif
+}
+
+const char* ncclHostIsaName(ncclHostIsa isa) {
+  switch (isa) {
+    case ncclHostIsaScalar: return "scalar";
+    case ncclHostIsaAvx2: return "avx2";
+    case ncclHostIsaAvx512: return "avx512";
+    default: return "unknown";
+  }
+}
+
+static int selectedIsa = -1;
+
+ncclResult_t ncclHostReduceSetIsa(ncclHostIsa isa) {
+  if (isa < ncclHostIsaScalar || isa > ncclHostIsaDetect()) return ncclInvalidUsage;
+  __atomic_store_n(&selectedIsa, (int)isa, __ATOMIC_RELAXED);
+  return ncclSuccess;
+}
+
+ncclHostIsa ncclHostReduceGetIsa() {
+  int isa = __atomic_load_n(&selectedIsa, __ATOMIC_RELAXED);
+  return isa < 0 ? ncclHostIsaDetect() : (ncclHostIsa)isa;
+}
+
+ncclResult_t ncclHostReduce(void* dst, void const* src0, void const* src1, size_t count,
+    ncclDataType_t type, ncclRedOp_t op) {
+  if (count == 0) return ncclSuccess;
+  // Commutative ops: keep the in-place case on the aliasing-friendly loop
+  if (dst == src1 && dst != src0) { void const* t = src0; src0 = src1; src1 = t; }
+  return funcs[ncclHostReduceGetIsa()].reduce(dst, src0, src1, count, type, op);
+}
+
+ncclResult_t ncclHostScale(void* buff, size_t count, ncclDataType_t type, void const* scalar) {
+  if (count == 0) return ncclSuccess;
+  return funcs[ncclHostReduceGetIsa()].scale(buff, count, type, scalar);
+}
+
+ncclResult_t ncclHostDivide(void* buff, size_t count, ncclDataType_t type, int divisor) {
+  if (count == 0) return ncclSuccess;
+  if (divisor == 0) return ncclInvalidArgument;
+  return funcs[ncclHostReduceGetIsa()].divide(buff, count, type, divisor);
+}
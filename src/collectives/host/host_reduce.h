@@ -0,0 +1,44 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_HOST_REDUCE_H_
+#define NCCL_HOST_REDUCE_H_
+
+// Element-wise reductions on host buffers, for all ncclDataType_t. The loops
+// are compiled once per instruction set (scalar, AVX2, AVX-512) and the best
+// one supported by the CPU is picked at the first call. ncclFloat16 and
+// ncclBfloat16 are computed in float and rounded to nearest even, like
+// __float2half and rccl_bfloat16.
+
+#include "nccl.h"
+#include <stddef.h>
+
+enum ncclHostIsa {
+  ncclHostIsaScalar = 0, // baseline target of the compiler (SSE2 on x86-64)
+  ncclHostIsaAvx2 = 1,   // AVX2 + F16C
+  ncclHostIsaAvx512 = 2, // AVX-512 F/BW/DQ/VL + F16C
+  ncclHostIsaNum = 3
+};
+
+// Best instruction set supported by this CPU
+ncclHostIsa ncclHostIsaDetect();
+const char* ncclHostIsaName(ncclHostIsa isa);
+
+// Instruction set used by the calls below. Selecting one the CPU does not
+// support returns ncclInvalidUsage.
+ncclResult_t ncclHostReduceSetIsa(ncclHostIsa isa);
+ncclHostIsa ncclHostReduceGetIsa();
+
+// dst[i] = op(src0[i], src1[i]) for ncclSum, ncclProd, ncclMax and ncclMin.
+// dst may be src0 or src1, other overlaps are not supported.
+ncclResult_t ncclHostReduce(void* dst, void const* src0, void const* src1, size_t count,
+    ncclDataType_t type, ncclRedOp_t op);
+// buff[i] *= *scalar, scalar pointing to one element of the same type
+ncclResult_t ncclHostScale(void* buff, size_t count, ncclDataType_t type, void const* scalar);
+// buff[i] /= divisor (ncclAvg)
+ncclResult_t ncclHostDivide(void* buff, size_t count, ncclDataType_t type, int divisor);
+
+#endif
@@ -0,0 +1,172 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+// Reduction loops of host_reduce.cc. This file is included once per
+// instruction set, with:
+//   NCCL_HOST_REDUCE_NS     namespace of this variant
+//   NCCL_HOST_REDUCE_TARGET target attribute applied to every function
+//   NCCL_HOST_REDUCE_F16C   1 to convert halves with F16C
+// The loops are plain C++ left to the vectorizer; only the half conversions
+// use intrinsics.
+
+namespace NCCL_HOST_REDUCE_NS {
+
+// Number of fp16/bf16 elements converted to float at a time
+static constexpr size_t CvtBlock = 512;
+
+struct CvtBf16 {
+  NCCL_HOST_REDUCE_TARGET static void load(float* dst, uint16_t const* src, size_t n) {
+    for (size_t i=0; i<n; i++) {
+      uint32_t u = (uint32_t)src[i] << 16;
+      memcpy(dst+i, &u, sizeof(float));
+    }
+  }
+  // Same rounding as rccl_bfloat16(float), written without branches
+  NCCL_HOST_REDUCE_TARGET static void store(uint16_t* dst, float const* src, size_t n) {
+    for (size_t i=0; i<n; i++) {
+      uint32_t u;
+      memcpy(&u, src+i, sizeof(float));
+      uint32_t rounded = u + 0x7fff + ((u >> 16) & 1);
+      uint32_t special = (u & 0xffff) ? (u | 0x10000) : u; // Inf or NaN
+      dst[i] = (uint16_t)(((~u & 0x7f800000) ? rounded : special) >> 16);
+    }
+  }
+};
+
+struct CvtHalf {
+  NCCL_HOST_REDUCE_TARGET static void load(float* dst, uint16_t const* src, size_t n) {
+    size_t i = 0;
+#if NCCL_HOST_REDUCE_F16C
+    for (; i+8<=n; i+=8) _mm256_storeu_ps(dst+i, _mm256_cvtph_ps(_mm_loadu_si128((__m128i const*)(src+i))));
+#endif
+    for (; i<n; i++) dst[i] = ncclHostHalfToFloat(src[i]);
+  }
+  NCCL_HOST_REDUCE_TARGET static void store(uint16_t* dst, float const* src, size_t n) {
+    size_t i = 0;
+#if NCCL_HOST_REDUCE_F16C
+    for (; i+8<=n; i+=8) _mm_storeu_si128((__m128i*)(dst+i), _mm256_cvtps_ph(_mm256_loadu_ps(src+i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for (; i<n; i++) dst[i] = ncclHostFloatToHalf(src[i]);
+  }
+};
+
+// dst == src0 gets its own loop: the vectorizer versions loops on the pointers
+// not overlapping and would fall back to scalar code for an in-place reduction.
+template<typename T, typename Fn>
+NCCL_HOST_REDUCE_TARGET static void reduce(T* dst, T const* src0, T const* src1, size_t n, Fn fn) {
+  if (dst == src0) {
+    for (size_t i=0; i<n; i++) dst[i] = fn(dst[i], src1[i]);
+  } else {
+    for (size_t i=0; i<n; i++) dst[i] = fn(src0[i], src1[i]);
+  }
+}
+
+template<typename T, typename Fn>
+NCCL_HOST_REDUCE_TARGET static void apply(T* buff, size_t n, Fn fn) {
+  for (size_t i=0; i<n; i++) buff[i] = fn(buff[i]);
+}
+
+template<typename Cvt, typename Fn>
+NCCL_HOST_REDUCE_TARGET static void reduceCvt(uint16_t* dst, uint16_t const* src0, uint16_t const* src1, size_t n, Fn fn) {
+  float a[CvtBlock], b[CvtBlock];
+  for (size_t offset=0; offset<n; offset+=CvtBlock) {
+    size_t m = n-offset < CvtBlock ? n-offset : CvtBlock;
+    Cvt::load(a, src0+offset, m);
+    Cvt::load(b, src1+offset, m);
+    for (size_t i=0; i<m; i++) a[i] = fn(a[i], b[i]);
+    Cvt::store(dst+offset, a, m);
+  }
+}
+
+template<typename Cvt, typename Fn>
+NCCL_HOST_REDUCE_TARGET static void applyCvt(uint16_t* buff, size_t n, Fn fn) {
+  float a[CvtBlock];
+  for (size_t offset=0; offset<n; offset+=CvtBlock) {
+    size_t m = n-offset < CvtBlock ? n-offset : CvtBlock;
+    Cvt::load(a, buff+offset, m);
+    for (size_t i=0; i<m; i++) a[i] = fn(a[i]);
+    Cvt::store(buff+offset, a, m);
+  }
+}
+
+template<typename Fn>
+NCCL_HOST_REDUCE_TARGET static ncclResult_t reduceType(void* dst, void const* src0, void const* src1, size_t n, ncclDataType_t type, Fn fn) {
+  switch (type) {
+    case ncclInt8: reduce((int8_t*)dst, (int8_t const*)src0, (int8_t const*)src1, n, fn); break;
+    case ncclUint8: reduce((uint8_t*)dst, (uint8_t const*)src0, (uint8_t const*)src1, n, fn); break;
+    case ncclInt32: reduce((int32_t*)dst, (int32_t const*)src0, (int32_t const*)src1, n, fn); break;
+    case ncclUint32: reduce((uint32_t*)dst, (uint32_t const*)src0, (uint32_t const*)src1, n, fn); break;
+    case ncclInt64: reduce((int64_t*)dst, (int64_t const*)src0, (int64_t const*)src1, n, fn); break;
+    case ncclUint64: reduce((uint64_t*)dst, (uint64_t const*)src0, (uint64_t const*)src1, n, fn); break;
+    case ncclFloat16: reduceCvt<CvtHalf>((uint16_t*)dst, (uint16_t const*)src0, (uint16_t const*)src1, n, fn); break;
+    case ncclFloat32: reduce((float*)dst, (float const*)src0, (float const*)src1, n, fn); break;
+    case ncclFloat64: reduce((double*)dst, (double const*)src0, (double const*)src1, n, fn); break;
+    case ncclBfloat16: reduceCvt<CvtBf16>((uint16_t*)dst, (uint16_t const*)src0, (uint16_t const*)src1, n, fn); break;
+    default: return ncclInvalidArgument;
+  }
+  return ncclSuccess;
+}
+
+NCCL_HOST_REDUCE_TARGET static ncclResult_t hostReduce(void* dst, void const* src0, void const* src1, size_t n, ncclDataType_t type, ncclRedOp_t op) {
+  switch (op) {
+    case ncclSum: return reduceType(dst, src0, src1, n, type, ncclHostOpSum());
+    case ncclProd: return reduceType(dst, src0, src1, n, type, ncclHostOpProd());
+    case ncclMax: return reduceType(dst, src0, src1, n, type, ncclHostOpMax());
+    case ncclMin: return reduceType(dst, src0, src1, n, type, ncclHostOpMin());
+    default: return ncclInvalidArgument;
+  }
+}
+
+template<typename T>
+NCCL_HOST_REDUCE_TARGET static void scaleT(void* buff, size_t n, void const* scalar) {
+  T s;
+  memcpy(&s, scalar, sizeof(T));
+  apply((T*)buff, n, ncclHostOpScale<T>(s));
+}
+
+template<typename Cvt>
+NCCL_HOST_REDUCE_TARGET static void scaleCvt(void* buff, size_t n, void const* scalar) {
+  float s;
+  Cvt::load(&s, (uint16_t const*)scalar, 1);
+  applyCvt<Cvt>((uint16_t*)buff, n, ncclHostOpScale<float>(s));
+}
+
+NCCL_HOST_REDUCE_TARGET static ncclResult_t hostScale(void* buff, size_t n, ncclDataType_t type, void const* scalar) {
+  switch (type) {
+    case ncclInt8: scaleT<int8_t>(buff, n, scalar); break;
+    case ncclUint8: scaleT<uint8_t>(buff, n, scalar); break;
+    case ncclInt32: scaleT<int32_t>(buff, n, scalar); break;
+    case ncclUint32: scaleT<uint32_t>(buff, n, scalar); break;
+    case ncclInt64: scaleT<int64_t>(buff, n, scalar); break;
+    case ncclUint64: scaleT<uint64_t>(buff, n, scalar); break;
+    case ncclFloat16: scaleCvt<CvtHalf>(buff, n, scalar); break;
+    case ncclFloat32: scaleT<float>(buff, n, scalar); break;
+    case ncclFloat64: scaleT<double>(buff, n, scalar); break;
+    case ncclBfloat16: scaleCvt<CvtBf16>(buff, n, scalar); break;
+    default: return ncclInvalidArgument;
+  }
+  return ncclSuccess;
+}
+
+NCCL_HOST_REDUCE_TARGET static ncclResult_t hostDivide(void* buff, size_t n, ncclDataType_t type, int divisor) {
+  ncclHostOpDivide div(divisor);
+  switch (type) {
+    case ncclInt8: apply((int8_t*)buff, n, div); break;
+    case ncclUint8: apply((uint8_t*)buff, n, div); break;
+    case ncclInt32: apply((int32_t*)buff, n, div); break;
+    case ncclUint32: apply((uint32_t*)buff, n, div); break;
+    case ncclInt64: apply((int64_t*)buff, n, div); break;
+    case ncclUint64: apply((uint64_t*)buff, n, div); break;
+    case ncclFloat16: applyCvt<CvtHalf>((uint16_t*)buff, n, div); break;
+    case ncclFloat32: apply((float*)buff, n, div); break;
+    case ncclFloat64: apply((double*)buff, n, div); break;
+    case ncclBfloat16: applyCvt<CvtBf16>((uint16_t*)buff, n, div); break;
+    default: return ncclInvalidArgument;
+  }
+  return ncclSuccess;
+}
+
+} // namespace NCCL_HOST_REDUCE_NS
@@ -0,0 +1,173 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_PRIMS_HOST_H_
+#define NCCL_PRIMS_HOST_H_
+
+#include "host_comm.h"
+#include <sched.h>
+
+// Host implementation of the Primitives class, shared by all protocols. Only
+// the first thread of a group (tid 0) moves data, the other warps of the group
+// return right away. Data goes through the FIFO of each (sender, receiver)
+// pair, one FIFO step per Proto::calcBytePerStep() bytes, so a chunk uses the
+// same number of steps as on the device for SIMPLE and LL. Received steps are
+// reduced in place from the FIFO slots and the result is written once, to the
+// output buffer or the first send slot, then copied to the other destinations.
+template<typename T, typename RedOp, typename Fan, int Direct, typename Proto, int P2p>
+class Primitives {
+  static constexpr int MaxRecv = Fan::MaxRecv, MaxSend = Fan::MaxSend;
+  static constexpr int SpinsBeforeYield = 64;
+
+  RedOp redOp;
+  bool active;
+  int nrecv, nsend;
+  struct ncclHostFifo* recvFifo[MaxRecv+1];
+  struct ncclHostFifo* sendFifo[MaxSend+1];
+  struct ncclHostConns* conns;
+  T const* userInput;
+  T* userOutput;
+  int stepElems;
+
+  template<typename Cond>
+  bool waitUntil(Cond cond) {
+    int spins = 0;
+    while (!cond()) {
+      if (++spins < SpinsBeforeYield) continue;
+      if (__atomic_load_n(&conns->abortFlag, __ATOMIC_RELAXED)) {
+        active = false;
+        return false;
+      }
+      sched_yield();
+      spins = 0;
+    }
+    return true;
+  }
+
+  void genericOp(bool recv, T const* src, bool srcIsInput, T* dst, bool send, int eltN, bool postOp) {
+    if (!active) return;
+    int nr = recv ? nrecv : 0, ns = send ? nsend : 0;
+    int total = eltN > 0 ? eltN : 0, done = 0;
+    // Even empty chunks use one step so that both sides stay in sync.
+    do {
+      int n = min(stepElems, total-done);
+      T const* srcs[MaxRecv+1] = {};
+      T* dsts[MaxSend+1] = {};
+      int nSrcs = 0, nDsts = 0;
+      if (src) srcs[nSrcs++] = src+done;
+      for (int i=0; i<nr; i++) {
+        struct ncclHostFifo* fifo = recvFifo[i];
+        uint64_t step = fifo->head;
+        if (!waitUntil([&]() { return __atomic_load_n(&fifo->tail, __ATOMIC_ACQUIRE) > step; })) return;
+        if (fifo->sizes[step%NCCL_STEPS] != n*(int)sizeof(T)) {
+          // Sender and receiver disagree on the chunk size: the algorithm is broken
+          __atomic_store_n(&conns->abortFlag, 2, __ATOMIC_RELAXED);
+          active = false;
+          return;
+        }
+        srcs[nSrcs++] = (T const*)ncclHostFifoSlot(conns, fifo, step);
+      }
+      if (dst) dsts[nDsts++] = dst+done;
+      for (int i=0; i<ns; i++) {
+        struct ncclHostFifo* fifo = sendFifo[i];
+        uint64_t step = fifo->tail;
+        if (!waitUntil([&]() { return __atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE) + NCCL_STEPS > step; })) return;
+        dsts[nDsts++] = (T*)ncclHostFifoSlot(conns, fifo, step);
+      }
+      if (n && nDsts > 0) {
+        ncclHostReduceCopy(redOp, dsts[0], srcs, nSrcs, srcIsInput, postOp, n);
+        for (int i=1; i<nDsts; i++) memcpy(dsts[i], dsts[0], n*sizeof(T));
+      }
+      for (int i=0; i<nr; i++) __atomic_store_n(&recvFifo[i]->head, recvFifo[i]->head+1, __ATOMIC_RELEASE);
+      for (int i=0; i<ns; i++) {
+        struct ncclHostFifo* fifo = sendFifo[i];
+        fifo->sizes[fifo->tail%NCCL_STEPS] = n*sizeof(T);
+        __atomic_store_n(&fifo->tail, fifo->tail+1, __ATOMIC_RELEASE);
+      }
+      done += n;
+    } while (done < total);
+  }
+
+ public:
+  Primitives(
+      int tid, int nthreads, int const* recvPeers, int const* sendPeers,
+      void const* inputBuf, void* outputBuf, uint64_t redOpArg, uint32_t group=0, struct ncclWorkElem* e = nullptr
+    ):
+    redOp(redOpArg), active(tid == 0), nrecv(0), nsend(0), conns(ncclShmem->conns),
+    userInput((T const*)inputBuf), userOutput((T*)outputBuf), stepElems(0) {
+    // A single connection per peer: group (and the connIndex it carries) is not used.
+    if (!active) return;
+    int rank = ncclShmem->comm.rank, channel = ncclShmem->channelId;
+    while (recvPeers && nrecv < MaxRecv && recvPeers[nrecv] >= 0) {
+      recvFifo[nrecv] = ncclHostConnsFifo(conns, channel, recvPeers[nrecv], rank);
+      nrecv++;
+    }
+    while (sendPeers && nsend < MaxSend && sendPeers[nsend] >= 0) {
+      sendFifo[nsend] = ncclHostConnsFifo(conns, channel, rank, sendPeers[nsend]);
+      nsend++;
+    }
+    stepElems = Proto::calcBytePerStep()/sizeof(T);
+    if (stepElems*sizeof(T) > conns->slotBytes) stepElems = conns->slotBytes/sizeof(T);
+    for (int i=0; i<nrecv; i++) if (recvFifo[i] == NULL) active = false;
+    for (int i=0; i<nsend; i++) if (sendFifo[i] == NULL) active = false;
+    if (!active || stepElems == 0) {
+      __atomic_store_n(&conns->abortFlag, 2, __ATOMIC_RELAXED);
+      active = false;
+    }
+  }
+
+  void send(intptr_t inpIx, int eltN) {
+    genericOp(false, userInput+inpIx, true, nullptr, true, eltN, false);
+  }
+  void sendFromOutput(intptr_t outIx, int eltN) {
+    genericOp(false, userOutput+outIx, false, nullptr, true, eltN, false);
+  }
+  void directSend(intptr_t inpIx, intptr_t remoteOutIx, int eltN) {
+    send(inpIx, eltN);
+  }
+  void directSendFromOutput(intptr_t outIx, intptr_t remoteOutIx, int eltN) {
+    sendFromOutput(outIx, eltN);
+  }
+
+  void recv(intptr_t outIx, int eltN, bool postOp=false) {
+    genericOp(true, nullptr, false, userOutput+outIx, false, eltN, postOp);
+  }
+  void directRecv(intptr_t outIx, int eltN) {
+    recv(outIx, eltN, /*postOp=*/false);
+  }
+
+  void copySend(intptr_t inpIx, intptr_t outIx, int eltN, bool postOp=false) {
+    genericOp(false, userInput+inpIx, true, userOutput+outIx, true, eltN, postOp);
+  }
+  void directCopySend(intptr_t inpIx, intptr_t outIx, intptr_t remoteOutIx, int eltN, bool postOp=false) {
+    copySend(inpIx, outIx, eltN, postOp);
+  }
+
+  void recvSend(int eltN, bool postOp=false) {
+    genericOp(true, nullptr, false, nullptr, true, eltN, postOp);
+  }
+  void recvCopySend(intptr_t outIx, int eltN, bool postOp=false) {
+    genericOp(true, nullptr, false, userOutput+outIx, true, eltN, postOp);
+  }
+  void directRecvCopySend(intptr_t outIx, intptr_t remoteOutIx, int eltN) {
+    recvCopySend(outIx, eltN, /*postOp=*/false);
+  }
+
+  void recvReduceSend(intptr_t inpIx, int eltN, bool postOp=false) {
+    genericOp(true, userInput+inpIx, true, nullptr, true, eltN, postOp);
+  }
+  void recvReduceCopy(intptr_t inpIx, intptr_t outIx, int eltN, bool postOp=false) {
+    genericOp(true, userInput+inpIx, true, userOutput+outIx, false, eltN, postOp);
+  }
+  void recvReduceCopySend(intptr_t inpIx, intptr_t outIx, int eltN, bool postOp=false) {
+    genericOp(true, userInput+inpIx, true, userOutput+outIx, true, eltN, postOp);
+  }
+  void directRecvReduceCopySend(intptr_t inpIx, intptr_t outIx, intptr_t remoteOutIx, int eltN, bool postOp=false) {
+    recvReduceCopySend(inpIx, outIx, eltN, postOp);
+  }
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_REDUCE_HOST_H_
+#define NCCL_REDUCE_HOST_H_
+
+// Host versions of the reduce_kernel.h functors, with the same interface, plus
+// array loops written so that the compiler vectorizes them. Plain reductions
+// go through the runtime dispatched SIMD loops of host_reduce.h. half is
+// device only and is not supported; rccl_bfloat16 goes through float.
+
+#include "nccl.h"
+#include "rccl_bfloat16.h"
+#include "host_reduce.h"
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+template<typename T>
+struct FuncNull {
+  FuncNull(uint64_t opArg=0) {}
+  T operator()(const T x, const T y) const { return 0; }
+};
+
+template<typename T>
+struct FuncSum {
+  FuncSum(uint64_t opArg=0) {}
+  T operator()(const T x, const T y) const { return x + y; }
+};
+
+template<typename T>
+struct FuncProd {
+  FuncProd(uint64_t opArg=0) {}
+  T operator()(const T x, const T y) const { return x * y; }
+};
+
+template<typename T>
+struct FuncMax {
+  FuncMax(uint64_t opArg=0) {}
+  T operator()(const T x, const T y) const { return (x < y) ? y : x; }
+};
+
+template<typename T>
+struct FuncMin {
+  FuncMin(uint64_t opArg=0) {}
+  T operator()(const T x, const T y) const { return (x < y) ? x : y; }
+};
+
+template<typename Fn>
+struct FuncTraits { // generic implementation for FuncSum,Prod,Min,Max
+  static constexpr bool IsPreOpIdentity = true;
+  static constexpr bool IsPostOpIdentity = true;
+
+  template<typename T>
+  static T preOp(Fn, T x) { return x; }
+  template<typename T>
+  static T postOp(Fn, T x) { return x; }
+};
+
+template<typename T>
+struct IsFloatingPoint: std::false_type {};
+template<>
+struct IsFloatingPoint<rccl_bfloat16>: std::true_type {};
+template<>
+struct IsFloatingPoint<float>: std::true_type {};
+template<>
+struct IsFloatingPoint<double>: std::true_type {};
+
+template<typename T, bool IsFloating=IsFloatingPoint<T>::value>
+struct FuncSumPostDiv;
+
+template<typename T>
+struct FuncSumPostDiv<T, /*IsFloating=*/false>: FuncSum<T> {
+  static constexpr bool IsPreOpIdentity = true;
+  static constexpr bool IsPostOpIdentity = false;
+  int n;
+  FuncSumPostDiv(uint64_t opArg): n(opArg) {}
+  T preOp(T x) const { return x; }
+  T postOp(T x) const { return T(x/n); }
+};
+
+template<typename T>
+struct FuncSumPostDiv<T, /*IsFloating=*/true> {
+  static_assert(sizeof(T)!=sizeof(T), "FuncSumPostDiv is only for implementing ncclAvg on integral types.");
+};
+
+template<typename T>
+struct FuncPreMulSum: FuncSum<T> { // opArg holds the bits of a T scalar
+  static constexpr bool IsPreOpIdentity = false;
+  static constexpr bool IsPostOpIdentity = true;
+  T scale;
+  FuncPreMulSum(uint64_t opArg) { memcpy(&scale, &opArg, sizeof(T)); }
+  T preOp(T x) const { return x*scale; }
+  T postOp(T x) const { return x; }
+};
+
+template<typename T>
+struct FuncTraits<FuncSumPostDiv<T>> {
+  static constexpr bool IsPreOpIdentity = FuncSumPostDiv<T>::IsPreOpIdentity;
+  static constexpr bool IsPostOpIdentity = FuncSumPostDiv<T>::IsPostOpIdentity;
+
+  static T preOp(FuncSumPostDiv<T> fn, T x) { return fn.preOp(x); }
+  static T postOp(FuncSumPostDiv<T> fn, T x) { return fn.postOp(x); }
+};
+template<typename T>
+struct FuncTraits<FuncPreMulSum<T>> {
+  static constexpr bool IsPreOpIdentity = FuncPreMulSum<T>::IsPreOpIdentity;
+  static constexpr bool IsPostOpIdentity = FuncPreMulSum<T>::IsPostOpIdentity;
+
+  static T preOp(FuncPreMulSum<T> fn, T x) { return fn.preOp(x); }
+  static T postOp(FuncPreMulSum<T> fn, T x) { return fn.postOp(x); }
+};
+
+// ncclDataType_t and ncclRedOp_t of the functors, -1 when host_reduce.h has
+// no equivalent. FuncSumPostDiv and FuncPreMulSum combine values with a sum.
+template<typename T> struct ncclHostTypeOf { static constexpr int value = -1; };
+template<> struct ncclHostTypeOf<int8_t> { static constexpr int value = ncclInt8; };
+template<> struct ncclHostTypeOf<uint8_t> { static constexpr int value = ncclUint8; };
+template<> struct ncclHostTypeOf<int32_t> { static constexpr int value = ncclInt32; };
+template<> struct ncclHostTypeOf<uint32_t> { static constexpr int value = ncclUint32; };
+template<> struct ncclHostTypeOf<int64_t> { static constexpr int value = ncclInt64; };
+template<> struct ncclHostTypeOf<uint64_t> { static constexpr int value = ncclUint64; };
+template<> struct ncclHostTypeOf<float> { static constexpr int value = ncclFloat32; };
+template<> struct ncclHostTypeOf<double> { static constexpr int value = ncclFloat64; };
+template<> struct ncclHostTypeOf<rccl_bfloat16> { static constexpr int value = ncclBfloat16; };
+
+template<typename RedOp> struct ncclHostOpOf { static constexpr int value = -1; };
+template<typename T> struct ncclHostOpOf<FuncSum<T>> { static constexpr int value = ncclSum; };
+template<typename T> struct ncclHostOpOf<FuncProd<T>> { static constexpr int value = ncclProd; };
+template<typename T> struct ncclHostOpOf<FuncMax<T>> { static constexpr int value = ncclMax; };
+template<typename T> struct ncclHostOpOf<FuncMin<T>> { static constexpr int value = ncclMin; };
+template<typename T> struct ncclHostOpOf<FuncSumPostDiv<T>> { static constexpr int value = ncclSum; };
+template<typename T> struct ncclHostOpOf<FuncPreMulSum<T>> { static constexpr int value = ncclSum; };
+
+// dst[i] = redOp(a[i], b[i]); dst may alias a
+template<typename RedOp, typename T>
+static void ncclHostCombine(RedOp redOp, T* dst, T const* a, T const* b, size_t n) {
+  constexpr int type = ncclHostTypeOf<T>::value, op = ncclHostOpOf<RedOp>::value;
+  if (type >= 0 && op >= 0 && ncclHostReduce(dst, a, b, n, (ncclDataType_t)type, (ncclRedOp_t)op) == ncclSuccess) return;
+  for (size_t i=0; i<n; i++) dst[i] = redOp(a[i], b[i]);
+}
+
+// dst[i] = postOp(op(preOp(srcs[0][i]), srcs[1][i], ...)). preOp is applied to
+// the first source only when preOpFirst is set (user input), like the device
+// primitives. dst may alias srcs[0].
+template<typename RedOp, typename T>
+static void ncclHostReduceCopy(RedOp redOp, T* dst, T const* const* srcs, int nSrcs, bool preOpFirst, bool postOp, size_t n) {
+  typedef FuncTraits<RedOp> Traits;
+  bool pre = preOpFirst && !Traits::IsPreOpIdentity;
+  bool post = postOp && !Traits::IsPostOpIdentity;
+  T const* s0 = srcs[0];
+  if (nSrcs == 1) {
+    if (pre && post) {
+      for (size_t i=0; i<n; i++) dst[i] = Traits::postOp(redOp, Traits::preOp(redOp, s0[i]));
+    } else if (pre) {
+      for (size_t i=0; i<n; i++) dst[i] = Traits::preOp(redOp, s0[i]);
+    } else if (post) {
+      for (size_t i=0; i<n; i++) dst[i] = Traits::postOp(redOp, s0[i]);
+    } else if (dst != s0) {
+      memcpy(dst, s0, n*sizeof(T));
+    }
+    return;
+  }
+  T const* s1 = srcs[1];
+  if (pre) {
+    for (size_t i=0; i<n; i++) dst[i] = redOp(Traits::preOp(redOp, s0[i]), s1[i]);
+  } else {
+    ncclHostCombine(redOp, dst, s0, s1, n);
+  }
+  for (int s=2; s<nSrcs; s++) ncclHostCombine(redOp, dst, (T const*)dst, srcs[s], n);
+  if (post) {
+    for (size_t i=0; i<n; i++) dst[i] = Traits::postOp(redOp, dst[i]);
+  }
+}
+
+#endif
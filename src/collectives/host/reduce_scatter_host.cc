@@ -0,0 +1,22 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#define NCCL_HOST_PRIMS
+#include "../device/reduce_scatter.h"
+#include "host_comm.h"
+
+ncclResult_t ncclHostRunReduceScatter(int devRedOp, ncclDataType_t type, int algo, int proto, struct ncclWorkElem* args) {
+  switch (algo*NCCL_NUM_PROTOCOLS+proto) {
+    case NCCL_ALGO_RING*NCCL_NUM_PROTOCOLS+NCCL_PROTO_LL:
+      return ncclHostRunElem<ncclFuncReduceScatter, NCCL_ALGO_RING, NCCL_PROTO_LL>(devRedOp, type, args);
+    case NCCL_ALGO_RING*NCCL_NUM_PROTOCOLS+NCCL_PROTO_LL128:
+      return ncclHostRunElem<ncclFuncReduceScatter, NCCL_ALGO_RING, NCCL_PROTO_LL128>(devRedOp, type, args);
+    case NCCL_ALGO_RING*NCCL_NUM_PROTOCOLS+NCCL_PROTO_SIMPLE:
+      return ncclHostRunElem<ncclFuncReduceScatter, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE>(devRedOp, type, args);
+    default:
+      return ncclInvalidUsage;
+  }
+}
@@ -17,6 +17,9 @@
 #include "channel.h"
 #include "rocmwrap.h"
 #include "rccl_vars.h"
+#include "alltoallv.h"
+#include "p2p_sched.h"
+#include "recorder.h"
 #include <cstring> // std::memcpy
 #include <cinttypes> // PRIx64
 
@@ -340,11 +343,11 @@ static ncclResult_t addCollToPlan(
   return ncclSuccess;
 }
 
-// Put p2p op in plan assuming there is space in nWorkBudget, so you must
-// ensure *nWorkBudget >= 1 upon entry.
-static ncclResult_t addP2pToPlan(
+// Put p2p op in plan on the given channel assuming there is space in nWorkBudget,
+// so you must ensure *nWorkBudget >= 1 upon entry.
+static ncclResult_t addP2pToPlanChannel(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget,
-    bool isSendNotRecv, int peer, int chunk, void *addr, size_t bytes, uint32_t connIndex
+    bool isSendNotRecv, int peer, int channelId, void *addr, size_t bytes, uint32_t connIndex
   ) {
   struct ncclInfo info = {
     isSendNotRecv ? ncclFuncSend : ncclFuncRecv,
@@ -352,9 +355,6 @@ static ncclResult_t addP2pToPlan(
     nullptr, addr, bytes, ncclInt8, ncclSum, peer, comm, (hipStream_t)0,
     /*Args*/1, 1
   };
-
-  int channelId;
-  NCCLCHECK(ncclChannelCompute(comm, peer, chunk%comm->p2pnChannelsPerPeer, info.coll, &channelId));
   info.channelId = channelId;
 
   struct ncclProxyOp proxyOp = {};
@@ -384,6 +384,17 @@ static ncclResult_t addP2pToPlan(
   return ncclSuccess;
 }
 
+// Same as above, with the channel derived from the peer and chunk index.
+static ncclResult_t addP2pToPlan(
+    struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget,
+    bool isSendNotRecv, int peer, int chunk, void *addr, size_t bytes, uint32_t connIndex
+  ) {
+  int channelId;
+  NCCLCHECK(ncclChannelCompute(comm, peer, chunk%comm->p2pnChannelsPerPeer, isSendNotRecv ? ncclFuncSend : ncclFuncRecv, &channelId));
+  NCCLCHECK(addP2pToPlanChannel(comm, plan, nWorkBudget, isSendNotRecv, peer, channelId, addr, bytes, connIndex));
+  return ncclSuccess;
+}
+
 static void finishPlan(struct ncclKernelPlan* plan) {
   int channelUbound = 0;
   int channelCount = 0;
@@ -472,6 +483,76 @@ NCCL_PARAM(GraphRegister, "GRAPH_REGISTER", 0);
 static ncclResult_t getCollNetSupport(struct ncclInfo* info, int* collNetTypeSupport);
 static ncclResult_t getAlgoInfo(struct ncclInfo* info, int collNetTypeSupport, int numPipeOps);
 
+RCCL_PARAM(CollCacheSize, "COLL_CACHE_SIZE", 256);
+
+// Returns the cache slot for the shape of `info`, or nullptr when the cache is disabled.
+static struct ncclCollCacheEntry* collCacheSlot(struct ncclComm* comm, struct ncclInfo const* info) {
+  if (comm->collCache == nullptr) {
+    int64_t size = rcclParamCollCacheSize();
+    if (size <= 0) return nullptr;
+    comm->collCacheSize = 1;
+    while (comm->collCacheSize < size && comm->collCacheSize < (1<<16)) comm->collCacheSize *= 2;
+    comm->collCache = ncclMemoryStackAlloc<struct ncclCollCacheEntry>(&comm->memPermanent, comm->collCacheSize);
+  }
+  uint64_t h = info->count * 0x9E3779B97F4A7C15ull;
+  h ^= (uint64_t(info->coll) << 48) ^ (uint64_t(info->datatype) << 40) ^ (uint64_t(info->opFull.op) << 32);
+  h ^= (uint64_t(info->chunkSteps) << 16) ^ info->sliceSteps;
+  h ^= h >> 29;
+  return &comm->collCache[h & (comm->collCacheSize-1)];
+}
+
+static bool collCacheMatch(struct ncclCollCacheEntry const* e, struct ncclInfo const* info) {
+  return e->valid && e->count == info->count && e->func == info->coll &&
+         e->datatype == info->datatype && e->op == info->opFull.op &&
+         e->chunkSteps == info->chunkSteps && e->sliceSteps == info->sliceSteps;
+}
+
+// computeColl() with the shape-dependent part served from the collective cache.
+// Only used for collectives which are not aggregated with others.
+static ncclResult_t computeCollCached(struct ncclInfo* info, int* workFuncIndex, struct ncclWorkElem* work, struct ncclProxyOp* proxyOp) {
+  struct ncclComm* comm = info->comm;
+  struct ncclCollCacheEntry* e = collCacheSlot(comm, info);
+  if (e == nullptr) return computeColl(info, workFuncIndex, work, proxyOp);
+
+  if (collCacheMatch(e, info)) {
+    comm->collCacheHits++;
+    *workFuncIndex = e->workFuncIndex;
+    info->algorithm = e->algorithm;
+    info->protocol = e->protocol;
+    info->nChannels = e->nChannels;
+    info->nThreads = e->nThreads;
+    *work = e->workElem; // C++ struct assignment
+    *proxyOp = e->proxyOp; // C++ struct assignment
+    // Patch the fields which change from call to call
+    work->sendbuff = info->sendbuff;
+    work->recvbuff = info->recvbuff;
+    work->root = info->root;
+    work->redOpArg = info->opFull.scalarArg;
+    work->redOpArgIsPtr = info->opFull.scalarArgIsPtr;
+    work->opCount = comm->opCount;
+    proxyOp->root = info->root;
+    return ncclSuccess;
+  }
+
+  comm->collCacheMisses++;
+  NCCLCHECK(computeColl(info, workFuncIndex, work, proxyOp));
+  e->count = info->count;
+  e->func = info->coll;
+  e->datatype = info->datatype;
+  e->op = info->opFull.op;
+  e->chunkSteps = info->chunkSteps;
+  e->sliceSteps = info->sliceSteps;
+  e->workFuncIndex = *workFuncIndex;
+  e->algorithm = info->algorithm;
+  e->protocol = info->protocol;
+  e->nChannels = info->nChannels;
+  e->nThreads = info->nThreads;
+  e->workElem = *work; // C++ struct assignment
+  e->proxyOp = *proxyOp; // C++ struct assignment
+  e->valid = true;
+  return ncclSuccess;
+}
+
 static ncclResult_t scheduleCollTasksToPlan(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget
   ) {
@@ -557,7 +638,11 @@ static ncclResult_t scheduleCollTasksToPlan(
       int workFuncIndex;
       struct ncclWorkElem workElem = {};
       struct ncclProxyOp proxyOp = {};
-      NCCLCHECK(computeColl(&info, &workFuncIndex, &workElem, &proxyOp));
+      if (nAggOps > 1) {
+        NCCLCHECK(computeColl(&info, &workFuncIndex, &workElem, &proxyOp));
+      } else {
+        NCCLCHECK(computeCollCached(&info, &workFuncIndex, &workElem, &proxyOp));
+      }
 
       if (*nWorkBudget < info.nChannels) return ncclSuccess; // Ensure room for addCollToPlan()
 
@@ -597,6 +682,8 @@ static size_t calcP2pChunkSize(size_t totalSize, int minChannels, int maxChannel
 }
 
 RCCL_PARAM(P2pNetThreshold, "P2P_NET_THRESHOLD", 131072);
+// Balanced split of send/recv operations across channels (see p2p_sched.h)
+RCCL_PARAM(P2pBalance, "P2P_BALANCE", 0);
 
 static ncclResult_t scheduleP2pTasksToPlan(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget
@@ -620,6 +707,23 @@ static ncclResult_t scheduleP2pTasksToPlan(
   while (nChannelsMin*nRanks > comm->p2pnChannels && nChannelsMin > 1) nChannelsMin /= 2;
   // Avoid overloading channels with 8+ operations as we loose the sync warp, hence a bit of bandwidth.
   while (nChannelsMax*nRanks > comm->p2pnChannels*4 && nChannelsMax > 1) nChannelsMax /= 2;
+  bool balance = rcclParamP2pBalance();
+  struct ncclP2pSchedConfig sched;
+  if (balance) ncclP2pSchedInit(&sched, nRanks, comm->nNodes, comm->p2pnChannels, comm->p2pnChannelsPerPeer, stepSize, 1);
+
+  // AllToAllv ops come pre-scheduled (see ncclA2avSchedule), every rank drains them first.
+  while (!ncclIntruQueueEmpty(&tasks->a2avQueue)) {
+    struct ncclTaskA2av* a2av = ncclIntruQueueHead(&tasks->a2avQueue);
+    for (; a2av->opIndex < a2av->nOps; a2av->opIndex++) {
+      struct ncclA2avOp* op = a2av->ops + a2av->opIndex;
+      char* addr = op->isSend ? a2av->sendbuff + a2av->sendDispls[op->peer] : a2av->recvbuff + a2av->recvDispls[op->peer];
+      uint32_t connIndex = comm->p2pNet && op->bytes > (size_t)rcclParamP2pNetThreshold() ? NCCL_CONN_IDX_P2P_NET : 1;
+      if (*nWorkBudget < 1) return ncclSuccess; // ensure room in budget
+      NCCLCHECK(addP2pToPlanChannel(comm, plan, nWorkBudget, op->isSend, op->peer, op->channel, addr + op->offset, op->bytes, connIndex));
+    }
+    ncclIntruQueueDequeue(&tasks->a2avQueue);
+    tasks->nTasksP2p -= 1;
+  }
 
   while (tasks->nTasksP2p != 0) {
     for (int i=0; i < nRanks; i++) {
@@ -648,8 +752,8 @@ static ncclResult_t scheduleP2pTasksToPlan(
         ssize_t sendBytes = send ? send->bytes : 0;
         ssize_t minSize = stepSize/8;
         ssize_t maxSize = comm->nNodes > 1 ? stepSize : stepSize*32;
-        ssize_t recvChunkBytesMax = calcP2pChunkSize(recvBytes, nChannelsMin, nChannelsMax, minSize, maxSize);
-        ssize_t sendChunkBytesMax = calcP2pChunkSize(sendBytes, nChannelsMin, nChannelsMax, minSize, maxSize);
+        ssize_t recvChunkBytesMax = balance ? ncclP2pChunkSize(&sched, recvBytes) : calcP2pChunkSize(recvBytes, nChannelsMin, nChannelsMax, minSize, maxSize);
+        ssize_t sendChunkBytesMax = balance ? ncclP2pChunkSize(&sched, sendBytes) : calcP2pChunkSize(sendBytes, nChannelsMin, nChannelsMax, minSize, maxSize);
         // Zero size send/recv are syncs, encode here with -1.
         recvBytes = recv && recvBytes == 0 ? -1 : recvBytes;
         sendBytes = send && sendBytes == 0 ? -1 : sendBytes;
@@ -710,47 +814,137 @@ static inline uint32_t rollingMin32(uint32_t a, uint32_t b) {
   constexpr uint32_t PositiveMax = uint32_t(-1)>>1;
   return (b-a <= PositiveMax) ? a : b;
 }
+static inline uint32_t rollingMax32(uint32_t a, uint32_t b) {
+  constexpr uint32_t PositiveMax = uint32_t(-1)>>1;
+  return (b-a <= PositiveMax) ? b : a;
+}
 
-// Spin until its safe to increase comm->workFifoSent to desiredSent.
-static void waitWorkFifoAvailable(struct ncclComm* comm, uint32_t desiredSent) {
-  if (__builtin_expect(rollingLess32(comm->workFifoAckdMin + comm->workFifoDepth, desiredSent), false)) {
+static inline bool workFifoFull(struct ncclComm* comm, uint32_t desiredSent) {
+  // Slots of previous heaps do not take room in the current one
+  return rollingLess32(rollingMax32(comm->workFifoAckdMin, comm->workFifoFloor) + comm->workFifoDepth, desiredSent);
+}
+
+// Replace the fifo heap by one twice as deep. Works already in flight keep
+// being read from the old heap, which is only freed with the communicator;
+// kernels only address the heap through the workHead of their plan.
+static ncclResult_t growWorkFifo(struct ncclComm* comm) {
+  int depth = comm->workFifoDepth*2;
+  if (comm->workFifoHeapGdrHandle != nullptr) {
+    NCCLCHECK(ncclGdrCudaCalloc(&comm->workFifoHeap, &comm->devWorkFifoHeap, depth, &comm->workFifoHeapGdrHandle));
+    ncclCommPushCudaGdrFree(comm, comm->workFifoHeapGdrHandle);
+  } else {
+    int numaSave = ncclNumaThreadNode;
+    ncclNumaThreadNode = comm->numaNode;
+    ncclResult_t ret = ncclCudaHostCalloc(&comm->workFifoHeap, depth);
+    ncclNumaThreadNode = numaSave;
+    NCCLCHECK(ret);
+    ncclCommPushCudaHostFree(comm, comm->workFifoHeap);
+    comm->devWorkFifoHeap = comm->workFifoHeap;
+  }
+  INFO(NCCL_COLL, "comm %p rank %d work fifo full, depth %d -> %d", comm, comm->rank, comm->workFifoDepth, depth);
+  comm->workFifoDepth = depth;
+  comm->workFifoFloor = comm->workFifoSent;
+  return ncclSuccess;
+}
+
+// Poll for notifications from device, updating comm->workFifoAckdMin.
+static void pollWorkFifoDone(struct ncclComm* comm) {
+  uint32_t* doneLive = comm->workFifoDone;
+  uint32_t ackd[MAXCHANNELS];
+  for (int c=0; c < MAXCHANNELS; c++) {
+    ackd[c] = __atomic_load_n(&doneLive[c], __ATOMIC_RELAXED);
+  }
+  // Compiler-only fence to prevent fusion of loops to encourage dense loads.
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+  uint32_t ackdAll = comm->workFifoSent;
+  for (int c=0; c < MAXCHANNELS; c++) {
+    // ackdAll is min over all non-quiesced channels
+    if (ackd[c] != comm->channels[c].workFifoSent)
+      ackdAll = rollingMin32(ackdAll, ackd[c]);
+  }
+
+  // Compiler only fence to prevent fusion of loops to encourage dense stores.
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+  for (int c=0; c < MAXCHANNELS; c++) {
+    // Advance counter on quiesced channels so they don't lag behind
+    // too far where they could get lost in 32-bit wraparound.
+    if (ackd[c] == comm->channels[c].workFifoSent) {
+      comm->channels[c].workFifoSent = ackdAll;
+      __atomic_store_n(&doneLive[c], ackdAll, __ATOMIC_RELAXED);
+    }
+  }
+  comm->workFifoAckdMin = ackdAll;
+  if (!rollingLess32(ackdAll, comm->workFifoEventSent)) comm->workFifoEventPending = false;
+}
+
+// Wait until its safe to increase comm->workFifoSent to desiredSent.
+static ncclResult_t waitWorkFifoAvailable(struct ncclComm* comm, uint32_t desiredSent) {
+  if (__builtin_expect(workFifoFull(comm, desiredSent), false)) {
     uint64_t t0 = clockNano();
+    uint64_t sleepNs = 1000;
+    bool stalled = false;
     while (1) {
-      // We have to poll for notifications from device.
-      uint32_t* doneLive = comm->workFifoDone;
-      uint32_t ackd[MAXCHANNELS];
-      for (int c=0; c < MAXCHANNELS; c++) {
-        ackd[c] = __atomic_load_n(&doneLive[c], __ATOMIC_RELAXED);
+      pollWorkFifoDone(comm);
+      // See if that was enough.
+      if (!workFifoFull(comm, desiredSent)) break;
+      if (!stalled) {
+        stalled = true;
+        comm->workFifoStalls++;
       }
-      // Compiler-only fence to prevent fusion of loops to encourage dense loads.
-      __atomic_signal_fence(__ATOMIC_SEQ_CST);
-
-      uint32_t ackdAll = comm->workFifoSent;
-      for (int c=0; c < MAXCHANNELS; c++) {
-        // ackdAll is min over all non-quiesced channels
-        if (ackd[c] != comm->channels[c].workFifoSent)
-          ackdAll = rollingMin32(ackdAll, ackd[c]);
+      if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) {
+        WARN("Aborted while waiting for room in the work fifo");
+        return ncclInternalError;
       }
-
-      // Compiler only fence to prevent fusion of loops to encourage dense stores.
-      __atomic_signal_fence(__ATOMIC_SEQ_CST);
-
-      for (int c=0; c < MAXCHANNELS; c++) {
-        // Advance counter on quiesced channels so they don't lag behind
-        // too far where they could get lost in 32-bit wraparound.
-        if (ackd[c] == comm->channels[c].workFifoSent) {
-          comm->channels[c].workFifoSent = ackdAll;
-          __atomic_store_n(&doneLive[c], ackdAll, __ATOMIC_RELAXED);
-        }
+      // Nope. Maintain vigorous spin for first 5us, then yield and back off.
+      // This runs within the intra-process barrier, so it must not block on
+      // the device: reserveWorkFifo() does that before the barrier.
+      uint64_t t = clockNano()-t0;
+      if (t < 5*1000) continue;
+      if (t < 100*1000) {
+        sched_yield();
+      } else {
+        struct timespec ts = { 0, (long)sleepNs };
+        nanosleep(&ts, NULL);
+        if (sleepNs < 100*1000) sleepNs *= 2;
       }
-      comm->workFifoAckdMin = ackdAll;
-
-      // See if that was enough.
-      if (!rollingLess32(comm->workFifoAckdMin + comm->workFifoDepth, desiredSent)) break;
-      // Nope. Maintain vigorous spin for first 5us, then start yielding.
-      if (clockNano()-t0 >= 5*1000) sched_yield();
     }
+    if (stalled) comm->workFifoStallTime += clockNano()-t0;
+  }
+  uint32_t used = desiredSent - rollingMax32(comm->workFifoAckdMin, comm->workFifoFloor);
+  if (used > comm->workFifoHighWater) comm->workFifoHighWater = used;
+  return ncclSuccess;
+}
+
+// Make room in the work fifo for the plans of a launch. Called from
+// ncclLaunchPrepare, before the intra-process barrier: uploadWork() runs
+// within it and can then only poll workFifoDone. Rather than waiting on a
+// full fifo, grow it up to workFifoMaxDepth. Once there, block on the event
+// recorded after an earlier launch if its completion makes enough room.
+static ncclResult_t reserveWorkFifo(struct ncclComm* comm, struct ncclKernelPlan* planHead) {
+  uint32_t nWork = 0;
+  for (struct ncclKernelPlan* plan=planHead; plan != nullptr; plan = plan->next) {
+    if (plan->persistent) return ncclSuccess;
+    for (int c=0; c < plan->channelUbound; c++) nWork += plan->channels[c].nWork;
+    // Slots uploadWork() may skip to avoid a wraparound
+    nWork += plan->channelCount-1;
+  }
+  uint32_t desiredSent = comm->workFifoSent + nWork;
+  pollWorkFifoDone(comm);
+  while (workFifoFull(comm, desiredSent) && comm->workFifoDepth < comm->workFifoMaxDepth) {
+    NCCLCHECK(growWorkFifo(comm));
+  }
+  if (workFifoFull(comm, desiredSent) && comm->workFifoEventPending &&
+      !rollingLess32(rollingMax32(comm->workFifoEventSent, comm->workFifoFloor) + comm->workFifoDepth, desiredSent)) {
+    uint64_t t0 = clockNano();
+    CUDACHECK(hipEventSynchronize(comm->workFifoEvent));
+    comm->workFifoEventPending = false;
+    comm->workFifoStalls++;
+    comm->workFifoStallTime += clockNano()-t0;
+    pollWorkFifoDone(comm);
   }
+  return ncclSuccess;
 }
 
 static ncclResult_t uploadWork(struct ncclComm* comm, struct ncclKernelPlan* plan) {
@@ -781,7 +975,7 @@ static ncclResult_t uploadWork(struct ncclComm* comm, struct ncclKernelPlan* pla
       // this way the skipped slots will be considered consumed as well.
       comm->workFifoSent = ixSent;
     }
-    waitWorkFifoAvailable(comm, ixSent + nWork);
+    NCCLCHECK(waitWorkFifoAvailable(comm, ixSent + nWork));
   }
   uint32_t ixHead = ixSent;
   ixSent += plan->channelCount;
@@ -949,6 +1143,7 @@ ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
 
     struct ncclKernelPlan* planHead = ncclIntruQueueHead(&comm->planQueue);
     comm->unlaunchedPlansHead = planHead;
+    NCCLCHECKGOTO(reserveWorkFifo(comm, planHead), result, failure);
 
     NCCLCHECKGOTO(ncclStrongStreamAcquire(tasks->capturingGraph, &comm->deviceStream), result, failure);
 
@@ -1012,6 +1207,13 @@ ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan
       tasks->capturingGraph, &comm->deviceStream, plan->kernelFn, grid, block, args, 0
     ));
   }
+  // Once the fifo is half full, give waitWorkFifoAvailable() something to block on.
+  if (comm->workFifoEvent != nullptr && !plan->persistent && !comm->workFifoEventPending &&
+      comm->workFifoSent - rollingMax32(comm->workFifoAckdMin, comm->workFifoFloor) >= (uint32_t)comm->workFifoDepth/2) {
+    CUDACHECK(hipEventRecord(comm->workFifoEvent, tasks->numStreams == 1 ? tasks->streams->stream : comm->deviceStream.stream));
+    comm->workFifoEventSent = comm->workFifoSent;
+    comm->workFifoEventPending = true;
+  }
   return ncclSuccess;
 }
 
@@ -1420,6 +1622,35 @@ static ncclResult_t hostToDevRedOp(
 // Converts `info` to a task and adds it to `comm->tasks`. The exception is with
 // single rank communicators, collectives are issued as `ncclMemcpyAsync`s and
 // thus don't need a task.
+static ncclResult_t taskAppendStream(struct ncclComm* comm, hipStream_t stream) {
+  ncclTasks *tasks = &comm->tasks;
+  if (stream != tasks->streamRecent || tasks->streams == nullptr) {
+    tasks->streamRecent = stream;
+    struct ncclCudaStreamList* l = tasks->streams;
+    while (true) {
+      if (l == nullptr) { // Got to the end, this must be a new stream.
+        struct ncclCudaGraph graph;
+        NCCLCHECK(ncclCudaGetCapturingGraph(&graph, stream))
+        if (tasks->streams != nullptr && !ncclCudaGraphSame(tasks->capturingGraph, graph)) {
+          WARN("Streams given to a communicator within a NCCL group must either be all uncaptured or all captured by the same graph.");
+          return ncclInvalidUsage;
+        }
+        tasks->capturingGraph = graph; // C++ struct assignment
+        // Add stream to list
+        l = ncclMemoryStackAlloc<struct ncclCudaStreamList>(&comm->memScoped);
+        l->stream = stream;
+        l->next = tasks->streams;
+        tasks->streams = l;
+        tasks->numStreams++;
+        break;
+      }
+      if (l->stream == stream)
+        break; // Already seen stream.
+    }
+  }
+  return ncclSuccess;
+}
+
 static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo const* info) {
   ncclTasks *tasks = &comm->tasks;
   if (info->coll == ncclFuncSend || info->coll == ncclFuncRecv) {
@@ -1498,33 +1729,20 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo const* inf
       ncclIntruQueueEnqueue(&tasks->collQueue, t);
       tasks->collBytesTotal += t->count*ncclTypeSize(t->datatype);
       tasks->nTasksColl += 1;
-    }
-  }
 
-  if (info->stream != tasks->streamRecent || tasks->streams == nullptr) {
-    tasks->streamRecent = info->stream;
-    struct ncclCudaStreamList* l = tasks->streams;
-    while (true) {
-      if (l == nullptr) { // Got to the end, this must be a new stream.
-        struct ncclCudaGraph graph;
-        NCCLCHECK(ncclCudaGetCapturingGraph(&graph, info->stream))
-        if (tasks->streams != nullptr && !ncclCudaGraphSame(tasks->capturingGraph, graph)) {
-          WARN("Streams given to a communicator within a NCCL group must either be all uncaptured or all captured by the same graph.");
-          return ncclInvalidUsage;
+      // Rings are used by all collectives, trees only by AllReduce
+      if (comm->runtimeConn) {
+        bool needTree = info->coll == ncclFuncAllReduce;
+        if (!comm->ringConnected || (needTree && !comm->treeConnected)) {
+          comm->ringConnectPending = !comm->ringConnected;
+          if (needTree) comm->treeConnectPending = !comm->treeConnected;
+          ncclGroupCommPreconnect(comm);
         }
-        tasks->capturingGraph = graph; // C++ struct assignment
-        // Add stream to list
-        l = ncclMemoryStackAlloc<struct ncclCudaStreamList>(&comm->memScoped);
-        l->stream = info->stream;
-        l->next = tasks->streams;
-        tasks->streams = l;
-        tasks->numStreams++;
-        break;
       }
-      if (l->stream == info->stream)
-        break; // Already seen stream.
     }
   }
+
+  NCCLCHECK(taskAppendStream(comm, info->stream));
   return ncclSuccess;
 }
 
@@ -1533,11 +1751,17 @@ ncclResult_t ncclEnqueueCheck(struct ncclInfo* info) {
   ncclResult_t ret = ncclSuccess;
   int devOld = -1;
   NCCLCHECKGOTO(PtrCheck(info->comm, info->opName, "comm"), ret, end0);
+  if (__atomic_load_n(&info->comm->initState, __ATOMIC_ACQUIRE) != ncclSuccess) {
+    WARN("%s : comm %p is not initialized (state %d)", info->opName, info->comm, info->comm->initState);
+    ret = ncclInvalidUsage;
+    goto end0;
+  }
   if (info->comm->checkPointers) {
     CUDACHECKGOTO(hipGetDevice(&devOld), ret, end0);
     CUDACHECKGOTO(hipSetDevice(info->comm->cudaDev), ret, end0);
   }
   NCCLCHECKGOTO(ArgsCheck(info), ret, end1);
+  if (rcclRecordEnabled()) rcclRecordColl(info);
 
   INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p",
         info->opName, info->comm->opCount, info->sendbuff, info->recvbuff, info->count,
@@ -1554,6 +1778,130 @@ end0:
   return ret;
 }
 
+RCCL_PARAM(AllToAllvSched, "ALLTOALLV_SCHED", 0);
+
+static ncclResult_t a2avMarkConnect(struct ncclComm* comm, struct ncclA2avOp const* op) {
+  int c = op->channel, peer = op->peer;
+  struct ncclChannelPeer* chPeer = comm->channels[c].peers+peer;
+  if (op->isSend) {
+    if (chPeer->send[1].connected == 0) comm->connectSend[peer] |= (1<<c);
+    if (comm->p2pNet && chPeer->send[NCCL_CONN_IDX_P2P_NET].connected == 0)
+      comm->connectSend[peer+comm->nRanks*NCCL_CONN_IDX_P2P_NET] |= (1<<c);
+  } else {
+    if (chPeer->recv[1].connected == 0) comm->connectRecv[peer] |= (1<<c);
+    if (comm->p2pNet && chPeer->recv[NCCL_CONN_IDX_P2P_NET].connected == 0)
+      comm->connectRecv[peer+comm->nRanks*NCCL_CONN_IDX_P2P_NET] |= (1<<c);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclEnqueueAllToAllv(struct ncclInfo* info, const size_t* sendcounts, const size_t* sdispls,
+    const size_t* recvcounts, const size_t* rdispls, const size_t* countMatrix) {
+  NCCLCHECK(ncclGroupStartInternal());
+  ncclResult_t ret = ncclSuccess;
+  int devOld = -1;
+  struct ncclComm* comm = info->comm;
+  NCCLCHECKGOTO(PtrCheck(comm, info->opName, "comm"), ret, end0);
+  if (__atomic_load_n(&comm->initState, __ATOMIC_ACQUIRE) != ncclSuccess) {
+    WARN("%s : comm %p is not initialized (state %d)", info->opName, comm, comm->initState);
+    ret = ncclInvalidUsage;
+    goto end0;
+  }
+  if (comm->checkPointers) {
+    CUDACHECKGOTO(hipGetDevice(&devOld), ret, end0);
+    CUDACHECKGOTO(hipSetDevice(comm->cudaDev), ret, end0);
+  }
+
+  {
+    int nRanks = comm->nRanks;
+    if (info->datatype < 0 || info->datatype >= ncclNumTypes) {
+      WARN("%s : invalid type %d", info->opName, info->datatype);
+      ret = ncclInvalidArgument;
+      goto end1;
+    }
+    size_t typeSize = ncclTypeSize(info->datatype);
+    NCCLCHECKGOTO(PtrCheck((void*)sendcounts, info->opName, "sendcounts"), ret, end1);
+    NCCLCHECKGOTO(PtrCheck((void*)sdispls, info->opName, "sdispls"), ret, end1);
+    NCCLCHECKGOTO(PtrCheck((void*)recvcounts, info->opName, "recvcounts"), ret, end1);
+    NCCLCHECKGOTO(PtrCheck((void*)rdispls, info->opName, "rdispls"), ret, end1);
+    size_t sendTotal = 0, recvTotal = 0;
+    for (int r=0; r<nRanks; r++) {
+      sendTotal += sendcounts[r];
+      recvTotal += recvcounts[r];
+    }
+    if (comm->checkPointers) {
+      if (sendTotal) NCCLCHECKGOTO(CudaPtrCheck(info->sendbuff, comm, "sendbuff", info->opName), ret, end1);
+      if (recvTotal) NCCLCHECKGOTO(CudaPtrCheck(info->recvbuff, comm, "recvbuff", info->opName), ret, end1);
+    }
+
+    INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p sendcount %zi recvcount %zi datatype %d matrix %d comm %p [nranks=%d] stream %p",
+          info->opName, comm->opCount, info->sendbuff, info->recvbuff, sendTotal, recvTotal,
+          info->datatype, countMatrix != nullptr, comm, nRanks, info->stream);
+    TRACE_CALL("nccl%s(%" PRIx64 ",%" PRIx64 ",%zi,%zi,%d,%p,%p)", info->opName, reinterpret_cast<int64_t>(info->sendbuff), reinterpret_cast<int64_t>(info->recvbuff), sendTotal, recvTotal, info->datatype, comm, info->stream);
+    if (rcclRecordEnabled()) rcclRecordAllToAllvCounts(info, sendcounts, recvcounts, countMatrix);
+
+    // Same chunking as scheduleP2pTasksToPlan
+    ssize_t stepSize = comm->buffSizes[NCCL_PROTO_SIMPLE]/NCCL_STEPS;
+    if (comm->nNodes > 1) stepSize /= SENDRECV_SLICEFACTOR;
+    struct ncclA2avConfig config;
+    config.nRanks = nRanks;
+    config.rank = comm->rank;
+    config.nChannels = comm->p2pnChannels;
+    config.maxChannelsPerPeer = comm->p2pnChannelsPerPeer;
+    config.chunkBytes = comm->nNodes == 1 ? stepSize*32 : stepSize;
+    config.smallBytes = stepSize;
+    config.smallBatch = 4;
+
+    // Must be in thread local group before tasks can be alloc'd in `comm->memScoped`.
+    ncclGroupCommJoin(comm);
+    struct ncclTaskA2av* a2av = ncclMemoryStackAlloc<struct ncclTaskA2av>(&comm->memScoped);
+    a2av->sendbuff = (char*)info->sendbuff;
+    a2av->recvbuff = (char*)info->recvbuff;
+    a2av->sendDispls = ncclMemoryStackAlloc<size_t>(&comm->memScoped, nRanks);
+    a2av->recvDispls = ncclMemoryStackAlloc<size_t>(&comm->memScoped, nRanks);
+    size_t* sendBytes = ncclMemoryStackAlloc<size_t>(&comm->memScoped, nRanks);
+    size_t* recvBytes = ncclMemoryStackAlloc<size_t>(&comm->memScoped, nRanks);
+    size_t* matrixBytes = nullptr;
+    for (int r=0; r<nRanks; r++) {
+      a2av->sendDispls[r] = sdispls[r]*typeSize;
+      a2av->recvDispls[r] = rdispls[r]*typeSize;
+      sendBytes[r] = sendcounts[r]*typeSize;
+      recvBytes[r] = recvcounts[r]*typeSize;
+    }
+    if (countMatrix) {
+      matrixBytes = ncclMemoryStackAlloc<size_t>(&comm->memScoped, (size_t)nRanks*nRanks);
+      for (size_t i=0; i<(size_t)nRanks*nRanks; i++) matrixBytes[i] = countMatrix[i]*typeSize;
+    }
+    a2av->ops = ncclMemoryStackAlloc<struct ncclA2avOp>(&comm->memScoped, ncclA2avMaxOps(&config));
+    a2av->opIndex = 0;
+    ret = ncclA2avSchedule(&config, sendBytes, recvBytes, matrixBytes, a2av->ops, &a2av->nOps);
+    if (ret == ncclInvalidUsage) {
+      WARN("%s : send to self of %zi bytes does not match receive from self of %zi bytes", info->opName, sendBytes[comm->rank], recvBytes[comm->rank]);
+    } else if (ret == ncclInvalidArgument) {
+      WARN("%s : count matrix does not match sendcounts/recvcounts", info->opName);
+    }
+    NCCLCHECKGOTO(ret, ret, end1);
+    if (a2av->nOps == 0) goto end1;
+
+    // Mark channels that need pre-connect
+    for (int i=0; i<a2av->nOps; i++) {
+      if (a2av->ops[i].peer == comm->rank) continue;
+      NCCLCHECKGOTO(a2avMarkConnect(comm, a2av->ops+i), ret, end1);
+      ncclGroupCommPreconnect(comm);
+    }
+    ncclIntruQueueEnqueue(&comm->tasks.a2avQueue, a2av);
+    comm->tasks.nTasksP2p += 1;
+    NCCLCHECKGOTO(taskAppendStream(comm, info->stream), ret, end1);
+  }
+
+end1:
+  if (devOld != -1) CUDACHECKGOTO(hipSetDevice(devOld), ret, end0);
+end0:
+  ncclGroupErrCheck(ret);
+  NCCLCHECK(ncclGroupEndInternal());
+  return ret;
+}
+
 NCCL_API(ncclResult_t, ncclRedOpCreatePreMulSum, ncclRedOp_t *op, void *scalar, ncclDataType_t datatype, ncclScalarResidence_t residence, ncclComm_t comm);
 ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t *op, void *scalar, ncclDataType_t datatype, ncclScalarResidence_t residence, ncclComm_t comm) {
   if (comm->userRedOpFreeHead == comm->userRedOpCapacity) {
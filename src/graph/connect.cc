@@ -263,38 +263,92 @@ static ncclResult_t setTreeDown(struct ncclTree* tree, int* indexes, int d) {
   return ncclSuccess;
 }
 
-static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int* treeToChild0, int* treeToChild1, int* firstRanks, int* treePatterns) {
-  const int nChannels = (comm->nChannels > MAXCHANNELS/2) ? comm->nChannels/2 : comm->nChannels, nNodes = comm->nNodes, node = comm->node;
+RCCL_PARAM(TreeType, "TREE_TYPE", NCCL_TREE_TYPE_BTREE);
+RCCL_PARAM(TreeArity, "TREE_ARITY", 2);
+RCCL_PARAM(TreeNTrees, "TREE_NTREES", 2);
+
+// Inter-node trees. The default is the double binary tree; RCCL_TREE_TYPE,
+// RCCL_TREE_ARITY and RCCL_TREE_NTREES select other trees, which channels
+// use in turn. Kernels only handle two children per rank (NCCL_MAX_DEV_ARITY),
+// wider trees can only be evaluated with tools/TreeBalance.
+static ncclResult_t getTreeConfig(struct ncclComm* comm, int* type, int* arity, int* nTrees) {
+  const char* names[] = NCCL_TREE_TYPE_NAMES;
+  *type = rcclParamTreeType();
+  *arity = rcclParamTreeArity();
+  *nTrees = rcclParamTreeNTrees();
+  if (*type == NCCL_TREE_TYPE_BTREE && *nTrees == 2) return ncclSuccess;
+  if (*type < 0 || *type > NCCL_TREE_TYPE_KNOMIAL || *arity < 1 || *nTrees < 1 || *nTrees > MAXCHANNELS ||
+      (*type == NCCL_TREE_TYPE_KNOMIAL && *arity < 2) ||
+      (*type != NCCL_TREE_TYPE_BTREE && ncclTreeSlots(*type, *arity, comm->nNodes) > 2)) {
+    if (comm->rank == 0) WARN("Tree type %d arity %d x %d trees is not supported on %d nodes, using the double binary tree",
+        *type, *arity, *nTrees, comm->nNodes);
+    *type = NCCL_TREE_TYPE_BTREE;
+    *nTrees = 2;
+    return ncclSuccess;
+  }
+  if (comm->rank == 0) INFO(NCCL_INIT|NCCL_GRAPH, "Using %d %s trees of arity %d", *nTrees,
+      names[*type], *type == NCCL_TREE_TYPE_BTREE ? 2 : *arity);
+  return ncclSuccess;
+}
+
+// Tree used by channel c of each half (0 : c, 1 : c+nChannels). Both halves
+// of a channel use the two trees of a pair, pairs are spread over channels.
+static inline int channelTree(int nTrees, int c, int half) {
+  return (((c % ((nTrees+1)/2))*2) + half) % nTrees;
+}
+
+static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int* treeToChild0, int* treeToChild1, int* firstRanks, int* treePatterns, int node) {
+  const int nChannels = (comm->nChannels > MAXCHANNELS/2) ? comm->nChannels/2 : comm->nChannels, nNodes = comm->nNodes;
   int* ranksToParent, *ranksToChild0, *ranksToChild1;
   NCCLCHECK(ncclCalloc(&ranksToParent, nNodes));
   NCCLCHECK(ncclCalloc(&ranksToChild0, nNodes));
   NCCLCHECK(ncclCalloc(&ranksToChild1, nNodes));
 
-  // Compute tree depth. Not an exact value but a good approximation in most
-  // cases
-  int depth = comm->nRanks/nNodes - 1 + log2i(nNodes);
+  int type, arity, nTrees;
+  NCCLCHECK(getTreeConfig(comm, &type, &arity, &nTrees));
+  int tu[MAXCHANNELS], td0[MAXCHANNELS], td1[MAXCHANNELS], tChildType[MAXCHANNELS];
+  for (int t=0; t<nTrees; t++) {
+    int d[NCCL_TREE_MAX_CHILDREN], nd;
+    NCCLCHECK(ncclGetMultiTree(type, arity, nTrees, t, nNodes, node, tu+t, d, &nd, tChildType+t));
+    td0[t] = d[0];
+    td1[t] = nd > 1 ? d[1] : -1;
+  }
 
-  int t0u, t0d0, t0d1, t0ChildType, t1u, t1d0, t1d1, t1ChildType;
-  NCCLCHECK(ncclGetDtree(nNodes, node, &t0u, &t0d0, &t0d1, &t0ChildType, &t1u, &t1d0, &t1d1, &t1ChildType));
+  // Compute tree depth. Not an exact value but a good approximation in most
+  // cases. Trees other than the double binary tree use their exact inter-node
+  // depth, and scale the tree bandwidth by how many tree links the busiest node
+  // carries compared to the double binary tree.
+  comm->treeInterDepth = log2i(nNodes);
+  comm->treeBwScale = 1.0;
+  if (nNodes > 1 && !(type == NCCL_TREE_TYPE_BTREE && nTrees == 2)) {
+    struct ncclTreeStats stats, dtreeStats;
+    NCCLCHECK(ncclGetTreeStats(type, arity, nTrees, nNodes, &stats));
+    NCCLCHECK(ncclGetTreeStats(NCCL_TREE_TYPE_BTREE, 2, 2, nNodes, &dtreeStats));
+    comm->treeInterDepth = stats.depth;
+    comm->treeBwScale = dtreeStats.maxLinks / stats.maxLinks;
+    INFO(NCCL_GRAPH, "Trees inter-node depth %d, bandwidth scale %g", comm->treeInterDepth, comm->treeBwScale);
+  }
+  int depth = comm->nRanks/nNodes - 1 + comm->treeInterDepth;
 
   if (comm->nChannels <= MAXCHANNELS/2) {
     for (int c=0; c<nChannels; c++) {
        struct ncclChannel* channel0 = comm->channels+c;
        struct ncclChannel* channel1 = channel0+nChannels;
+       int t0 = channelTree(nTrees, c, 0), t1 = channelTree(nTrees, c, 1);
        NCCLCHECK(getIndexes(treeToParent+c*comm->nRanks, ranksToParent, nNodes, firstRanks));
        NCCLCHECK(getIndexes(treeToChild0+c*comm->nRanks, ranksToChild0, nNodes, firstRanks));
        NCCLCHECK(getIndexes(treeToChild1+c*comm->nRanks, ranksToChild1, nNodes, firstRanks));
        if (comm->rank == ranksToParent[node]) {
-         NCCLCHECK(setTreeUp(&channel0->tree, t0ChildType == 0 ? ranksToChild0 : ranksToChild1, t0u));
-         NCCLCHECK(setTreeUp(&channel1->tree, t1ChildType == 0 ? ranksToChild0 : ranksToChild1, t1u));
+         NCCLCHECK(setTreeUp(&channel0->tree, tChildType[t0] == 0 ? ranksToChild0 : ranksToChild1, tu[t0]));
+         NCCLCHECK(setTreeUp(&channel1->tree, tChildType[t1] == 0 ? ranksToChild0 : ranksToChild1, tu[t1]));
        }
        if (comm->rank == ranksToChild0[node]) {
-         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, t0d0));
-         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, t1d0));
+         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, td0[t0]));
+         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, td0[t1]));
        }
        if (comm->rank == ranksToChild1[node]) {
-         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, t0d1));
-         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, t1d1));
+         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, td1[t0]));
+         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, td1[t1]));
        }
        if (comm->rank == ranksToParent[node] ||
            comm->rank == ranksToChild0[node] ||
@@ -307,17 +361,18 @@ static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int*
   } else {
     for (int c=0; c<nChannels; c++) {
        struct ncclChannel* channel0 = comm->channels+c;
+       int t0 = channelTree(nTrees, c, 0);
        NCCLCHECK(getIndexes(treeToParent+c*comm->nRanks, ranksToParent, nNodes, firstRanks));
        NCCLCHECK(getIndexes(treeToChild0+c*comm->nRanks, ranksToChild0, nNodes, firstRanks));
        NCCLCHECK(getIndexes(treeToChild1+c*comm->nRanks, ranksToChild1, nNodes, firstRanks));
        if (comm->rank == ranksToParent[node]) {
-         NCCLCHECK(setTreeUp(&channel0->tree, t0ChildType == 0 ? ranksToChild0 : ranksToChild1, t0u));
+         NCCLCHECK(setTreeUp(&channel0->tree, tChildType[t0] == 0 ? ranksToChild0 : ranksToChild1, tu[t0]));
        }
        if (comm->rank == ranksToChild0[node]) {
-         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, t0d0));
+         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, td0[t0]));
        }
        if (comm->rank == ranksToChild1[node]) {
-         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, t0d1));
+         NCCLCHECK(setTreeDown(&channel0->tree, ranksToParent, td1[t0]));
        }
        if (comm->rank == ranksToParent[node] ||
            comm->rank == ranksToChild0[node] ||
@@ -328,17 +383,18 @@ static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int*
     }
     for (int c=nChannels; c<nChannels*2; c++) {
        struct ncclChannel* channel1 = comm->channels+c;
+       int t1 = channelTree(nTrees, c-nChannels, 1);
        NCCLCHECK(getIndexes(treeToParent+c*comm->nRanks, ranksToParent, nNodes, firstRanks));
        NCCLCHECK(getIndexes(treeToChild0+c*comm->nRanks, ranksToChild0, nNodes, firstRanks));
        NCCLCHECK(getIndexes(treeToChild1+c*comm->nRanks, ranksToChild1, nNodes, firstRanks));
        if (comm->rank == ranksToParent[node]) {
-         NCCLCHECK(setTreeUp(&channel1->tree, t1ChildType == 0 ? ranksToChild0 : ranksToChild1, t1u));
+         NCCLCHECK(setTreeUp(&channel1->tree, tChildType[t1] == 0 ? ranksToChild0 : ranksToChild1, tu[t1]));
        }
        if (comm->rank == ranksToChild0[node]) {
-         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, t1d0));
+         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, td0[t1]));
        }
        if (comm->rank == ranksToChild1[node]) {
-         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, t1d1));
+         NCCLCHECK(setTreeDown(&channel1->tree, ranksToParent, td1[t1]));
        }
        if (comm->rank == ranksToParent[node] ||
            comm->rank == ranksToChild0[node] ||
@@ -471,9 +527,22 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
     }
   }
 
+  // Chain nodes in switch locality order (comm->nodeOrder) rather than in
+  // order of their first rank. node is our position in that order.
+  int* nodeFirstRanks = firstRanks;
+  int node = comm->node;
+  if (comm->nodeOrder) {
+    NCCLCHECK(ncclCalloc(&nodeFirstRanks, comm->nNodes));
+    for (int n=0; n<comm->nNodes; n++) {
+      nodeFirstRanks[n] = firstRanks[comm->nodeOrder[n]];
+      if (comm->nodeOrder[n] == comm->node) node = n;
+    }
+  }
+
   // Connect rings and trees. This should also duplicate the channels.
-  NCCLCHECK(connectRings(comm, ringRecv, ringSend, ringPrev, ringNext, firstRanks));
-  NCCLCHECK(connectTrees(comm, treeToParent, treeToChild0, treeToChild1, firstRanks, treePatterns));
+  NCCLCHECK(connectRings(comm, ringRecv, ringSend, ringPrev, ringNext, nodeFirstRanks));
+  NCCLCHECK(connectTrees(comm, treeToParent, treeToChild0, treeToChild1, nodeFirstRanks, treePatterns, node));
+  if (nodeFirstRanks != firstRanks) free(nodeFirstRanks);
 
   // Duplicate ringPrev/ringNext for ncclBuildRing
   if (nChannels <= MAXCHANNELS/2) memcpy(ringPrev+nChannels*nranks, ringPrev, nChannels*nranks*sizeof(int));
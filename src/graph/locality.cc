@@ -0,0 +1,59 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "locality.h"
+#include <stdlib.h>
+
+#define LEVELS NCCL_TOPO_MAX_SWITCH_LEVELS
+
+int ncclTopoSameSwitch(uint64_t const* paths, int a, int b, int level) {
+  for (int l=level; l<LEVELS; l++) {
+    if (paths[a*LEVELS+l] != paths[b*LEVELS+l]) return 0;
+  }
+  return 1;
+}
+
+struct nodeKey {
+  int key[LEVELS];
+  int node;
+};
+
+static int compareKeys(const void* a, const void* b) {
+  struct nodeKey const* ka = (struct nodeKey const*)a;
+  struct nodeKey const* kb = (struct nodeKey const*)b;
+  for (int l=LEVELS-1; l>=0; l--) {
+    if (ka->key[l] != kb->key[l]) return ka->key[l] < kb->key[l] ? -1 : 1;
+  }
+  return ka->node - kb->node;
+}
+
+ncclResult_t ncclTopoOrderNodes(int nNodes, uint64_t const* paths, int* order) {
+  struct nodeKey* keys = (struct nodeKey*)malloc(nNodes*sizeof(struct nodeKey));
+  if (keys == NULL) return ncclSystemError;
+  // The key of a node at each level is the first node sharing its switch at
+  // that level and above.
+  for (int n=0; n<nNodes; n++) {
+    keys[n].node = n;
+    for (int l=0; l<LEVELS; l++) {
+      int m = 0;
+      while (m < n && !ncclTopoSameSwitch(paths, m, n, l)) m++;
+      keys[n].key[l] = m;
+    }
+  }
+  qsort(keys, nNodes, sizeof(struct nodeKey), compareKeys);
+  for (int n=0; n<nNodes; n++) order[n] = keys[n].node;
+  free(keys);
+  return ncclSuccess;
+}
+
+int ncclTopoRingCrossings(int nNodes, uint64_t const* paths, int const* order, int level) {
+  if (nNodes < 2) return 0;
+  int crossings = 0;
+  for (int n=0; n<nNodes; n++) {
+    if (!ncclTopoSameSwitch(paths, order[n], order[(n+1)%nNodes], level)) crossings++;
+  }
+  return crossings;
+}
@@ -31,6 +31,7 @@ static ncclResult_t getPath(struct ncclTopoSystem* system, struct ncclTopoNode*
 }
 
 NCCL_PARAM(NvbDisable, "NVB_DISABLE", 0);
+RCCL_PARAM(TopoIncrementalPaths, "TOPO_INCREMENTAL_PATHS", 1);
 
 static ncclResult_t ncclTopoSetPaths(struct ncclTopoNode* baseNode, struct ncclTopoSystem* system) {
   if (baseNode->paths[baseNode->type] == NULL) {
@@ -108,6 +109,31 @@ static ncclResult_t ncclTopoSetPaths(struct ncclTopoNode* baseNode, struct ncclT
   return ncclSuccess;
 }
 
+// When recomputing paths incrementally, only run the BFS for nodes which had
+// paths going through a removed node.
+static ncclResult_t ncclTopoUpdatePaths(struct ncclTopoNode* baseNode, struct ncclTopoSystem* system, int incremental) {
+  if (incremental) {
+    if (baseNode->pathsDirty == 0) return ncclSuccess;
+    // Clear all paths to that node before restarting the BFS.
+    int t = baseNode->type;
+    int index = baseNode - system->nodes[t].nodes;
+    for (int tn=0; tn<NCCL_TOPO_NODE_TYPES; tn++) {
+      for (int n=0; n<system->nodes[tn].count; n++) {
+        struct ncclTopoLinkList* path = system->nodes[tn].nodes[n].paths[t];
+        if (path == NULL) continue;
+        path += index;
+        path->list[0] = NULL;
+        path->count = 0;
+        path->width = 0;
+        path->type = 0;
+      }
+    }
+  }
+  NCCLCHECK(ncclTopoSetPaths(baseNode, system));
+  baseNode->pathsDirty = 0;
+  return ncclSuccess;
+}
+
 static void printNodePaths(struct ncclTopoSystem* system, struct ncclTopoNode* node) {
   char line[1024];
 #ifdef ENABLE_TRACE
@@ -170,9 +196,62 @@ static ncclResult_t getLocalCpu(struct ncclTopoSystem* system, int gpu, int* ret
   return ncclSuccess;
 }
 
+// Paths which are modified after the BFS (inter steps through CPUs or GPUs,
+// inaccessible peers) are saved so that the BFS result can be restored when
+// paths are recomputed incrementally.
+struct ncclTopoPathOverride {
+  int t1, i1; // Source node
+  int t2, i2; // Destination node
+  int count;
+  float width;
+  int type;
+  struct ncclTopoLink** list;
+};
+
+static ncclResult_t ncclTopoSavePath(struct ncclTopoSystem* system, int t1, int i1, int t2, int i2) {
+  if (system->nPathOverrides == system->maxPathOverrides) {
+    int newMax = std::max(64, 2*system->maxPathOverrides);
+    NCCLCHECK(ncclRealloc(&system->pathOverrides, system->maxPathOverrides, newMax));
+    system->maxPathOverrides = newMax;
+  }
+  struct ncclTopoLinkList* path = system->nodes[t1].nodes[i1].paths[t2]+i2;
+  struct ncclTopoPathOverride* save = system->pathOverrides+system->nPathOverrides;
+  save->t1 = t1; save->i1 = i1;
+  save->t2 = t2; save->i2 = i2;
+  save->count = path->count;
+  save->width = path->width;
+  save->type = path->type;
+  save->list = NULL;
+  if (path->count) {
+    NCCLCHECK(ncclCalloc(&save->list, path->count));
+    memcpy(save->list, path->list, path->count*sizeof(struct ncclTopoLink*));
+  }
+  system->nPathOverrides++;
+  return ncclSuccess;
+}
+
+static void ncclTopoFreePathOverrides(struct ncclTopoSystem* system) {
+  for (int o=0; o<system->nPathOverrides; o++) free(system->pathOverrides[o].list);
+  system->nPathOverrides = 0;
+}
+
+// Put back BFS results, in reverse order as a path can be modified more than once.
+static void ncclTopoRestorePaths(struct ncclTopoSystem* system) {
+  for (int o=system->nPathOverrides-1; o>=0; o--) {
+    struct ncclTopoPathOverride* save = system->pathOverrides+o;
+    struct ncclTopoLinkList* path = system->nodes[save->t1].nodes[save->i1].paths[save->t2]+save->i2;
+    if (save->count) memcpy(path->list, save->list, save->count*sizeof(struct ncclTopoLink*));
+    path->count = save->count;
+    path->width = save->width;
+    path->type = save->type;
+  }
+  ncclTopoFreePathOverrides(system);
+}
+
 static ncclResult_t addInterStep(struct ncclTopoSystem* system, int tx, int ix, int t1, int i1, int t2, int i2) {
   struct ncclTopoNode* cpuNode = system->nodes[tx].nodes+ix;
   struct ncclTopoNode* srcNode = system->nodes[t1].nodes+i1;
+  NCCLCHECK(ncclTopoSavePath(system, t1, i1, t2, i2));
 
   int l=0;
   // Node 1 -> CPU
@@ -493,18 +572,27 @@ ncclResult_t ncclTopoGetPxnRanks(struct ncclComm* comm, int** intermediateRanks,
 ncclResult_t ncclTopoComputePaths(struct ncclTopoSystem* system, struct ncclComm* comm) {
   // Precompute paths between GPUs/NICs.
 
-  // Remove everything in case we're re-computing
-  for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) ncclTopoRemovePathType(system, t);
+  int incremental = system->pathsValid && rcclParamTopoIncrementalPaths();
+  if (incremental) {
+    // Only nodes were removed since the last call. Go back to the BFS results and
+    // only recompute paths to nodes marked dirty by ncclTopoRemoveNodePaths.
+    ncclTopoRestorePaths(system);
+  } else {
+    // Remove everything in case we're re-computing
+    for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) ncclTopoRemovePathType(system, t);
+    ncclTopoFreePathOverrides(system);
+  }
+  system->pathsValid = 0;
 
   // Set direct paths from/to CPUs. We need them in many cases.
   for (int c=0; c<system->nodes[CPU].count; c++) {
-    NCCLCHECK(ncclTopoSetPaths(system->nodes[CPU].nodes+c, system));
+    NCCLCHECK(ncclTopoUpdatePaths(system->nodes[CPU].nodes+c, system, incremental));
   }
 
   // Set direct paths from/to GPUs.
   for (int g=0; g<system->nodes[GPU].count; g++) {
     // Compute paths to GPU g
-    NCCLCHECK(ncclTopoSetPaths(system->nodes[GPU].nodes+g, system));
+    NCCLCHECK(ncclTopoUpdatePaths(system->nodes[GPU].nodes+g, system, incremental));
 
     // Update path when we don't want to / can't use GPU Direct P2P
     for (int p=0; p<system->nodes[GPU].count; p++) {
@@ -530,6 +618,7 @@ ncclResult_t ncclTopoComputePaths(struct ncclTopoSystem* system, struct ncclComm
       NCCLCHECK(ncclTransports[TRANSPORT_P2P]->canConnect(&p2p, system, NULL, srcInfo, dstInfo));
       if (shm == 0 && p2p == 0) {
         // Mark this peer as inaccessible. We'll trim it later.
+        NCCLCHECK(ncclTopoSavePath(system, GPU, p, GPU, g));
         system->nodes[GPU].nodes[p].paths[GPU][g].count = 0;
       }
     }
@@ -538,7 +627,7 @@ ncclResult_t ncclTopoComputePaths(struct ncclTopoSystem* system, struct ncclComm
   // Set direct paths from/to NICs.
   for (int n=0; n<system->nodes[NET].count; n++) {
     struct ncclTopoNode* netNode = system->nodes[NET].nodes+n;
-    NCCLCHECK(ncclTopoSetPaths(netNode, system));
+    NCCLCHECK(ncclTopoUpdatePaths(netNode, system, incremental));
 
     for (int g=0; g<system->nodes[GPU].count; g++) {
       // Check whether we can access the NIC through another NVLink-connected GPU (PXN)
@@ -579,6 +668,108 @@ ncclResult_t ncclTopoComputePaths(struct ncclTopoSystem* system, struct ncclComm
       }
     }
   }
+  system->pathsValid = 1;
+  return ncclSuccess;
+}
+
+// Return where a link used by a path will be after ncclTopoRemoveNode has removed
+// delNode, or NULL if the link goes from or to delNode.
+static struct ncclTopoLink* ncclTopoRemapLink(struct ncclTopoSystem* system, int type, int index, struct ncclTopoLink* link) {
+  struct ncclTopoNode* delNode = system->nodes[type].nodes+index;
+  if (link->remNode == delNode) return NULL;
+  for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) {
+    struct ncclTopoNode* nodes = system->nodes[t].nodes;
+    if ((char*)link < (char*)nodes || (char*)link >= (char*)(nodes+system->nodes[t].count)) continue;
+    int n = ((char*)link - (char*)nodes) / sizeof(struct ncclTopoNode);
+    struct ncclTopoNode* node = nodes+n;
+    if (node == delNode) return NULL;
+    int l = link - node->links;
+    int newL = l;
+    for (int i=0; i<l; i++) if (node->links[i].remNode == delNode) newL--;
+    if (t == type && n > index) n--;
+    return nodes[n].links+newL;
+  }
+  return link;
+}
+
+// Remap all links of a path. Returns 1 if the path goes through the removed node.
+static int ncclTopoRemapPath(struct ncclTopoSystem* system, int type, int index, struct ncclTopoLink** list, int count) {
+  for (int i=0; i<count; i++) {
+    list[i] = ncclTopoRemapLink(system, type, index, list[i]);
+    if (list[i] == NULL) return 1;
+  }
+  return 0;
+}
+
+static void ncclTopoCopyPath(struct ncclTopoLinkList* dst, struct ncclTopoLinkList* src) {
+  memcpy(dst->list, src->list, src->count*sizeof(struct ncclTopoLink*));
+  dst->count = src->count;
+  dst->width = src->width;
+  dst->type = src->type;
+}
+
+// Called by ncclTopoRemoveNode before a node is removed, to keep pre-computed
+// paths usable by the next ncclTopoComputePaths call. Paths to the removed node
+// are dropped and all links are moved to where they will be once the node is
+// removed. Only GPU and NET nodes can be removed this way: GPUs are never used
+// as intermediate steps by the BFS and NET nodes are leaves, so removing them
+// does not change any other BFS result.
+ncclResult_t ncclTopoRemoveNodePaths(struct ncclTopoSystem* system, int type, int index) {
+  if (system->pathsValid == 0) return ncclSuccess;
+  if ((type != GPU && type != NET) || rcclParamTopoIncrementalPaths() == 0) {
+    system->pathsValid = 0;
+    ncclTopoFreePathOverrides(system);
+    return ncclSuccess;
+  }
+  int count = system->nodes[type].count;
+
+  // Saved BFS results
+  int o = 0;
+  for (int s=0; s<system->nPathOverrides; s++) {
+    struct ncclTopoPathOverride* save = system->pathOverrides+s;
+    if ((save->t1 == type && save->i1 == index) || (save->t2 == type && save->i2 == index)) {
+      free(save->list);
+      continue;
+    }
+    if (ncclTopoRemapPath(system, type, index, save->list, save->count)) {
+      // Should not happen, but the BFS from the destination would be impacted.
+      system->nodes[save->t2].nodes[save->i2].pathsDirty = 1;
+      free(save->list);
+      continue;
+    }
+    if (save->t1 == type && save->i1 > index) save->i1--;
+    if (save->t2 == type && save->i2 > index) save->i2--;
+    system->pathOverrides[o++] = *save;
+  }
+  system->nPathOverrides = o;
+
+  // Current paths
+  struct ncclTopoNode* delNode = system->nodes[type].nodes+index;
+  for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) {
+    for (int n=0; n<system->nodes[t].count; n++) {
+      struct ncclTopoNode* node = system->nodes[t].nodes+n;
+      if (node == delNode) continue;
+      for (int r=0; r<NCCL_TOPO_NODE_TYPES; r++) {
+        struct ncclTopoLinkList* paths = node->paths[r];
+        if (paths == NULL) continue;
+        for (int p=0; p<system->nodes[r].count; p++) {
+          if (r == type && p == index) continue;
+          if (ncclTopoRemapPath(system, type, index, paths[p].list, paths[p].count)) {
+            system->nodes[r].nodes[p].pathsDirty = 1;
+            paths[p].count = 0;
+          }
+        }
+        if (r == type) {
+          for (int p=index; p<count-1; p++) ncclTopoCopyPath(paths+p, paths+p+1);
+          if (count == 1) {
+            // Last node of that type
+            free(paths);
+            node->paths[r] = NULL;
+          }
+        }
+      }
+    }
+  }
   return ncclSuccess;
 }
 
@@ -699,6 +890,9 @@ ncclResult_t ncclTopoTrimSystem(struct ncclTopoSystem* system, struct ncclComm*
 
 void ncclTopoFree(struct ncclTopoSystem* system) {
   for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) ncclTopoRemovePathType(system, t);
+  ncclTopoFreePathOverrides(system);
+  free(system->pathOverrides);
+  free(system->xmlNodes);
   free(system);
 }
 
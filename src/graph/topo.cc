@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include "xml.h"
 #include "cpuset.h"
+#include "bootstrap.h"
 
 #define BUSID_SIZE (sizeof("0000:00:00.0"))
 #define BUSID_REDUCED_SIZE (sizeof("0000:00"))
@@ -108,6 +109,8 @@ ncclResult_t ncclTopoCreateNode(struct ncclTopoSystem* system, struct ncclTopoNo
   }
   struct ncclTopoNode* n = system->nodes[type].nodes+system->nodes[type].count;
   system->nodes[type].count++;
+  // New nodes have no paths yet
+  system->pathsValid = 0;
   n->type = type;
   n->id = id;
   if (type == GPU) {
@@ -137,6 +140,7 @@ ncclResult_t ncclTopoCreateNode(struct ncclTopoSystem* system, struct ncclTopoNo
 }
 
 ncclResult_t ncclTopoRemoveNode(struct ncclTopoSystem* system, int type, int index) {
+  NCCLCHECK(ncclTopoRemoveNodePaths(system, type, index));
   struct ncclTopoNode* delNode = system->nodes[type].nodes+index;
   for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) {
     free(delNode->paths[t]);
@@ -689,9 +693,8 @@ static ncclResult_t xmlInitAttrFloat(struct ncclXmlNode* node, const char* attrN
 }
 
 
-ncclResult_t ncclTopoGetSystem(struct ncclComm* comm, struct ncclTopoSystem** system) {
-  struct ncclXml* xml;
-  NCCLCHECK(ncclCalloc(&xml, 1));
+// Detects the GPUs of all the local ranks and the NICs of the host
+static ncclResult_t ncclTopoDetectXml(struct ncclComm* comm, struct ncclXml* xml) {
   char* xmlTopoFile = getenv("NCCL_TOPO_FILE");
   if (xmlTopoFile) {
     INFO(NCCL_ENV, "NCCL_TOPO_FILE set by environment to %s", xmlTopoFile);
@@ -765,15 +768,133 @@ ncclResult_t ncclTopoGetSystem(struct ncclComm* comm, struct ncclTopoSystem** sy
 
   // Remove XML branches which don't have a node with keep="1" (typically when importing a topology)
   NCCLCHECK(ncclTopoTrimXml(xml));
+  return ncclSuccess;
+}
+
+RCCL_PARAM(TopoShared, "TOPO_SHARED", 0);
+
+// With RCCL_TOPO_SHARED=1, the lowest local rank detects the XML of the host
+// and publishes it in a shared memory segment, the other local ranks restore
+// it from there instead of walking sysfs again. If the leader can't publish,
+// every rank detects its own XML.
+static ncclResult_t ncclTopoGetXml(struct ncclComm* comm, struct ncclXml* xml) {
+  int nLocalRanks = 0;
+  int* localRanks;
+  NCCLCHECK(ncclCalloc(&localRanks, comm->nRanks));
+  for (int r=0; r<comm->nRanks; r++) {
+    if (comm->peerInfo[r].hostHash == comm->peerInfo[comm->rank].hostHash) localRanks[nLocalRanks++] = r;
+  }
+  ncclResult_t ret = ncclSuccess;
+  if (rcclParamTopoShared() == 0 || nLocalRanks == 1) {
+    ret = ncclTopoDetectXml(comm, xml);
+  } else if (comm->rank == localRanks[0]) {
+    struct ncclTopoXmlShmInfo info;
+    struct ncclXmlNode* nodes = NULL;
+    int nNodes;
+    ret = ncclTopoDetectXml(comm, xml);
+    if (ret == ncclSuccess && ncclTopoXmlSnapshot(xml, &nodes, &nNodes) == ncclSuccess &&
+        ncclTopoXmlShmPublish(nodes, nNodes, nLocalRanks-1, &info) == ncclSuccess) {
+      INFO(NCCL_INIT, "Sharing topology (%d XML nodes) with %d local ranks through %s", nNodes, nLocalRanks-1, info.shmPath);
+    } else {
+      info.shmSize = 0;
+    }
+    free(nodes);
+    for (int i=1; i<nLocalRanks; i++) {
+      NCCLCHECKGOTO(bootstrapSend(comm->bootstrap, localRanks[i], BOOTSTRAP_TAG_TOPO, &info, sizeof(info)), ret, exit);
+    }
+  } else {
+    struct ncclTopoXmlShmInfo info;
+    NCCLCHECKGOTO(bootstrapRecv(comm->bootstrap, localRanks[0], BOOTSTRAP_TAG_TOPO, &info, sizeof(info)), ret, exit);
+    if (info.shmSize == 0) {
+      INFO(NCCL_INIT, "Rank %d did not share its topology, detecting it", localRanks[0]);
+      ret = ncclTopoDetectXml(comm, xml);
+    } else {
+      ret = ncclTopoXmlShmRead(&info, xml);
+      if (ret == ncclSuccess) INFO(NCCL_INIT, "Using topology of rank %d (%d XML nodes)", localRanks[0], xml->maxIndex);
+    }
+  }
+exit:
+  free(localRanks);
+  return ret;
+}
+
+ncclResult_t ncclTopoGetSystem(struct ncclComm* comm, struct ncclTopoSystem** system) {
+  struct ncclXml* xml;
+  NCCLCHECK(ncclCalloc(&xml, 1));
+  NCCLCHECK(ncclTopoGetXml(comm, xml));
 
-  xmlTopoFile = getenv("NCCL_TOPO_DUMP_FILE");
+  char* xmlTopoFile = getenv("NCCL_TOPO_DUMP_FILE");
   if (xmlTopoFile && comm->rank == ncclParamTopoDumpFileRank()) {
     INFO(NCCL_ENV, "NCCL_TOPO_DUMP_FILE set by environment to %s", xmlTopoFile);
     NCCLCHECK(ncclTopoDumpXmlToFile(xmlTopoFile, xml));
   }
 
+  // Save the XML before ncclTopoGetSystemFromXml() parses (and modifies) it
+  struct ncclXmlNode* xmlNodes;
+  int nXmlNodes;
+  NCCLCHECK(ncclTopoXmlSnapshot(xml, &xmlNodes, &nXmlNodes));
+  NCCLCHECK(ncclTopoGetSystemFromXml(xml, system));
+  (*system)->xmlNodes = xmlNodes;
+  (*system)->nXmlNodes = nXmlNodes;
+  free(xml);
+  return ncclSuccess;
+}
+
+// Keep the GPUs used by ranks of a split communicator, renumbering their
+// ranks, and all NICs.
+static ncclResult_t ncclTopoSplitXmlRec(struct ncclXmlNode* node, struct ncclComm* comm) {
+  if (strcmp(node->name, "gpu") == 0) {
+    const char* rankStr;
+    NCCLCHECK(xmlGetAttr(node, "rank", &rankStr));
+    if (rankStr == NULL) return ncclSuccess;
+    char ranks[MAX_STR_LEN+1];
+    strncpy(ranks, rankStr, MAX_STR_LEN);
+    ranks[MAX_STR_LEN] = '\0';
+    char newRanks[MAX_STR_LEN+1] = "";
+    char *tmpStr;
+    char *token = strtok_r(ranks, ",", &tmpStr);
+    while (token != NULL) {
+      int parentRank = atoi(token);
+      for (int r=0; r<comm->nRanks; r++) {
+        if (comm->parentRanks[r] != parentRank) continue;
+        int len = strlen(newRanks);
+        snprintf(newRanks+len, MAX_STR_LEN+1-len, "%s%d", len ? "," : "", r);
+      }
+      token = strtok_r(NULL, ",", &tmpStr);
+    }
+    if (newRanks[0] == '\0') return ncclSuccess;
+    NCCLCHECK(xmlSetAttr(node, "rank", newRanks));
+    NCCLCHECK(xmlSetAttrInt(node, "keep", 1));
+    return ncclSuccess;
+  }
+  if (strcmp(node->name, "net") == 0) {
+    NCCLCHECK(xmlSetAttrInt(node, "keep", 1));
+    return ncclSuccess;
+  }
+  for (int s=0; s<node->nSubs; s++) NCCLCHECK(ncclTopoSplitXmlRec(node->subs[s], comm));
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTopoGetSystemFromParent(struct ncclComm* comm, struct ncclComm* parent, struct ncclTopoSystem** system) {
+  struct ncclTopoSystem* parentSystem = parent->topo;
+  if (parentSystem == NULL || parentSystem->xmlNodes == NULL) return ncclTopoGetSystem(comm, system);
+
+  // All our local GPUs are also local GPUs of the parent, so we can start from
+  // its XML and drop what we don't use instead of probing the system again.
+  struct ncclXml* xml;
+  NCCLCHECK(ncclCalloc(&xml, 1));
+  NCCLCHECK(ncclTopoXmlRestore(parentSystem->xmlNodes, parentSystem->nXmlNodes, xml));
+  NCCLCHECK(ncclTopoSplitXmlRec(xml->nodes, comm));
+  NCCLCHECK(ncclTopoTrimXml(xml));
+
+  struct ncclXmlNode* xmlNodes;
+  int nXmlNodes;
+  NCCLCHECK(ncclTopoXmlSnapshot(xml, &xmlNodes, &nXmlNodes));
   NCCLCHECK(ncclTopoGetSystemFromXml(xml, system));
+  (*system)->xmlNodes = xmlNodes;
+  (*system)->nXmlNodes = nXmlNodes;
   free(xml);
+  INFO(NCCL_INIT, "Reusing topology of comm %p (%d XML nodes)", parent, nXmlNodes);
   return ncclSuccess;
 }
 
@@ -885,6 +1006,31 @@ ncclResult_t ncclTopoGetCpuAffinity(struct ncclTopoSystem* system, int rank, cpu
   return ncclSuccess;
 }
 
+ncclResult_t ncclTopoGetNumaNode(struct ncclTopoSystem* system, int rank, int netDev, int* numaNode) {
+  struct ncclTopoNode* node;
+  int index;
+  *numaNode = -1;
+  if (netDev >= 0) {
+    // Virtual devices (bonds) are not in the topology
+    if (ncclTopoIdToIndex(system, NET, netDev, &index) != ncclSuccess) return ncclSuccess;
+    node = system->nodes[NET].nodes+index;
+  } else {
+    NCCLCHECK(ncclTopoRankToIndex(system, rank, &index));
+    node = system->nodes[GPU].nodes+index;
+  }
+  // CPU nodes are identified by their NUMA id
+  int cpuIndex = -1, minHops = 0;
+  for (int c=0; c<system->nodes[CPU].count; c++) {
+    int nHops = node->paths[CPU][c].count;
+    if (cpuIndex == -1 || nHops < minHops) {
+      cpuIndex = c;
+      minHops = nHops;
+    }
+  }
+  *numaNode = cpuIndex == -1 ? -1 : system->nodes[CPU].nodes[cpuIndex].id;
+  return ncclSuccess;
+}
+
 ncclResult_t ncclTopoGetNetCount(struct ncclTopoSystem* system, int* count) {
   *count = system->nodes[NET].count;
   return ncclSuccess;
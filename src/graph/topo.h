@@ -147,6 +147,8 @@ struct ncclTopoNode {
   struct ncclTopoLinkList* paths[NCCL_TOPO_NODE_TYPES];
   // Used during search
   uint64_t used;
+  // Paths to this node need to be recomputed (see ncclTopoRemoveNodePaths)
+  int pathsDirty;
 };
 
 struct ncclTopoNodeSet {
@@ -166,11 +168,22 @@ struct ncclTopoSystem {
   bool pivotA2AEnabled;
   int pivotA2ANumBiRings;
   bool ll128Enabled;
+
+  // Incremental path computation state
+  int pathsValid;
+  int nPathOverrides;
+  int maxPathOverrides;
+  struct ncclTopoPathOverride* pathOverrides;
+
+  // XML this system was built from, reused by ncclCommSplit
+  struct ncclXmlNode* xmlNodes;
+  int nXmlNodes;
 };
 
 ncclResult_t ncclTopoGetNode(struct ncclTopoSystem* system, struct ncclTopoNode** node, int type, uint64_t id);
 ncclResult_t ncclTopoCreateNode(struct ncclTopoSystem* system, struct ncclTopoNode** node, int type, uint64_t id);
 ncclResult_t ncclTopoRemoveNode(struct ncclTopoSystem* system, int type, int id);
+ncclResult_t ncclTopoRemoveNodePaths(struct ncclTopoSystem* system, int type, int index);
 ncclResult_t ncclTopoConnectNodes(struct ncclTopoNode* node, struct ncclTopoNode* remNode, int type, float width);
 ncclResult_t ncclTopoPrintPaths(struct ncclTopoSystem* system);
 ncclResult_t ncclTopoLoadSystem(const char* xmlTopoFile, struct ncclTopoSystem* system);
@@ -5,6 +5,8 @@
  ************************************************************************/
 
 #include "nccl.h"
+#include "trees.h"
+#include <stdlib.h>
 
 #define RANK_TO_INDEX(r) (rank > root ? rank-1 : rank)
 
@@ -107,3 +109,141 @@ ncclResult_t ncclGetDtree(int nranks, int rank, int* s0, int* d0_0, int* d0_1, i
   }
   return ncclSuccess;
 }
+
+/* K-ary tree : heap layout, rank r has children r*k+1 ... r*k+k.
+ * k=1 builds a chain, i.e. a pipeline through all ranks.
+ *
+ * K-nomial tree : write ranks in base k. The parent of r is r with its lowest
+ * non-zero digit cleared, children of r are obtained by setting one of the
+ * digits below its lowest non-zero digit. For k=3 and 27 ranks, 0 has children
+ * 1,2 3,6 9,18, 3 has children 4,5, 9 has children 10,11 12,15 and 12 has
+ * children 13,14.
+ *
+ * Child slots are indexed by digit position then digit value, so that a rank
+ * always finds its children at the same slots, some being -1.
+ */
+static int knomialDigits(int k, int nranks) {
+  int n = 0;
+  for (long p=1; p<nranks; p*=k) n++;
+  return n;
+}
+
+int ncclTreeSlots(int type, int k, int nranks) {
+  if (type == NCCL_TREE_TYPE_BTREE) return 2;
+  if (type == NCCL_TREE_TYPE_KARY) return k;
+  return (k-1)*knomialDigits(k, nranks);
+}
+
+ncclResult_t ncclGetKtree(int type, int k, int nranks, int rank, int* u, int* d, int* nd, int* parentChildType) {
+  if (nranks <= 0 || rank < 0 || rank >= nranks) return ncclInvalidArgument;
+  if (type == NCCL_TREE_TYPE_BTREE) {
+    *nd = 2;
+    *parentChildType = -1;
+    return ncclGetBtree(nranks, rank, u, d, d+1, parentChildType);
+  }
+  if (type < 0 || k < 1 || (type == NCCL_TREE_TYPE_KNOMIAL && k < 2) || type > NCCL_TREE_TYPE_KNOMIAL ||
+      ncclTreeSlots(type, k, nranks) > NCCL_TREE_MAX_CHILDREN) return ncclInvalidArgument;
+  *nd = ncclTreeSlots(type, k, nranks);
+  for (int i=0; i<*nd; i++) d[i] = -1;
+  *u = *parentChildType = -1;
+  if (type == NCCL_TREE_TYPE_KARY) {
+    if (rank) {
+      *u = (rank-1)/k;
+      *parentChildType = (rank-1)%k;
+    }
+    for (int i=0; i<k; i++) {
+      long c = (long)rank*k+1+i;
+      if (c < nranks) d[i] = c;
+    }
+    return ncclSuccess;
+  }
+  // K-nomial
+  int pos = 0;
+  long p = 1;
+  while (rank && (rank/p)%k == 0) { p *= k; pos++; }
+  if (rank) {
+    int digit = (rank/p)%k;
+    *u = rank - digit*p;
+    *parentChildType = pos*(k-1)+digit-1;
+  } else {
+    pos = knomialDigits(k, nranks);
+  }
+  p = 1;
+  for (int i=0; i<pos; i++, p*=k) {
+    for (int j=1; j<k; j++) {
+      long c = rank + j*p;
+      if (c < nranks) d[i*(k-1)+j-1] = c;
+    }
+  }
+  return ncclSuccess;
+}
+
+/* Multiple trees. Trees come in pairs: tree 2p is the base tree rotated by
+ * p*nranks/nPairs ranks so that each pair is rooted on a different rank, tree
+ * 2p+1 is its mirror (or its shift by one for a binary tree on an odd number of
+ * ranks), as for the double binary tree. Trees 0 and 1 are ncclGetDtree.
+ */
+static inline int treeRot(int nTrees, int tree, int nranks) {
+  return (int)((long)(tree/2)*nranks/((nTrees+1)/2));
+}
+
+static inline int treeShift(int type, int nranks) {
+  return type == NCCL_TREE_TYPE_BTREE && nranks % 2 == 1;
+}
+
+static inline int treeToVirtual(int type, int nTrees, int tree, int nranks, int rank) {
+  int x = (rank - treeRot(nTrees, tree, nranks) + nranks) % nranks;
+  if (tree % 2 == 0) return x;
+  return treeShift(type, nranks) ? (x-1+nranks) % nranks : nranks-1-x;
+}
+
+static inline int treeFromVirtual(int type, int nTrees, int tree, int nranks, int x) {
+  if (x == -1) return -1;
+  if (tree % 2) x = treeShift(type, nranks) ? (x+1) % nranks : nranks-1-x;
+  return (x + treeRot(nTrees, tree, nranks)) % nranks;
+}
+
+ncclResult_t ncclGetMultiTree(int type, int k, int nTrees, int tree, int nranks, int rank, int* u, int* d, int* nd, int* parentChildType) {
+  if (nTrees < 1 || tree < 0 || tree >= nTrees || rank < 0 || rank >= nranks) return ncclInvalidArgument;
+  ncclResult_t res = ncclGetKtree(type, k, nranks, treeToVirtual(type, nTrees, tree, nranks, rank), u, d, nd, parentChildType);
+  if (res != ncclSuccess) return res;
+  *u = treeFromVirtual(type, nTrees, tree, nranks, *u);
+  for (int i=0; i<*nd; i++) d[i] = treeFromVirtual(type, nTrees, tree, nranks, d[i]);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclGetTreeStats(int type, int k, int nTrees, int nranks, struct ncclTreeStats* stats) {
+  int* depths = (int*)malloc(nranks*sizeof(int));
+  int* parents = (int*)malloc(nranks*sizeof(int));
+  int* links = (int*)calloc(nranks, sizeof(int));
+  ncclResult_t res = (depths && parents && links) ? ncclSuccess : ncclSystemError;
+  stats->depth = stats->maxChildren = 0;
+  for (int t=0; t<nTrees && res == ncclSuccess; t++) {
+    for (int r=0; r<nranks && res == ncclSuccess; r++) {
+      int d[NCCL_TREE_MAX_CHILDREN], nd, childType, nChildren = 0;
+      res = ncclGetMultiTree(type, k, nTrees, t, nranks, r, parents+r, d, &nd, &childType);
+      for (int i=0; res == ncclSuccess && i<nd; i++) if (d[i] != -1) nChildren++;
+      links[r] += nChildren + (parents[r] != -1);
+      if (nChildren > stats->maxChildren) stats->maxChildren = nChildren;
+      depths[r] = -1;
+    }
+    // Parents have lower depths, but not always lower virtual ranks; walk up.
+    for (int r=0; r<nranks && res == ncclSuccess; r++) {
+      int x = r, len = 0;
+      while (depths[x] == -1 && parents[x] != -1 && len <= nranks) { x = parents[x]; len++; }
+      if (len > nranks) { res = ncclInternalError; break; }
+      int base = depths[x] == -1 ? 0 : depths[x];
+      for (int y=r, l=len; l>=0; y=parents[y], l--) depths[y] = base+l;
+      if (depths[r] > stats->depth) stats->depth = depths[r];
+    }
+  }
+  stats->maxLinks = 0;
+  for (int r=0; r<nranks && res == ncclSuccess; r++) {
+    float l = (float)links[r]/nTrees;
+    if (l > stats->maxLinks) stats->maxLinks = l;
+  }
+  free(depths);
+  free(parents);
+  free(links);
+  return res;
+}
@@ -14,6 +14,7 @@
 #include "nvmlwrap.h"
 #include "xml.h"
 #include "rocm_smi_wrap.h"
+#include "shm.h"
 
 /*******************/
 /* XML File Parser */
@@ -436,7 +437,7 @@ ncclResult_t ncclTopoGetXmlFromCpu(struct ncclXmlNode* cpuNode, struct ncclXml*
       };
       uint32_t val;
     } cpuid1;
-    asm volatile("cpuid" : "=a" (cpuid1.val) : "a" (1) : "memory");
+    asm volatile("cpuid" : "=a" (cpuid1.val) : "a" (1) : "ebx", "ecx", "edx", "memory");
     int familyId = cpuid1.familyId + (cpuid1.extFamilyId << 4);
     int modelId = cpuid1.modelId + (cpuid1.extModelId << 4);
     NCCLCHECK(xmlSetAttrInt(cpuNode, "familyid", familyId));
@@ -590,6 +591,11 @@ ncclResult_t ncclTopoGetXmlFromSys(struct ncclXmlNode* pciNode, struct ncclXml*
         NCCLCHECK(ncclTopoGetXmlFromCpu(parent, xml));
       }
     }
+    if (parent->nSubs == MAX_SUBS) {
+      WARN("Error : too many XML subnodes of %s (max %d)", parent->name, MAX_SUBS);
+      free(path);
+      return ncclInternalError;
+    }
     pciNode->parent = parent;
     parent->subs[parent->nSubs++] = pciNode;
   }
@@ -869,6 +875,95 @@ ncclResult_t ncclTopoTrimXml(struct ncclXml* xml) {
   return ncclSuccess;
 }
 
+static int xmlCountNodes(struct ncclXmlNode* node) {
+  int count = 1;
+  for (int s=0; s<node->nSubs; s++) count += xmlCountNodes(node->subs[s]);
+  return count;
+}
+
+static struct ncclXmlNode* xmlCopyNodes(struct ncclXmlNode* node, struct ncclXmlNode* parent, struct ncclXmlNode* nodes, int* index) {
+  struct ncclXmlNode* copy = nodes+(*index)++;
+  memcpy(copy, node, sizeof(struct ncclXmlNode));
+  copy->parent = parent;
+  for (int s=0; s<node->nSubs; s++) copy->subs[s] = xmlCopyNodes(node->subs[s], copy, nodes, index);
+  return copy;
+}
+
+// Only nodes reachable from the top node are kept; removed nodes stay in
+// xml->nodes[] so copying the whole array would waste a lot of memory.
+ncclResult_t ncclTopoXmlSnapshot(struct ncclXml* xml, struct ncclXmlNode** nodes, int* nNodes) {
+  *nNodes = xmlCountNodes(xml->nodes);
+  NCCLCHECK(ncclCalloc(nodes, *nNodes));
+  int index = 0;
+  xmlCopyNodes(xml->nodes, NULL, *nodes, &index);
+  return ncclSuccess;
+}
+
+// Links of the copied nodes point into base[], the address of the snapshot
+// in the process which created it
+static ncclResult_t xmlRestoreFrom(struct ncclXmlNode* nodes, struct ncclXmlNode* base, int nNodes, struct ncclXml* xml) {
+  if (nNodes > MAX_NODES) {
+    WARN("Error : too many XML nodes (%d, max %d)", nNodes, MAX_NODES);
+    return ncclInternalError;
+  }
+  memcpy(xml->nodes, nodes, nNodes*sizeof(struct ncclXmlNode));
+  xml->maxIndex = nNodes;
+  // Relocate links from the snapshot to xml->nodes[]
+  for (int i=0; i<nNodes; i++) {
+    struct ncclXmlNode* node = xml->nodes+i;
+    if (node->parent) node->parent = xml->nodes + (node->parent - base);
+    for (int s=0; s<node->nSubs; s++) node->subs[s] = xml->nodes + (node->subs[s] - base);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTopoXmlRestore(struct ncclXmlNode* nodes, int nNodes, struct ncclXml* xml) {
+  return xmlRestoreFrom(nodes, nodes, nNodes, xml);
+}
+
+#define NCCL_TOPO_XML_SHM_MAGIC 0x6c6d786f706f74ULL // "topoxml"
+
+struct ncclTopoXmlShmHeader {
+  uint64_t magic;
+  int nodeSize;              // sizeof(struct ncclXmlNode) of the publisher
+  int nNodes;
+  int readers;               // ranks which still have to read the segment
+  struct ncclXmlNode* base;  // address of the snapshot in the publisher
+  struct ncclXmlNode nodes[0];
+};
+
+ncclResult_t ncclTopoXmlShmPublish(struct ncclXmlNode* nodes, int nNodes, int nReaders, struct ncclTopoXmlShmInfo* info) {
+  struct ncclTopoXmlShmHeader* shm;
+  info->shmPath[0] = '\0';
+  info->shmSize = sizeof(struct ncclTopoXmlShmHeader) + nNodes*sizeof(struct ncclXmlNode);
+  NCCLCHECK(ncclShmOpen(info->shmPath, info->shmSize, (void**)&shm, NULL, 1));
+  shm->magic = NCCL_TOPO_XML_SHM_MAGIC;
+  shm->nodeSize = sizeof(struct ncclXmlNode);
+  shm->nNodes = nNodes;
+  shm->readers = nReaders;
+  shm->base = nodes;
+  memcpy(shm->nodes, nodes, nNodes*sizeof(struct ncclXmlNode));
+  NCCLCHECK(ncclShmClose(shm, NULL, info->shmSize));
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTopoXmlShmRead(struct ncclTopoXmlShmInfo* info, struct ncclXml* xml) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclTopoXmlShmHeader* shm;
+  NCCLCHECK(ncclShmOpen(info->shmPath, info->shmSize, (void**)&shm, NULL, 0));
+  if (shm->magic != NCCL_TOPO_XML_SHM_MAGIC || shm->nodeSize != sizeof(struct ncclXmlNode) ||
+      info->shmSize != (int)(sizeof(struct ncclTopoXmlShmHeader) + shm->nNodes*sizeof(struct ncclXmlNode))) {
+    WARN("Shared topology %s is corrupted or from another version (node size %d, expected %zu)",
+        info->shmPath, shm->nodeSize, sizeof(struct ncclXmlNode));
+    ret = ncclInternalError;
+  }
+  if (ret == ncclSuccess) ret = xmlRestoreFrom(shm->nodes, shm->base, shm->nNodes, xml);
+  int last = __atomic_sub_fetch(&shm->readers, 1, __ATOMIC_ACQ_REL) == 0;
+  NCCLCHECK(ncclShmClose(shm, NULL, info->shmSize));
+  if (last) NCCLCHECK(ncclShmUnlink(info->shmPath));
+  return ret;
+}
+
 /**************************************************/
 /* Parser rules for the user-defined graph search */
 /**************************************************/
@@ -56,6 +56,19 @@ ncclResult_t ncclTopoFillNet(struct ncclXml* xml, const char* pciPath, const cha
 /* Remove unneeded parts */
 ncclResult_t ncclTopoTrimXml(struct ncclXml* xml);
 
+/* Compact copy of a detected XML, so that communicators split from this one can reuse it */
+ncclResult_t ncclTopoXmlSnapshot(struct ncclXml* xml, struct ncclXmlNode** nodes, int* nNodes);
+ncclResult_t ncclTopoXmlRestore(struct ncclXmlNode* nodes, int nNodes, struct ncclXml* xml);
+
+/* Snapshot published in a shared memory segment, so that the other ranks of the host don't detect it again */
+struct ncclTopoXmlShmInfo {
+  char shmPath[sizeof("/dev/shm/nccl-XXXXXX")];
+  int shmSize;
+};
+// The segment is unlinked by the last of the nReaders ranks calling ncclTopoXmlShmRead
+ncclResult_t ncclTopoXmlShmPublish(struct ncclXmlNode* nodes, int nNodes, int nReaders, struct ncclTopoXmlShmInfo* info);
+ncclResult_t ncclTopoXmlShmRead(struct ncclTopoXmlShmInfo* info, struct ncclXml* xml);
+
 ncclResult_t ncclTopoGetStrFromSys(const char* path, const char* fileName, char* strValue);
 
 /**************/
@@ -260,6 +273,10 @@ static ncclResult_t xmlAddNode(struct ncclXml* xml, struct ncclXmlNode* parent,
     WARN("Error : too many XML nodes (max %d)", MAX_NODES);
     return ncclInternalError;
   }
+  if (parent && parent->nSubs == MAX_SUBS) {
+    WARN("Error : too many XML subnodes of %s (max %d)", parent->name, MAX_SUBS);
+    return ncclInternalError;
+  }
   struct ncclXmlNode* s = xml->nodes+xml->maxIndex++;
   s->nSubs = 0;
   s->nAttrs = 0;
@@ -10,6 +10,7 @@
 #include "enqueue.h"
 #include "transport.h"
 #include "channel.h"
+#include "recorder.h"
 
 __thread int ncclGroupDepth = 0; // depth of ncclGroupStart nesting
 __thread ncclResult_t ncclGroupError = ncclSuccess;
@@ -50,6 +51,7 @@ NCCL_API(ncclResult_t, ncclGroupStart);
 ncclResult_t ncclGroupStart() {
   NVTX3_FUNC_RANGE_IN(nccl_domain);
   NCCLCHECK(ncclGroupStartInternal());
+  if (rcclRecordEnabled()) rcclRecordGroup(1);
   TRACE_CALL("ncclGroupStart()");
   return ncclSuccess;
 }
@@ -57,6 +59,7 @@ ncclResult_t ncclGroupStart() {
 NCCL_API(ncclResult_t, ncclGroupEnd);
 ncclResult_t ncclGroupEnd() {
   NVTX3_FUNC_RANGE_IN(nccl_domain);
+  if (rcclRecordEnabled()) rcclRecordGroup(0);
   NCCLCHECK(ncclGroupEndInternal());
   TRACE_CALL("ncclGroupEnd()");
   return ncclSuccess;
@@ -71,11 +74,98 @@ ncclResult_t ncclPreconnectFunc(struct ncclAsyncJob* job_) {
   struct ncclComm* comm = job->comm;
   CUDACHECK(hipSetDevice(comm->cudaDev));
   if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+  ncclNumaThreadNode = comm->numaNode;
   NCCLCHECK(ncclTransportP2pSetup(comm, NULL, 1));
   if (comm->p2pNet) NCCLCHECK(ncclTransportP2pSetup(comm, NULL, NCCL_CONN_IDX_P2P_NET));
+  if (comm->runtimeConn) NCCLCHECK(ncclTransportRuntimeConnect(comm));
   return ncclSuccess;
 }
 
+RCCL_PARAM(ParallelLaunchPrepare, "PARALLEL_LAUNCH_PREPARE", 0);
+
+// Persistent threads preparing the plans of the communicators of a clique
+// concurrently (RCCL_PARALLEL_LAUNCH_PREPARE=1), for single process multi-GPU
+// groups. The pool is shared by all the threads of the process and prepares
+// one clique at a time; the calling thread takes part in the work.
+#define NCCL_PREPARE_MAX_WORKERS 63
+
+static pthread_mutex_t prepareCliqueMutex = PTHREAD_MUTEX_INITIALIZER; // one clique at a time
+static pthread_mutex_t prepareMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prepareWorkCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t prepareDoneCond = PTHREAD_COND_INITIALIZER;
+static int prepareNWorkers = 0;
+static uint64_t prepareGeneration = 0; // incremented for every clique
+static int prepareBusy = 0;            // workers still working on the current clique
+static struct ncclComm** prepareComms;
+static ncclResult_t* prepareResults;
+static int prepareNComms;
+static int prepareNext;                // next comm to prepare
+
+static ncclResult_t prepareComm(struct ncclComm* comm) {
+  CUDACHECK(hipSetDevice(comm->cudaDev));
+  NCCLCHECK(ncclLaunchPrepare(comm));
+  return ncclSuccess;
+}
+
+// Prepares comms of the current clique until there are none left. Called with
+// prepareMutex held.
+static void prepareDrain() {
+  while (prepareNext < prepareNComms) {
+    int i = prepareNext++;
+    pthread_mutex_unlock(&prepareMutex);
+    ncclResult_t res = prepareComm(prepareComms[i]);
+    pthread_mutex_lock(&prepareMutex);
+    prepareResults[i] = res;
+  }
+}
+
+static void* prepareWorkerMain(void* arg) {
+  uint64_t seen = (uint64_t)(uintptr_t)arg;
+  pthread_mutex_lock(&prepareMutex);
+  while (true) {
+    while (prepareGeneration == seen) pthread_cond_wait(&prepareWorkCond, &prepareMutex);
+    seen = prepareGeneration;
+    prepareDrain();
+    if (--prepareBusy == 0) pthread_cond_signal(&prepareDoneCond);
+  }
+  return nullptr;
+}
+
+// Runs ncclLaunchPrepare on comms[0..nComms-1], results in results[]
+static ncclResult_t prepareClique(struct ncclComm** comms, ncclResult_t* results, int nComms) {
+  pthread_mutex_lock(&prepareCliqueMutex);
+  pthread_mutex_lock(&prepareMutex);
+  ncclResult_t ret = ncclSuccess;
+  int nWorkers = std::min(nComms-1, NCCL_PREPARE_MAX_WORKERS);
+  while (prepareNWorkers < nWorkers) {
+    pthread_t thread;
+    // Workers start from the current generation, so they wait for the next clique
+    int err = pthread_create(&thread, nullptr, prepareWorkerMain, (void*)(uintptr_t)prepareGeneration);
+    if (err != 0) {
+      WARN("Failed to create launch prepare thread : %s", strerror(err));
+      ret = ncclSystemError;
+      break;
+    }
+    pthread_detach(thread);
+    ncclSetThreadName(thread, "NCCL Prepare%2d", prepareNWorkers);
+    prepareNWorkers++;
+  }
+  if (ret == ncclSuccess) {
+    prepareComms = comms;
+    prepareResults = results;
+    prepareNComms = nComms;
+    prepareNext = 0;
+    prepareBusy = prepareNWorkers;
+    prepareGeneration++;
+    pthread_cond_broadcast(&prepareWorkCond);
+    prepareDrain();
+    while (prepareBusy != 0) pthread_cond_wait(&prepareDoneCond, &prepareMutex);
+  }
+  pthread_mutex_unlock(&prepareMutex);
+  pthread_mutex_unlock(&prepareCliqueMutex);
+  return ret;
+}
+
 static ncclResult_t doLaunches(struct ncclComm* head) {
   ncclResult_t result = ncclSuccess;
   struct ncclComm* cliqueComm0 = head->intraComm0;
@@ -88,15 +178,43 @@ static ncclResult_t doLaunches(struct ncclComm* head) {
   do {
     struct ncclComm* comm = cliqueHead;
     bool capturingYes = false, capturingNo = false;
+    int nComms = 0;
     do {
       (ncclCudaGraphValid(comm->tasks.capturingGraph) ? capturingYes : capturingNo) = true;
-      CUDACHECKGOTO(hipSetDevice(comm->cudaDev), result, failure);
-      NCCLCHECKGOTO(ncclLaunchPrepare(comm), result, failure);
-      if (useBarrier) ncclCommIntraBarrierIn(comm, 1);
+      nComms++;
       comm = comm->groupNext;
     } while (comm != nullptr && comm->intraComm0 == cliqueComm0);
     cliqueNextHead = comm;
 
+    // Graph captures keep the serial path: capture rules are per thread.
+    if (rcclParamParallelLaunchPrepare() && nComms > 1 && !capturingYes) {
+      struct ncclComm** comms = nullptr;
+      ncclResult_t* results = nullptr;
+      NCCLCHECKGOTO(ncclCalloc(&comms, nComms), result, failure);
+      NCCLCHECKGOTO(ncclCalloc(&results, nComms), result, prepare_fail);
+      comm = cliqueHead;
+      for (int i=0; i<nComms; i++, comm = comm->groupNext) comms[i] = comm;
+      NCCLCHECKGOTO(prepareClique(comms, results, nComms), result, prepare_fail);
+      // Enter the barrier in the same order as the serial path would have,
+      // stopping at the first failure.
+      for (int i=0; i<nComms; i++) {
+        NCCLCHECKGOTO(results[i], result, prepare_fail);
+        if (useBarrier) ncclCommIntraBarrierIn(comms[i], 1);
+      }
+prepare_fail:
+      free(comms);
+      free(results);
+      if (result != ncclSuccess) goto failure;
+    } else {
+      comm = cliqueHead;
+      do {
+        CUDACHECKGOTO(hipSetDevice(comm->cudaDev), result, failure);
+        NCCLCHECKGOTO(ncclLaunchPrepare(comm), result, failure);
+        if (useBarrier) ncclCommIntraBarrierIn(comm, 1);
+        comm = comm->groupNext;
+      } while (comm != cliqueNextHead);
+    }
+
     if (capturingYes && capturingNo) {
       // We have entered barriers but are aborting without leaving them. Thus
       // these comms are permanently trashed. We need a good mechanism for
@@ -249,6 +367,7 @@ ncclResult_t ncclGroupEndInternal() {
       comm->tasks.nTasksP2p = 0;
       comm->tasks.streams = nullptr;
       ncclIntruQueueConstruct(&comm->tasks.collQueue);
+      ncclIntruQueueConstruct(&comm->tasks.a2avQueue);
       comm->tasks.collBytesTotal = 0;
       for (int i=0; i < comm->nRanks; i++) {
         ncclIntruQueueConstruct(&comm->tasks.peers[i].sendQueue);
@@ -12,6 +12,8 @@
 #include "checks.h"
 #include "align.h"
 #include "utils.h"
+#include "numa.h"
+#include "hugepage.h"
 #include <sys/mman.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -25,14 +27,19 @@ ncclResult_t ncclCudaHostCallocDebug(T** ptr, size_t nelem, const char *filefunc
   ncclResult_t result = ncclSuccess;
   uint64_t time = 0;
   hipStreamCaptureMode mode = hipStreamCaptureModeRelaxed;
+  int numaNode = ncclNumaThreadNode, numaSet = 0;
   *ptr = nullptr;
   CUDACHECK(hipThreadExchangeStreamCaptureMode(&mode));
+  // Pinned pages cannot move, so the policy must be in place when they are allocated
+  if (numaNode >= 0) NCCLCHECKGOTO(ncclNumaThreadPolicySet(numaNode, &numaSet), result, finish);
   time = clockNano();
-  CUDACHECKGOTO(hipHostMalloc(ptr, nelem*sizeof(T), hipHostMallocMapped), result, finish);
+  CUDACHECKGOTO(hipHostMalloc(ptr, nelem*sizeof(T), hipHostMallocMapped | (numaSet ? hipHostMallocNumaUser : 0)), result, finish);
   time = clockNano() - time;
   memset(*ptr, 0, nelem*sizeof(T));
   INFO(NCCL_ALLOC, "%s:%d Cuda Host Alloc Size %ld pointer %p seconds: hipHostAlloc=%g", filefunc, line, nelem*sizeof(T), *ptr, double(time)/1.e9);
+  if (numaSet) INFO(NCCL_ALLOC, "%s:%d Cuda Host Alloc pointer %p on NUMA node %d (requested %d)", filefunc, line, *ptr, ncclNumaNodeOf(*ptr), numaNode);
 finish:
+  if (numaSet) ncclNumaThreadPolicyReset();
   CUDACHECK(hipThreadExchangeStreamCaptureMode(&mode));
   return result;
 }
@@ -213,13 +220,18 @@ finish:
 // and if they are shared, that could cause a crash in a child process
 inline ncclResult_t ncclIbMallocDebug(void** ptr, size_t size, const char *filefunc, int line) {
   size_t page_size = sysconf(_SC_PAGESIZE);
+  // Large buffers can only use transparent huge pages, as they are released with free()
+  int hugeMode = ncclHugePagesMode(size);
+  if (hugeMode != NCCL_HUGEPAGES_NONE) page_size = NCCL_HUGEPAGES_THP_SIZE;
   void* p;
-  int size_aligned = ROUNDUP(size, page_size);
+  size_t size_aligned = ROUNDUP(size, page_size);
   int ret = posix_memalign(&p, page_size, size_aligned);
   if (ret != 0) return ncclSystemError;
+  if (hugeMode != NCCL_HUGEPAGES_NONE) ncclHugePagesAdvise(p, size_aligned);
   memset(p, 0, size);
   *ptr = p;
   INFO(NCCL_ALLOC, "%s:%d Ib Alloc Size %ld pointer %p", filefunc, line, size, *ptr);
+  if (hugeMode != NCCL_HUGEPAGES_NONE) ncclHugePagesReport(p, size, "Ib Alloc");
   return ncclSuccess;
 }
 #define ncclIbMalloc(...) ncclIbMallocDebug(__VA_ARGS__, __FILE__, __LINE__)
@@ -0,0 +1,71 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_ALLTOALL_HIER_H_
+#define NCCL_ALLTOALL_HIER_H_
+
+#include "nccl.h"
+#include <stddef.h>
+
+// Two level AllToAll. For every pair of nodes (n, m), one relay rank on node n
+// handles the traffic with node m: it is the NIC-local (PXN intermediate) rank
+// of local rank m%localRanks. The exchange runs in three stages:
+//  0. each rank sends its blocks for node m to relay(n, m), blocks for ranks of
+//     its own node go straight to their destination,
+//  1. relay(n, m) sends all blocks from node n to node m as one message to
+//     relay(m, n),
+//  2. relay(m, n) scatters the blocks to the ranks of node m.
+// Each stage only starts once the previous one completed on the same rank.
+
+enum ncclA2aHierBuffer {
+  ncclA2aHierSendBuff,  // user send buffer
+  ncclA2aHierRecvBuff,  // user recv buffer
+  ncclA2aHierStageSend, // stage 0 -> 1 staging, blocks leaving the node
+  ncclA2aHierStageRecv, // stage 1 -> 2 staging, blocks entering the node
+  ncclA2aHierNumBuffers
+};
+
+struct ncclA2aHierTopo {
+  int nRanks;
+  int nNodes;
+  int const* rankToNode;             // [nRanks]
+  int const* rankToLocalRank;        // [nRanks]
+  int const* nodeLocalRanks;         // [nNodes]
+  int const* const* localRankToRank; // [nNodes][nodeLocalRanks[node]]
+  int const* relay;                  // [nRanks] NIC-local rank to use instead of each rank
+};
+
+struct ncclA2aHierOp {
+  int stage;
+  int peer;
+  int isSend;
+  int buffer; // ncclA2aHierBuffer
+  size_t offset;
+  size_t bytes;
+};
+
+struct ncclA2aHierPlan {
+  struct ncclA2aHierOp* ops;
+  int nOps;
+  size_t stageBytes[2]; // sizes of the StageSend and StageRecv buffers
+  int nNetOps;          // stage 1 sends, for statistics
+};
+
+// Rank of node `node` relaying traffic with node `peerNode`
+int ncclA2aHierRelay(struct ncclA2aHierTopo const* topo, int node, int peerNode);
+
+// Upper bound of plan->nOps for rank
+size_t ncclA2aHierMaxOps(struct ncclA2aHierTopo const* topo, int rank);
+
+// Computes the ops of `rank`. Sizes come from matrix (bytes, [src*nRanks+dst]),
+// or are all `bytes` when matrix is NULL. sendDispls / recvDispls are the
+// offsets of each peer block in the user buffers, in bytes; when matrix is NULL
+// they must be the natural ones (peer*bytes) and contiguous blocks are merged.
+// plan->ops must hold ncclA2aHierMaxOps(topo, rank) entries.
+ncclResult_t ncclA2aHierSchedule(struct ncclA2aHierTopo const* topo, int rank, size_t const* matrix, size_t bytes,
+    size_t const* sendDispls, size_t const* recvDispls, struct ncclA2aHierPlan* plan);
+
+#endif
@@ -0,0 +1,56 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_ALLTOALLV_H_
+#define NCCL_ALLTOALLV_H_
+
+#include "nccl.h"
+#include <stddef.h>
+
+// Scheduler for AllToAllv. The exchange is split into nRanks phases; in each
+// phase every rank sends to one peer and receives from another one (linear
+// shift, or pairwise exchange when nRanks is a power of two). Each phase is
+// mapped onto p2p channels. Sender and receiver of a given pair derive the
+// same channels, offsets and sizes, and process phases in the same order on
+// every channel.
+
+#define NCCL_A2AV_MAX_CHANNELS_PER_PEER 64
+
+struct ncclA2avConfig {
+  int nRanks;
+  int rank;
+  int nChannels;          // p2p channels to schedule on
+  int maxChannelsPerPeer; // a peer is spread on at most this many channels
+  size_t chunkBytes;      // a peer gets one more channel for each chunkBytes
+  size_t smallBytes;      // peers up to smallBytes are not split ...
+  int smallBatch;         // ... and consecutive small phases share a channel
+};
+
+struct ncclA2avOp {
+  int peer;
+  int isSend;
+  int channel;
+  int phase;
+  size_t offset; // in bytes, within the block exchanged with peer
+  size_t bytes;
+};
+
+// Maximum number of ops returned by ncclA2avSchedule
+static inline int ncclA2avMaxOps(struct ncclA2avConfig const* config) {
+  return 2*config->nRanks*config->maxChannelsPerPeer;
+}
+
+// Peers of config->rank in the given phase
+void ncclA2avPhasePeers(struct ncclA2avConfig const* config, int phase, int* sendPeer, int* recvPeer);
+
+// sendBytes / recvBytes are the sizes exchanged with each peer. When every rank
+// provides the full matrix (matrix[src*nRanks+dst] bytes, may be NULL), channels
+// are bin-packed across phases by bytes; otherwise each pair picks its channels
+// from its own size.
+ncclResult_t ncclA2avSchedule(struct ncclA2avConfig const* config, size_t const* sendBytes, size_t const* recvBytes,
+    size_t const* matrix, struct ncclA2avOp* ops, int* nOps);
+
+#endif
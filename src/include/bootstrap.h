@@ -10,13 +10,22 @@
 #include "nccl.h"
 #include "comm.h"
 
+// Tags of the messages exchanged during the initialization, out of the range of the transports
+#define BOOTSTRAP_TAG_COMMSPLIT 0x80000000
+#define BOOTSTRAP_TAG_TOPO      0x80000001
+
 ncclResult_t bootstrapNetInit();
 ncclResult_t bootstrapCreateRoot(ncclUniqueId* commId, bool idFromEnv);
 ncclResult_t bootstrapGetUniqueId(ncclUniqueId* out);
 ncclResult_t bootstrapInit(ncclUniqueId* id, struct ncclComm* comm);
+ncclResult_t bootstrapSplit(struct ncclComm* comm, struct ncclComm* parent, int* parentRanks);
 ncclResult_t bootstrapAllGather(void* commState, void* allData, int size);
 ncclResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size);
 ncclResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size);
+// Receive whichever expected message is available first. match(ctx, peer, tag, &data, &size) returns 1
+// and where to receive the message if (peer, tag) is expected, 0 otherwise.
+typedef int (*bootstrapMatchFn)(void* ctx, int peer, int tag, void** data, int* size);
+ncclResult_t bootstrapRecvAny(void* commState, bootstrapMatchFn match, void* ctx, int* peer, int* tag);
 ncclResult_t bootstrapBarrier(void* commState, int *ranks, int rank, int nranks, int tag);
 ncclResult_t bootstrapIntraNodeAllGather(void* commState, int *ranks, int rank, int nranks, void* allData, int size);
 ncclResult_t bootstrapClose(void* commState);
@@ -159,6 +159,24 @@ struct ncclKernelPlan {
   } channels[MAXCHANNELS];
 };
 
+// Result of scheduling a single collective, which only depends on its shape.
+// Later collectives with the same shape reuse it instead of going through
+// the tuning model again (see scheduleCollTasksToPlan).
+struct ncclCollCacheEntry {
+  // Key
+  size_t count;
+  ncclFunc_t func;
+  ncclDataType_t datatype;
+  ncclDevRedOp_t op;
+  int chunkSteps, sliceSteps;
+  bool valid;
+  // Value
+  int workFuncIndex;
+  int algorithm, protocol, nChannels, nThreads;
+  struct ncclWorkElem workElem;
+  struct ncclProxyOp proxyOp;
+};
+
 struct ncclComm {
   struct ncclMemoryStack memPermanent, memScoped;
   // List of destructors to run when comm is destructed
@@ -174,14 +192,29 @@ struct ncclComm {
   // Bitmasks for ncclTransportP2pSetup
   uint32_t* connectSend;
   uint32_t* connectRecv;
+  // With RCCL_RUNTIME_CONNECT=1 rings and trees are only connected when
+  // a collective first needs them, from the group preconnect job.
+  int runtimeConn;
+  int ringConnected, treeConnected;
+  int ringConnectPending, treeConnectPending;
+  struct ncclTopoGraph* runtimeGraphs[2]; // ring and tree graphs, kept for runtime connection
+  // Connection statistics, reported at destroy time
+  int nConnectors, nNetConnectors;
 
   int rank;    // my rank in the communicator
   int nRanks;  // number of GPUs in communicator
   int cudaDev; // my cuda device index
   int64_t busId;   // my PCI bus ID in int format
   cpu_set_t cpuAffinity; // CPU affinity of the GPU
+  int numaNode; // NUMA node of the host memory of the GPU, -1 to leave it to first touch
   int WarpSize;
   int virtualId;
+  uint64_t commHash;
+  int recordId; // 1 + id of the communicator in RCCL_RECORD_FILE, 0 if not recorded yet
+
+  // Communicator split (ncclCommSplit)
+  int* parentRanks; // rank in the parent communicator of each of our ranks, NULL if not split
+  int splitCount;   // number of splits of this communicator so far
 
   int node;
   int nNodes;
@@ -191,6 +224,10 @@ struct ncclComm {
   int* rankToNode;
   int* rankToLocalRank;
   int* localRankToRank;
+  int* nodeOrder; // order of nodes in inter-node rings and trees, by switch locality
+  // Inter-node trees (connectTrees), used by the tuning model
+  int treeInterDepth;
+  float treeBwScale;
   // localRanks and localRanktoRank for all nodes
   struct ncclNodeRanks* nodeRanks;
 
@@ -220,6 +257,9 @@ struct ncclComm {
 
   // Whether there has been a fatal error in this communicator.
   ncclResult_t fatalError;
+  // ncclInProgress while a non-blocking initialization is running, then its result
+  ncclResult_t initState;
+  pthread_t initThread;
 
   // Flag to ask NCCL kernels to abort
   volatile uint32_t *abortFlag;
@@ -234,6 +274,7 @@ struct ncclComm {
 
   // Operation pool.
   int workFifoDepth; // size of workFifoHeap[], power of 2
+  int workFifoMaxDepth; // workFifoHeap is replaced by a deeper one when full, up to this size
   struct ncclWork* workFifoHeap;
   struct ncclWork* devWorkFifoHeap;
   void* workFifoHeapGdrHandle;
@@ -242,6 +283,15 @@ struct ncclComm {
   uint32_t* workFifoDone/*[MAXCHANNELS]*/; // in cudaHost memory
   uint32_t workFifoSent; // Monotonic (mod 1<<32) index of next unused fifo slot.
   uint32_t workFifoAckdMin; // Monotonic index of least unprocessed fifo slot over all channels.
+  uint32_t workFifoFloor; // Slots below this index belong to previous heaps.
+  // Recorded after a kernel launch once the fifo is half full, so that a full
+  // fifo can be waited for without spinning.
+  hipEvent_t workFifoEvent;
+  uint32_t workFifoEventSent; // workFifoSent when workFifoEvent was recorded
+  bool workFifoEventPending;
+  // Statistics, reported on destroy
+  uint32_t workFifoHighWater; // Most slots in use at once
+  uint64_t workFifoStalls, workFifoStallTime;
 
   // Intra-process sync
   struct ncclComm* intraComm0; // leader of intra-process comms (self possible)
@@ -278,8 +328,18 @@ struct ncclComm {
   int persistentRefs; // number of persistent plan-lists capturing this comm
   struct ncclTasks tasks;
 
+  // Direct-mapped cache of collective scheduling results, allocated on first use
+  struct ncclCollCacheEntry* collCache;
+  int collCacheSize;
+  uint64_t collCacheHits, collCacheMisses;
+
   hipStream_t sideStream; // [RCCL] Cached non-captured stream
 
+  // [RCCL] Hierarchical AllToAll: NIC-local (PXN) rank of each rank, and staging buffer
+  int* a2aRelay;
+  char* a2aHierBuff;
+  size_t a2aHierBuffSize;
+
   // user-created reduction ops
   int userRedOpCapacity, userRedOpFreeHead;
   ncclUserRedOp *userRedOps;
@@ -0,0 +1,34 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_CPUCOPY_H_
+#define NCCL_CPUCOPY_H_
+
+#include "nccl.h"
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pool of threads copying host memory, used by the SHM transport in place of
+// hipMemcpyAsync when RCCL_SHM_CPU_COPY_THREADS is set. Copies are split in
+// chunks which the threads process in submission order, so that copies of
+// different steps overlap. The threads are bound to the given CPUs, normally
+// those close to the GPU, and write with non-temporal stores: the destination
+// is read by another process or by the GPU, not by the copying CPU.
+
+struct ncclCpuCopyPool;
+
+ncclResult_t ncclCpuCopyPoolCreate(struct ncclCpuCopyPool** pool, int nThreads, size_t chunkSize, int nonTemporal, cpu_set_t* affinity);
+// Copies size bytes from src to dst. *pending is incremented by the number of
+// chunks of the copy, and decremented (with release semantics) as each of
+// them completes.
+ncclResult_t ncclCpuCopyPoolSubmit(struct ncclCpuCopyPool* pool, void* dst, const void* src, size_t size, uint32_t* pending);
+ncclResult_t ncclCpuCopyPoolDestroy(struct ncclCpuCopyPool* pool);
+
+// memcpy with non-temporal stores where supported, followed by a store fence
+void ncclCpuCopyNt(void* dst, const void* src, size_t size);
+
+#endif
@@ -19,6 +19,11 @@ size_t ncclKernMaxLocalSize();
 size_t ncclKernLocalSize(int i);
 ncclResult_t ncclKernSetSharedMemoryCarveout(int carveOut);
 ncclResult_t ncclEnqueueCheck(struct ncclInfo* info);
+ncclResult_t ncclEnqueueAllToAllv(struct ncclInfo* info, const size_t* sendcounts, const size_t* sdispls,
+    const size_t* recvcounts, const size_t* rdispls, const size_t* countMatrix);
+bool ncclAllToAllHierEnabled(struct ncclComm* comm, size_t pairBytes);
+ncclResult_t ncclAllToAllHier(struct ncclComm* comm, const void* sendbuff, void* recvbuff, const size_t* matrix, size_t bytes,
+    const size_t* sendDispls, const size_t* recvDispls, hipStream_t stream);
 ncclResult_t ncclLaunchPrepare(struct ncclComm* comm);
 ncclResult_t ncclLaunchKernelBefore_NoUncapturedCuda(struct ncclComm* comm, struct ncclKernelPlan* plan);
 ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan);
@@ -21,6 +21,7 @@ ncclResult_t ncclTopoCudaPath(int cudaDev, char** path);
 struct ncclTopoSystem;
 // Build the topology
 ncclResult_t ncclTopoGetSystem(struct ncclComm* comm, struct ncclTopoSystem** system);
+ncclResult_t ncclTopoGetSystemFromParent(struct ncclComm* comm, struct ncclComm* parent, struct ncclTopoSystem** system);
 ncclResult_t ncclTopoSortSystem(struct ncclTopoSystem* system);
 ncclResult_t ncclTopoPrint(struct ncclTopoSystem* system);
 
@@ -43,6 +44,8 @@ ncclResult_t ncclTopoGetLocalRank(struct ncclTopoSystem* system, int rank, int*
 
 // Find CPU affinity
 ncclResult_t ncclTopoGetCpuAffinity(struct ncclTopoSystem* system, int rank, cpu_set_t* affinity);
+// NUMA node of the CPU closest to the GPU of rank, or to netDev if >= 0
+ncclResult_t ncclTopoGetNumaNode(struct ncclTopoSystem* system, int rank, int netDev, int* numaNode);
 
 #define NCCL_TOPO_CPU_ARCH_X86 1
 #define NCCL_TOPO_CPU_ARCH_POWER 2
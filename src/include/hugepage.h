@@ -0,0 +1,42 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_HUGEPAGE_H_
+#define NCCL_HUGEPAGE_H_
+
+#include "nccl.h"
+#include <stddef.h>
+
+// Huge page backing of the large host buffers of the transports, selected by
+// RCCL_HUGEPAGES: 0 regular pages (default), 1 transparent huge pages
+// (madvise), 2 hugetlb pages of RCCL_HUGEPAGES_SIZE (2MB or 1GB), falling
+// back to transparent then regular pages when none are available. Only
+// buffers of at least RCCL_HUGEPAGES_MIN_SIZE bytes are concerned. Shared
+// segments use files in the hugetlbfs mount RCCL_HUGEPAGES_DIR.
+#define NCCL_HUGEPAGES_NONE        0
+#define NCCL_HUGEPAGES_TRANSPARENT 1
+#define NCCL_HUGEPAGES_EXPLICIT    2
+
+// Size of transparent huge pages (PMD) on x86-64
+#define NCCL_HUGEPAGES_THP_SIZE (2UL<<20)
+
+// Mode applying to a buffer of size bytes
+int ncclHugePagesMode(size_t size);
+size_t ncclHugePageSize();
+const char* ncclHugePagesDir();
+
+// Private anonymous memory, zeroed. *mapSize is the length to give to
+// ncclHugePagesFree.
+ncclResult_t ncclHugePagesAlloc(void** ptr, size_t size, int mode, size_t* mapSize);
+ncclResult_t ncclHugePagesFree(void* ptr, size_t mapSize);
+// Ask for transparent huge pages on [ptr, ptr+size), before it is touched
+void ncclHugePagesAdvise(void* ptr, size_t size);
+// Bytes of the mappings of [ptr, ptr+size) on huge pages, and their page size
+ncclResult_t ncclHugePagesUsed(const void* ptr, size_t size, size_t* hugeBytes, size_t* pageSize);
+// INFO line with the above, only with NCCL_DEBUG=INFO and NCCL_DEBUG_SUBSYS=ALLOC
+void ncclHugePagesReport(const void* ptr, size_t size, const char* what);
+
+#endif
@@ -88,6 +88,19 @@ struct ncclTaskP2p {
   int chunk;
 };
 
+// AllToAllv scheduled as a whole, see alltoallv.h
+struct ncclTaskA2av {
+  struct ncclTaskA2av* next;
+  char* sendbuff;
+  char* recvbuff;
+  size_t* sendDispls; // in bytes, per peer
+  size_t* recvDispls;
+  struct ncclA2avOp* ops;
+  int nOps;
+  // Stateful op index, if the AllToAllv gets cut over two plans.
+  int opIndex;
+};
+
 struct ncclCudaStreamList {
   struct ncclCudaStreamList *next;
   hipStream_t stream;
@@ -100,6 +113,7 @@ struct ncclTasks {
     struct ncclIntruQueue<struct ncclTaskP2p, &ncclTaskP2p::next> recvQueue;
   };
   struct ncclIntruQueue<ncclTaskColl, &ncclTaskColl::next> collQueue;
+  struct ncclIntruQueue<ncclTaskA2av, &ncclTaskA2av::next> a2avQueue;
   size_t collBytesTotal;
   struct Peer* peers/*[nRanks]*/;
   int *p2pSendOrder/*[nRanks]*/, *p2pRecvOrder/*[nRanks]*/;
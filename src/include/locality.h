@@ -0,0 +1,34 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_LOCALITY_H_
+#define NCCL_LOCALITY_H_
+
+#include "nccl.h"
+#include <stdint.h>
+
+// Network locality of nodes. Each node is described by the switches above it,
+// lowest level (leaf / top of rack switch) first, as name hashes. 0 means
+// unknown; nodes with unknown switches are considered to share one. Inter-node rings and trees follow an order of nodes in which nodes
+// under the same switch are contiguous, at every level, so that rings cross
+// each switch boundary as few times as possible.
+
+#define NCCL_TOPO_MAX_SWITCH_LEVELS 4
+
+// Fills order[nNodes] with the node indexes, grouped by switches from the top
+// level down. Groups come in order of their first node, so that the order is
+// the identity when all nodes share the same switches or locality is unknown.
+// paths is [nNodes][NCCL_TOPO_MAX_SWITCH_LEVELS].
+ncclResult_t ncclTopoOrderNodes(int nNodes, uint64_t const* paths, int* order);
+
+// Number of hops between consecutive nodes of the ring (order, looping back)
+// which leave the switch of level `level`, i.e. go through a higher level.
+int ncclTopoRingCrossings(int nNodes, uint64_t const* paths, int const* order, int level);
+
+// Whether nodes a and b are under the same switch of level `level`
+int ncclTopoSameSwitch(uint64_t const* paths, int a, int b, int level);
+
+#endif
@@ -43,4 +43,11 @@ ncclResult_t ncclGpuGdrSupport(struct ncclComm* comm, int* gdrSupport);
 extern ncclNet_t ncclNetIb;
 extern ncclNet_t ncclNetSocket;
 
+// Bonds devices of base into virtual devices striping messages across their
+// members (RCCL_NET_BOND, see transport/net_bond.cc). net is set to the
+// bonding network, or to base if another network is already bonded.
+ncclResult_t ncclNetBondInit(ncclNet_t* base, const char* config, ncclNet_t** net);
+// Network bonded by net, or net itself
+ncclNet_t* ncclNetBondBase(ncclNet_t* net);
+
 #endif
@@ -0,0 +1,35 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_NUMA_H_
+#define NCCL_NUMA_H_
+
+#include "nccl.h"
+#include <stddef.h>
+
+// Explicit NUMA placement of the host memory shared with GPUs and NICs,
+// selected by RCCL_NUMA_POLICY: 0 leaves pages where they are first touched,
+// 1 prefers the target node (default) and 2 binds to it.
+//
+// Threads working for a communicator set ncclNumaThreadNode to the node local
+// to its GPU (or NIC); ncclShmOpen and ncclCudaHostCalloc then place the memory
+// they create on that node. -1 keeps the default placement.
+extern __thread int ncclNumaThreadNode;
+
+// node if host memory can be placed on it, -1 otherwise (single node system,
+// RCCL_NUMA_POLICY=0 or process already under a NUMA policy).
+int ncclNumaUsableNode(int node);
+// Set the policy of [ptr, ptr+size) to node, before its pages are touched
+ncclResult_t ncclNumaBind(void* ptr, size_t size, int node);
+// Make the allocations of the calling thread follow node until
+// ncclNumaThreadPolicyReset, for allocators touching the pages themselves.
+// *set is 0 when no policy was applied.
+ncclResult_t ncclNumaThreadPolicySet(int node, int* set);
+void ncclNumaThreadPolicyReset();
+// Node of the page holding ptr, -1 if unknown
+int ncclNumaNodeOf(const void* ptr);
+
+#endif
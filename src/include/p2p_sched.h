@@ -0,0 +1,47 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_P2P_SCHED_H_
+#define NCCL_P2P_SCHED_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Splitting of send/recv operations across the p2p channels of a peer. Chunk
+// c of an operation runs on channel increment c % channelsPerPeer of the pair,
+// so sender and receiver must split it identically: the chunk size only
+// depends on the size of the operation and on values shared by all ranks.
+//
+// The legacy split picks a power of two number of channels between
+// nChannelsMin and nChannelsMax, both derived from nRanks, and leaves the
+// remainder in the last chunk; a large operation stays on nChannelsMax
+// channels even if it is the only one of the group. The balanced split sizes
+// the number of channels of an operation from its bytes, up to all the
+// channels connected to the peer, and gives each of them the same number of
+// bytes.
+
+// Alignment of chunks with the balanced split
+#define NCCL_P2P_SCHED_ALIGN 4096
+
+struct ncclP2pSchedConfig {
+  int nChannelsMin;    // channels used by any operation larger than minSize
+  int nChannelsMax;    // legacy: channels used by the largest operations
+  int channelsPerPeer; // channels connected to each peer
+  ssize_t minSize;     // operations up to minSize are not split
+  ssize_t maxSize;     // legacy: preferred upper bound of a chunk
+  ssize_t targetSize;  // balanced: one channel per targetSize bytes, up to nChannelsMax ...
+  ssize_t spreadSize;  // ... then one per spreadSize bytes, up to channelsPerPeer
+  int balance;         // 1: balanced split, 0: legacy split
+};
+
+// stepSize is the size of a SIMPLE buffer step, after SENDRECV_SLICEFACTOR
+void ncclP2pSchedInit(struct ncclP2pSchedConfig* config, int nRanks, int nNodes, int p2pnChannels,
+    int p2pnChannelsPerPeer, ssize_t stepSize, int balance);
+
+// Size of every chunk but the last one of an operation of `bytes` bytes
+ssize_t ncclP2pChunkSize(struct ncclP2pSchedConfig const* config, ssize_t bytes);
+
+#endif
@@ -126,6 +126,8 @@ struct ncclProxySharedP2p {
   int size;
   char* cudaBuff;
   char* hostBuff;
+  char* hostBuffGpu;
+  size_t hostMapSize; // hostBuff is on huge pages, registered with hipHostRegister
   hipIpcMemHandle_t ipc;
   struct ncclProxyArgs* proxyAppend[MAXCHANNELS]; // Separate send and recv
 };
@@ -182,6 +184,10 @@ struct ncclProxyState {
 
   // Progress thread
   struct ncclProxyProgressState progressState;
+
+  // CPU copies of the SHM transport, shared by its proxy connections
+  struct ncclCpuCopyPool* shmCopyPool;
+  int shmCopyPoolRefs;
 };
 
 struct ncclProxyConnection {
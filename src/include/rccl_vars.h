@@ -26,5 +26,6 @@ THE SOFTWARE.
 #include "param.h"
 
 RCCL_PARAM_DECLARE(EnableHipGraph);  // Opt-in environment variable for enabling hipGraph
+RCCL_PARAM_DECLARE(AllToAllvSched);  // Schedule AllToAllv natively instead of as a group of send/recv (opt-in)
 
 #endif
@@ -0,0 +1,84 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_RECORDER_H_
+#define NCCL_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recording of the API calls of a process, for offline replay of the host
+// path (tools/RcclReplay). Enabled by RCCL_RECORD_FILE=<path>, where %h and %p
+// are replaced by the hostname and the pid as in NCCL_DEBUG_FILE.
+//
+// The file is a rcclRecordHeader followed by 32 bytes records. Communicators
+// and streams are numbered in order of first use; a comm record describes a
+// communicator before its first call. Operations are recorded after argument
+// checking, with the count and datatype of the enqueued task: AllGather,
+// Broadcast and AllToAllPivot are counted in bytes. The per-peer counts of an
+// AllToAllv follow its record, as `count` uint64_t values.
+
+#define RCCL_RECORD_MAGIC "RCCLREC"
+#define RCCL_RECORD_VERSION 1
+
+struct rcclRecordHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t startTime; // CLOCK_REALTIME of time 0, in ns
+};
+
+enum rcclRecordType {
+  rcclRecordComm = 0,       // comm: id, root: rank, stream: nRanks, count: commHash
+  rcclRecordCall = 1,
+  rcclRecordGroupStart = 2,
+  rcclRecordGroupEnd = 3
+};
+
+// Same order as ncclFunc_t
+enum rcclRecordFunc {
+  rcclRecordBroadcast, rcclRecordReduce, rcclRecordAllGather, rcclRecordReduceScatter, rcclRecordAllReduce,
+  rcclRecordSendRecv, rcclRecordSend, rcclRecordRecv, rcclRecordAllToAllPivot,
+  rcclRecordAllToAllv, // payload: sendcounts[nRanks], recvcounts[nRanks] [, countMatrix[nRanks*nRanks]]
+  rcclRecordNumFuncs
+};
+
+#define RCCL_RECORD_FLAG_INPLACE 0x1
+#define RCCL_RECORD_FLAG_MATRIX  0x2 // AllToAllv with a count matrix
+#define RCCL_RECORD_USER_OP 0xff     // user defined reduction operation
+
+struct rcclRecord {
+  uint8_t type;     // rcclRecordType
+  uint8_t func;     // rcclRecordFunc
+  uint8_t datatype;
+  uint8_t op;
+  uint8_t flags;
+  uint8_t thread;   // calling thread, in order of first record
+  uint16_t comm;
+  int32_t root;     // root, or peer of a send/recv
+  int32_t stream;   // stream, numbered per communicator
+  uint64_t count;
+  uint64_t time;    // ns since startTime
+};
+
+#ifdef __cplusplus
+static_assert(sizeof(struct rcclRecord) == 32, "rcclRecord must be 32 bytes");
+
+struct ncclInfo;
+
+extern int rcclRecordOn;
+void rcclRecordInit();
+static inline bool rcclRecordEnabled() {
+  if (__builtin_expect(__atomic_load_n(&rcclRecordOn, __ATOMIC_ACQUIRE) == -1, 0)) rcclRecordInit();
+  return rcclRecordOn == 1;
+}
+void rcclRecordGroup(int start);
+void rcclRecordColl(struct ncclInfo* info);
+void rcclRecordAllToAllvCounts(struct ncclInfo* info, const size_t* sendcounts, const size_t* recvcounts, const size_t* countMatrix);
+void rcclRecordFlush();
+#endif
+
+#endif
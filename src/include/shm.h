@@ -9,7 +9,9 @@
 
 #include "nccl.h"
 
-ncclResult_t ncclShmOpen(char* shmPath, const int shmSize, void** shmPtr, void** devShmPtr, int create);
+// With hugePages, segments may be created on huge pages (RCCL_HUGEPAGES), in
+// which case shmPath must hold PATH_MAX characters.
+ncclResult_t ncclShmOpen(char* shmPath, const int shmSize, void** shmPtr, void** devShmPtr, int create, int hugePages = 0);
 ncclResult_t ncclShmUnlink(const char* shmname);
 ncclResult_t ncclShmClose(void* shmPtr, void* devShmPtr, const int shmSize);
 #endif
@@ -20,6 +20,8 @@
 #define SLEEP_INT            1000 // connection retry sleep interval in usec
 #define RETRY_REFUSED_TIMES   2e4 // connection refused retry times before reporting a timeout (20 sec)
 #define RETRY_TIMEDOUT_TIMES    3 // connection timed out retry times (each one can take 20s)
+#define CONNECT_BACKOFF_MAX   20000 // maximum delay between two connection retries in usec
+#define CONNECT_POLL_INT      10000 // abort flag polling interval while connecting in usec
 #define SOCKET_NAME_MAXLEN (NI_MAXHOST+NI_MAXSERV)
 
 /* Common socket address storage structure for IPv4/IPv6 */
@@ -52,6 +54,9 @@ int ncclFindInterfaces(char* ifNames, union ncclSocketAddress *ifAddrs, int ifNa
 ncclResult_t ncclSocketListen(struct ncclSocket* sock);
 // Connect to sock->addr. sock->fd is set after a successful call.
 ncclResult_t ncclSocketConnect(struct ncclSocket* sock, int portReuse = 0);
+// Connect socks[i] to socks[i]->addr for all i concurrently, returns once all are connected. Refused
+// connections are retried with a randomized exponential backoff for up to RETRY_REFUSED_TIMES*SLEEP_INT usec.
+ncclResult_t ncclSocketConnectMany(struct ncclSocket** socks, int nSocks, int portReuse = 0);
 // Return socket connection state.
 ncclResult_t ncclGetSocketState(struct ncclSocket* sock, enum ncclSocketState* state);
 // Accept an incoming connection from listenSocket->fd and keep the file descriptor in sock->fd, with the remote side IP/port in sock->addr.
@@ -73,6 +73,10 @@ struct ncclTransport {
 
 ncclResult_t ncclTransportP2pConnect(struct ncclComm* comm, int channelId, int nrecv, int* peerRecv, int nsend, int* peerSend, int connIndex);
 ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, int connIndex, int* highestTransportType=NULL);
+ncclResult_t ncclTransportRingConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph);
+ncclResult_t ncclTransportTreeConnect(struct ncclComm* comm, struct ncclTopoGraph* treeGraph);
+ncclResult_t ncclTransportRuntimeConnect(struct ncclComm* comm);
+ncclResult_t ncclTransportReportConnStats(struct ncclComm* comm);
 
 enum { collNetRecv=0, collNetSend=1 };
 int ncclTransportCollNetSetup(struct ncclComm* comm, struct ncclTopoGraph* collNetGraph, struct ncclChannel* channel, int masterRank, int masterPeer, int collNetGraphChannelId, int type);
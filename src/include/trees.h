@@ -1,5 +1,6 @@
 /*************************************************************************
  * Copyright (c) 2015-2020, NVIDIA CORPORATION. All rights reserved.
+ * Modifications Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
  *
  * See LICENSE.txt for license information
  ************************************************************************/
@@ -10,4 +11,30 @@
 ncclResult_t ncclGetBtree(int nranks, int rank, int* u0, int* d1, int* d0, int* parentChildType);
 ncclResult_t ncclGetDtree(int nranks, int rank, int* u0, int* d0_0, int* d0_1, int* parentChildType0, int* u1, int* d1_0, int* d1_1, int* parentChildType1);
 
+#define NCCL_TREE_TYPE_BTREE 0   // binary tree, as in ncclGetBtree
+#define NCCL_TREE_TYPE_KARY 1    // k-ary heap, a chain for k=1
+#define NCCL_TREE_TYPE_KNOMIAL 2 // k-nomial tree
+#define NCCL_TREE_TYPE_NAMES { "btree", "kary", "knomial" }
+
+#define NCCL_TREE_MAX_CHILDREN 64
+
+// Number of child slots of every rank. Empty slots are -1.
+int ncclTreeSlots(int type, int k, int nranks);
+
+// Single tree rooted at 0. d must hold NCCL_TREE_MAX_CHILDREN entries, nd is
+// set to the number of slots, parentChildType to our slot in our parent.
+ncclResult_t ncclGetKtree(int type, int k, int nranks, int rank, int* u, int* d, int* nd, int* parentChildType);
+
+// Tree `tree` out of nTrees. Trees 0 and 1 of a binary type are the double
+// binary tree of ncclGetDtree.
+ncclResult_t ncclGetMultiTree(int type, int k, int nTrees, int tree, int nranks, int rank, int* u, int* d, int* nd, int* parentChildType);
+
+struct ncclTreeStats {
+  int depth;       // largest number of hops from a root, over all trees
+  int maxChildren; // largest number of actual children of a rank in one tree
+  float maxLinks;  // largest number of tree edges of a rank, averaged over trees
+};
+
+ncclResult_t ncclGetTreeStats(int type, int k, int nTrees, int nranks, struct ncclTreeStats* stats);
+
 #endif
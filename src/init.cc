@@ -16,7 +16,9 @@
 #include "coll_net.h"
 #include "enqueue.h"
 #include "graph.h"
+#include "locality.h"
 #include "argcheck.h"
+#include "recorder.h"
 #if defined(ENABLE_NPKIT)
 #include "npkit/npkit.h"
 #endif
@@ -304,6 +306,11 @@ void commZombieCleanup(struct ncclComm* comm) {
   ncclMemoryStackDestruct(&comm->memPermanent);
 
   struct ncclComm* intraComm0 = comm->intraComm0;
+  if (intraComm0 == nullptr) {
+    // Initialization failed before intra-process ranks were known
+    free(comm);
+    return;
+  }
   if (0 == ncclAtomicRefCountDecrement(&intraComm0->intraRefs)) {
     // Wait for all service threads to be done. We could not
     // do it earlier because it could have blocked and prevented
@@ -340,6 +347,7 @@ static ncclResult_t commFree(ncclComm_t comm) {
 
   // First stop all threads before we free anything.
   NCCLCHECK(ncclProxyDestroy(comm));
+  if (comm->recordId) rcclRecordFlush();
 
   delete[] comm->userRedOps;
 
@@ -371,6 +379,12 @@ static ncclResult_t commFree(ncclComm_t comm) {
 #endif
 
   free(comm->peerInfo);
+  free(comm->parentRanks);
+  free(comm->runtimeGraphs[0]);
+  free(comm->runtimeGraphs[1]);
+  free(comm->a2aRelay);
+  free(comm->nodeOrder);
+  if (comm->a2aHierBuff) NCCLCHECK(ncclCudaFree(comm->a2aHierBuff));
   ncclTopoFree(comm->topo);
   for (int n=0; n<comm->nNodes; n++) free(comm->nodeRanks[n].localRankToRank);
   free(comm->nodeRanks);
@@ -385,6 +399,8 @@ static ncclResult_t commFree(ncclComm_t comm) {
 
   if (comm->doneEvent != NULL)
     CUDACHECK(hipEventDestroy(comm->doneEvent));
+  if (comm->workFifoEvent != NULL)
+    CUDACHECK(hipEventDestroy(comm->workFifoEvent));
 
   NCCLCHECK(ncclStrongStreamDestruct(&comm->hostStream));
   NCCLCHECK(ncclStrongStreamDestruct(&comm->deviceStream));
@@ -415,11 +431,14 @@ RCCL_PARAM(CliqueIgnoreTopo, "CLIQUE_IGNORE_TOPO", 0);
 RCCL_PARAM(P2pNetDisable, "P2P_NET_DISABLE", 0);
 RCCL_PARAM(PivotAlltoallEnable, "PIVOT_ALLTOALL_ENABLE", 1);
 RCCL_PARAM(LL128ForceEnable, "LL128_FORCE_ENABLE", 0);
+RCCL_PARAM(RuntimeConnect, "RUNTIME_CONNECT", 0);
 NCCL_PARAM(AggChannelSize, "AGG_CHANNEL_SIZE", -2);
 NCCL_PARAM(DisableGraphHelper, "GRAPH_HELPER_DISABLE", 0);
 // GDRCOPY support: FIFO_ENABLE when enabled locates a workFifo in CUDA memory
 NCCL_PARAM(GdrCopyFifoEnable, "GDRCOPY_FIFO_ENABLE", 1);
 NCCL_PARAM(WorkFifoDepth, "WORK_FIFO_DEPTH", 64<<10);
+RCCL_PARAM(WorkFifoMaxDepth, "WORK_FIFO_MAX_DEPTH", 64<<10);
+RCCL_PARAM(WorkFifoBlockingWait, "WORK_FIFO_BLOCKING_WAIT", 1);
 enum ncclLaunchMode ncclParamLaunchMode;
 
 NCCL_PARAM(DmaBufEnable, "DMABUF_ENABLE", 0);
@@ -477,6 +496,7 @@ static ncclResult_t commAlloc(ncclComm_t* comret, int ndev, int rank, int virtua
   comm->doneEvent = doneEvent;
   comm->lastStream = nullptr;
   comm->virtualId = virtualId;
+  comm->numaNode = -1;
   hipGetDevice(&comm->cudaDev);
   NCCLCHECK(getBusId(comm->cudaDev, &comm->busId));
   TRACE(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx", comm, rank, ndev, comm->cudaDev, comm->busId);
@@ -547,6 +567,15 @@ static ncclResult_t devCommSetup(ncclComm_t comm) {
     WARN("NCCL_WORK_FIFO_DEPTH=%d is being ignored because it is not a power of 2.", comm->workFifoDepth);
     comm->workFifoDepth = 64<<10;
   }
+  comm->workFifoMaxDepth = rcclParamWorkFifoMaxDepth();
+  if (0 != (comm->workFifoMaxDepth & (comm->workFifoMaxDepth-1))) {
+    WARN("RCCL_WORK_FIFO_MAX_DEPTH=%d is being ignored because it is not a power of 2.", comm->workFifoMaxDepth);
+    comm->workFifoMaxDepth = 64<<10;
+  }
+  if (comm->workFifoMaxDepth < comm->workFifoDepth) comm->workFifoMaxDepth = comm->workFifoDepth;
+  if (rcclParamWorkFifoBlockingWait()) {
+    CUDACHECK(hipEventCreateWithFlags(&comm->workFifoEvent, hipEventBlockingSync | hipEventDisableTiming));
+  }
   tmpCommAndChans.comm.workFifoDepth = comm->workFifoDepth;
 
   if (ncclGdrCopy != NULL && ncclParamGdrCopyFifoEnable() == 1) {
@@ -622,7 +651,7 @@ static void showVersion() {
   }
 }
 
-static ncclResult_t fillInfo(struct ncclComm* comm, struct ncclPeerInfo* info, uint64_t commHash) {
+static ncclResult_t fillInfo(struct ncclComm* comm, struct ncclComm* parent, struct ncclPeerInfo* info, uint64_t commHash) {
   info->rank = comm->rank;
   info->virtualId = comm->virtualId;
   CUDACHECK(hipGetDevice(&info->cudaDev));
@@ -640,7 +669,12 @@ static ncclResult_t fillInfo(struct ncclComm* comm, struct ncclPeerInfo* info, u
 
   // detect if fine grained memory is available on this GPU
   int *ptr;
-  if (hipExtMallocWithFlags((void**)&ptr, sizeof(int), hipDeviceMallocFinegrained) == hipSuccess) {
+  if (parent) {
+    // Same GPU as in the parent, no need to probe again
+    info->hasFineGrain = parent->peerInfo[parent->rank].hasFineGrain;
+    info->gdrSupport = parent->peerInfo[parent->rank].gdrSupport;
+  }
+  else if (hipExtMallocWithFlags((void**)&ptr, sizeof(int), hipDeviceMallocFinegrained) == hipSuccess) {
     CUDACHECK(hipFree(ptr));
     info->hasFineGrain = true;
     NCCLCHECK(ncclGpuGdrSupport(comm, &info->gdrSupport));
@@ -701,20 +735,82 @@ NCCL_PARAM(GraphDumpFileRank, "GRAPH_DUMP_FILE_RANK", 0);
 NCCL_PARAM(CollNetNodeThreshold, "COLLNET_NODE_THRESHOLD", 2);
 NCCL_PARAM(NvbPreconnect, "NVB_PRECONNECT", 0);
 
-static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* commId) {
+static void parseSwitchPath(char* str, char** save, uint64_t* path) {
+  int l = 0;
+  for (char* name = strtok_r(str, " \t,\n", save); name && l < NCCL_TOPO_MAX_SWITCH_LEVELS; name = strtok_r(NULL, " \t,\n", save)) {
+    path[l++] = getHash(name, strlen(name));
+  }
+}
+
+// Switches above this host, lowest level first. Either given directly with
+// RCCL_TOPO_SWITCH="leaf,spine", or found in RCCL_TOPO_SWITCH_FILE which has one
+// "hostname leaf spine" line per host.
+static ncclResult_t getSwitchPath(uint64_t* path) {
+  memset(path, 0, NCCL_TOPO_MAX_SWITCH_LEVELS*sizeof(uint64_t));
+  char line[1024];
+  char* save;
+  char* str = getenv("RCCL_TOPO_SWITCH");
+  if (str) {
+    INFO(NCCL_ENV, "RCCL_TOPO_SWITCH set by environment to %s", str);
+    strncpy(line, str, sizeof(line)-1);
+    line[sizeof(line)-1] = '\0';
+    parseSwitchPath(line, &save, path);
+    return ncclSuccess;
+  }
+  char* switchFile = getenv("RCCL_TOPO_SWITCH_FILE");
+  if (switchFile == NULL) return ncclSuccess;
+  INFO(NCCL_ENV, "RCCL_TOPO_SWITCH_FILE set by environment to %s", switchFile);
+  FILE* file = fopen(switchFile, "r");
+  if (file == NULL) {
+    WARN("Could not open switch file %s : %s", switchFile, strerror(errno));
+    return ncclSuccess;
+  }
+  char hostname[1024];
+  NCCLCHECK(getHostName(hostname, sizeof(hostname), '.'));
+  int found = 0;
+  while (found == 0 && fgets(line, sizeof(line), file)) {
+    char* name = strtok_r(line, " \t,\n", &save);
+    if (name == NULL || name[0] == '#') continue;
+    char* dot = strchr(name, '.');
+    if (dot) *dot = '\0';
+    if (strcmp(name, hostname) != 0) continue;
+    parseSwitchPath(NULL, &save, path);
+    found = 1;
+  }
+  fclose(file);
+  if (found == 0) INFO(NCCL_GRAPH, "Host %s not found in %s", hostname, switchFile);
+  return ncclSuccess;
+}
+
+// When parent is set, comm is being split from it (see ncclCommSplit) and
+// comm->parentRanks is already filled.
+static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* commId, struct ncclComm* parent) {
   // We use 2 AllGathers
   // 1. { peerInfo, comm, compCap}
   // 2. { nChannels, graphInfo, topoRanks }
 
   int rank = comm->rank;
   int nranks = comm->nRanks;
-  uint64_t commHash = getHash(commId->internal, NCCL_UNIQUE_ID_BYTES);
+  uint64_t commHash;
+  if (parent) {
+    // Same on all ranks of the new communicator, and different from the
+    // parent and from other splits
+    uint64_t splitId[3] = { parent->commHash, (uint64_t)parent->splitCount, (uint64_t)comm->parentRanks[0] };
+    commHash = getHash((const char*)splitId, sizeof(splitId));
+  } else {
+    commHash = getHash(commId->internal, NCCL_UNIQUE_ID_BYTES);
+  }
+  comm->commHash = commHash;
   TRACE(NCCL_INIT, "comm %p, commHash %lx, rank %d nranks %d - BEGIN", comm, commHash, rank, nranks);
-  NCCLCHECK(bootstrapInit(commId, comm));
+  if (parent) {
+    NCCLCHECK(bootstrapSplit(comm, parent, comm->parentRanks));
+  } else {
+    NCCLCHECK(bootstrapInit(commId, comm));
+  }
 
   // AllGather1 - begin
   NCCLCHECK(ncclCalloc(&comm->peerInfo, nranks+1)); // Extra rank to represent CollNet root
-  NCCLCHECK(fillInfo(comm, comm->peerInfo+rank, commHash));
+  NCCLCHECK(fillInfo(comm, parent, comm->peerInfo+rank, commHash));
   NCCLCHECK(bootstrapAllGather(comm->bootstrap, comm->peerInfo, sizeof(struct ncclPeerInfo)));
 
   //If virtualId == -1 multiRank support has not been requested by user, using original interface
@@ -744,7 +840,11 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* comm
   // AllGather1 - end
 
   // Topo detection / System graph creation
-  NCCLCHECK(ncclTopoGetSystem(comm, &comm->topo));
+  if (parent) {
+    NCCLCHECK(ncclTopoGetSystemFromParent(comm, parent, &comm->topo));
+  } else {
+    NCCLCHECK(ncclTopoGetSystem(comm, &comm->topo));
+  }
   // save nRanks to ncclTopoSystem as indicator of multi-node
   comm->topo->nRanks = comm->nRanks;
   // init netGdrLevel
@@ -773,6 +873,13 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* comm
     sched_getaffinity(0, sizeof(cpu_set_t), &affinitySave);
     sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
   }
+  // Also place the host memory explicitly, as pages may have been touched
+  // elsewhere, or be allocated by other threads (proxy)
+  NCCLCHECK(ncclTopoGetNumaNode(comm->topo, comm->rank, -1, &comm->numaNode));
+  comm->numaNode = ncclNumaUsableNode(comm->numaNode);
+  if (comm->numaNode >= 0) INFO(NCCL_INIT, "comm %p rank %d host memory on NUMA node %d", comm, comm->rank, comm->numaNode);
+  int numaSave = ncclNumaThreadNode;
+  ncclNumaThreadNode = comm->numaNode;
   ncclResult_t ret;
 
   // Launch proxy service thread
@@ -872,6 +979,8 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* comm
     struct ncclTopoRanks topoRanks;
     bool pivotA2AEnabled;
     bool ll128Enabled;
+    int a2aRelay;
+    uint64_t switchPath[NCCL_TOPO_MAX_SWITCH_LEVELS];
   } *allGather3Data;
 
   NCCLCHECK(ncclCalloc(&allGather3Data, nranks));
@@ -897,6 +1006,11 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* comm
   if (ringGraph.nChannels > MAXCHANNELS/2)
     allGather3Data[rank].nc = 1;
   NCCLCHECK(ncclTopoGetLocalNet(comm->topo, rank, &allGather3Data[rank].netDev));
+  // Rank to go through to reach our NIC, used as relay by the hierarchical AllToAll
+  allGather3Data[rank].a2aRelay = rank;
+  if (comm->topo->nodes[NET].count)
+    NCCLCHECK(ncclTopoGetIntermediateRank(comm->topo, rank, allGather3Data[rank].netDev, &allGather3Data[rank].a2aRelay));
+  NCCLCHECK(getSwitchPath(allGather3Data[rank].switchPath));
   allGather3Data[rank].tree.pattern = treeGraph.pattern;
   allGather3Data[rank].tree.nChannels = treeGraph.nChannels;
   allGather3Data[rank].tree.sameChannels = treeGraph.sameChannels;
@@ -969,6 +1083,32 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* comm
   comm->localRankToRank = comm->nodeRanks[comm->node].localRankToRank;
   comm->localRank = comm->rankToLocalRank[rank];
   comm->localRanks = comm->nodeRanks[comm->node].localRanks;
+  NCCLCHECK(ncclCalloc(&comm->a2aRelay, nranks));
+  for (int r=0; r<nranks; r++) {
+    int relay = allGather3Data[r].a2aRelay;
+    comm->a2aRelay[r] = relay >= 0 && relay < nranks && comm->rankToNode[relay] == comm->rankToNode[r] ? relay : r;
+  }
+  // Order nodes by switch locality for inter-node rings and trees
+  uint64_t* nodePaths;
+  NCCLCHECK(ncclCalloc(&nodePaths, comm->nNodes*NCCL_TOPO_MAX_SWITCH_LEVELS));
+  for (int n=0; n<comm->nNodes; n++) {
+    memcpy(nodePaths+n*NCCL_TOPO_MAX_SWITCH_LEVELS, allGather3Data[comm->nodeRanks[n].localRankToRank[0]].switchPath,
+        NCCL_TOPO_MAX_SWITCH_LEVELS*sizeof(uint64_t));
+  }
+  NCCLCHECK(ncclCalloc(&comm->nodeOrder, comm->nNodes));
+  NCCLCHECK(ncclTopoOrderNodes(comm->nNodes, nodePaths, comm->nodeOrder));
+  if (rank == 0 && comm->nNodes > 1) {
+    int* identity;
+    NCCLCHECK(ncclCalloc(&identity, comm->nNodes));
+    for (int n=0; n<comm->nNodes; n++) identity[n] = n;
+    for (int l=0; l<NCCL_TOPO_MAX_SWITCH_LEVELS; l++) {
+      int before = ncclTopoRingCrossings(comm->nNodes, nodePaths, identity, l);
+      int after = ncclTopoRingCrossings(comm->nNodes, nodePaths, comm->nodeOrder, l);
+      if (before) INFO(NCCL_INIT|NCCL_GRAPH, "Ring hops leaving level %d switches : %d in rank order, %d in switch order", l, before, after);
+    }
+    free(identity);
+  }
+  free(nodePaths);
 
   TRACE(NCCL_INIT,"hostHash[%d] %lx localRank %d localRanks %d localRank0 %d",
         rank, comm->peerInfo[rank].hostHash, comm->localRank, comm->localRanks, comm->localRankToRank[0]);
@@ -1077,41 +1217,25 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, ncclUniqueId* comm
 
   NCCLCHECK(computeBuffSizes(comm));
 
-  // Connect with prev/next for each ring
   for (int c=0; c<comm->nChannels; c++) {
-    struct ncclChannel* channel = comm->channels+c;
     NCCLCHECKGOTO(setupChannel(comm, c, rank, nranks, rings+c*nranks), ret, affinity_restore);
-    if (comm->nRanks == 1) continue;
-    NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, 0), ret, affinity_restore);
-  }
-  NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &ringGraph, 0), ret, affinity_restore);
-  if (ringGraph.nIntraChannels && rcclParamP2pNetDisable() == 0) {
-    comm->useIntraNet = 1;
-    // Connect NET for intranode use
-    for (int c=0; c<comm->nChannels; c++) {
-      struct ncclChannel* channel = comm->channels+c;
-      if (comm->nRanks == 1) continue;
-      NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, NCCL_CONN_IDX_P2P_NET), ret, affinity_restore);
-    }
-    NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &ringGraph, NCCL_CONN_IDX_P2P_NET), ret, affinity_restore);
   }
   free(rings);
-  INFO(NCCL_INIT, "Connected all rings comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
-
-  // Connect Trees
-  for (int c=0; c<comm->nChannels; c++) {
-    struct ncclChannel* channel = comm->channels+c;
-    if (comm->nRanks == 1) continue;
-    NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, NCCL_MAX_TREE_ARITY, channel->tree.down, 1, &channel->tree.up, 0), ret, affinity_restore);
-    NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->tree.up, NCCL_MAX_TREE_ARITY, channel->tree.down, 0), ret, affinity_restore);
-    // RCCL: need to connect binTree as well
-    if (comm->topo->pivotA2ANumBiRings == 3) {
-      NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, NCCL_MAX_TREE_ARITY, channel->binTree.down, 1, &channel->binTree.up, 0), ret, affinity_restore);
-      NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->binTree.up, NCCL_MAX_TREE_ARITY, channel->binTree.down, 0), ret, affinity_restore);
-    }
+  if (ringGraph.nIntraChannels && rcclParamP2pNetDisable() == 0) comm->useIntraNet = 1;
+
+  comm->runtimeConn = rcclParamRuntimeConnect();
+  if (comm->runtimeConn) {
+    // Keep the graphs around, rings and trees get connected when first used
+    NCCLCHECKGOTO(ncclCalloc(comm->runtimeGraphs+0, 1), ret, affinity_restore);
+    NCCLCHECKGOTO(ncclCalloc(comm->runtimeGraphs+1, 1), ret, affinity_restore);
+    memcpy(comm->runtimeGraphs[0], &ringGraph, sizeof(ringGraph));
+    memcpy(comm->runtimeGraphs[1], &treeGraph, sizeof(treeGraph));
+    INFO(NCCL_INIT, "Runtime connection enabled, rings and trees will be connected on first use comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
+  } else {
+    // Connect with prev/next for each ring, then trees
+    NCCLCHECKGOTO(ncclTransportRingConnect(comm, &ringGraph), ret, affinity_restore);
+    NCCLCHECKGOTO(ncclTransportTreeConnect(comm, &treeGraph), ret, affinity_restore);
   }
-  NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &treeGraph, 0), ret, affinity_restore);
-  INFO(NCCL_INIT, "Connected all trees comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
 
   // Check if we can setup CollNet
   if (comm->collNetSupport > 0) {
@@ -1337,6 +1461,7 @@ collnet_cleanup:
   // restore the affinity.
 affinity_restore:
   if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &affinitySave);
+  ncclNumaThreadNode = numaSave;
   if (ret != ncclSuccess) return ret;
 
   TRACE(NCCL_INIT, "rank %d nranks %d - DONE", rank, nranks);
@@ -1344,16 +1469,57 @@ affinity_restore:
 }
 
 NCCL_PARAM(SetStackSize, "SET_STACK_SIZE", 0);
+NCCL_PARAM(CommBlocking, "COMM_BLOCKING", 1);
 
 struct ncclCommInitRankAsyncJob {
   struct ncclAsyncJob base;
   ncclComm_t* newcomm;
+  struct ncclComm* comm; // allocated upfront for non-blocking inits
   int nranks, myrank;
   ncclUniqueId commId;
   int cudaDev;
   int virtualId;
+  // ncclCommSplit
+  struct ncclComm* parent;
+  int color, key;
 };
 
+// Find which ranks of parent end up in the same communicator as us. This is
+// collective over all ranks of parent, including those with NCCL_SPLIT_NOCOLOR.
+static ncclResult_t commGetSplitInfo(struct ncclComm* parent, int color, int key, int* nRanksRet, int* myRankRet, int** parentRanksRet) {
+  int nRanks = 0, myRank = -1;
+  int* parentRanks = NULL;
+  ncclResult_t res = ncclSuccess;
+  int* colorKeys;
+  NCCLCHECK(ncclCalloc(&colorKeys, 2*parent->nRanks));
+  colorKeys[2*parent->rank] = color;
+  colorKeys[2*parent->rank+1] = key;
+  NCCLCHECKGOTO(bootstrapAllGather(parent->bootstrap, colorKeys, 2*sizeof(int)), res, exit);
+
+  if (color != NCCL_SPLIT_NOCOLOR) {
+    NCCLCHECKGOTO(ncclCalloc(&parentRanks, parent->nRanks), res, exit);
+    // Insertion sort by key, then parent rank
+    for (int r=0; r<parent->nRanks; r++) {
+      if (colorKeys[2*r] != color) continue;
+      int i = nRanks++;
+      while (i > 0 && colorKeys[2*parentRanks[i-1]+1] > colorKeys[2*r+1]) {
+        parentRanks[i] = parentRanks[i-1];
+        i--;
+      }
+      parentRanks[i] = r;
+    }
+    for (int r=0; r<nRanks; r++) {
+      if (parentRanks[r] == parent->rank) myRank = r;
+    }
+  }
+  *nRanksRet = nRanks;
+  *myRankRet = myRank;
+  *parentRanksRet = parentRanks;
+exit:
+  free(colorKeys);
+  return res;
+}
+
 static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   struct ncclCommInitRankAsyncJob* job = (struct ncclCommInitRankAsyncJob*)job_;
   ncclComm_t* newcomm = job->newcomm;
@@ -1362,32 +1528,70 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   int myrank = job->myrank;
   int cudaDev = job->cudaDev;
   int virtualId = job->virtualId;
+  struct ncclComm* parent = job->parent;
+  int* parentRanks = NULL;
   ncclResult_t res = ncclSuccess;
 
   CUDACHECK(hipSetDevice(cudaDev));
+  // Non-blocking inits allocate the comm before launching the job
+  struct ncclComm* comm = job->comm;
+  if (comm == NULL) *newcomm = NULL;
+  if (parent) {
+    NCCLCHECK(commGetSplitInfo(parent, job->color, job->key, &nranks, &myrank, &parentRanks));
+    parent->splitCount++;
+    if (job->color == NCCL_SPLIT_NOCOLOR) return ncclSuccess;
+  }
   // Set the maximum kernel stack size of all kernels to avoid
   // a CUDA memory reconfig on load (c.f. NVSHMEM issue)
   if (maxLocalSizeBytes > 0 && ncclParamSetStackSize() == 1) {
     TRACE(NCCL_INIT, "Setting cudaLimitStackSize to %zi", maxLocalSizeBytes);
     //CUDACHECKIGNORE(hipDeviceSetLimit(hipLimitStackSize, maxLocalSizeBytes));
   }
-  *newcomm = NULL;
-  NCCLCHECKGOTO(commAlloc(newcomm, nranks, myrank, virtualId), res, cleanup);
-  NCCLCHECKGOTO(initTransportsRank(*newcomm, &commId), res, cleanup);
-  NCCLCHECKGOTO(devCommSetup(*newcomm), res, cleanup);
+  if (comm == NULL) {
+    NCCLCHECKGOTO(commAlloc(newcomm, nranks, myrank, virtualId), res, cleanup);
+    comm = *newcomm;
+  }
+  comm->parentRanks = parentRanks;
+  parentRanks = NULL;
+  NCCLCHECKGOTO(initTransportsRank(comm, &commId, parent), res, cleanup);
+  {
+    int numaSave = ncclNumaThreadNode;
+    ncclNumaThreadNode = comm->numaNode;
+    res = devCommSetup(comm);
+    ncclNumaThreadNode = numaSave;
+    NCCLCHECKGOTO(res, res, cleanup);
+  }
 
-  INFO(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx localSize %ld used %ld bytes - Init COMPLETE", *newcomm, myrank, nranks, (*newcomm)->cudaDev, (*newcomm)->busId, ncclKernLocalSize(ncclGetKernelIndex(*newcomm)), allocTracker[(*newcomm)->cudaDev].totalAllocSize);
-  TRACE_CALL("ncclCommInitRank(%p,%d,0x%llx,%d,%d)", *newcomm, nranks, (unsigned long long)hashUniqueId(commId), myrank, (*newcomm)->cudaDev);
+  INFO(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx localSize %ld used %ld bytes - Init COMPLETE", comm, myrank, nranks, comm->cudaDev, comm->busId, ncclKernLocalSize(ncclGetKernelIndex(comm)), allocTracker[comm->cudaDev].totalAllocSize);
+  if (parent) {
+    TRACE_CALL("ncclCommSplit(%p,%d,%d,%p,%d)", parent, job->color, job->key, comm, myrank);
+  } else {
+    TRACE_CALL("ncclCommInitRank(%p,%d,0x%llx,%d,%d)", comm, nranks, (unsigned long long)hashUniqueId(commId), myrank, comm->cudaDev);
+  }
   return ncclSuccess;
 cleanup:
-  if ((*newcomm) && (*newcomm)->bootstrap) bootstrapAbort((*newcomm)->bootstrap);
-  *newcomm = NULL;
+  if (comm && comm->bootstrap) bootstrapAbort(comm->bootstrap);
+  // A non-blocking init already handed the comm to the user, who will destroy it
+  if (job->comm == NULL) *newcomm = NULL;
+  free(parentRanks);
   return res;
 }
 
+static void* ncclCommInitRankThreadMain(void* arg) {
+  struct ncclCommInitRankAsyncJob* job = (struct ncclCommInitRankAsyncJob*)arg;
+  struct ncclComm* comm = job->comm;
+  ncclResult_t res = ncclCommInitRankFunc(&job->base);
+  if (res != ncclSuccess) {
+    INFO(NCCL_INIT,"%s:%d -> %d [Async thread]", __FILE__, __LINE__, res);
+  }
+  free(job);
+  __atomic_store_n(&comm->initState, res, __ATOMIC_RELEASE);
+  return NULL;
+}
+
 static void ncclCommInitRankUndo(struct ncclAsyncJob* job_) {
   struct ncclCommInitRankAsyncJob* job = (struct ncclCommInitRankAsyncJob*)job_;
-  ncclCommDestroy(*job->newcomm);
+  if (*job->newcomm) ncclCommDestroy(*job->newcomm);
   *job->newcomm = nullptr;
 }
 
@@ -1421,10 +1625,35 @@ static ncclResult_t ncclCommInitRankDev(ncclComm_t* newcomm, int nranks, ncclUni
   job->myrank = myrank;
   job->cudaDev = cudaDev;
   job->virtualId = virtualId;
+  if (ncclParamCommBlocking() == 0 && ncclGroupDepth == 0) {
+    // Hand the comm to the user right away and initialize it in the background.
+    // The user polls for completion with ncclCommGetAsyncError.
+    NCCLCHECKGOTO(commAlloc(&job->comm, nranks, myrank, virtualId), res, fail);
+    job->comm->initState = ncclInProgress;
+    job->newcomm = &job->comm;
+    *newcomm = job->comm;
+    int ret = pthread_create(&job->comm->initThread, NULL, ncclCommInitRankThreadMain, job);
+    if (ret != 0) {
+      WARN("Unable to create init thread : %s", strerror(ret));
+      res = ncclSystemError;
+      goto fail;
+    }
+    ncclSetThreadName((*newcomm)->initThread, "NCCL Init%2d", cudaDev);
+    res = ncclInProgress;
+    goto end;
+  }
   NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, ncclCommInitRankUndo, free), res, end);
 
 end:
   return ncclGroupErrCheck(res);
+fail:
+  // The comm was handed to the user before the init thread failed to start
+  if (job->comm) {
+    commFree(job->comm);
+    *newcomm = NULL;
+  }
+  free(job);
+  goto end;
 }
 
 NCCL_API(ncclResult_t, ncclCommInitRank, ncclComm_t* newcomm, int nranks, ncclUniqueId commId, int myrank);
@@ -1436,7 +1665,9 @@ ncclResult_t ncclCommInitRank(ncclComm_t* newcomm, int nranks, ncclUniqueId comm
 
   int cudaDev;
   CUDACHECK(hipGetDevice(&cudaDev));
-  NCCLCHECK(ncclCommInitRankDev(newcomm, nranks, commId, myrank, cudaDev, -1));
+  ncclResult_t ret = ncclCommInitRankDev(newcomm, nranks, commId, myrank, cudaDev, -1);
+  if (ret == ncclInProgress) return ret;
+  NCCLCHECK(ret);
   return ncclSuccess;
 }
 
@@ -1445,11 +1676,41 @@ ncclResult_t ncclCommInitRankMulti(ncclComm_t* newcomm, int nranks, ncclUniqueId
   NVTX3_FUNC_RANGE_IN(nccl_domain);
   int cudaDev;
   CUDACHECK(hipGetDevice(&cudaDev));
-  NCCLCHECK(ncclCommInitRankDev(newcomm, nranks, commId, myrank, cudaDev, virtualId));
+  ncclResult_t ret = ncclCommInitRankDev(newcomm, nranks, commId, myrank, cudaDev, virtualId);
+  if (ret == ncclInProgress) return ret;
+  NCCLCHECK(ret);
   return ncclSuccess;
 }
 
 
+NCCL_API(ncclResult_t, ncclCommSplit, ncclComm_t comm, int color, int key, ncclComm_t* newcomm);
+ncclResult_t ncclCommSplit(ncclComm_t comm, int color, int key, ncclComm_t* newcomm) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  ncclResult_t res;
+  struct ncclCommInitRankAsyncJob *job;
+
+  NCCLCHECKGOTO(PtrCheck(comm, "CommSplit", "comm"), res, end);
+  NCCLCHECKGOTO(PtrCheck(newcomm, "CommSplit", "newcomm"), res, end);
+  if (color < 0 && color != NCCL_SPLIT_NOCOLOR) {
+    WARN("Invalid color %d, must be non-negative or NCCL_SPLIT_NOCOLOR", color);
+    res = ncclInvalidArgument;
+    goto end;
+  }
+  NCCLCHECKGOTO(ncclInit(), res, end);
+
+  NCCLCHECKGOTO(ncclCalloc(&job, 1), res, end);
+  job->newcomm = newcomm;
+  job->cudaDev = comm->cudaDev;
+  job->virtualId = comm->virtualId;
+  job->parent = comm;
+  job->color = color;
+  job->key = key;
+  NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, ncclCommInitRankUndo, free), res, end);
+
+end:
+  return ncclGroupErrCheck(res);
+}
+
 NCCL_API(ncclResult_t, ncclCommInitAll, ncclComm_t* comms, int ndev, const int* devlist);
 ncclResult_t ncclCommInitAll(ncclComm_t* comms, int ndev, const int* devlist) {
   NVTX3_FUNC_RANGE_IN(nccl_domain);
@@ -1481,6 +1742,12 @@ static ncclResult_t commDestroy(ncclComm_t comm) {
     return ncclInvalidArgument;
   }
 
+  // Wait for a non-blocking init to finish before tearing the comm down
+  if (comm->initThread) {
+    pthread_join(comm->initThread, NULL);
+    comm->initThread = 0;
+  }
+
   int savedDevice;
 #ifdef ENABLE_TRACE
   int rank = comm->rank;
@@ -1497,6 +1764,14 @@ static ncclResult_t commDestroy(ncclComm_t comm) {
   NCCLCHECK(ncclStrongStreamSynchronize(&comm->hostStream));
   NCCLCHECK(ncclStrongStreamSynchronize(&comm->deviceStream));
   NCCLCHECK(ncclCommPollCallbacks(comm));
+  if (comm->initState == ncclSuccess) NCCLCHECK(ncclTransportReportConnStats(comm));
+  if (comm->collCache) {
+    INFO(NCCL_COLL, "comm %p rank %d collective cache : %lu hits %lu misses", comm, comm->rank, comm->collCacheHits, comm->collCacheMisses);
+  }
+  if (comm->initState == ncclSuccess) {
+    INFO(NCCL_COLL, "comm %p rank %d work fifo : depth %d (max %d), high water mark %u, %lu stalls, %g ms stalled", comm, comm->rank,
+        comm->workFifoDepth, comm->workFifoMaxDepth, comm->workFifoHighWater, comm->workFifoStalls, comm->workFifoStallTime/1e6);
+  }
 
   NCCLCHECK(commFree(comm));
 
@@ -1560,6 +1835,7 @@ const char* ncclGetErrorString(ncclResult_t code) {
     case ncclInvalidArgument        : return "invalid argument";
     case ncclInvalidUsage           : return "invalid usage";
     case ncclRemoteError            : return "remote process exited or there was a network error";
+    case ncclInProgress             : return "NCCL operation in progress";
     default                         : return "unknown result code";
   }
 }
@@ -1576,7 +1852,8 @@ NCCL_API(ncclResult_t, ncclCommGetAsyncError, ncclComm_t comm, ncclResult_t *asy
 ncclResult_t ncclCommGetAsyncError(ncclComm_t comm, ncclResult_t *asyncError) {
   NCCLCHECK(PtrCheck(comm, "ncclGetAsyncError", "comm"));
   NCCLCHECK(PtrCheck(asyncError, "ncclGetAsyncError", "asyncError"));
-  *asyncError = comm->fatalError;
+  ncclResult_t initState = __atomic_load_n(&comm->initState, __ATOMIC_ACQUIRE);
+  *asyncError = initState != ncclSuccess ? initState : comm->fatalError;
   return ncclSuccess;
 }
 
@@ -0,0 +1,210 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alltoall_hier.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define A2AH_UNKNOWN SIZE_MAX
+
+int ncclA2aHierRelay(struct ncclA2aHierTopo const* topo, int node, int peerNode) {
+  return topo->relay[topo->localRankToRank[node][peerNode % topo->nodeLocalRanks[node]]];
+}
+
+size_t ncclA2aHierMaxOps(struct ncclA2aHierTopo const* topo, int rank) {
+  int n = topo->rankToNode[rank];
+  size_t ln = topo->nodeLocalRanks[n];
+  // Direct blocks and blocks sent to / received from relays
+  size_t nOps = 2*(size_t)topo->nRanks;
+  // Blocks gathered and scattered as a relay, plus one message each way per region
+  for (int m=0; m<topo->nNodes; m++) {
+    if (m != n && ncclA2aHierRelay(topo, n, m) == rank) nOps += 2*ln*topo->nodeLocalRanks[m] + 2;
+  }
+  return nOps;
+}
+
+struct hierState {
+  struct ncclA2aHierTopo const* topo;
+  size_t const* matrix;
+  size_t bytes;
+  struct ncclA2aHierPlan* plan;
+  // Last op with each peer in the current stage, to merge contiguous blocks
+  int* last[2];
+  int* lastRemoteBuffer[2];
+  size_t* lastRemoteEnd[2];
+};
+
+static inline size_t pairBytes(struct hierState* st, int src, int dst) {
+  return st->matrix ? st->matrix[(size_t)src*st->topo->nRanks+dst] : st->bytes;
+}
+
+// Bytes sent by all ranks of node x to all ranks of node y
+static size_t regionBytes(struct hierState* st, int x, int y) {
+  struct ncclA2aHierTopo const* topo = st->topo;
+  if (st->matrix == NULL) return (size_t)topo->nodeLocalRanks[x]*topo->nodeLocalRanks[y]*st->bytes;
+  size_t total = 0;
+  for (int i=0; i<topo->nodeLocalRanks[x]; i++) {
+    for (int j=0; j<topo->nodeLocalRanks[y]; j++) {
+      total += pairBytes(st, topo->localRankToRank[x][i], topo->localRankToRank[y][j]);
+    }
+  }
+  return total;
+}
+
+static void newStage(struct hierState* st) {
+  for (int s=0; s<2; s++) {
+    for (int r=0; r<st->topo->nRanks; r++) st->last[s][r] = -1;
+  }
+}
+
+// Blocks are merged with the previous op with the same peer when they are
+// contiguous on both sides. Both sides see the same sequence of blocks, so they
+// take the same decisions. remoteOffset is A2AH_UNKNOWN when the peer layout is
+// not known, which disables merging.
+static void addOp(struct hierState* st, int stage, int peer, int isSend, int buffer, size_t offset, size_t bytes,
+    int remoteBuffer, size_t remoteOffset) {
+  if (bytes == 0) return;
+  struct ncclA2aHierPlan* plan = st->plan;
+  int l = st->last[isSend][peer];
+  if (l != -1 && remoteOffset != A2AH_UNKNOWN && plan->ops[l].buffer == buffer &&
+      plan->ops[l].offset + plan->ops[l].bytes == offset &&
+      st->lastRemoteBuffer[isSend][peer] == remoteBuffer && st->lastRemoteEnd[isSend][peer] == remoteOffset) {
+    plan->ops[l].bytes += bytes;
+  } else {
+    l = st->last[isSend][peer] = plan->nOps++;
+    struct ncclA2aHierOp* op = plan->ops+l;
+    op->stage = stage;
+    op->peer = peer;
+    op->isSend = isSend;
+    op->buffer = buffer;
+    op->offset = offset;
+    op->bytes = bytes;
+    st->lastRemoteBuffer[isSend][peer] = remoteBuffer;
+  }
+  st->lastRemoteEnd[isSend][peer] = remoteOffset == A2AH_UNKNOWN ? A2AH_UNKNOWN : remoteOffset + bytes;
+}
+
+ncclResult_t ncclA2aHierSchedule(struct ncclA2aHierTopo const* topo, int rank, size_t const* matrix, size_t bytes,
+    size_t const* sendDispls, size_t const* recvDispls, struct ncclA2aHierPlan* plan) {
+  int nRanks = topo->nRanks, nNodes = topo->nNodes;
+  if (rank < 0 || rank >= nRanks) return ncclInvalidArgument;
+  int n = topo->rankToNode[rank], ln = topo->nodeLocalRanks[n], li = topo->rankToLocalRank[rank];
+  int const* nodeRanks = topo->localRankToRank[n];
+  bool uniform = matrix == NULL;
+
+  struct hierState st = { topo, matrix, bytes, plan };
+  // Offset of region n->m (resp. m->n) in the StageSend (resp. StageRecv) buffer of relay(n, m)
+  size_t* sendBase = (size_t*)malloc(nNodes*sizeof(size_t));
+  size_t* recvBase = (size_t*)malloc(nNodes*sizeof(size_t));
+  size_t* acc = (size_t*)calloc(2*ln, sizeof(size_t));
+  bool ok = sendBase && recvBase && acc;
+  for (int s=0; s<2; s++) {
+    st.last[s] = (int*)malloc(nRanks*sizeof(int));
+    st.lastRemoteBuffer[s] = (int*)malloc(nRanks*sizeof(int));
+    st.lastRemoteEnd[s] = (size_t*)malloc(nRanks*sizeof(size_t));
+    ok = ok && st.last[s] && st.lastRemoteBuffer[s] && st.lastRemoteEnd[s];
+  }
+  ncclResult_t ret = ok ? ncclSuccess : ncclSystemError;
+  if (!ok) goto exit;
+
+  plan->nOps = 0;
+  plan->nNetOps = 0;
+  plan->stageBytes[0] = plan->stageBytes[1] = 0;
+  for (int m=0; m<nNodes; m++) {
+    if (m == n) continue;
+    int q = topo->rankToLocalRank[ncclA2aHierRelay(topo, n, m)];
+    sendBase[m] = acc[2*q];
+    recvBase[m] = acc[2*q+1];
+    acc[2*q] += regionBytes(&st, n, m);
+    acc[2*q+1] += regionBytes(&st, m, n);
+  }
+  plan->stageBytes[0] = acc[2*li];
+  plan->stageBytes[1] = acc[2*li+1];
+
+  // Stage 0 : send blocks to local ranks, and to the relays of remote nodes
+  newStage(&st);
+  for (int j=0; j<ln; j++) {
+    int d = nodeRanks[j];
+    addOp(&st, 0, d, 1, ncclA2aHierSendBuff, sendDispls[d], pairBytes(&st, rank, d),
+        ncclA2aHierRecvBuff, uniform ? rank*bytes : A2AH_UNKNOWN);
+  }
+  for (int m=0; m<nNodes; m++) {
+    if (m == n) continue;
+    int q = ncclA2aHierRelay(topo, n, m), lm = topo->nodeLocalRanks[m];
+    size_t remote = uniform ? sendBase[m] + (size_t)li*lm*bytes : A2AH_UNKNOWN;
+    for (int j=0; j<lm; j++) {
+      int d = topo->localRankToRank[m][j];
+      size_t b = pairBytes(&st, rank, d);
+      addOp(&st, 0, q, 1, ncclA2aHierSendBuff, sendDispls[d], b, ncclA2aHierStageSend, remote);
+      if (uniform) remote += b;
+    }
+  }
+  for (int j=0; j<ln; j++) {
+    int s = nodeRanks[j];
+    addOp(&st, 0, s, 0, ncclA2aHierRecvBuff, recvDispls[s], pairBytes(&st, s, rank),
+        ncclA2aHierSendBuff, uniform ? rank*bytes : A2AH_UNKNOWN);
+  }
+  for (int m=0; m<nNodes; m++) {
+    if (m == n || ncclA2aHierRelay(topo, n, m) != rank) continue;
+    int lm = topo->nodeLocalRanks[m];
+    size_t offset = sendBase[m];
+    for (int i=0; i<ln; i++) {
+      for (int j=0; j<lm; j++) {
+        int s = nodeRanks[i], d = topo->localRankToRank[m][j];
+        size_t b = pairBytes(&st, s, d);
+        addOp(&st, 0, s, 0, ncclA2aHierStageSend, offset, b, ncclA2aHierSendBuff, uniform ? d*bytes : A2AH_UNKNOWN);
+        offset += b;
+      }
+    }
+  }
+
+  // Stage 1 : exchange node to node regions between relays
+  newStage(&st);
+  for (int m=0; m<nNodes; m++) {
+    if (m == n || ncclA2aHierRelay(topo, n, m) != rank) continue;
+    int peer = ncclA2aHierRelay(topo, m, n);
+    size_t b = regionBytes(&st, n, m);
+    if (b) plan->nNetOps++;
+    addOp(&st, 1, peer, 1, ncclA2aHierStageSend, sendBase[m], b, ncclA2aHierStageRecv, A2AH_UNKNOWN);
+    addOp(&st, 1, peer, 0, ncclA2aHierStageRecv, recvBase[m], regionBytes(&st, m, n), ncclA2aHierStageSend, A2AH_UNKNOWN);
+  }
+
+  // Stage 2 : scatter the regions received from remote nodes
+  newStage(&st);
+  for (int m=0; m<nNodes; m++) {
+    if (m == n || ncclA2aHierRelay(topo, n, m) != rank) continue;
+    int lm = topo->nodeLocalRanks[m];
+    size_t offset = recvBase[m];
+    for (int i=0; i<lm; i++) {
+      for (int j=0; j<ln; j++) {
+        int s = topo->localRankToRank[m][i], d = nodeRanks[j];
+        size_t b = pairBytes(&st, s, d);
+        addOp(&st, 2, d, 1, ncclA2aHierStageRecv, offset, b, ncclA2aHierRecvBuff, uniform ? s*bytes : A2AH_UNKNOWN);
+        offset += b;
+      }
+    }
+  }
+  for (int m=0; m<nNodes; m++) {
+    if (m == n) continue;
+    int q = ncclA2aHierRelay(topo, n, m), lm = topo->nodeLocalRanks[m];
+    for (int i=0; i<lm; i++) {
+      int s = topo->localRankToRank[m][i];
+      size_t remote = uniform ? recvBase[m] + ((size_t)i*ln+li)*bytes : A2AH_UNKNOWN;
+      addOp(&st, 2, q, 0, ncclA2aHierRecvBuff, recvDispls[s], pairBytes(&st, s, rank), ncclA2aHierStageRecv, remote);
+    }
+  }
+
+exit:
+  free(sendBase);
+  free(recvBase);
+  free(acc);
+  for (int s=0; s<2; s++) {
+    free(st.last[s]);
+    free(st.lastRemoteBuffer[s]);
+    free(st.lastRemoteEnd[s]);
+  }
+  return ret;
+}
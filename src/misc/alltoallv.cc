@@ -0,0 +1,171 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alltoallv.h"
+#include <stdlib.h>
+
+#define A2AV_ALIGN 64
+
+static inline bool isPow2(int n) { return n > 0 && (n & (n-1)) == 0; }
+
+static inline int phaseSendPeer(int nRanks, int rank, int phase) {
+  return isPow2(nRanks) ? rank ^ phase : (rank+phase)%nRanks;
+}
+
+void ncclA2avPhasePeers(struct ncclA2avConfig const* config, int phase, int* sendPeer, int* recvPeer) {
+  int n = config->nRanks, r = config->rank;
+  *sendPeer = phaseSendPeer(n, r, phase);
+  *recvPeer = isPow2(n) ? r ^ phase : (r-phase+n)%n;
+}
+
+static inline int maxChannels(struct ncclA2avConfig const* config) {
+  return config->maxChannelsPerPeer < config->nChannels ? config->maxChannelsPerPeer : config->nChannels;
+}
+
+// Number of channels a pair exchanging `bytes` is spread on
+static int pairChannels(struct ncclA2avConfig const* config, size_t bytes) {
+  if (bytes <= config->smallBytes) return 1;
+  size_t k = (bytes + config->chunkBytes - 1) / config->chunkBytes;
+  int maxK = maxChannels(config);
+  return k < (size_t)maxK ? (k ? (int)k : 1) : maxK;
+}
+
+static int leastLoaded(int nChannels, double const* loads, bool const* used) {
+  int best = -1;
+  for (int c=0; c<nChannels; c++) {
+    if (used && used[c]) continue;
+    if (best == -1 || loads[c] < loads[best]) best = c;
+  }
+  return best;
+}
+
+// Bin-pack phases onto channels, using the largest pair of each phase. Every
+// rank runs this on the same matrix and gets the same result.
+static ncclResult_t packPhases(struct ncclA2avConfig const* config, size_t const* matrix, int* phaseK, int* phaseChannels) {
+  int n = config->nRanks, nc = config->nChannels, maxK = maxChannels(config);
+  double* loads = (double*)calloc(nc, sizeof(double));
+  bool* used = (bool*)calloc(nc, sizeof(bool));
+  if (loads == NULL || used == NULL) {
+    free(loads);
+    free(used);
+    return ncclSystemError;
+  }
+  int smallChannel = -1, smallCount = 0;
+  for (int p=0; p<n; p++) {
+    size_t maxBytes = 0;
+    for (int s=0; s<n; s++) {
+      size_t bytes = matrix[(size_t)s*n+phaseSendPeer(n, s, p)];
+      if (bytes > maxBytes) maxBytes = bytes;
+    }
+    int* channels = phaseChannels+p*maxK;
+    if (maxBytes == 0) {
+      phaseK[p] = 0;
+    } else if (maxBytes <= config->smallBytes) {
+      if (smallChannel == -1 || smallCount == config->smallBatch) {
+        smallChannel = leastLoaded(nc, loads, NULL);
+        smallCount = 0;
+      }
+      phaseK[p] = 1;
+      channels[0] = smallChannel;
+      loads[smallChannel] += maxBytes;
+      smallCount++;
+    } else {
+      int k = pairChannels(config, maxBytes);
+      for (int j=0; j<k; j++) {
+        channels[j] = leastLoaded(nc, loads, used);
+        used[channels[j]] = true;
+      }
+      for (int j=0; j<k; j++) {
+        loads[channels[j]] += (double)maxBytes/k;
+        used[channels[j]] = false;
+      }
+      phaseK[p] = k;
+    }
+  }
+  free(loads);
+  free(used);
+  return ncclSuccess;
+}
+
+// Channels used by a pair exchanging `bytes` in phase p, when not bin-packing
+static void pairChannelsLocal(struct ncclA2avConfig const* config, int p, size_t bytes, int* k, int* channels) {
+  int nc = config->nChannels;
+  *k = pairChannels(config, bytes);
+  if (bytes <= config->smallBytes) {
+    channels[0] = (p / config->smallBatch) % nc;
+  } else {
+    int stride = nc / *k;
+    for (int j=0; j<*k; j++) channels[j] = (p + j*stride) % nc;
+  }
+}
+
+static void addOps(struct ncclA2avOp* ops, int* nOps, int peer, int isSend, int phase, size_t bytes, int k, int const* channels) {
+  size_t piece = (bytes + k - 1) / k;
+  piece = (piece + A2AV_ALIGN - 1) / A2AV_ALIGN * A2AV_ALIGN;
+  size_t offset = 0;
+  for (int j=0; j<k && offset < bytes; j++) {
+    struct ncclA2avOp* op = ops + (*nOps)++;
+    op->peer = peer;
+    op->isSend = isSend;
+    op->channel = channels[j];
+    op->phase = phase;
+    op->offset = offset;
+    op->bytes = bytes-offset < piece ? bytes-offset : piece;
+    offset += op->bytes;
+  }
+}
+
+ncclResult_t ncclA2avSchedule(struct ncclA2avConfig const* config, size_t const* sendBytes, size_t const* recvBytes,
+    size_t const* matrix, struct ncclA2avOp* ops, int* nOps) {
+  int n = config->nRanks, r = config->rank, maxK = maxChannels(config);
+  if (n <= 0 || r < 0 || r >= n || config->nChannels <= 0 || config->maxChannelsPerPeer <= 0 ||
+      config->maxChannelsPerPeer > NCCL_A2AV_MAX_CHANNELS_PER_PEER ||
+      config->chunkBytes == 0 || config->smallBatch <= 0) return ncclInvalidArgument;
+  if (sendBytes[r] != recvBytes[r]) return ncclInvalidUsage; // send to self without a matching recv
+  if (matrix) {
+    for (int p=0; p<n; p++) {
+      if (matrix[(size_t)r*n+p] != sendBytes[p] || matrix[(size_t)p*n+r] != recvBytes[p]) return ncclInvalidArgument;
+    }
+  }
+
+  int* phaseK = NULL;
+  int* phaseChannels = NULL;
+  if (matrix) {
+    phaseK = (int*)malloc(n*sizeof(int));
+    phaseChannels = (int*)malloc((size_t)n*maxK*sizeof(int));
+    ncclResult_t res = (phaseK && phaseChannels) ? packPhases(config, matrix, phaseK, phaseChannels) : ncclSystemError;
+    if (res != ncclSuccess) {
+      free(phaseK);
+      free(phaseChannels);
+      return res;
+    }
+  }
+
+  *nOps = 0;
+  for (int p=0; p<n; p++) {
+    int sendPeer, recvPeer;
+    ncclA2avPhasePeers(config, p, &sendPeer, &recvPeer);
+    int peers[2] = { recvPeer, sendPeer };
+    size_t bytes[2] = { recvBytes[recvPeer], sendBytes[sendPeer] };
+    for (int isSend=0; isSend<2; isSend++) {
+      if (bytes[isSend] == 0) continue;
+      int k, localChannels[NCCL_A2AV_MAX_CHANNELS_PER_PEER];
+      int const* channels;
+      if (matrix) {
+        k = pairChannels(config, bytes[isSend]);
+        if (k > phaseK[p]) k = phaseK[p];
+        channels = phaseChannels+p*maxK;
+      } else {
+        pairChannelsLocal(config, p, bytes[isSend], &k, localChannels);
+        channels = localChannels;
+      }
+      addOps(ops, nOps, peers[isSend], isSend, p, bytes[isSend], k, channels);
+    }
+  }
+  free(phaseK);
+  free(phaseChannels);
+  return ncclSuccess;
+}
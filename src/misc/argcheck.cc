@@ -8,7 +8,7 @@
 #include "argcheck.h"
 #include "comm.h"
 
-static ncclResult_t CudaPtrCheck(const void* pointer, struct ncclComm* comm, const char* ptrname, const char* opname) {
+ncclResult_t CudaPtrCheck(const void* pointer, struct ncclComm* comm, const char* ptrname, const char* opname) {
   hipPointerAttribute_t attr;
   hipError_t err = hipPointerGetAttributes(&attr, pointer);
   if (err != hipSuccess || attr.devicePointer == NULL) {
@@ -0,0 +1,169 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "cpucopy.h"
+#include "debug.h"
+#include <algorithm>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+struct ncclCpuCopyTask {
+  char* dst;
+  const char* src;
+  size_t size;
+  uint32_t* pending;
+};
+
+struct ncclCpuCopyPool {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct ncclCpuCopyTask* tasks; // ring of maxTasks
+  int maxTasks, head, count;
+  int stop;
+  size_t chunkSize;
+  int nonTemporal;
+  cpu_set_t affinity;
+  int nThreads;
+  pthread_t* threads;
+};
+
+void ncclCpuCopyNt(void* dst, const void* src, size_t size) {
+#if defined(__x86_64__)
+  char* d = (char*)dst;
+  const char* s = (const char*)src;
+  // Streaming stores need an aligned destination
+  size_t head = (-(uintptr_t)d) & 15;
+  if (head > size) head = size;
+  memcpy(d, s, head);
+  d += head; s += head; size -= head;
+  for (; size >= 64; d += 64, s += 64, size -= 64) {
+    __m128i v0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(s+16));
+    __m128i v2 = _mm_loadu_si128((const __m128i*)(s+32));
+    __m128i v3 = _mm_loadu_si128((const __m128i*)(s+48));
+    _mm_stream_si128((__m128i*)d, v0);
+    _mm_stream_si128((__m128i*)(d+16), v1);
+    _mm_stream_si128((__m128i*)(d+32), v2);
+    _mm_stream_si128((__m128i*)(d+48), v3);
+  }
+  for (; size >= 16; d += 16, s += 16, size -= 16) {
+    _mm_stream_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+  }
+  memcpy(d, s, size);
+  _mm_sfence();
+#else
+  memcpy(dst, src, size);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+static void* cpuCopyThreadMain(void* arg) {
+  struct ncclCpuCopyPool* pool = (struct ncclCpuCopyPool*)arg;
+  if (CPU_COUNT(&pool->affinity)) sched_setaffinity(0, sizeof(cpu_set_t), &pool->affinity);
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    while (pool->count == 0 && !pool->stop) pthread_cond_wait(&pool->cond, &pool->mutex);
+    if (pool->count == 0) break;
+    struct ncclCpuCopyTask task = pool->tasks[pool->head];
+    pool->head = (pool->head+1) % pool->maxTasks;
+    pool->count--;
+    pthread_mutex_unlock(&pool->mutex);
+    if (pool->nonTemporal) ncclCpuCopyNt(task.dst, task.src, task.size);
+    else memcpy(task.dst, task.src, task.size);
+    __atomic_fetch_sub(task.pending, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+ncclResult_t ncclCpuCopyPoolCreate(struct ncclCpuCopyPool** poolPtr, int nThreads, size_t chunkSize, int nonTemporal, cpu_set_t* affinity) {
+  struct ncclCpuCopyPool* pool = (struct ncclCpuCopyPool*)calloc(1, sizeof(struct ncclCpuCopyPool));
+  if (pool == NULL) {
+    WARN("Failed to allocate CPU copy pool");
+    return ncclSystemError;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+  pool->chunkSize = chunkSize ? chunkSize : 1;
+  pool->nonTemporal = nonTemporal;
+  if (affinity) memcpy(&pool->affinity, affinity, sizeof(cpu_set_t));
+  else CPU_ZERO(&pool->affinity);
+  pool->maxTasks = 64;
+  pool->tasks = (struct ncclCpuCopyTask*)malloc(pool->maxTasks*sizeof(struct ncclCpuCopyTask));
+  pool->threads = (pthread_t*)calloc(nThreads, sizeof(pthread_t));
+  if (pool->tasks == NULL || pool->threads == NULL) {
+    WARN("Failed to allocate CPU copy pool");
+    ncclCpuCopyPoolDestroy(pool);
+    return ncclSystemError;
+  }
+  for (int t=0; t<nThreads; t++) {
+    int err = pthread_create(pool->threads+t, NULL, cpuCopyThreadMain, pool);
+    if (err != 0) {
+      WARN("Failed to create CPU copy thread : %s", strerror(err));
+      ncclCpuCopyPoolDestroy(pool);
+      return ncclSystemError;
+    }
+    ncclSetThreadName(pool->threads[t], "NCCL CpuCopy%2d", t);
+    pool->nThreads++;
+  }
+  *poolPtr = pool;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCpuCopyPoolSubmit(struct ncclCpuCopyPool* pool, void* dst, const void* src, size_t size, uint32_t* pending) {
+  int nChunks = size ? (size+pool->chunkSize-1)/pool->chunkSize : 0;
+  if (nChunks == 0) return ncclSuccess;
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->count + nChunks > pool->maxTasks) {
+    int maxTasks = pool->maxTasks*2;
+    while (pool->count + nChunks > maxTasks) maxTasks *= 2;
+    struct ncclCpuCopyTask* tasks = (struct ncclCpuCopyTask*)malloc(maxTasks*sizeof(struct ncclCpuCopyTask));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&pool->mutex);
+      WARN("Failed to grow CPU copy queue to %d tasks", maxTasks);
+      return ncclSystemError;
+    }
+    for (int i=0; i<pool->count; i++) tasks[i] = pool->tasks[(pool->head+i) % pool->maxTasks];
+    free(pool->tasks);
+    pool->tasks = tasks;
+    pool->maxTasks = maxTasks;
+    pool->head = 0;
+  }
+  __atomic_fetch_add(pending, nChunks, __ATOMIC_RELAXED);
+  for (int c=0; c<nChunks; c++) {
+    size_t offset = c*pool->chunkSize;
+    struct ncclCpuCopyTask* task = pool->tasks+(pool->head+pool->count) % pool->maxTasks;
+    task->dst = (char*)dst+offset;
+    task->src = (const char*)src+offset;
+    task->size = std::min(pool->chunkSize, size-offset);
+    task->pending = pending;
+    pool->count++;
+  }
+  if (nChunks == 1) pthread_cond_signal(&pool->cond);
+  else pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCpuCopyPoolDestroy(struct ncclCpuCopyPool* pool) {
+  // Pending copies are completed first
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int t=0; t<pool->nThreads; t++) pthread_join(pool->threads[t], NULL);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->cond);
+  free(pool->threads);
+  free(pool->tasks);
+  free(pool);
+  return ncclSuccess;
+}
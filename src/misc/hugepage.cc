@@ -0,0 +1,127 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "hugepage.h"
+#include "checks.h"
+#include "debug.h"
+#include "param.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+RCCL_PARAM(HugePages, "HUGEPAGES", 0);
+RCCL_PARAM(HugePagesSize, "HUGEPAGES_SIZE", 2<<20);
+RCCL_PARAM(HugePagesMinSize, "HUGEPAGES_MIN_SIZE", 2<<20);
+
+static inline size_t roundUp(size_t size, size_t align) { return (size+align-1) / align * align; }
+
+int ncclHugePagesMode(size_t size) {
+  int64_t mode = rcclParamHugePages();
+  if (mode <= 0 || size < (size_t)rcclParamHugePagesMinSize()) return NCCL_HUGEPAGES_NONE;
+  return mode >= NCCL_HUGEPAGES_EXPLICIT ? NCCL_HUGEPAGES_EXPLICIT : NCCL_HUGEPAGES_TRANSPARENT;
+}
+
+size_t ncclHugePageSize() {
+  // Only the sizes of x86-64
+  return rcclParamHugePagesSize() == (1LL<<30) ? 1UL<<30 : 2UL<<20;
+}
+
+const char* ncclHugePagesDir() {
+  const char* dir = getenv("RCCL_HUGEPAGES_DIR");
+  return dir && dir[0] ? dir : "/dev/hugepages";
+}
+
+ncclResult_t ncclHugePagesAlloc(void** ptr, size_t size, int mode, size_t* mapSize) {
+  void* p = MAP_FAILED;
+  if (mode == NCCL_HUGEPAGES_EXPLICIT) {
+    size_t pageSize = ncclHugePageSize();
+    *mapSize = roundUp(size, pageSize);
+    p = mmap(NULL, *mapSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(__builtin_ctzl(pageSize) << MAP_HUGE_SHIFT), -1, 0);
+    if (p == MAP_FAILED) {
+      INFO(NCCL_ALLOC, "Huge pages : no %ld kB pages for %ld bytes (%s), using transparent huge pages", pageSize>>10, size, strerror(errno));
+      mode = NCCL_HUGEPAGES_TRANSPARENT;
+    }
+  }
+  if (mode == NCCL_HUGEPAGES_TRANSPARENT) {
+    // Over-allocate and trim, so that the mapping is aligned on huge pages
+    *mapSize = roundUp(size, NCCL_HUGEPAGES_THP_SIZE);
+    char* base = (char*)mmap(NULL, *mapSize+NCCL_HUGEPAGES_THP_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED) {
+      char* aligned = (char*)roundUp((uintptr_t)base, NCCL_HUGEPAGES_THP_SIZE);
+      if (aligned > base) munmap(base, aligned-base);
+      munmap(aligned+*mapSize, base+NCCL_HUGEPAGES_THP_SIZE-aligned);
+      ncclHugePagesAdvise(aligned, *mapSize);
+      p = aligned;
+    }
+  } else if (mode == NCCL_HUGEPAGES_NONE) {
+    *mapSize = roundUp(size, sysconf(_SC_PAGESIZE));
+    p = mmap(NULL, *mapSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    WARN("Huge pages : failed to map %ld bytes : %s", size, strerror(errno));
+    *ptr = NULL;
+    return ncclSystemError;
+  }
+  *ptr = p;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclHugePagesFree(void* ptr, size_t mapSize) {
+  if (ptr == NULL) return ncclSuccess;
+  SYSCHECK(munmap(ptr, mapSize), "munmap");
+  return ncclSuccess;
+}
+
+void ncclHugePagesAdvise(void* ptr, size_t size) {
+  uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (uintptr_t)ptr & ~(pageSize-1);
+  // Fails when transparent huge pages are disabled, which the report shows
+  (void)madvise((void*)begin, (uintptr_t)ptr+size-begin, MADV_HUGEPAGE);
+}
+
+ncclResult_t ncclHugePagesUsed(const void* ptr, size_t size, size_t* hugeBytes, size_t* pageSize) {
+  *hugeBytes = *pageSize = 0;
+  FILE* file = fopen("/proc/self/smaps", "r");
+  if (file == NULL) return ncclSystemError;
+  uintptr_t begin = (uintptr_t)ptr, end = begin+size;
+  char line[512];
+  bool inRange = false;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long start, stop, value;
+    char name[64];
+    // A mapping starts with its address range, followed by its fields
+    if (sscanf(line, "%lx-%lx ", &start, &stop) == 2) {
+      inRange = start < end && stop > begin;
+      continue;
+    }
+    if (!inRange || sscanf(line, "%63[^:]: %lu kB", name, &value) != 2) continue;
+    if (strcmp(name, "KernelPageSize") == 0) {
+      *pageSize = std::max(*pageSize, (size_t)value<<10);
+    } else if (strcmp(name, "AnonHugePages") == 0 || strcmp(name, "ShmemPmdMapped") == 0 || strcmp(name, "FilePmdMapped") == 0 ||
+        strcmp(name, "Shared_Hugetlb") == 0 || strcmp(name, "Private_Hugetlb") == 0) {
+      *hugeBytes += value<<10;
+    }
+  }
+  fclose(file);
+  return ncclSuccess;
+}
+
+void ncclHugePagesReport(const void* ptr, size_t size, const char* what) {
+  // Parsing smaps is too slow to do for every segment when nobody reads it
+  if (ncclDebugLevel < NCCL_LOG_INFO || (ncclDebugMask & NCCL_ALLOC) == 0) return;
+  size_t hugeBytes, pageSize;
+  if (ncclHugePagesUsed(ptr, size, &hugeBytes, &pageSize) != ncclSuccess) return;
+  INFO(NCCL_ALLOC, "%s %p size %ld : %ld kB on huge pages, page size %ld kB", what, ptr, size, hugeBytes>>10, pageSize>>10);
+}
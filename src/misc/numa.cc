@@ -0,0 +1,115 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "numa.h"
+#include "debug.h"
+#include "param.h"
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From <numaif.h>, which is only installed with libnuma
+#define NUMA_MPOL_DEFAULT   0
+#define NUMA_MPOL_PREFERRED 1
+#define NUMA_MPOL_BIND      2
+#define NUMA_MPOL_F_NODE    (1<<0)
+#define NUMA_MPOL_F_ADDR    (1<<1)
+#define NUMA_MAX_NODES      1024
+
+RCCL_PARAM(NumaPolicy, "NUMA_POLICY", 1);
+
+__thread int ncclNumaThreadNode = -1;
+
+static int numaMode = NUMA_MPOL_DEFAULT; // policy applied, NUMA_MPOL_DEFAULT when disabled
+static int numaNodes = 0;                // highest online node + 1
+static pthread_once_t numaOnce = PTHREAD_ONCE_INIT;
+
+static void numaDisable(const char* call) {
+  INFO(NCCL_INIT|NCCL_ALLOC, "NUMA : %s failed : %s, host memory left to first touch placement", call, strerror(errno));
+  __atomic_store_n(&numaMode, NUMA_MPOL_DEFAULT, __ATOMIC_RELAXED);
+}
+
+static void numaInitOnce() {
+  int64_t policy = rcclParamNumaPolicy();
+  if (policy != 1 && policy != 2) return;
+  // List of online nodes, such as "0-1" or "0,2-3"
+  FILE* file = fopen("/sys/devices/system/node/online", "r");
+  if (file == NULL) return;
+  int first, last, count = 0;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-' && fscanf(file, "%d", &last) == 1) c = fgetc(file);
+    count += last-first+1;
+    numaNodes = std::max(numaNodes, last+1);
+    if (c != ',') break;
+  }
+  fclose(file);
+  if (count <= 1 || numaNodes > NUMA_MAX_NODES) return;
+  // Leave placement to the user when the process runs under numactl or similar
+  int mode;
+  if (syscall(SYS_get_mempolicy, &mode, NULL, 0, NULL, 0) != 0) {
+    numaDisable("get_mempolicy");
+    return;
+  }
+  if (mode != NUMA_MPOL_DEFAULT) {
+    INFO(NCCL_INIT|NCCL_ALLOC, "NUMA : process has a memory policy (mode %d), keeping it", mode);
+    return;
+  }
+  numaMode = policy == 2 ? NUMA_MPOL_BIND : NUMA_MPOL_PREFERRED;
+  INFO(NCCL_INIT|NCCL_ALLOC, "NUMA : %d nodes, host buffers %s the node of their GPU or NIC", count,
+      numaMode == NUMA_MPOL_BIND ? "bound to" : "preferably on");
+}
+
+int ncclNumaUsableNode(int node) {
+  pthread_once(&numaOnce, numaInitOnce);
+  if (__atomic_load_n(&numaMode, __ATOMIC_RELAXED) == NUMA_MPOL_DEFAULT) return -1;
+  return node >= 0 && node < numaNodes ? node : -1;
+}
+
+static void numaMask(int node, unsigned long* mask) {
+  memset(mask, 0, NUMA_MAX_NODES/8);
+  mask[node/(8*sizeof(unsigned long))] = 1UL << (node%(8*sizeof(unsigned long)));
+}
+
+ncclResult_t ncclNumaBind(void* ptr, size_t size, int node) {
+  if (ncclNumaUsableNode(node) < 0 || size == 0) return ncclSuccess;
+  unsigned long mask[NUMA_MAX_NODES/(8*sizeof(unsigned long))];
+  numaMask(node, mask);
+  uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (uintptr_t)ptr & ~(pageSize-1);
+  uintptr_t end = ((uintptr_t)ptr+size+pageSize-1) & ~(pageSize-1);
+  if (syscall(SYS_mbind, begin, end-begin, numaMode, mask, NUMA_MAX_NODES+1, 0) != 0) numaDisable("mbind");
+  return ncclSuccess;
+}
+
+ncclResult_t ncclNumaThreadPolicySet(int node, int* set) {
+  *set = 0;
+  if (ncclNumaUsableNode(node) < 0) return ncclSuccess;
+  unsigned long mask[NUMA_MAX_NODES/(8*sizeof(unsigned long))];
+  numaMask(node, mask);
+  if (syscall(SYS_set_mempolicy, numaMode, mask, NUMA_MAX_NODES+1) != 0) {
+    numaDisable("set_mempolicy");
+    return ncclSuccess;
+  }
+  *set = 1;
+  return ncclSuccess;
+}
+
+void ncclNumaThreadPolicyReset() {
+  syscall(SYS_set_mempolicy, NUMA_MPOL_DEFAULT, NULL, 0);
+}
+
+int ncclNumaNodeOf(const void* ptr) {
+  int node;
+  if (syscall(SYS_get_mempolicy, &node, NULL, 0, ptr, NUMA_MPOL_F_NODE|NUMA_MPOL_F_ADDR) != 0) return -1;
+  return node;
+}
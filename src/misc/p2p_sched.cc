@@ -0,0 +1,60 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "p2p_sched.h"
+
+static inline ssize_t divUpSize(ssize_t x, ssize_t y) { return (x+y-1)/y; }
+static inline ssize_t alignUpSize(ssize_t x, ssize_t a) { return divUpSize(x, a)*a; }
+
+void ncclP2pSchedInit(struct ncclP2pSchedConfig* config, int nRanks, int nNodes, int p2pnChannels,
+    int p2pnChannelsPerPeer, ssize_t stepSize, int balance) {
+  // Try to use all channels
+  int nChannelsMax = p2pnChannelsPerPeer;
+  int nChannelsMin = nChannelsMax;
+  // Try to use all channels, but one channel per operation.
+  while (nChannelsMin*nRanks > p2pnChannels && nChannelsMin > 1) nChannelsMin /= 2;
+  // Avoid overloading channels with 8+ operations as we loose the sync warp, hence a bit of bandwidth.
+  while (nChannelsMax*nRanks > p2pnChannels*4 && nChannelsMax > 1) nChannelsMax /= 2;
+  config->nChannelsMin = nChannelsMin;
+  config->nChannelsMax = nChannelsMax;
+  config->channelsPerPeer = p2pnChannelsPerPeer;
+  config->minSize = stepSize/8;
+  config->maxSize = nNodes > 1 ? stepSize : stepSize*32;
+  // Chunks of targetSize spread mid-size operations on more channels than the
+  // legacy split. Going beyond nChannelsMax adds work elements to channels
+  // shared by many peers, so it is only worth it for chunks over spreadSize.
+  config->targetSize = config->maxSize/4;
+  config->spreadSize = config->maxSize*16;
+  config->balance = balance;
+}
+
+static ssize_t legacyChunkSize(struct ncclP2pSchedConfig const* config, ssize_t bytes) {
+  ssize_t size = divUpSize(bytes, config->nChannelsMin);
+  if (size < config->minSize) size = config->minSize;
+  int nChannels = config->nChannelsMin;
+  while (size > config->maxSize && nChannels <= config->nChannelsMax/2) {
+    nChannels *= 2;
+    size = divUpSize(bytes, nChannels);
+  }
+  return alignUpSize(size, config->minSize);
+}
+
+ssize_t ncclP2pChunkSize(struct ncclP2pSchedConfig const* config, ssize_t bytes) {
+  if (!config->balance) return legacyChunkSize(config, bytes);
+  if (bytes <= config->minSize) return config->minSize;
+  // One channel per targetSize bytes, between nChannelsMin and nChannelsMax.
+  ssize_t nChunks = divUpSize(bytes, config->targetSize);
+  if (nChunks < config->nChannelsMin) nChunks = config->nChannelsMin;
+  if (nChunks > config->nChannelsMax) nChunks = config->nChannelsMax;
+  // Beyond nChannelsMax, one more channel per spreadSize bytes, up to all the
+  // channels connected to the peer.
+  ssize_t nSpread = divUpSize(bytes, config->spreadSize);
+  if (nChunks < nSpread) nChunks = nSpread;
+  if (nChunks > config->channelsPerPeer) nChunks = config->channelsPerPeer;
+  // No chunk under minSize
+  if (nChunks > bytes/config->minSize) nChunks = bytes/config->minSize;
+  return alignUpSize(divUpSize(bytes, nChunks), NCCL_P2P_SCHED_ALIGN);
+}
@@ -0,0 +1,225 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "recorder.h"
+#include "comm.h"
+#include "info.h"
+#include "utils.h"
+#include <map>
+#include <utility>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static_assert(rcclRecordAllToAllPivot == (int)ncclFuncAllToAllPivot, "rcclRecordFunc must follow ncclFunc_t");
+
+int rcclRecordOn = -1;
+
+#define RECORD_BUFFER_SIZE (1<<20)
+
+static pthread_mutex_t recordLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* recordFile = NULL;
+static char* recordBuffer = NULL;
+static size_t recordBytes = 0;
+static uint64_t recordStart = 0;
+static int recordNextComm = 0;
+static int recordNextThread = 0;
+static std::map<std::pair<int, hipStream_t>, int>* recordStreams = NULL;
+static std::map<int, int>* recordNextStream = NULL;
+static __thread int recordThread = -1;
+
+static void recordFlushLocked() {
+  if (recordFile == NULL || recordBytes == 0) return;
+  if (fwrite(recordBuffer, 1, recordBytes, recordFile) != recordBytes) {
+    WARN("Recorder : failed to write to RCCL_RECORD_FILE, recording stopped");
+    fclose(recordFile);
+    recordFile = NULL;
+    __atomic_store_n(&rcclRecordOn, 0, __ATOMIC_RELEASE);
+  }
+  recordBytes = 0;
+}
+
+static void recordAtExit() {
+  pthread_mutex_lock(&recordLock);
+  recordFlushLocked();
+  if (recordFile) fclose(recordFile);
+  recordFile = NULL;
+  pthread_mutex_unlock(&recordLock);
+}
+
+static void recordInitOnce() {
+  const char* env = getenv("RCCL_RECORD_FILE");
+  int on = 0;
+  if (env && env[0] != '\0') {
+    char hostname[1024];
+    getHostName(hostname, 1024, '.');
+    // Same expansion as NCCL_DEBUG_FILE
+    char fn[PATH_MAX+1] = "";
+    char* p = fn;
+    char* end = fn+PATH_MAX;
+    for (int c=0; env[c] != '\0' && p < end; c++) {
+      if (env[c] != '%' || env[c+1] == '\0') { *p++ = env[c]; continue; }
+      c++;
+      if (env[c] == 'h') p += snprintf(p, end-p, "%s", hostname);
+      else if (env[c] == 'p') p += snprintf(p, end-p, "%d", getpid());
+      else if (env[c] == '%') *p++ = '%';
+      else { *p++ = '%'; if (p < end) *p++ = env[c]; }
+      if (p > end) p = end;
+    }
+    *p = '\0';
+    recordFile = fopen(fn, "w");
+    recordBuffer = (char*)malloc(RECORD_BUFFER_SIZE);
+    if (recordFile == NULL || recordBuffer == NULL) {
+      WARN("Recorder : could not open RCCL_RECORD_FILE %s : %s", fn, strerror(errno));
+      if (recordFile) fclose(recordFile);
+      recordFile = NULL;
+    } else {
+      struct rcclRecordHeader header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, RCCL_RECORD_MAGIC, sizeof(RCCL_RECORD_MAGIC));
+      header.version = RCCL_RECORD_VERSION;
+      header.recordSize = sizeof(struct rcclRecord);
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      recordStart = clockNano();
+      header.startTime = uint64_t(ts.tv_sec)*1000*1000*1000 + ts.tv_nsec;
+      memcpy(recordBuffer, &header, sizeof(header));
+      recordBytes = sizeof(header);
+      recordStreams = new std::map<std::pair<int, hipStream_t>, int>;
+      recordNextStream = new std::map<int, int>;
+      atexit(recordAtExit);
+      INFO(NCCL_INIT, "Recording API calls to %s", fn);
+      on = 1;
+    }
+  }
+  __atomic_store_n(&rcclRecordOn, on, __ATOMIC_RELEASE);
+}
+
+void rcclRecordInit() {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, recordInitOnce);
+}
+
+// Must be called with recordLock held
+static void recordAppend(const void* data, size_t bytes) {
+  while (bytes && recordFile) {
+    if (recordBytes == RECORD_BUFFER_SIZE) recordFlushLocked();
+    size_t n = std::min(bytes, (size_t)RECORD_BUFFER_SIZE-recordBytes);
+    memcpy(recordBuffer+recordBytes, data, n);
+    recordBytes += n;
+    data = (const char*)data+n;
+    bytes -= n;
+  }
+}
+
+static void recordInit(struct rcclRecord* rec, int type) {
+  memset(rec, 0, sizeof(*rec));
+  rec->type = type;
+  if (recordThread == -1) recordThread = __atomic_fetch_add(&recordNextThread, 1, __ATOMIC_RELAXED);
+  rec->thread = recordThread > 255 ? 255 : recordThread;
+  rec->time = clockNano()-recordStart;
+}
+
+// Must be called with recordLock held. Returns the id of the communicator,
+// recording it on first use.
+static int recordComm(struct ncclComm* comm, uint64_t time) {
+  if (comm->recordId == 0) {
+    if (recordNextComm == UINT16_MAX) return UINT16_MAX;
+    comm->recordId = ++recordNextComm;
+    struct rcclRecord rec;
+    recordInit(&rec, rcclRecordComm);
+    rec.comm = comm->recordId-1;
+    rec.root = comm->rank;
+    rec.stream = comm->nRanks;
+    rec.count = comm->commHash;
+    rec.time = time;
+    recordAppend(&rec, sizeof(rec));
+  }
+  return comm->recordId-1;
+}
+
+// Must be called with recordLock held
+static int recordStream(int comm, hipStream_t stream) {
+  auto it = recordStreams->find(std::make_pair(comm, stream));
+  if (it != recordStreams->end()) return it->second;
+  int id = (*recordNextStream)[comm]++;
+  recordStreams->emplace(std::make_pair(comm, stream), id);
+  return id;
+}
+
+static void recordCall(struct rcclRecord* rec, struct ncclInfo* info, const uint64_t* payload) {
+  pthread_mutex_lock(&recordLock);
+  rec->comm = recordComm(info->comm, rec->time);
+  rec->stream = recordStream(rec->comm, info->stream);
+  recordAppend(rec, sizeof(*rec));
+  if (payload) recordAppend(payload, rec->count*sizeof(uint64_t));
+  pthread_mutex_unlock(&recordLock);
+}
+
+void rcclRecordGroup(int start) {
+  struct rcclRecord rec;
+  recordInit(&rec, start ? rcclRecordGroupStart : rcclRecordGroupEnd);
+  pthread_mutex_lock(&recordLock);
+  recordAppend(&rec, sizeof(rec));
+  pthread_mutex_unlock(&recordLock);
+}
+
+void rcclRecordColl(struct ncclInfo* info) {
+  struct rcclRecord rec;
+  recordInit(&rec, rcclRecordCall);
+  rec.func = info->coll;
+  rec.datatype = info->datatype;
+  rec.op = info->op < ncclNumOps ? info->op : RCCL_RECORD_USER_OP;
+  rec.root = info->root;
+  rec.count = info->count;
+  // Counts are per rank for AllGather and ReduceScatter, and already in bytes for AllGather
+  size_t rankBytes = info->count*ncclTypeSize(info->datatype)*info->comm->rank;
+  const char* sendbuff = (const char*)info->sendbuff;
+  const char* recvbuff = (const char*)info->recvbuff;
+  if (info->coll == ncclFuncAllGather ? sendbuff == recvbuff+rankBytes :
+      info->coll == ncclFuncReduceScatter ? recvbuff == sendbuff+rankBytes :
+      sendbuff == recvbuff) rec.flags |= RCCL_RECORD_FLAG_INPLACE;
+  recordCall(&rec, info, NULL);
+}
+
+void rcclRecordAllToAllvCounts(struct ncclInfo* info, const size_t* sendcounts, const size_t* recvcounts, const size_t* countMatrix) {
+  int nRanks = info->comm->nRanks;
+  struct rcclRecord rec;
+  recordInit(&rec, rcclRecordCall);
+  rec.func = rcclRecordAllToAllv;
+  rec.datatype = info->datatype;
+  rec.count = 2*(uint64_t)nRanks;
+  if (countMatrix) {
+    rec.flags |= RCCL_RECORD_FLAG_MATRIX;
+    rec.count += (uint64_t)nRanks*nRanks;
+  }
+  if (info->sendbuff == info->recvbuff) rec.flags |= RCCL_RECORD_FLAG_INPLACE;
+  uint64_t* payload = (uint64_t*)malloc(rec.count*sizeof(uint64_t));
+  if (payload == NULL) {
+    WARN("Recorder : failed to allocate %lu bytes, AllToAllv not recorded", rec.count*sizeof(uint64_t));
+    return;
+  }
+  for (int r=0; r<nRanks; r++) {
+    payload[r] = sendcounts[r];
+    payload[nRanks+r] = recvcounts[r];
+  }
+  if (countMatrix) {
+    for (size_t i=0; i<(size_t)nRanks*nRanks; i++) payload[2*nRanks+i] = countMatrix[i];
+  }
+  recordCall(&rec, info, payload);
+  free(payload);
+}
+
+void rcclRecordFlush() {
+  if (__atomic_load_n(&rcclRecordOn, __ATOMIC_ACQUIRE) != 1) return;
+  pthread_mutex_lock(&recordLock);
+  recordFlushLocked();
+  if (recordFile) fflush(recordFile);
+  pthread_mutex_unlock(&recordLock);
+}
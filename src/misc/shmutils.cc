@@ -6,9 +6,15 @@
 
 #include "shm.h"
 #include "checks.h"
+#include "numa.h"
+#include "hugepage.h"
+#include <map>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
+#include <limits.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
@@ -26,38 +32,110 @@ static int shm_map(int fd, const int shmSize, void** ptr) {
   return (*ptr == MAP_FAILED) ? -1 : 0;
 }
 
-static ncclResult_t ncclShmSetup(char* shmPath, const int shmSize, int* fd, void** ptr, int create) {
-  if (create) {
-    if (shmPath[0] == '\0') {
-      sprintf(shmPath, "/dev/shm/nccl-XXXXXX");
-      *fd = mkstemp(shmPath);
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+
+// Segments on hugetlbfs are mapped and must be unmapped in whole huge pages
+static pthread_mutex_t shmHugeLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<void*, size_t> shmHugeMaps;
+
+// Size of the mapping of a segment, in whole pages of hugetlbfs. 0 for other file systems.
+static size_t shmHugeMapSize(int fd, const int shmSize) {
+  struct statfs fs;
+  if (fstatfs(fd, &fs) != 0 || fs.f_type != HUGETLBFS_MAGIC) return 0;
+  return (shmSize+fs.f_bsize-1) / fs.f_bsize * fs.f_bsize;
+}
+
+static int shmUnmap(void* ptr, const int shmSize) {
+  size_t mapSize = shmSize;
+  pthread_mutex_lock(&shmHugeLock);
+  auto it = shmHugeMaps.find(ptr);
+  if (it != shmHugeMaps.end()) {
+    mapSize = it->second;
+    shmHugeMaps.erase(it);
+  }
+  pthread_mutex_unlock(&shmHugeLock);
+  return munmap(ptr, mapSize);
+}
+
+// Create the segment as a tmp file on the hugetlbfs mount. On failure, for
+// instance when no huge page is left, *ptr is MAP_FAILED and shmPath empty.
+static void shmCreateHuge(char* shmPath, const int shmSize, void** ptr, size_t* mapSize) {
+  snprintf(shmPath, PATH_MAX, "%s/nccl-XXXXXX", ncclHugePagesDir());
+  int fd = mkstemp(shmPath);
+  const char* error = NULL;
+  *ptr = MAP_FAILED;
+  if (fd == -1) {
+    error = strerror(errno);
+  } else if ((*mapSize = shmHugeMapSize(fd, shmSize)) == 0) {
+    error = "not a hugetlbfs mount";
+  } else if (ftruncate(fd, *mapSize) != 0 || (*ptr = mmap(NULL, *mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    error = strerror(errno);
+  }
+  if (fd != -1) close(fd);
+  if (error) {
+    INFO(NCCL_ALLOC, "Huge pages : cannot create %s (%s), using regular shared memory", shmPath, error);
+    if (fd != -1) unlink(shmPath);
+    shmPath[0] = '\0';
+    *ptr = MAP_FAILED;
+  }
+}
+
+static ncclResult_t ncclShmSetup(char* shmPath, const int shmSize, int* fd, void** ptr, int create, int hugePages) {
+  int hugeMode = hugePages ? ncclHugePagesMode(shmSize) : NCCL_HUGEPAGES_NONE;
+  size_t mapSize = shmSize;
+  *ptr = MAP_FAILED;
+  if (create && shmPath[0] == '\0' && hugeMode == NCCL_HUGEPAGES_EXPLICIT) shmCreateHuge(shmPath, shmSize, ptr, &mapSize);
+  if (*ptr == MAP_FAILED) {
+    mapSize = shmSize;
+    if (create) {
+      if (shmPath[0] == '\0') {
+        sprintf(shmPath, "/dev/shm/nccl-XXXXXX");
+        *fd = mkstemp(shmPath);
+      } else {
+        SYSCHECKVAL(open(shmPath, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR), "open", *fd);
+      }
+      if (ftruncate(*fd, shmSize) != 0) {
+        WARN("Error: failed to extend %s to %d bytes", shmPath, shmSize);
+        return ncclSystemError;
+      }
     } else {
-      SYSCHECKVAL(open(shmPath, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR), "open", *fd);
+      SYSCHECKVAL(open(shmPath, O_RDWR, S_IRUSR | S_IWUSR), "open", *fd);
+      // Created by a peer on hugetlbfs
+      size_t hugeMapSize = shmHugeMapSize(*fd, shmSize);
+      if (hugeMapSize) mapSize = hugeMapSize;
     }
-    if (ftruncate(*fd, shmSize) != 0) {
-      WARN("Error: failed to extend %s to %d bytes", shmPath, shmSize);
+    *ptr = (char*)mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (*ptr == MAP_FAILED) {
+      WARN("Could not map %s\n", shmPath);
       return ncclSystemError;
     }
-  } else {
-    SYSCHECKVAL(open(shmPath, O_RDWR, S_IRUSR | S_IWUSR), "open", *fd);
+    close(*fd);
+    *fd = -1;
+    if (create && hugeMode != NCCL_HUGEPAGES_NONE) ncclHugePagesAdvise(*ptr, shmSize);
   }
-  *ptr = (char*)mmap(NULL, shmSize, PROT_READ|PROT_WRITE, MAP_SHARED, *fd, 0);
-  if (*ptr == NULL) {
-    WARN("Could not map %s\n", shmPath);
-    return ncclSystemError;
+  if (mapSize != (size_t)shmSize) {
+    pthread_mutex_lock(&shmHugeLock);
+    shmHugeMaps[*ptr] = mapSize;
+    pthread_mutex_unlock(&shmHugeLock);
+  }
+  if (create) {
+    int numaNode = ncclNumaThreadNode;
+    if (numaNode >= 0) NCCLCHECK(ncclNumaBind(*ptr, shmSize, numaNode));
+    memset(*ptr, 0, shmSize);
+    if (numaNode >= 0) INFO(NCCL_ALLOC, "Shm %s size %d on NUMA node %d (requested %d)", shmPath, shmSize, ncclNumaNodeOf(*ptr), numaNode);
   }
-  close(*fd);
-  *fd = -1;
-  if (create) memset(*ptr, 0, shmSize);
+  if (hugeMode != NCCL_HUGEPAGES_NONE) ncclHugePagesReport(*ptr, shmSize, shmPath);
   return ncclSuccess;
 }
 
-ncclResult_t ncclShmOpen(char* shmPath, const int shmSize, void** shmPtr, void** devShmPtr, int create) {
+ncclResult_t ncclShmOpen(char* shmPath, const int shmSize, void** shmPtr, void** devShmPtr, int create, int hugePages) {
   int fd = -1;
   void* ptr = MAP_FAILED;
   ncclResult_t res = ncclSuccess;
 
-  NCCLCHECKGOTO(ncclShmSetup(shmPath, shmSize, &fd, &ptr, create), res, sysError);
+  NCCLCHECKGOTO(ncclShmSetup(shmPath, shmSize, &fd, &ptr, create, hugePages), res, sysError);
   if (devShmPtr) {
     CUDACHECKGOTO(hipHostRegister(ptr, shmSize, hipHostRegisterMapped), res, hipError_t);
     CUDACHECKGOTO(hipHostGetDevicePointer(devShmPtr, ptr, 0), res, hipError_t);
@@ -69,8 +147,8 @@ sysError:
   WARN("Error while %s shared memory segment %s (size %d)", create ? "creating" : "attaching to", shmPath, shmSize);
 hipError_t:
   if (fd != -1) close(fd);
-  if (create) shm_unlink(shmPath);
-  if (ptr != MAP_FAILED) munmap(ptr, shmSize);
+  if (create) unlink(shmPath);
+  if (ptr != MAP_FAILED) shmUnmap(ptr, shmSize);
   *shmPtr = NULL;
   return res;
 }
@@ -82,7 +160,7 @@ ncclResult_t ncclShmUnlink(const char* shmPath) {
 
 ncclResult_t ncclShmClose(void* shmPtr, void* devShmPtr, const int shmSize) {
   if (devShmPtr) CUDACHECK(hipHostUnregister(shmPtr));
-  if (munmap(shmPtr, shmSize) != 0) {
+  if (shmUnmap(shmPtr, shmSize) != 0) {
     WARN("munmap of shared memory failed");
     return ncclSystemError;
   }
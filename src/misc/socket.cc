@@ -17,6 +17,8 @@
 #include <unordered_set>
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <algorithm>
 
 static std::vector<std::pair<int, std::unordered_set<std::string>>> clientPortPool;
 
@@ -397,7 +399,28 @@ ncclResult_t ncclGetSocketState(struct ncclSocket* sock, enum ncclSocketState* s
     return ncclSuccess;
 }
 
-ncclResult_t ncclSocketConnect(struct ncclSocket* sock, int portReuse) {
+// Picks a client port for sock->addr among the ports of this thread, -1 if none is free
+static int socketReusePort(struct ncclSocket* sock) {
+  char line[SOCKET_NAME_MAXLEN+1];
+  // pre-define ports according to tid, to avoid extra lock for race condition
+  if (clientPortPool.size() == 0) {
+    for (int tid = syscall(SYS_gettid), i = 1; i < 5; i++) {
+      clientPortPool.push_back(std::make_pair(60000 + i * 1000 + tid % 1000, std::unordered_set<std::string>()));
+    }
+  }
+  // find a port without conflict (different remote peer) in best effort
+  std::string remote_peer(ncclSocketToString(&sock->addr, line));
+  for (auto& port : clientPortPool) {
+    if (port.second.find(remote_peer) == port.second.end()) {
+      port.second.insert(remote_peer);
+      return port.first;
+    }
+  }
+  return -1;
+}
+
+// Creates a socket to connect to sock->addr, bound to reusePort if not -1
+static ncclResult_t socketCreate(struct ncclSocket* sock, int nonBlocking, int reusePort, int* fdOut) {
   char line[SOCKET_NAME_MAXLEN+1];
   /* IPv4/IPv6 support */
   int family = sock->addr.sa.sa_family;
@@ -418,9 +441,8 @@ ncclResult_t ncclSocketConnect(struct ncclSocket* sock, int portReuse) {
 
   const int one = 1;
   SYSCHECK(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(int)), "setsockopt");
-  
-  /* support non-blocking socket; by default, the socket is non-blocking */
-  if (sock->asyncFlag) {
+
+  if (nonBlocking) {
     EQCHECK(flags = fcntl(fd, F_GETFL), -1);
     SYSCHECK(fcntl(fd, F_SETFL, flags | O_NONBLOCK), "fcntl");
   }
@@ -429,63 +451,185 @@ ncclResult_t ncclSocketConnect(struct ncclSocket* sock, int portReuse) {
     SYSCHECK(setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (char*)&bufsize, sizeof(int)), "setsockopt");
     SYSCHECK(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&bufsize, sizeof(int)), "setsockopt");*/
 
-  if (portReuse) {
-    // pre-define ports according to tid, to avoid extra lock for race condition
-    if (clientPortPool.size() == 0) {
-      for (int tid = syscall(SYS_gettid), i = 1; i < 5; i++) {
-        clientPortPool.push_back(std::make_pair(60000 + i * 1000 + tid % 1000, std::unordered_set<std::string>()));
-      }
-    }
-    // find a port without conflict (different remote peer) in best effort
-    int reused_port = -1;
-    std::string remote_peer(ncclSocketToString(&sock->addr, line));
-    for (auto& port : clientPortPool) {
-      if (port.second.find(remote_peer) == port.second.end()) {
-        reused_port = port.first;
-        port.second.insert(remote_peer);
-        break;
-      }
-    }
-    // bind the port in fd for connect system call
-    if (reused_port != -1) {
-      int opt = 1;
-      SYSCHECK(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)), "setsockopt");
-      struct sockaddr_in sin;
-      sin.sin_family = family;
-      sin.sin_addr.s_addr = htonl(INADDR_ANY);
-      sin.sin_port = htons(reused_port);
-      SYSCHECK(bind(fd, (struct sockaddr *)&sin, salen), "bind_client_port");
-    }
+  // bind the port in fd for connect system call
+  if (reusePort != -1) {
+    int opt = 1;
+    SYSCHECK(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)), "setsockopt");
+    struct sockaddr_in sin;
+    sin.sin_family = family;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(reusePort);
+    SYSCHECK(bind(fd, (struct sockaddr *)&sin, salen), "bind_client_port");
   }
+  *fdOut = fd;
+  return ncclSuccess;
+}
 
-  TRACE(NCCL_INIT|NCCL_NET,"Connecting to socket %s", ncclSocketToString(&sock->addr, line));
+ncclResult_t ncclSocketConnect(struct ncclSocket* sock, int portReuse) {
+  // Blocking sockets go through the connection manager, which retries
+  if (!sock->asyncFlag) return ncclSocketConnectMany(&sock, 1, portReuse);
 
-  int ret;
-  int timedout_retries = 0;
-  int refused_retries = 0;
-retry:
-  /* blocking/non-blocking connect() is determined by asyncFlag. */
-  ret = connect(fd, &sock->addr.sa, salen);
-
-  if (!sock->asyncFlag && (errno == EAGAIN || (errno == ECONNREFUSED && ++refused_retries < RETRY_REFUSED_TIMES) ||
-    (errno == ETIMEDOUT && ++timedout_retries < RETRY_TIMEDOUT_TIMES))) {
-    if (errno == ECONNREFUSED && refused_retries % 1000 == 0) INFO(NCCL_ALL, "Call to connect returned %s, retrying", strerror(errno));
-    usleep(SLEEP_INT);
-    goto retry;
-  }
+  char line[SOCKET_NAME_MAXLEN+1];
+  int fd;
+  NCCLCHECK(socketCreate(sock, 1, portReuse ? socketReusePort(sock) : -1, &fd));
+  int salen = (sock->addr.sa.sa_family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+
+  TRACE(NCCL_INIT|NCCL_NET,"Connecting to socket %s", ncclSocketToString(&sock->addr, line));
 
-  /* If connect() fails with errno == EAGAIN/EINPROGRESS/ETIMEDOUT, we may want to try connect again.
-   * However, it can return EISCONN instead of success which indicates connection is built up in
-   * background already. No need to call connect() again. */
-  if (ret == 0 || ((errno == EINPROGRESS || errno == ECONNREFUSED) && sock->asyncFlag) || errno == EISCONN) {
+  /* non-blocking connect(): the caller polls the state with ncclGetSocketState.
+   * It can return EISCONN instead of success which indicates connection is built up in
+   * background already. */
+  int ret = connect(fd, &sock->addr.sa, salen);
+  if (ret == 0 || errno == EINPROGRESS || errno == ECONNREFUSED || errno == EISCONN) {
     sock->fd = fd;
     return ncclSuccess;
   }
 
   WARN("Net : Connect to %s failed : %s", ncclSocketToString(&sock->addr, line), strerror(errno));
+  close(fd);
   return ncclRemoteError;
 }
 
+// Connection manager. All sockets are connected concurrently with non-blocking
+// connect() calls, completions are collected with epoll. A refused connection
+// (peer not listening yet) is retried after a randomized, exponentially
+// growing delay until the deadline of that peer; a timed out one is retried
+// RETRY_TIMEDOUT_TIMES times.
+struct ncclSocketConnectOp {
+  struct ncclSocket* sock;
+  int fd;
+  int reusePort;
+  int done;
+  int attempts;
+  int timedout;
+  uint64_t retryAt;  // ns, next attempt when fd == -1
+  uint64_t deadline; // ns
+  uint64_t backoff;  // ns
+};
+
+// Random delay in [backoff/2, 3*backoff/2), so that peers refused at the same
+// time do not retry at the same time
+static uint64_t connectJitter(uint64_t backoff, uint64_t* seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return backoff/2 + *seed % (backoff ? backoff : 1);
+}
+
+static ncclResult_t connectFailed(struct ncclSocketConnectOp* op, int err, uint64_t now, uint64_t* seed) {
+  char line[SOCKET_NAME_MAXLEN+1];
+  close(op->fd);
+  op->fd = -1;
+  bool retry = (err == EAGAIN || err == ECONNREFUSED) ? now < op->deadline :
+               (err == ETIMEDOUT) ? ++op->timedout < RETRY_TIMEDOUT_TIMES : false;
+  if (!retry) {
+    WARN("Net : Connect to %s failed : %s", ncclSocketToString(&op->sock->addr, line), strerror(err));
+    return ncclRemoteError;
+  }
+  if (op->attempts % 100 == 0) INFO(NCCL_ALL, "Call to connect returned %s, retrying", strerror(err));
+  op->retryAt = now + connectJitter(op->backoff, seed);
+  op->backoff = std::min(op->backoff*2, (uint64_t)CONNECT_BACKOFF_MAX*1000);
+  return ncclSuccess;
+}
+
+static ncclResult_t connectDone(struct ncclSocketConnectOp* op) {
+  if (!op->sock->asyncFlag) {
+    int flags;
+    EQCHECK(flags = fcntl(op->fd, F_GETFL), -1);
+    SYSCHECK(fcntl(op->fd, F_SETFL, flags & ~O_NONBLOCK), "fcntl");
+  }
+  op->sock->fd = op->fd;
+  op->done = 1;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclSocketConnectMany(struct ncclSocket** socks, int nSocks, int portReuse) {
+#ifdef ENABLE_TRACE
+  char line[SOCKET_NAME_MAXLEN+1];
+#endif
+  ncclResult_t ret = ncclSuccess;
+  struct ncclSocketConnectOp* ops = NULL;
+  struct epoll_event events[64];
+  int pending = nSocks;
+  uint64_t now = clockNano();
+  uint64_t seed = now ^ ((uint64_t)getpid() << 32) ^ (uintptr_t)socks;
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd == -1) {
+    WARN("Net : epoll_create1 failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  NCCLCHECKGOTO(ncclCalloc(&ops, nSocks), ret, exit);
+  for (int i=0; i<nSocks; i++) {
+    ops[i].sock = socks[i];
+    ops[i].fd = -1;
+    ops[i].reusePort = portReuse ? socketReusePort(socks[i]) : -1;
+    ops[i].retryAt = now;
+    ops[i].deadline = now + (uint64_t)(RETRY_REFUSED_TIMES*SLEEP_INT)*1000;
+    ops[i].backoff = SLEEP_INT*1000;
+    TRACE(NCCL_INIT|NCCL_NET,"Connecting to socket %s", ncclSocketToString(&socks[i]->addr, line));
+  }
+
+  while (pending) {
+    now = clockNano();
+    uint64_t wakeup = now + CONNECT_POLL_INT*1000ULL;
+    for (int i=0; i<nSocks; i++) {
+      struct ncclSocketConnectOp* op = ops+i;
+      if (op->sock->abortFlag && *op->sock->abortFlag) { ret = ncclInternalError; goto exit; }
+      if (op->done || op->fd != -1) continue;
+      if (op->retryAt > now) {
+        wakeup = std::min(wakeup, op->retryAt);
+        continue;
+      }
+      NCCLCHECKGOTO(socketCreate(op->sock, 1, op->reusePort, &op->fd), ret, exit);
+      op->attempts++;
+      int salen = (op->sock->addr.sa.sa_family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+      if (connect(op->fd, &op->sock->addr.sa, salen) == 0 || errno == EISCONN) {
+        NCCLCHECKGOTO(connectDone(op), ret, exit);
+        pending--;
+      } else if (errno == EINPROGRESS) {
+        struct epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.u32 = i;
+        SYSCHECKGOTO(epoll_ctl(epfd, EPOLL_CTL_ADD, op->fd, &ev), ret, exit);
+      } else {
+        NCCLCHECKGOTO(connectFailed(op, errno, now, &seed), ret, exit);
+        wakeup = std::min(wakeup, op->retryAt);
+      }
+    }
+    if (pending == 0) break;
+
+    int timeout = wakeup > now ? (int)((wakeup - now + 999999) / 1000000) : 0;
+    int nEvents = epoll_wait(epfd, events, 64, timeout);
+    if (nEvents == -1 && errno != EINTR) {
+      WARN("Net : epoll_wait failed : %s", strerror(errno));
+      ret = ncclSystemError;
+      goto exit;
+    }
+    now = clockNano();
+    for (int e=0; e<nEvents; e++) {
+      struct ncclSocketConnectOp* op = ops+events[e].data.u32;
+      int err = 0;
+      socklen_t rlen = sizeof(int);
+      SYSCHECKGOTO(getsockopt(op->fd, SOL_SOCKET, SO_ERROR, (void*)&err, &rlen), ret, exit);
+      SYSCHECKGOTO(epoll_ctl(epfd, EPOLL_CTL_DEL, op->fd, NULL), ret, exit);
+      if (err == 0) {
+        NCCLCHECKGOTO(connectDone(op), ret, exit);
+        pending--;
+      } else {
+        NCCLCHECKGOTO(connectFailed(op, err, now, &seed), ret, exit);
+      }
+    }
+  }
+
+exit:
+  if (ops) {
+    for (int i=0; i<nSocks; i++) if (!ops[i].done && ops[i].fd != -1) close(ops[i].fd);
+  }
+  free(ops);
+  close(epfd);
+  return ret;
+}
+
 ncclResult_t ncclSocketAccept(struct ncclSocket* sock, struct ncclSocket* listenSocket) {
   socklen_t socklen = sizeof(union ncclSocketAddress);
   int tmpFd = sock->fd = -1;
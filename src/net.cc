@@ -290,6 +290,9 @@ ncclResult_t ncclNetInit(struct ncclComm* comm) {
     WARN("Error: network %s not found.", netName ? netName : "");
     return ncclInvalidUsage;
   }
+
+  const char* bondConfig = getenv("RCCL_NET_BOND");
+  if (bondConfig && strlen(bondConfig)) NCCLCHECK(ncclNetBondInit(comm->ncclNet, bondConfig, &comm->ncclNet));
   return ncclSuccess;
 }
 
@@ -356,5 +359,6 @@ cleanup1:
 }
 
 int ncclNetVersion(struct ncclComm* comm) {
-  return (comm->ncclNet == &ncclNet_v4_as_v6) ? 4 : ((comm->ncclNet == &ncclNet_v5_as_v6) ? 5 : 6);
+  ncclNet_t* net = ncclNetBondBase(comm->ncclNet);
+  return (net == &ncclNet_v4_as_v6) ? 4 : ((net == &ncclNet_v5_as_v6) ? 5 : 6);
 }
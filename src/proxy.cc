@@ -650,6 +650,7 @@ void* ncclProxyProgress(void *comm_) {
     WARN("[Proxy Progress] Failed to set CUDA device %d", comm->cudaDev);
   }
   if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+  ncclNumaThreadNode = comm->numaNode;
 
   struct ncclProxyProgressState* state = &comm->proxyState.progressState;
   state->nextOps = -1;
@@ -1009,6 +1010,7 @@ void* ncclProxyService(void* _args) {
     WARN("[Proxy Service] Failed to set CUDA device %d", comm->cudaDev);
   }
   if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+  ncclNumaThreadNode = comm->numaNode;
 
   // Prepare poll descriptor
   struct ncclProxyConnectionPool connectionPool;
@@ -8,6 +8,7 @@
 #include "comm.h"
 #include "info.h"
 #include "bootstrap.h"
+#include "graph/topo.h"
 #define ENABLE_TIMER 0
 #include "timer.h"
 
@@ -77,82 +78,335 @@ void dumpData(struct ncclConnect* data, int ndata) {
   }
 }
 
+// Exchange of connect infos with the peers at offset i (send to rank+i, receive from rank-i)
+struct p2pSetupOffset {
+  int recvPeer, sendPeer;
+  uint32_t recvMask, sendMask;
+  int recvChannels, sendChannels;
+  struct ncclConnect* data; // from sendPeer (sendChannels), then from recvPeer (recvChannels)
+  int pending;              // P2P_SETUP_FROM_* messages not received yet
+};
+#define P2P_SETUP_FROM_SEND 1
+#define P2P_SETUP_FROM_RECV 2
+
+// Offsets whose infos are posted before the ones of lower offsets are received.
+// Bounds the connections waiting in the accept queue of the bootstrap sockets.
+#define P2P_SETUP_WINDOW 64
+
+struct p2pSetupState {
+  struct p2pSetupOffset* offsets;
+  int nRanks;
+  int graphTag;
+};
+
+static int p2pSetupTag(int i, struct ncclTopoGraph* graph) { return (i<<8) + (graph ? graph->id+1 : 0); }
+
+static int p2pSetupMatch(void* ctx, int peer, int tag, void** data, int* size) {
+  struct p2pSetupState* state = (struct p2pSetupState*)ctx;
+  int i = tag >> 8;
+  if ((tag & 0xff) != state->graphTag || i < 1 || i >= state->nRanks) return 0;
+  struct p2pSetupOffset* o = state->offsets+i;
+  if (o->sendPeer == o->recvPeer) {
+    // One message carrying both directions
+    if (peer != o->sendPeer || o->pending == 0) return 0;
+    *data = o->data;
+    *size = sizeof(struct ncclConnect)*(o->sendChannels+o->recvChannels);
+    return 1;
+  }
+  if (peer == o->sendPeer && (o->pending & P2P_SETUP_FROM_SEND)) {
+    *data = o->data;
+    *size = sizeof(struct ncclConnect)*o->sendChannels;
+    return 1;
+  }
+  if (peer == o->recvPeer && (o->pending & P2P_SETUP_FROM_RECV)) {
+    *data = o->data+o->sendChannels;
+    *size = sizeof(struct ncclConnect)*o->recvChannels;
+    return 1;
+  }
+  return 0;
+}
+
+// Select the transports of offset i and send our connect infos to its peers
+static ncclResult_t p2pSetupPost(struct ncclComm* comm, struct ncclTopoGraph* graph, int connIndex, int i, struct p2pSetupOffset* o, int* highestType) {
+  struct ncclConnect data[2*MAXCHANNELS];
+  struct ncclConnect* recvData = data;
+  int type;
+  TIME_START(0);
+  for (int c=0; c<MAXCHANNELS; c++) {
+    if (o->recvMask & (1<<c)) {
+      NCCLCHECK(selectTransport<0>(comm, graph, recvData+o->recvChannels++, c, o->recvPeer, connIndex, &type));
+      if (type > *highestType) *highestType = type;
+    }
+  }
+  TIME_STOP(0);
+  TIME_START(1);
+  struct ncclConnect* sendData = recvData+o->recvChannels;
+  for (int c=0; c<MAXCHANNELS; c++) {
+    if (o->sendMask & (1<<c)) {
+      NCCLCHECK(selectTransport<1>(comm, graph, sendData+o->sendChannels++, c, o->sendPeer, connIndex, &type));
+      if (type > *highestType) *highestType = type;
+    }
+  }
+  TIME_STOP(1);
+
+  TIME_START(2);
+  int tag = p2pSetupTag(i, graph);
+  if (o->sendPeer == o->recvPeer) {
+    if (o->recvChannels+o->sendChannels) {
+      NCCLCHECK(bootstrapSend(comm->bootstrap, o->recvPeer, tag, data, sizeof(struct ncclConnect)*(o->recvChannels+o->sendChannels)));
+      o->pending = P2P_SETUP_FROM_SEND|P2P_SETUP_FROM_RECV;
+    }
+  } else {
+    if (o->recvChannels) {
+      NCCLCHECK(bootstrapSend(comm->bootstrap, o->recvPeer, tag, recvData, sizeof(struct ncclConnect)*o->recvChannels));
+      o->pending |= P2P_SETUP_FROM_RECV;
+    }
+    if (o->sendChannels) {
+      NCCLCHECK(bootstrapSend(comm->bootstrap, o->sendPeer, tag, sendData, sizeof(struct ncclConnect)*o->sendChannels));
+      o->pending |= P2P_SETUP_FROM_SEND;
+    }
+  }
+  TIME_STOP(2);
+  return ncclSuccess;
+}
+
+// Connection whose ncclConnInfo has to be copied to devPeers
+struct p2pSetupConn {
+  int channel;
+  int send;
+  int peer;
+};
+
+static int p2pSetupConnCompare(const void* a, const void* b) {
+  const struct p2pSetupConn* x = (const struct p2pSetupConn*)a;
+  const struct p2pSetupConn* y = (const struct p2pSetupConn*)b;
+  if (x->channel != y->channel) return x->channel - y->channel;
+  if (x->send != y->send) return x->send - y->send;
+  return x->peer - y->peer;
+}
+
+static ncclResult_t p2pSetupConnect(struct ncclComm* comm, int connIndex, int send, int peer, uint32_t mask, struct ncclConnect* data,
+    struct p2pSetupConn* conns, int* nConns) {
+  for (int c=0; c<MAXCHANNELS; c++) {
+    if (mask & (1<<c)) {
+      struct ncclConnector* conn = send ? comm->channels[c].peers[peer].send + connIndex : comm->channels[c].peers[peer].recv + connIndex;
+      NCCLCHECK(conn->transportComm->connect(comm, data++, 1, comm->rank, conn));
+      conn->connected = 1;
+      comm->nConnectors++;
+      if (conn->transportComm == (send ? &netTransport.send : &netTransport.recv)) comm->nNetConnectors++;
+      struct p2pSetupConn* sc = conns + (*nConns)++;
+      sc->channel = c;
+      sc->send = send;
+      sc->peer = peer;
+    }
+  }
+  return ncclSuccess;
+}
+
+// Copy the ncclConnInfo of the new connections to devPeers. Connections of the
+// same channel and direction to consecutive peers are copied at once; other
+// entries of devPeers can't be rewritten as kernels save their step there.
+static ncclResult_t p2pSetupCopyConns(struct ncclComm* comm, int connIndex, struct p2pSetupConn* conns, int nConns) {
+  if (nConns == 0) return ncclSuccess;
+  struct ncclConnInfo* staging;
+  NCCLCHECK(ncclCalloc(&staging, nConns));
+  qsort(conns, nConns, sizeof(struct p2pSetupConn), p2pSetupConnCompare);
+  ncclResult_t ret = ncclSuccess;
+  for (int start=0, end; start<nConns; start=end) {
+    struct p2pSetupConn* first = conns+start;
+    for (end=start; end<nConns; end++) {
+      struct p2pSetupConn* sc = conns+end;
+      if (sc->channel != first->channel || sc->send != first->send || sc->peer != first->peer+(end-start)) break;
+      struct ncclChannelPeer* peer = comm->channels[sc->channel].peers+sc->peer;
+      memcpy(staging+end, &(sc->send ? peer->send : peer->recv)[connIndex].conn, sizeof(struct ncclConnInfo));
+    }
+    struct ncclDevChannelPeer* devPeer = comm->channels[first->channel].devPeers+first->peer;
+    CUDACHECKGOTO(hipMemcpy2DAsync(first->send ? devPeer->send+connIndex : devPeer->recv+connIndex, sizeof(struct ncclDevChannelPeer),
+          staging+start, sizeof(struct ncclConnInfo), sizeof(struct ncclConnInfo), end-start, hipMemcpyHostToDevice, comm->sideStream), ret, exit);
+  }
+  CUDACHECKGOTO(hipStreamSynchronize(comm->sideStream), ret, exit);
+exit:
+  free(staging);
+  return ret;
+}
+
+// All connect infos are posted before waiting for the ones of our peers (up
+// to P2P_SETUP_WINDOW offsets ahead), and received in whatever order they
+// arrive. Send connections are established as soon as their infos arrive;
+// receive connections are established once all our send connections are, as
+// they may wait for the send side of the peer.
 ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, int connIndex, int* highestTransportType/*=NULL*/) {
   int highestType = TRANSPORT_P2P;  // track highest transport type
+  int nRanks = comm->nRanks;
+  int maskOffset = comm->nRanks*(connIndex == NCCL_CONN_IDX_P2P_NET ? NCCL_CONN_IDX_P2P_NET : 0);
+  ncclResult_t ret = ncclSuccess;
+  struct p2pSetupState state;
+  struct p2pSetupOffset* offsets = NULL;
+  struct ncclConnect* data = NULL;
+  struct p2pSetupConn* conns = NULL;
+  int nConns = 0, nData = 0, posted = 1, received = 0;
 
-  struct ncclConnect data[2*MAXCHANNELS];
-  for (int i=1; i<comm->nRanks; i++) {
-    int bootstrapTag = (i<<8) + (graph ? graph->id+1 : 0);
-    int recvPeer = (comm->rank - i + comm->nRanks) % comm->nRanks;
-    int sendPeer = (comm->rank + i) % comm->nRanks;
-    uint32_t recvMask = comm->connectRecv[recvPeer+comm->nRanks*(connIndex == NCCL_CONN_IDX_P2P_NET ? NCCL_CONN_IDX_P2P_NET : 0)];
-    uint32_t sendMask = comm->connectSend[sendPeer+comm->nRanks*(connIndex == NCCL_CONN_IDX_P2P_NET ? NCCL_CONN_IDX_P2P_NET : 0)];
-
-    struct ncclConnect* recvData = data;
-    int sendChannels = 0, recvChannels = 0;
-    int type;
-    TIME_START(0);
-    for (int c=0; c<MAXCHANNELS; c++) {
-      if (recvMask & (1<<c)) {
-        NCCLCHECK(selectTransport<0>(comm, graph, recvData+recvChannels++, c, recvPeer, connIndex, &type));
-        if (type > highestType) highestType = type;
-      }
+  NCCLCHECKGOTO(ncclCalloc(&offsets, nRanks), ret, exit);
+  for (int i=1; i<nRanks; i++) {
+    struct p2pSetupOffset* o = offsets+i;
+    o->recvPeer = (comm->rank - i + nRanks) % nRanks;
+    o->sendPeer = (comm->rank + i) % nRanks;
+    o->recvMask = comm->connectRecv[o->recvPeer+maskOffset];
+    o->sendMask = comm->connectSend[o->sendPeer+maskOffset];
+    nData += __builtin_popcount(o->recvMask) + __builtin_popcount(o->sendMask);
+  }
+  NCCLCHECKGOTO(ncclCalloc(&data, nData+1), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&conns, nData+1), ret, exit);
+  for (int i=1, d=0; i<nRanks; i++) {
+    offsets[i].data = data+d;
+    d += __builtin_popcount(offsets[i].recvMask) + __builtin_popcount(offsets[i].sendMask);
+  }
+  state.offsets = offsets;
+  state.nRanks = nRanks;
+  state.graphTag = graph ? graph->id+1 : 0;
+
+  while (received < nRanks-1) {
+    // Post the infos of the next offsets
+    for (; posted < nRanks && posted <= received+P2P_SETUP_WINDOW; posted++) {
+      NCCLCHECKGOTO(p2pSetupPost(comm, graph, connIndex, posted, offsets+posted, &highestType), ret, exit);
+      if (offsets[posted].pending == 0) received++;
+    }
+    if (received == nRanks-1) break;
+
+    TIME_START(2);
+    int peer, tag;
+    NCCLCHECKGOTO(bootstrapRecvAny(comm->bootstrap, p2pSetupMatch, &state, &peer, &tag), ret, exit);
+    TIME_STOP(2);
+    struct p2pSetupOffset* o = offsets+(tag>>8);
+    int from = (o->sendPeer == o->recvPeer) ? P2P_SETUP_FROM_SEND|P2P_SETUP_FROM_RECV :
+               (peer == o->sendPeer) ? P2P_SETUP_FROM_SEND : P2P_SETUP_FROM_RECV;
+    if (from & P2P_SETUP_FROM_SEND) {
+      TIME_START(3);
+      NCCLCHECKGOTO(p2pSetupConnect(comm, connIndex, 1, o->sendPeer, o->sendMask, o->data, conns, &nConns), ret, exit);
+      TIME_STOP(3);
+    }
+    o->pending &= ~from;
+    if (o->pending == 0) received++;
+  }
+
+  TIME_START(4);
+  for (int i=1; i<nRanks; i++) {
+    struct p2pSetupOffset* o = offsets+i;
+    NCCLCHECKGOTO(p2pSetupConnect(comm, connIndex, 0, o->recvPeer, o->recvMask, o->data+o->sendChannels, conns, &nConns), ret, exit);
+    comm->connectRecv[o->recvPeer+maskOffset] = comm->connectSend[o->sendPeer+maskOffset] = 0;
+  }
+  TIME_STOP(4);
+  NCCLCHECKGOTO(p2pSetupCopyConns(comm, connIndex, conns, nConns), ret, exit);
+  if (highestTransportType != NULL) *highestTransportType = highestType;
+  TIME_PRINT("P2P Setup/Connect");
+exit:
+  free(offsets);
+  free(data);
+  free(conns);
+  return ret;
+}
+
+// Connect prev/next of every ring, through the network as well when rings use intra-node net.
+ncclResult_t ncclTransportRingConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph) {
+  if (comm->ringConnected) return ncclSuccess;
+  if (comm->nRanks > 1) {
+    for (int c=0; c<comm->nChannels; c++) {
+      struct ncclChannel* channel = comm->channels+c;
+      NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, 0));
     }
-    TIME_STOP(0);
-    TIME_START(1);
-    struct ncclConnect* sendData = recvData+recvChannels;
-    for (int c=0; c<MAXCHANNELS; c++) {
-      if (sendMask & (1<<c)) {
-        NCCLCHECK(selectTransport<1>(comm, graph, sendData+sendChannels++, c, sendPeer, connIndex, &type));
-        if (type > highestType) highestType = type;
+    NCCLCHECK(ncclTransportP2pSetup(comm, ringGraph, 0));
+    if (comm->useIntraNet) {
+      for (int c=0; c<comm->nChannels; c++) {
+        struct ncclChannel* channel = comm->channels+c;
+        NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, NCCL_CONN_IDX_P2P_NET));
       }
+      NCCLCHECK(ncclTransportP2pSetup(comm, ringGraph, NCCL_CONN_IDX_P2P_NET));
     }
-    TIME_STOP(1);
+  }
+  comm->ringConnected = 1;
+  INFO(NCCL_INIT, "Connected all rings comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
+  return ncclSuccess;
+}
 
-    TIME_START(2);
-    if (sendPeer == recvPeer) {
-      if (recvChannels+sendChannels) {
-         NCCLCHECK(bootstrapSend(comm->bootstrap, recvPeer, bootstrapTag, data, sizeof(struct ncclConnect)*(recvChannels+sendChannels)));
-         NCCLCHECK(bootstrapRecv(comm->bootstrap, recvPeer, bootstrapTag, data, sizeof(struct ncclConnect)*(recvChannels+sendChannels)));
-         sendData = data;
-         recvData = data+sendChannels;
+// Connect up/down of every tree (and binary tree, used by RCCL on some topologies)
+ncclResult_t ncclTransportTreeConnect(struct ncclComm* comm, struct ncclTopoGraph* treeGraph) {
+  if (comm->treeConnected) return ncclSuccess;
+  if (comm->nRanks > 1) {
+    for (int c=0; c<comm->nChannels; c++) {
+      struct ncclChannel* channel = comm->channels+c;
+      NCCLCHECK(ncclTransportP2pConnect(comm, c, NCCL_MAX_TREE_ARITY, channel->tree.down, 1, &channel->tree.up, 0));
+      NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->tree.up, NCCL_MAX_TREE_ARITY, channel->tree.down, 0));
+      if (comm->topo->pivotA2ANumBiRings == 3) {
+        NCCLCHECK(ncclTransportP2pConnect(comm, c, NCCL_MAX_TREE_ARITY, channel->binTree.down, 1, &channel->binTree.up, 0));
+        NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->binTree.up, NCCL_MAX_TREE_ARITY, channel->binTree.down, 0));
       }
-    } else {
-      if (recvChannels) NCCLCHECK(bootstrapSend(comm->bootstrap, recvPeer, bootstrapTag, recvData, sizeof(struct ncclConnect)*recvChannels));
-      if (sendChannels) NCCLCHECK(bootstrapSend(comm->bootstrap, sendPeer, bootstrapTag, sendData, sizeof(struct ncclConnect)*sendChannels));
-      if (sendChannels) NCCLCHECK(bootstrapRecv(comm->bootstrap, sendPeer, bootstrapTag, sendData, sizeof(struct ncclConnect)*sendChannels));
-      if (recvChannels) NCCLCHECK(bootstrapRecv(comm->bootstrap, recvPeer, bootstrapTag, recvData, sizeof(struct ncclConnect)*recvChannels));
     }
-    TIME_STOP(2);
+    NCCLCHECK(ncclTransportP2pSetup(comm, treeGraph, 0));
+  }
+  comm->treeConnected = 1;
+  INFO(NCCL_INIT, "Connected all trees comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
+  return ncclSuccess;
+}
+
+// Called from the group preconnect job: connect the rings and trees that
+// collectives enqueued in this group need (see RCCL_RUNTIME_CONNECT).
+ncclResult_t ncclTransportRuntimeConnect(struct ncclComm* comm) {
+  if (comm->ringConnectPending) {
+    NCCLCHECK(ncclTransportRingConnect(comm, comm->runtimeGraphs[0]));
+    comm->ringConnectPending = 0;
+  }
+  if (comm->treeConnectPending) {
+    NCCLCHECK(ncclTransportTreeConnect(comm, comm->runtimeGraphs[1]));
+    comm->treeConnectPending = 0;
+  }
+  return ncclSuccess;
+}
 
-    TIME_START(3);
-    for (int c=0; c<MAXCHANNELS; c++) {
-      if (sendMask & (1<<c)) {
-        struct ncclConnector* conn = comm->channels[c].peers[sendPeer].send + connIndex;
-        NCCLCHECK(conn->transportComm->connect(comm, sendData++, 1, comm->rank, conn));
-        conn->connected = 1;
+static void countDeferred(struct ncclComm* comm, int c, int npeers, int* peers, int send, int connIndex, uint8_t* seen, int* nDeferred, int* nNetDeferred, int64_t* bytesDeferred) {
+  uint8_t bit = 1 << (2*(connIndex == NCCL_CONN_IDX_P2P_NET) + send);
+  for (int i=0; i<npeers; i++) {
+    int peer = peers[i];
+    if (peer < 0 || peer >= comm->nRanks || peer == comm->rank || (seen[peer] & bit)) continue;
+    seen[peer] |= bit;
+    struct ncclChannelPeer* channelPeer = comm->channels[c].peers+peer;
+    if ((send ? channelPeer->send : channelPeer->recv)[connIndex].connected) continue;
+    (*nDeferred)++;
+    if (comm->peerInfo[peer].hostHash != comm->peerInfo[comm->rank].hostHash) (*nNetDeferred)++;
+    // Buffers are accounted once per connection, on the receive side
+    if (!send) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) *bytesDeferred += comm->buffSizes[p];
+  }
+}
 
-        CUDACHECK(hipMemcpyAsync(&comm->channels[c].devPeers[sendPeer].send[connIndex], &conn->conn, sizeof(struct ncclConnInfo), hipMemcpyHostToDevice, comm->sideStream));
-        CUDACHECK(hipMemcpyAsync(&comm->channels[c].devPeers[sendPeer].send[connIndex], &conn->conn, sizeof(struct ncclConnInfo), hipMemcpyHostToDevice, comm->sideStream));
+// Report how many connections were set up, and how many ring/tree connections
+// were never needed thanks to runtime connection.
+ncclResult_t ncclTransportReportConnStats(struct ncclComm* comm) {
+  int nDeferred = 0, nNetDeferred = 0;
+  int64_t bytesDeferred = 0;
+  if (comm->runtimeConn && comm->nRanks > 1) {
+    uint8_t* seen;
+    NCCLCHECK(ncclCalloc(&seen, comm->nRanks));
+    for (int c=0; c<comm->nChannels; c++) {
+      struct ncclChannel* channel = comm->channels+c;
+      memset(seen, 0, comm->nRanks);
+      countDeferred(comm, c, 1, &channel->ring.prev, 0, 0, seen, &nDeferred, &nNetDeferred, &bytesDeferred);
+      countDeferred(comm, c, 1, &channel->ring.next, 1, 0, seen, &nDeferred, &nNetDeferred, &bytesDeferred);
+      if (comm->useIntraNet) {
+        countDeferred(comm, c, 1, &channel->ring.prev, 0, NCCL_CONN_IDX_P2P_NET, seen, &nDeferred, &nNetDeferred, &bytesDeferred);
+        countDeferred(comm, c, 1, &channel->ring.next, 1, NCCL_CONN_IDX_P2P_NET, seen, &nDeferred, &nNetDeferred, &bytesDeferred);
       }
-    }
-    TIME_STOP(3);
-    TIME_START(4);
-    for (int c=0; c<MAXCHANNELS; c++) {
-      if (recvMask & (1<<c)) {
-        struct ncclConnector* conn = comm->channels[c].peers[recvPeer].recv + connIndex;
-        NCCLCHECK(conn->transportComm->connect(comm, recvData++, 1, comm->rank, conn));
-        conn->connected = 1;
-
-        CUDACHECK(hipMemcpyAsync(&comm->channels[c].devPeers[recvPeer].recv[connIndex], &conn->conn, sizeof(struct ncclConnInfo), hipMemcpyHostToDevice, comm->sideStream));
+      struct ncclTree* trees[2] = { &channel->tree, comm->topo->pivotA2ANumBiRings == 3 ? &channel->binTree : NULL };
+      for (int t=0; t<2; t++) {
+        if (trees[t] == NULL) continue;
+        for (int send=0; send<2; send++) {
+          countDeferred(comm, c, NCCL_MAX_TREE_ARITY, trees[t]->down, send, 0, seen, &nDeferred, &nNetDeferred, &bytesDeferred);
+          countDeferred(comm, c, 1, &trees[t]->up, send, 0, seen, &nDeferred, &nNetDeferred, &bytesDeferred);
+        }
       }
     }
-    TIME_STOP(4);
-    comm->connectRecv[recvPeer+comm->nRanks*(connIndex == NCCL_CONN_IDX_P2P_NET ? NCCL_CONN_IDX_P2P_NET : 0)] = comm->connectSend[sendPeer+comm->nRanks*(connIndex == NCCL_CONN_IDX_P2P_NET ? NCCL_CONN_IDX_P2P_NET : 0)] = 0;
+    free(seen);
   }
-  CUDACHECK(hipStreamSynchronize(comm->sideStream));
-  if (highestTransportType != NULL) *highestTransportType = highestType;
-  TIME_PRINT("P2P Setup/Connect");
+  INFO(NCCL_INIT, "comm %p rank %d connections : %d established (%d net), %d ring/tree deferred and unused (%d net), ~%ld bytes of buffers avoided",
+      comm, comm->rank, comm->nConnectors, comm->nNetConnectors, nDeferred, nNetDeferred, bytesDeferred);
   return ncclSuccess;
 }
 
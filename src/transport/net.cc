@@ -240,9 +240,21 @@ static ncclResult_t netMapShm(struct connectMapMem* mem) {
   NCCLCHECK(ncclShmUnlink(mem->shmPath));
   return ncclSuccess;
 }
+RCCL_PARAM(NetHostMemNicLocal, "NET_HOSTMEM_NIC_LOCAL", 0);
+
+// Host memory of a connection goes to the NUMA node of the GPU, or to the one
+// of the NIC with RCCL_NET_HOSTMEM_NIC_LOCAL=1.
+static int netHostMemNumaNode(struct ncclComm* comm, int netDev) {
+  if (comm->numaNode < 0 || rcclParamNetHostMemNicLocal() == 0) return comm->numaNode;
+  int numaNode;
+  if (ncclTopoGetNumaNode(comm->topo, -1, netDev, &numaNode) != ncclSuccess) return comm->numaNode;
+  numaNode = ncclNumaUsableNode(numaNode);
+  return numaNode >= 0 ? numaNode : comm->numaNode;
+}
+
 static ncclResult_t netCreateShm(struct connectMapMem* mem) {
   mem->shmPath[0] = '\0'; // Let ncclShmOpen create a tmp file
-  NCCLCHECK(ncclShmOpen(mem->shmPath, mem->size, (void**)&mem->cpuPtr, NULL, 1));
+  NCCLCHECK(ncclShmOpen(mem->shmPath, mem->size, (void**)&mem->cpuPtr, NULL, 1, 1));
   return ncclSuccess;
 }
 
@@ -393,11 +405,22 @@ static ncclResult_t sharedBuffersInit(struct ncclComm* comm, int cuda, int local
     }
   }
   if (!cuda && state->hostBuff == NULL) {
-    NCCLCHECK(ncclCudaHostCalloc(&state->hostBuff, state->size));
+    int hugeMode = ncclHugePagesMode(state->size);
+    if (hugeMode != NCCL_HUGEPAGES_NONE) {
+      // hipHostMalloc cannot use huge pages, so pin the buffer afterwards
+      NCCLCHECK(ncclHugePagesAlloc((void**)&state->hostBuff, state->size, hugeMode, &state->hostMapSize));
+      if (ncclNumaThreadNode >= 0) NCCLCHECK(ncclNumaBind(state->hostBuff, state->hostMapSize, ncclNumaThreadNode));
+      CUDACHECK(hipHostRegister(state->hostBuff, state->hostMapSize, hipHostRegisterMapped));
+      CUDACHECK(hipHostGetDevicePointer((void**)&state->hostBuffGpu, state->hostBuff, 0));
+      ncclHugePagesReport(state->hostBuff, state->size, "Net shared buffers");
+    } else {
+      NCCLCHECK(ncclCudaHostCalloc(&state->hostBuff, state->size));
+      state->hostBuffGpu = state->hostBuff;
+    }
   }
   if (cpuPtr) *cpuPtr = cuda ? state->cudaBuff : state->hostBuff;
   if (sameProcess) {
-    if (gpuPtr) *gpuPtr = *cpuPtr;
+    if (gpuPtr) *gpuPtr = cuda ? state->cudaBuff : state->hostBuffGpu;
   } else {
     if (gpuPtr) *gpuPtr = NULL;
     if (ipc) memcpy(ipc, &state->ipc, sizeof(hipIpcMemHandle_t));
@@ -422,7 +445,12 @@ static ncclResult_t sharedBuffersDestroy(struct ncclComm* comm, int localRank, i
   state->refcount--;
   if (state->refcount == 0) {
     if (state->cudaBuff) CUDACHECK(hipFree(state->cudaBuff));
-    if (state->hostBuff) NCCLCHECK(ncclCudaHostFree(state->hostBuff));
+    if (state->hostBuff && state->hostMapSize) {
+      CUDACHECK(hipHostUnregister(state->hostBuff));
+      NCCLCHECK(ncclHugePagesFree(state->hostBuff, state->hostMapSize));
+    } else if (state->hostBuff) {
+      NCCLCHECK(ncclCudaHostFree(state->hostBuff));
+    }
   }
   if (peer->send.refcount || peer->recv.refcount) return ncclSuccess;
   free(peer);
@@ -536,6 +564,8 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
   *done = 1;
 
   // Create structures
+  int numaSave = ncclNumaThreadNode;
+  ncclNumaThreadNode = netHostMemNumaNode(comm, resources->netDev);
   struct connectMap* map = &resources->map;
   map->sameProcess =
     comm->peerInfo[resources->rank].pidHash == comm->peerInfo[comm->rank].pidHash ? 1 : 0;
@@ -590,6 +620,8 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
     gdcMem->size = sizeof(uint64_t); // sendMem->head
   }
 
+  ncclNumaThreadNode = numaSave;
+
   resources->sendMem = (struct ncclSendMem*) NCCL_NET_MAP_GET_POINTER(map, cpu, sendMem);
   resources->recvMem = (struct ncclRecvMem*) NCCL_NET_MAP_GET_POINTER(map, cpu, recvMem);
 
@@ -677,6 +709,8 @@ static ncclResult_t recvProxyConnect(struct ncclProxyConnection* connection, str
   NCCLCHECK(ncclNetCloseListen(comm, resources->netListenComm));
 
   // Create structures
+  int numaSave = ncclNumaThreadNode;
+  ncclNumaThreadNode = netHostMemNumaNode(comm, resources->netDev);
   struct connectMap* map = &resources->map;
   map->sameProcess =
     comm->peerInfo[resources->rank].pidHash == comm->peerInfo[comm->rank].pidHash ? 1 : 0;
@@ -724,6 +758,8 @@ static ncclResult_t recvProxyConnect(struct ncclProxyConnection* connection, str
     if (ncclParamGdrCopyFlushEnable()) resources->gdcFlush = cpuPtr + 1;
   }
 
+  ncclNumaThreadNode = numaSave;
+
   resources->sendMem = (struct ncclSendMem*) NCCL_NET_MAP_GET_POINTER(map, cpu, sendMem);
   resources->recvMem = (struct ncclRecvMem*) NCCL_NET_MAP_GET_POINTER(map, cpu, recvMem);
   for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
@@ -0,0 +1,556 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "comm.h"
+#include "core.h"
+#include "net.h"
+#include "param.h"
+
+#include <pthread.h>
+#include <algorithm>
+
+// Bonding of the devices of a network into virtual devices (RCCL_NET_BOND).
+// A bonded device has one connection per member device, and stripes each
+// message across them. The receiver does not know the size of a message in
+// advance, so the sender first sends a header with its size and stripe size on
+// the first member; the receiver posts the stripes once the header is in, and
+// only then the header of the next message, which keeps the order of the
+// messages of the first member the same on both sides.
+
+#define BOND_MAX_DEVS 64
+#define BOND_MAX_MEMBERS 8
+#define BOND_MAX_REQUESTS NCCL_NET_MAX_REQUESTS
+#define BOND_STRIPE_ALIGN 4096
+
+RCCL_PARAM(NetBondMinStripe, "NET_BOND_MIN_STRIPE", 64*1024);
+
+struct ncclBondDev {
+  int nMembers;
+  int members[BOND_MAX_MEMBERS];
+  char name[256];
+  ncclNetProperties_t props;
+};
+
+static ncclNet_t* bondBase;
+static struct ncclBondDev bondDevs[BOND_MAX_DEVS];
+static int nBondDevs;
+static pthread_mutex_t bondLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ncclResult_t ncclBondAddDev(int* members, int nMembers, int nBaseDevs) {
+  if (nBondDevs == BOND_MAX_DEVS) {
+    WARN("NET/Bond : too many bonded devices");
+    return ncclInvalidUsage;
+  }
+  struct ncclBondDev* dev = bondDevs+nBondDevs;
+  ncclNetProperties_t* props = &dev->props;
+  dev->nMembers = nMembers;
+  dev->name[0] = '\0';
+  for (int m=0; m<nMembers; m++) {
+    if (members[m] < 0 || members[m] >= nBaseDevs) {
+      WARN("NET/Bond : device %d does not exist (%d devices)", members[m], nBaseDevs);
+      return ncclInvalidUsage;
+    }
+    ncclNetProperties_t member;
+    NCCLCHECK(bondBase->getProperties(members[m], &member));
+    dev->members[m] = members[m];
+    snprintf(dev->name+strlen(dev->name), sizeof(dev->name)-strlen(dev->name), "%s%s", m ? "+" : "", member.name);
+    if (m == 0) {
+      // Locality of the first member
+      *props = member;
+      continue;
+    }
+    props->ptrSupport &= member.ptrSupport;
+    props->speed += member.speed;
+    props->latency = std::max(props->latency, member.latency);
+    props->maxComms = std::min(props->maxComms, member.maxComms);
+  }
+  props->name = dev->name;
+  props->maxRecvs = 1;
+  nBondDevs++;
+  return ncclSuccess;
+}
+
+// config is either the number of consecutive devices to bond (the last group
+// can be smaller), or explicit groups: "0+1,2+3".
+static ncclResult_t ncclBondParseConfig(const char* config, int nBaseDevs) {
+  int members[BOND_MAX_MEMBERS];
+  if (strchr(config, '+') == NULL) {
+    int n = atoi(config);
+    if (n < 1 || n > BOND_MAX_MEMBERS) {
+      WARN("NET/Bond : invalid RCCL_NET_BOND=%s, expected 1 to %d devices per bond or groups like 0+1,2+3", config, BOND_MAX_MEMBERS);
+      return ncclInvalidUsage;
+    }
+    for (int d=0; d<nBaseDevs; d+=n) {
+      int nMembers = std::min(n, nBaseDevs-d);
+      for (int m=0; m<nMembers; m++) members[m] = d+m;
+      NCCLCHECK(ncclBondAddDev(members, nMembers, nBaseDevs));
+    }
+    return ncclSuccess;
+  }
+  const char* ptr = config;
+  while (*ptr) {
+    int nMembers = 0;
+    while (1) {
+      char* end;
+      long d = strtol(ptr, &end, 10);
+      if (end == ptr || nMembers == BOND_MAX_MEMBERS) {
+        WARN("NET/Bond : invalid RCCL_NET_BOND=%s at '%s'", config, ptr);
+        return ncclInvalidUsage;
+      }
+      members[nMembers++] = d;
+      ptr = end;
+      if (*ptr != '+') break;
+      ptr++;
+    }
+    NCCLCHECK(ncclBondAddDev(members, nMembers, nBaseDevs));
+    if (*ptr == ',') ptr++;
+    else if (*ptr) {
+      WARN("NET/Bond : invalid RCCL_NET_BOND=%s at '%s'", config, ptr);
+      return ncclInvalidUsage;
+    }
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondInit(ncclDebugLogger_t logFunction) { return ncclSuccess; }
+static ncclResult_t ncclBondDevices(int* ndev) { *ndev = nBondDevs; return ncclSuccess; }
+static ncclResult_t ncclBondGetProperties(int dev, ncclNetProperties_t* props) {
+  if (dev < 0 || dev >= nBondDevs) return ncclInternalError;
+  *props = bondDevs[dev].props;
+  return ncclSuccess;
+}
+
+// Member handles are packed as a length and the bytes up to their last non
+// zero byte, so that a few of them fit in one handle.
+struct ncclBondHandle {
+  struct ncclBondConnectStage* stage; // Used by the other side when connecting
+  uint8_t nMembers;
+  uint8_t data[NCCL_NET_HANDLE_MAXSIZE-sizeof(void*)-1];
+};
+
+struct ncclBondConnectStage {
+  ncclNetHandle_t handles[BOND_MAX_MEMBERS];
+  void* comms[BOND_MAX_MEMBERS];
+};
+
+struct ncclBondListenComm {
+  int dev;
+  void* listenComms[BOND_MAX_MEMBERS];
+  void* recvComms[BOND_MAX_MEMBERS];
+};
+
+struct ncclBondHeader {
+  int size;
+  int stripeSize;
+};
+
+struct ncclBondRequest {
+  struct ncclBondComm* comm;
+  int used;
+  uint64_t seq;
+  int send;
+  int flush;
+  char* data;
+  int size;
+  int tag;
+  struct ncclBondMhandle* mhandle;
+  int stripeSize, nStripes;
+  int posted;                 // stripes posted
+  void* hdrRequest;           // header, sent or received
+  int hdrPosted, hdrDone;
+  void* requests[BOND_MAX_MEMBERS];
+  uint32_t doneMask;          // stripes done
+};
+
+struct ncclBondComm {
+  int dev;
+  int nMembers;
+  void* comms[BOND_MAX_MEMBERS];
+  struct ncclBondHeader headers[BOND_MAX_REQUESTS];
+  void* hdrMhandle;
+  struct ncclBondRequest requests[BOND_MAX_REQUESTS];
+  uint64_t nextSeq;
+};
+
+struct ncclBondMhandle {
+  void* mhandles[BOND_MAX_MEMBERS];
+};
+
+static ncclResult_t ncclBondListen(int dev, void* opaqueHandle, void** listenComm) {
+  struct ncclBondHandle* handle = (struct ncclBondHandle*)opaqueHandle;
+  static_assert(sizeof(struct ncclBondHandle) <= NCCL_NET_HANDLE_MAXSIZE, "ncclBondHandle size too large");
+  if (dev < 0 || dev >= nBondDevs) return ncclInternalError;
+  struct ncclBondDev* bondDev = bondDevs+dev;
+  memset(handle, 0, sizeof(struct ncclBondHandle));
+  struct ncclBondListenComm* comm;
+  NCCLCHECK(ncclCalloc(&comm, 1));
+  comm->dev = dev;
+  ncclResult_t ret = ncclSuccess;
+  int offset = 0;
+  for (int m=0; m<bondDev->nMembers; m++) {
+    ncclNetHandle_t member;
+    memset(member, 0, sizeof(member));
+    NCCLCHECKGOTO(bondBase->listen(bondDev->members[m], member, comm->listenComms+m), ret, fail);
+    int len = NCCL_NET_HANDLE_MAXSIZE;
+    while (len > 0 && member[len-1] == 0) len--;
+    if (offset+1+len > (int)sizeof(handle->data)) {
+      WARN("NET/Bond : handles of the %d devices of %s do not fit in a net handle", bondDev->nMembers, bondDev->name);
+      ret = ncclInternalError;
+      goto fail;
+    }
+    handle->data[offset++] = len;
+    memcpy(handle->data+offset, member, len);
+    offset += len;
+  }
+  handle->nMembers = bondDev->nMembers;
+  *listenComm = comm;
+  return ncclSuccess;
+fail:
+  for (int m=0; m<bondDev->nMembers; m++) {
+    if (comm->listenComms[m]) bondBase->closeListen(comm->listenComms[m]);
+  }
+  free(comm);
+  return ret;
+}
+
+static ncclResult_t ncclBondNewComm(int dev, void** comms, struct ncclBondComm** bondComm) {
+  struct ncclBondComm* comm;
+  NCCLCHECK(ncclCalloc(&comm, 1));
+  comm->dev = dev;
+  comm->nMembers = bondDevs[dev].nMembers;
+  memcpy(comm->comms, comms, comm->nMembers*sizeof(void*));
+  NCCLCHECK(bondBase->regMr(comm->comms[0], comm->headers, sizeof(comm->headers), NCCL_PTR_HOST, &comm->hdrMhandle));
+  *bondComm = comm;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondConnect(int dev, void* opaqueHandle, void** sendComm) {
+  struct ncclBondHandle* handle = (struct ncclBondHandle*)opaqueHandle;
+  if (dev < 0 || dev >= nBondDevs) return ncclInternalError;
+  struct ncclBondDev* bondDev = bondDevs+dev;
+  *sendComm = NULL;
+  if (handle->nMembers != bondDev->nMembers) {
+    WARN("NET/Bond : remote device has %d members, local device %s has %d", handle->nMembers, bondDev->name, bondDev->nMembers);
+    return ncclInvalidUsage;
+  }
+  struct ncclBondConnectStage* stage = handle->stage;
+  if (stage == NULL) {
+    NCCLCHECK(ncclCalloc(&stage, 1));
+    handle->stage = stage;
+    int offset = 0;
+    for (int m=0; m<bondDev->nMembers; m++) {
+      int len = handle->data[offset++];
+      memcpy(stage->handles[m], handle->data+offset, len);
+      offset += len;
+    }
+  }
+  // Connect all members at once
+  int connected = 0;
+  for (int m=0; m<bondDev->nMembers; m++) {
+    if (stage->comms[m] == NULL) NCCLCHECK(bondBase->connect(bondDev->members[m], stage->handles[m], stage->comms+m));
+    if (stage->comms[m]) connected++;
+  }
+  if (connected < bondDev->nMembers) return ncclSuccess;
+  struct ncclBondComm* comm;
+  NCCLCHECK(ncclBondNewComm(dev, stage->comms, &comm));
+  free(stage);
+  handle->stage = NULL;
+  *sendComm = comm;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondAccept(void* listenComm, void** recvComm) {
+  struct ncclBondListenComm* lComm = (struct ncclBondListenComm*)listenComm;
+  struct ncclBondDev* bondDev = bondDevs+lComm->dev;
+  *recvComm = NULL;
+  int accepted = 0;
+  for (int m=0; m<bondDev->nMembers; m++) {
+    if (lComm->recvComms[m] == NULL) NCCLCHECK(bondBase->accept(lComm->listenComms[m], lComm->recvComms+m));
+    if (lComm->recvComms[m]) accepted++;
+  }
+  if (accepted < bondDev->nMembers) return ncclSuccess;
+  struct ncclBondComm* comm;
+  NCCLCHECK(ncclBondNewComm(lComm->dev, lComm->recvComms, &comm));
+  memset(lComm->recvComms, 0, sizeof(lComm->recvComms));
+  *recvComm = comm;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondRegMr(void* bondComm, void* data, int size, int type, void** mhandle) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)bondComm;
+  struct ncclBondMhandle* mh;
+  NCCLCHECK(ncclCalloc(&mh, 1));
+  for (int m=0; m<comm->nMembers; m++) {
+    ncclResult_t ret = bondBase->regMr(comm->comms[m], data, size, type, mh->mhandles+m);
+    if (ret != ncclSuccess) {
+      for (int i=0; i<m; i++) bondBase->deregMr(comm->comms[i], mh->mhandles[i]);
+      free(mh);
+      return ret;
+    }
+  }
+  *mhandle = mh;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondRegMrDmaBuf(void* bondComm, void* data, size_t size, int type, uint64_t offset, int fd, void** mhandle) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)bondComm;
+  struct ncclBondMhandle* mh;
+  NCCLCHECK(ncclCalloc(&mh, 1));
+  for (int m=0; m<comm->nMembers; m++) {
+    ncclResult_t ret = bondBase->regMrDmaBuf(comm->comms[m], data, size, type, offset, fd, mh->mhandles+m);
+    if (ret != ncclSuccess) {
+      for (int i=0; i<m; i++) bondBase->deregMr(comm->comms[i], mh->mhandles[i]);
+      free(mh);
+      return ret;
+    }
+  }
+  *mhandle = mh;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondDeregMr(void* bondComm, void* mhandle) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)bondComm;
+  struct ncclBondMhandle* mh = (struct ncclBondMhandle*)mhandle;
+  if (mh == NULL) return ncclSuccess;
+  for (int m=0; m<comm->nMembers; m++) NCCLCHECK(bondBase->deregMr(comm->comms[m], mh->mhandles[m]));
+  free(mh);
+  return ncclSuccess;
+}
+
+// Splits size bytes in stripes of at least NET_BOND_MIN_STRIPE bytes, one per member at most
+static void ncclBondStripes(int size, int nMembers, int* stripeSize) {
+  int64_t minStripe = std::max((int64_t)BOND_STRIPE_ALIGN, rcclParamNetBondMinStripe());
+  int nStripes = std::min((int64_t)nMembers, std::max((int64_t)1, size/minStripe));
+  *stripeSize = ROUNDUP(DIVUP(size, nStripes), BOND_STRIPE_ALIGN);
+}
+
+static int ncclBondNumStripes(int size, int stripeSize) {
+  return size == 0 ? 0 : DIVUP(size, stripeSize);
+}
+
+static ncclResult_t ncclBondGetRequest(struct ncclBondComm* comm, struct ncclBondRequest** req) {
+  *req = NULL;
+  for (int r=0; r<BOND_MAX_REQUESTS; r++) {
+    if (comm->requests[r].used) continue;
+    *req = comm->requests+r;
+    memset(*req, 0, sizeof(struct ncclBondRequest));
+    (*req)->comm = comm;
+    (*req)->used = 1;
+    (*req)->seq = comm->nextSeq++;
+    return ncclSuccess;
+  }
+  return ncclSuccess;
+}
+
+// Posts what the order of the messages allows, oldest request first
+static ncclResult_t ncclBondProgress(struct ncclBondComm* comm) {
+  while (1) {
+    struct ncclBondRequest* req = NULL;
+    for (int r=0; r<BOND_MAX_REQUESTS; r++) {
+      struct ncclBondRequest* other = comm->requests+r;
+      if (!other->used || other->flush) continue;
+      if (other->hdrPosted && (other->send || other->hdrDone) && other->posted == other->nStripes) continue;
+      if (req == NULL || other->seq < req->seq) req = other;
+    }
+    if (req == NULL) return ncclSuccess;
+
+    struct ncclBondHeader* header = comm->headers+(req-comm->requests);
+    if (!req->hdrPosted) {
+      if (req->send) {
+        header->size = req->size;
+        header->stripeSize = req->stripeSize;
+        NCCLCHECK(bondBase->isend(comm->comms[0], header, sizeof(struct ncclBondHeader), req->tag, comm->hdrMhandle, &req->hdrRequest));
+      } else {
+        int size = sizeof(struct ncclBondHeader);
+        void* data = header;
+        NCCLCHECK(bondBase->irecv(comm->comms[0], 1, &data, &size, &req->tag, &comm->hdrMhandle, &req->hdrRequest));
+      }
+      if (req->hdrRequest == NULL) return ncclSuccess;
+      req->hdrPosted = 1;
+    }
+    if (!req->send && !req->hdrDone) {
+      NCCLCHECK(bondBase->test(req->hdrRequest, &req->hdrDone, NULL));
+      if (!req->hdrDone) return ncclSuccess;
+      if (header->size > req->size) {
+        WARN("NET/Bond : message of %d bytes is larger than the posted receive of %d bytes", header->size, req->size);
+        return ncclInternalError;
+      }
+      req->size = header->size;
+      req->stripeSize = header->stripeSize;
+      req->nStripes = ncclBondNumStripes(req->size, req->stripeSize);
+    }
+    while (req->posted < req->nStripes) {
+      int m = req->posted;
+      char* data = req->data + (size_t)m*req->stripeSize;
+      int size = std::min(req->stripeSize, req->size - m*req->stripeSize);
+      void* mhandle = req->mhandle ? req->mhandle->mhandles[m] : NULL;
+      if (req->send) {
+        NCCLCHECK(bondBase->isend(comm->comms[m], data, size, req->tag, mhandle, req->requests+m));
+      } else {
+        NCCLCHECK(bondBase->irecv(comm->comms[m], 1, (void**)&data, &size, &req->tag, &mhandle, req->requests+m));
+      }
+      if (req->requests[m] == NULL) return ncclSuccess;
+      req->posted++;
+    }
+  }
+}
+
+static ncclResult_t ncclBondIsend(void* sendComm, void* data, int size, int tag, void* mhandle, void** request) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)sendComm;
+  struct ncclBondRequest* req;
+  NCCLCHECK(ncclBondGetRequest(comm, &req));
+  *request = req;
+  if (req == NULL) return ncclSuccess;
+  req->send = 1;
+  req->data = (char*)data;
+  req->size = size;
+  req->tag = tag;
+  req->mhandle = (struct ncclBondMhandle*)mhandle;
+  ncclBondStripes(size, comm->nMembers, &req->stripeSize);
+  req->nStripes = ncclBondNumStripes(size, req->stripeSize);
+  NCCLCHECK(ncclBondProgress(comm));
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondIrecv(void* recvComm, int n, void** data, int* sizes, int* tags, void** mhandles, void** request) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)recvComm;
+  if (n != 1) return ncclInternalError;
+  struct ncclBondRequest* req;
+  NCCLCHECK(ncclBondGetRequest(comm, &req));
+  *request = req;
+  if (req == NULL) return ncclSuccess;
+  req->data = (char*)data[0];
+  req->size = sizes[0];
+  req->tag = tags[0];
+  req->mhandle = (struct ncclBondMhandle*)mhandles[0];
+  NCCLCHECK(ncclBondProgress(comm));
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondIflush(void* recvComm, int n, void** data, int* sizes, void** mhandles, void** request) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)recvComm;
+  *request = NULL;
+  if (n != 1) return ncclInternalError;
+  struct ncclBondRequest* req;
+  NCCLCHECK(ncclBondGetRequest(comm, &req));
+  if (req == NULL) return ncclInternalError;
+  req->flush = 1;
+  // The stripes of the message are not known here, flush every member
+  req->nStripes = comm->nMembers;
+  struct ncclBondMhandle* mh = (struct ncclBondMhandle*)mhandles[0];
+  int pending = 0;
+  for (int m=0; m<comm->nMembers; m++) {
+    NCCLCHECK(bondBase->iflush(comm->comms[m], 1, data, sizes, mh->mhandles+m, req->requests+m));
+    if (req->requests[m]) pending++;
+    else req->doneMask |= 1U<<m;
+  }
+  req->posted = req->nStripes;
+  req->hdrPosted = req->hdrDone = 1;
+  if (pending == 0) req->used = 0;
+  else *request = req;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondTest(void* request, int* done, int* sizes) {
+  struct ncclBondRequest* req = (struct ncclBondRequest*)request;
+  struct ncclBondComm* comm = req->comm;
+  *done = 0;
+  NCCLCHECK(ncclBondProgress(comm));
+  if (req->send && req->hdrPosted && !req->hdrDone) NCCLCHECK(bondBase->test(req->hdrRequest, &req->hdrDone, NULL));
+  for (int m=0; m<req->posted; m++) {
+    if (req->doneMask & (1U<<m)) continue;
+    int memberDone;
+    NCCLCHECK(bondBase->test(req->requests[m], &memberDone, NULL));
+    if (memberDone) req->doneMask |= 1U<<m;
+  }
+  if (req->hdrDone && req->posted == req->nStripes && req->doneMask == (1U<<req->nStripes)-1) {
+    *done = 1;
+    if (sizes) *sizes = req->size;
+    req->used = 0;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondClose(void* bondComm) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)bondComm;
+  if (comm == NULL) return ncclSuccess;
+  NCCLCHECK(bondBase->deregMr(comm->comms[0], comm->hdrMhandle));
+  // Send and receive comms of the base network are closed the same way
+  for (int m=0; m<comm->nMembers; m++) NCCLCHECK(bondBase->closeSend(comm->comms[m]));
+  free(comm);
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondCloseRecv(void* bondComm) {
+  struct ncclBondComm* comm = (struct ncclBondComm*)bondComm;
+  if (comm == NULL) return ncclSuccess;
+  NCCLCHECK(bondBase->deregMr(comm->comms[0], comm->hdrMhandle));
+  for (int m=0; m<comm->nMembers; m++) NCCLCHECK(bondBase->closeRecv(comm->comms[m]));
+  free(comm);
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclBondCloseListen(void* listenComm) {
+  struct ncclBondListenComm* comm = (struct ncclBondListenComm*)listenComm;
+  if (comm == NULL) return ncclSuccess;
+  for (int m=0; m<bondDevs[comm->dev].nMembers; m++) {
+    if (comm->recvComms[m]) NCCLCHECK(bondBase->closeRecv(comm->recvComms[m]));
+    NCCLCHECK(bondBase->closeListen(comm->listenComms[m]));
+  }
+  free(comm);
+  return ncclSuccess;
+}
+
+static ncclNet_t ncclNetBond = {
+  "Bond",
+  ncclBondInit,
+  ncclBondDevices,
+  ncclBondGetProperties,
+  ncclBondListen,
+  ncclBondConnect,
+  ncclBondAccept,
+  ncclBondRegMr,
+  NULL, // Set if the base network supports DMA-BUF
+  ncclBondDeregMr,
+  ncclBondIsend,
+  ncclBondIrecv,
+  ncclBondIflush,
+  ncclBondTest,
+  ncclBondClose,
+  ncclBondCloseRecv,
+  ncclBondCloseListen
+};
+
+ncclResult_t ncclNetBondInit(ncclNet_t* base, const char* config, ncclNet_t** net) {
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&bondLock);
+  if (bondBase == NULL) {
+    int nBaseDevs;
+    bondBase = base;
+    NCCLCHECKGOTO(base->devices(&nBaseDevs), ret, exit);
+    NCCLCHECKGOTO(ncclBondParseConfig(config, nBaseDevs), ret, exit);
+    ncclNetBond.regMrDmaBuf = base->regMrDmaBuf ? ncclBondRegMrDmaBuf : NULL;
+    for (int d=0; d<nBondDevs; d++) {
+      INFO(NCCL_INIT|NCCL_NET, "NET/Bond : [%d] %s over NET/%s, speed %d", d, bondDevs[d].name, base->name, bondDevs[d].props.speed);
+    }
+  } else if (bondBase != base) {
+    INFO(NCCL_INIT|NCCL_NET, "NET/Bond : already bonding NET/%s, not bonding NET/%s", bondBase->name, base->name);
+    *net = base;
+    goto exit;
+  }
+  *net = &ncclNetBond;
+exit:
+  if (ret != ncclSuccess) {
+    bondBase = NULL;
+    nBondDevs = 0;
+  }
+  pthread_mutex_unlock(&bondLock);
+  return ret;
+}
+
+ncclNet_t* ncclNetBondBase(ncclNet_t* net) {
+  return net == &ncclNetBond ? bondBase : net;
+}
@@ -345,14 +345,18 @@ ncclResult_t ncclSocketConnect(int dev, void* opaqueHandle, void** sendComm) {
   comm->nThreads = handle->nThreads;
   comm->dev = dev;
   CUDACHECK(hipGetDevice(&comm->cudaDev));
+  // Start all connections at once so that their handshakes overlap; the
+  // receiver places each socket according to the index sent on it.
+  for (int s=0; s<comm->nSocks+1; s++) {
+    sock = s == comm->nSocks ? &comm->ctrlSock : comm->socks+s;
+    NCCLCHECK(ncclSocketInit(sock, &handle->connectAddr, NULL, 1));
+    NCCLCHECK(ncclSocketConnect(sock));
+  }
   for (; i<comm->nSocks+1; i++) {
     sock = i == comm->nSocks ? &comm->ctrlSock : comm->socks+i;
-    NCCLCHECK(ncclSocketInit(sock, &handle->connectAddr, NULL, 1));
-
     stage->sock = sock;
     stage->state = ncclSocketCommStateConnect;
     stage->iteration = i;
-    NCCLCHECK(ncclSocketConnect(sock));
 
 socket_connect_check:
     NCCLCHECK(ncclGetSocketState(sock, &conState));
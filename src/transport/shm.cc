@@ -6,10 +6,13 @@
 
 #include "comm.h"
 #include "shm.h"
+#include "cpucopy.h"
+#include "hugepage.h"
 
 struct shmConnectInfo {
   char shmName[7];
   int shmSize;
+  int hugePages; // shmName is in RCCL_HUGEPAGES_DIR rather than /dev/shm
 };
 static_assert(sizeof(shmConnectInfo) <= CONNECT_SIZE, "SHM Connect info is too large");
 
@@ -40,6 +43,10 @@ static int useMemcpySend = 0;
 static int useMemcpyRecv = 0;
 NCCL_PARAM(ShmLocality, "SHM_LOCALITY", SHM_RECV_SIDE); // 1 is sender-size, 2 is receiver-size
 static int shmLocality = 0;
+// With SHM_USE_CUDA_MEMCPY, copy the steps with CPU threads rather than hipMemcpyAsync
+RCCL_PARAM(ShmCpuCopyThreads, "SHM_CPU_COPY_THREADS", 0);
+RCCL_PARAM(ShmCpuCopyChunkSize, "SHM_CPU_COPY_CHUNKSIZE", 128<<10);
+RCCL_PARAM(ShmCpuCopyNt, "SHM_CPU_COPY_NT", 1);
 static void initCeOperation();
 
 /* Determine two peers can communicate with SHM */
@@ -64,6 +71,22 @@ static ncclResult_t shmCanConnect(int* ret, struct ncclTopoSystem* topo, struct
 
 #define MAX_SHM_NAME_LEN 1024
 
+// Segments are created as <dir>/nccl-XXXXXX, in /dev/shm or on hugetlbfs
+static ncclResult_t shmSetName(struct shmConnectInfo* info, const char* shmPath) {
+  const char* name = strrchr(shmPath, '/');
+  if (name == NULL || strlen(name) != sizeof("/nccl-XXXXXX")-1) {
+    WARN("Unexpected shared memory segment %s", shmPath);
+    return ncclInternalError;
+  }
+  memcpy(info->shmName, name+sizeof("/nccl-")-1, sizeof(info->shmName));
+  info->hugePages = strncmp(shmPath, "/dev/shm/", sizeof("/dev/shm/")-1) != 0;
+  return ncclSuccess;
+}
+
+static void shmGetPath(struct shmConnectInfo* info, char* shmPath) {
+  snprintf(shmPath, PATH_MAX, "%s/nccl-%s", info->hugePages ? ncclHugePagesDir() : "/dev/shm", info->shmName);
+}
+
 /* Create and return connect structures for this peer to connect to me */
 static ncclResult_t shmSendSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, struct ncclPeerInfo* myInfo, struct ncclPeerInfo* peerInfo, struct ncclConnect* connectInfo, struct ncclConnector* send, int channelId, int connIndex) {
   struct shmSendResources* resources;
@@ -80,11 +103,12 @@ static ncclResult_t shmSendSetup(struct ncclComm* comm, struct ncclTopoGraph* gr
     for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) shmSize += send->comm->buffSizes[p];
   }
   info->shmSize = resources->shmSize = shmSize;
-  NCCLCHECK(ncclShmOpen(shmPath, resources->shmSize, (void**)&resources->hostMem, (void**)&resources->devHostMem, 1));
+  NCCLCHECK(ncclShmOpen(shmPath, resources->shmSize, (void**)&resources->hostMem, (void**)&resources->devHostMem, 1, 1));
   TRACE(NCCL_SHM,"Opened shmName %s shmSize %d", shmPath, info->shmSize);
-  memcpy(info->shmName, shmPath+sizeof("/dev/shm/nccl-")-1, sizeof(info->shmName));
+  NCCLCHECK(shmSetName(info, shmPath));
 
-  INFO(NCCL_INIT|NCCL_SHM,"Channel %02d : %d[%lx] -> %d[%lx] via SHM/%s/%s comm %p nRanks %02d", channelId, myInfo->rank, myInfo->busId, peerInfo->rank, peerInfo->busId, useMemcpySend?"CE":"direct", useMemcpyRecv?"CE":"direct", comm, comm->nRanks);
+  const char* copyMode = rcclParamShmCpuCopyThreads() > 0 ? "CPU" : "CE";
+  INFO(NCCL_INIT|NCCL_SHM,"Channel %02d : %d[%lx] -> %d[%lx] via SHM/%s/%s comm %p nRanks %02d", channelId, myInfo->rank, myInfo->busId, peerInfo->rank, peerInfo->busId, useMemcpySend?copyMode:"direct", useMemcpyRecv?copyMode:"direct", comm, comm->nRanks);
   return ncclSuccess;
 }
 
@@ -103,9 +127,9 @@ static ncclResult_t shmRecvSetup(struct ncclComm* comm, struct ncclTopoGraph* gr
     for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) shmSize += recv->comm->buffSizes[p];
   }
   info->shmSize = resources->shmSize = shmSize;
-  NCCLCHECK(ncclShmOpen(shmPath, resources->shmSize, (void**)&resources->hostMem, (void**)&resources->devHostMem, 1));
+  NCCLCHECK(ncclShmOpen(shmPath, resources->shmSize, (void**)&resources->hostMem, (void**)&resources->devHostMem, 1, 1));
   TRACE(NCCL_SHM,"Opened shmName %s shmSize %d", shmPath, info->shmSize);
-  memcpy(info->shmName, shmPath+sizeof("/dev/shm/nccl-")-1, sizeof(info->shmName));
+  NCCLCHECK(shmSetName(info, shmPath));
 
   return ncclSuccess;
 }
@@ -121,6 +145,9 @@ struct shmProxyInfo {
   uint64_t step;
   hipStream_t stream;
   hipEvent_t events[NCCL_STEPS];
+  // CPU copies: devFifo is host memory, copied by the threads of copyPool
+  struct ncclCpuCopyPool* copyPool;
+  uint32_t copyPending[NCCL_STEPS];
 };
 
 /* Connect to this peer */
@@ -130,7 +157,7 @@ static ncclResult_t shmSendConnect(struct ncclComm* comm, struct ncclConnect* co
   struct shmSendResources* resources = (struct shmSendResources*)send->transportResources;
 
   char shmPath[PATH_MAX];
-  sprintf(shmPath, "/dev/shm/nccl-%s", info->shmName);
+  shmGetPath(info, shmPath);
   resources->remShmSize = info->shmSize;
   TRACE(NCCL_SHM,"Open shmName %s shmSize %d", shmPath, info->shmSize);
   NCCLCHECK(ncclShmOpen(shmPath, resources->remShmSize, (void**)&resources->remHostMem, (void**)&resources->devRemHostMem, 0));
@@ -165,7 +192,7 @@ static ncclResult_t shmRecvConnect(struct ncclComm* comm, struct ncclConnect* co
   struct shmConnectInfo* info = (struct shmConnectInfo*)connectInfo;
 
   char shmPath[PATH_MAX];
-  sprintf(shmPath, "/dev/shm/nccl-%s", info->shmName);
+  shmGetPath(info, shmPath);
   resources->remShmSize = info->shmSize;
   TRACE(NCCL_SHM,"Open shmName %s shmSize %d", shmPath, info->shmSize);
   NCCLCHECK(ncclShmOpen(shmPath, resources->remShmSize, (void**)&resources->remHostMem, (void**)&resources->devRemHostMem, 0));
@@ -205,17 +232,33 @@ static ncclResult_t shmRecvFree(struct ncclConnector* recv) {
   return ncclSuccess;
 }
 
-static ncclResult_t shmSendProxyConnect(struct ncclProxyConnection* connection, struct ncclComm* comm, void* reqBuff, int reqSize, void* respBuff, int respSize, int* done) {
+// Sets up the copies between devFifo and the SHM buffer, on the proxy side
+static ncclResult_t shmProxySetup(struct ncclProxyConnection* connection, struct ncclComm* comm, void* reqBuff, int reqSize, void* respBuff, int respSize) {
   struct shmProxyInfo* proxyInfo;
   NCCLCHECK(ncclCalloc(&proxyInfo, 1));
   if (reqSize != sizeof(struct shmProxyInfo)) return ncclInternalError;
   memcpy(proxyInfo, reqBuff, reqSize);
-  NCCLCHECK(ncclCudaCalloc(&proxyInfo->devFifo, comm->buffSizes[NCCL_PROTO_SIMPLE], comm->sideStream));
-  NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->ceRecvMem, 1));
-  CUDACHECK(hipStreamCreateWithFlags(&proxyInfo->stream, hipStreamNonBlocking));
-  for (int i=0; i<NCCL_STEPS; i++) {
-    CUDACHECK(hipEventCreate(proxyInfo->events+i));
+  int nThreads = rcclParamShmCpuCopyThreads();
+  if (nThreads > 0) {
+    // The GPU accesses the fifo in host memory, close to it as this thread
+    // follows the GPU affinity, and CPU threads copy it to or from the SHM
+    // buffer, which may be on another NUMA node.
+    struct ncclProxyState* state = &comm->proxyState;
+    if (state->shmCopyPool == NULL) {
+      NCCLCHECK(ncclCpuCopyPoolCreate(&state->shmCopyPool, nThreads, rcclParamShmCpuCopyChunkSize(), rcclParamShmCpuCopyNt(), &comm->cpuAffinity));
+      INFO(NCCL_INIT|NCCL_SHM, "SHM copies by %d CPU threads, %ld bytes chunks%s", nThreads, rcclParamShmCpuCopyChunkSize(), rcclParamShmCpuCopyNt() ? ", non-temporal stores" : "");
+    }
+    state->shmCopyPoolRefs++;
+    proxyInfo->copyPool = state->shmCopyPool;
+    NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->devFifo, comm->buffSizes[NCCL_PROTO_SIMPLE]));
+  } else {
+    NCCLCHECK(ncclCudaCalloc(&proxyInfo->devFifo, comm->buffSizes[NCCL_PROTO_SIMPLE], comm->sideStream));
+    CUDACHECK(hipStreamCreateWithFlags(&proxyInfo->stream, hipStreamNonBlocking));
+    for (int i=0; i<NCCL_STEPS; i++) {
+      CUDACHECK(hipEventCreate(proxyInfo->events+i));
+    }
   }
+  NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->ceRecvMem, 1));
   connection->proxyAppendPtr = &connection->proxyAppend;
   connection->transportResources = proxyInfo;
   if (respSize != sizeof(struct shmProxyInfo)) return ncclInternalError;
@@ -223,45 +266,67 @@ static ncclResult_t shmSendProxyConnect(struct ncclProxyConnection* connection,
   return ncclSuccess;
 }
 
+static ncclResult_t shmSendProxyConnect(struct ncclProxyConnection* connection, struct ncclComm* comm, void* reqBuff, int reqSize, void* respBuff, int respSize, int* done) {
+  return shmProxySetup(connection, comm, reqBuff, reqSize, respBuff, respSize);
+}
+
 static ncclResult_t shmRecvProxyConnect(struct ncclProxyConnection* connection, struct ncclComm* comm, void* reqBuff, int reqSize, void* respBuff, int respSize, int* done) {
-  struct shmProxyInfo* proxyInfo;
-  NCCLCHECK(ncclCalloc(&proxyInfo, 1));
-  if (reqSize != sizeof(struct shmProxyInfo)) return ncclInternalError;
-  memcpy(proxyInfo, reqBuff, reqSize);
-  NCCLCHECK(ncclCudaCalloc(&proxyInfo->devFifo, comm->buffSizes[NCCL_PROTO_SIMPLE], comm->sideStream));
-  NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->ceRecvMem, 1));
-  CUDACHECK(hipStreamCreateWithFlags(&proxyInfo->stream, hipStreamNonBlocking));
-  for (int i=0; i<NCCL_STEPS; i++) {
-    CUDACHECK(hipEventCreate(proxyInfo->events+i));
-  }
-  connection->proxyAppendPtr = &connection->proxyAppend;
-  connection->transportResources = proxyInfo;
-  if (respSize != sizeof(struct shmProxyInfo)) return ncclInternalError;
-  memcpy(respBuff, proxyInfo, respSize);
-  return ncclSuccess;
+  return shmProxySetup(connection, comm, reqBuff, reqSize, respBuff, respSize);
 }
 
-static ncclResult_t shmSendProxyFree(struct ncclProxyConnection* connection, struct ncclComm* comm) {
+static ncclResult_t shmProxyFree(struct ncclProxyConnection* connection, struct ncclComm* comm) {
   struct shmProxyInfo* resources = (struct shmProxyInfo*)connection->transportResources;
-  CUDACHECK(hipStreamDestroy(resources->stream));
-  CUDACHECK(hipFree(resources->devFifo));
-  NCCLCHECK(ncclCudaHostFree(resources->ceRecvMem));
-  for (int i=0; i<NCCL_STEPS; i++) {
-    CUDACHECK(hipEventDestroy(resources->events[i]));
+  if (resources->copyPool) {
+    // Copies still in flight write to or read from devFifo
+    for (int i=0; i<NCCL_STEPS; i++) {
+      while (__atomic_load_n(resources->copyPending+i, __ATOMIC_ACQUIRE)) sched_yield();
+    }
+    NCCLCHECK(ncclCudaHostFree(resources->devFifo));
+    struct ncclProxyState* state = &comm->proxyState;
+    if (--state->shmCopyPoolRefs == 0) {
+      NCCLCHECK(ncclCpuCopyPoolDestroy(state->shmCopyPool));
+      state->shmCopyPool = NULL;
+    }
+  } else {
+    CUDACHECK(hipStreamDestroy(resources->stream));
+    CUDACHECK(hipFree(resources->devFifo));
+    for (int i=0; i<NCCL_STEPS; i++) {
+      CUDACHECK(hipEventDestroy(resources->events[i]));
+    }
   }
+  NCCLCHECK(ncclCudaHostFree(resources->ceRecvMem));
   free(connection->transportResources);
   return ncclSuccess;
 }
 
+static ncclResult_t shmSendProxyFree(struct ncclProxyConnection* connection, struct ncclComm* comm) {
+  return shmProxyFree(connection, comm);
+}
+
 static ncclResult_t shmRecvProxyFree(struct ncclProxyConnection* connection, struct ncclComm* comm) {
-  struct shmProxyInfo* resources = (struct shmProxyInfo*)connection->transportResources;
-  CUDACHECK(hipStreamDestroy(resources->stream));
-  CUDACHECK(hipFree(resources->devFifo));
-  NCCLCHECK(ncclCudaHostFree(resources->ceRecvMem));
-  for (int i=0; i<NCCL_STEPS; i++) {
-    CUDACHECK(hipEventDestroy(resources->events[i]));
+  return shmProxyFree(connection, comm);
+}
+
+// Starts the copy of a step, with the CPU threads or the copy engine
+static ncclResult_t shmProxyCopyStart(struct shmProxyInfo* resources, int buffSlot, void* dst, void* src, int size, hipMemcpyKind kind) {
+  if (resources->copyPool) {
+    NCCLCHECK(ncclCpuCopyPoolSubmit(resources->copyPool, dst, src, size, resources->copyPending+buffSlot));
+  } else {
+    CUDACHECK(hipMemcpyAsync(dst, src, size, kind, resources->stream));
+    CUDACHECK(hipEventRecord(resources->events[buffSlot], resources->stream));
   }
-  free(connection->transportResources);
+  return ncclSuccess;
+}
+
+// Sets *done when the copy of a step has completed
+static ncclResult_t shmProxyCopyTest(struct shmProxyInfo* resources, int buffSlot, int* done) {
+  if (resources->copyPool) {
+    *done = __atomic_load_n(resources->copyPending+buffSlot, __ATOMIC_ACQUIRE) == 0;
+    return ncclSuccess;
+  }
+  hipError_t res = hipEventQuery(resources->events[buffSlot]);
+  if (res != hipErrorNotReady) CUDACHECK(res);
+  *done = res == hipSuccess;
   return ncclSuccess;
 }
 
@@ -295,8 +360,7 @@ static ncclResult_t shmSendProxyProgress(struct ncclComm* comm, struct ncclProxy
         // Check GPU has sent everything
         if ((*recvTail > sub->base+sub->transmitted)) {
           int size = sizesFifo[buffSlot];
-          CUDACHECK(hipMemcpyAsync(resources->shmFifo+buffSlot*stepSize, resources->devFifo+buffSlot*stepSize, size, hipMemcpyDeviceToHost, resources->stream));
-          CUDACHECK(hipEventRecord(resources->events[buffSlot], resources->stream));
+          NCCLCHECK(shmProxyCopyStart(resources, buffSlot, resources->shmFifo+buffSlot*stepSize, resources->devFifo+buffSlot*stepSize, size, hipMemcpyDeviceToHost));
           resources->recvMem->sizesFifo[buffSlot] = size;
           __sync_synchronize(); // make sure sizesFifo is visible
           sub->transmitted += args->sliceSteps;
@@ -304,9 +368,9 @@ static ncclResult_t shmSendProxyProgress(struct ncclComm* comm, struct ncclProxy
       }
       if (sub->done < sub->transmitted) {
         int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
-        hipError_t res = hipEventQuery(resources->events[buffSlot]);
-        if (res != hipErrorNotReady) CUDACHECK(res);
-        if (res == hipSuccess) {
+        int copied;
+        NCCLCHECK(shmProxyCopyTest(resources, buffSlot, &copied));
+        if (copied) {
           sub->done += args->sliceSteps;
           // Notify SHM
           resources->recvMem->tail = sub->base + sub->done;
@@ -354,16 +418,15 @@ static ncclResult_t shmRecvProxyProgress(struct ncclComm* comm, struct ncclProxy
         // Check data is ready in SHM
         if ((*recvTail > sub->base+sub->transmitted)) {
           int size = sizesFifo[buffSlot];
-          CUDACHECK(hipMemcpyAsync(resources->devFifo+buffSlot*stepSize, resources->shmFifo+buffSlot*stepSize, size, hipMemcpyHostToDevice, resources->stream));
-          CUDACHECK(hipEventRecord(resources->events[buffSlot], resources->stream));
+          NCCLCHECK(shmProxyCopyStart(resources, buffSlot, resources->devFifo+buffSlot*stepSize, resources->shmFifo+buffSlot*stepSize, size, hipMemcpyHostToDevice));
           sub->transmitted += args->sliceSteps;
         }
       }
       if (sub->done < sub->transmitted) {
         int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
-        hipError_t res = hipEventQuery(resources->events[buffSlot]);
-        if (res != hipErrorNotReady) CUDACHECK(res);
-        if (res == hipSuccess) {
+        int copied;
+        NCCLCHECK(shmProxyCopyTest(resources, buffSlot, &copied));
+        if (copied) {
           sub->done += args->sliceSteps;
           // Notify GPU
           resources->ceRecvMem->tail = sub->base + sub->done;
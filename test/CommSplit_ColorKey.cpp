@@ -0,0 +1,91 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#include "TestBed.hpp"
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace RcclUnitTesting
+{
+  // Splits a single process clique of numGpus ranks into even / odd ranks (in
+  // reverse order) and runs an AllReduce on the new communicators.
+  // Runs in a forked process so that HIP is never initialized in the parent,
+  // which would break the TestBed children of later tests.
+  static int RunCommSplit(int const numGpus)
+  {
+    std::vector<ncclComm_t> comms(numGpus), subComms(numGpus);
+    if (ncclCommInitAll(comms.data(), numGpus, NULL) != ncclSuccess) return 1;
+
+    ncclGroupStart();
+    for (int rank = 0; rank < numGpus; ++rank)
+      ncclCommSplit(comms[rank], rank % 2, numGpus - rank, &subComms[rank]);
+    if (ncclGroupEnd() != ncclSuccess) return 2;
+
+    int const numEven = (numGpus + 1) / 2;
+    std::vector<float*> buffers(numGpus);
+    for (int rank = 0; rank < numGpus; ++rank)
+    {
+      int const color   = rank % 2;
+      int const subSize = color ? numGpus - numEven : numEven;
+      int count, subRank;
+      if (ncclCommCount(subComms[rank], &count) != ncclSuccess || count != subSize) return 3;
+      // Keys are decreasing with rank, so the new ranks are reversed
+      if (ncclCommUserRank(subComms[rank], &subRank) != ncclSuccess || subRank != subSize - 1 - rank / 2) return 4;
+
+      float const one = 1.0f;
+      if (hipSetDevice(rank) != hipSuccess) return 5;
+      if (hipMalloc(&buffers[rank], sizeof(float)) != hipSuccess) return 5;
+      if (hipMemcpy(buffers[rank], &one, sizeof(float), hipMemcpyHostToDevice) != hipSuccess) return 5;
+    }
+
+    ncclGroupStart();
+    for (int rank = 0; rank < numGpus; ++rank)
+      ncclAllReduce(buffers[rank], buffers[rank], 1, ncclFloat32, ncclSum, subComms[rank], NULL);
+    if (ncclGroupEnd() != ncclSuccess) return 6;
+
+    for (int rank = 0; rank < numGpus; ++rank)
+    {
+      float result;
+      if (hipSetDevice(rank) != hipSuccess) return 7;
+      if (hipMemcpy(&result, buffers[rank], sizeof(float), hipMemcpyDeviceToHost) != hipSuccess) return 7;
+      if (result != (rank % 2 ? numGpus - numEven : numEven)) return 8;
+      hipFree(buffers[rank]);
+      ncclCommDestroy(subComms[rank]);
+      ncclCommDestroy(comms[rank]);
+    }
+    return 0;
+  }
+
+  static void ForkCommSplit(int const numGpus, std::vector<std::pair<char const*, char const*>> const& envVars)
+  {
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0)
+    {
+      for (auto const& envVar : envVars) setenv(envVar.first, envVar.second, 1);
+      exit(RunCommSplit(numGpus));
+    }
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+  }
+
+  TEST(CommSplit, ColorKey)
+  {
+    EnvVars ev;
+    if (ev.maxGpus < 2) return;
+    ForkCommSplit(ev.maxGpus, {});
+  }
+
+  TEST(CommSplit, SocketTransport)
+  {
+    EnvVars ev;
+    if (ev.maxGpus < 2) return;
+    // Force all connections of the new communicators through the socket transport
+    ForkCommSplit(ev.maxGpus, {{"NCCL_P2P_DISABLE", "1"}, {"NCCL_SHM_DISABLE", "1"}, {"NCCL_NET", "Socket"}});
+  }
+}
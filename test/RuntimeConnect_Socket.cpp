@@ -0,0 +1,38 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#include "TestBed.hpp"
+#include <cstdlib>
+namespace RcclUnitTesting
+{
+  TEST(RuntimeConnect, Socket)
+  {
+    // Connect rings / trees on first use, and force all connections through the socket transport.
+    // AllToAll only uses p2p connections, AllGather then connects rings and AllReduce trees.
+    setenv("RCCL_RUNTIME_CONNECT", "1", 1);
+    setenv("NCCL_P2P_DISABLE", "1", 1);
+    setenv("NCCL_SHM_DISABLE", "1", 1);
+    setenv("NCCL_NET", "Socket", 1);
+
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes      = {ncclCollAllToAll, ncclCollAllGather, ncclCollAllReduce};
+    std::vector<ncclDataType_t> const dataTypes      = {ncclFloat32};
+    std::vector<ncclRedOp_t>    const redOps         = {ncclSum};
+    std::vector<int>            const roots          = {0};
+    std::vector<int>            const numElements    = {1048576, 1024};
+    std::vector<bool>           const inPlaceList    = {false};
+    std::vector<bool>           const managedMemList = {false};
+
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements, inPlaceList, managedMemList);
+    testBed.Finalize();
+
+    unsetenv("RCCL_RUNTIME_CONNECT");
+    unsetenv("NCCL_P2P_DISABLE");
+    unsetenv("NCCL_SHM_DISABLE");
+    unsetenv("NCCL_NET");
+  }
+}
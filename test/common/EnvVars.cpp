@@ -147,7 +147,8 @@ namespace RcclUnitTesting
         std::make_pair("UT_REDOPS"           , "List of reduction ops to test"),
         std::make_pair("UT_DATATYPES"        , "List of datatypes to test"),
         std::make_pair("UT_MAX_RANKS_PER_GPU", "Maximum number of ranks using the same GPU"),
-        std::make_pair("UT_PRINT_VALUES"     , "Print array values (# of values to print, < 0 for all)")
+        std::make_pair("UT_PRINT_VALUES"     , "Print array values (# of values to print, < 0 for all)"),
+        std::make_pair("UT_NUM_THREADS"      , "Number of host threads preparing / validating data")
       };
 
     printf("================================================================================\n");
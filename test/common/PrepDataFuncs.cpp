@@ -11,6 +11,58 @@
 
 namespace RcclUnitTesting
 {
+  // Pattern offset of the slice starting at element 'start' of the input of 'rank'
+  static int PatternOffset(int const rank, size_t const start)
+  {
+    return (rank + start) % PatternPeriod;
+  }
+
+  // Computes one PatternPeriod of the expected result of a reduction.  Inputs only depend on
+  // (rank + index) % PatternPeriod, so element i of the result is period[i % PatternPeriod],
+  // obtained by reducing one period of each rank's input in the same order as the collective
+  static ErrCode ComputeReducedPeriod(CollectiveArgs const& collArgs, PtrUnion& period)
+  {
+    size_t const numBytes = PatternPeriod * DataTypeToBytes(collArgs.dataType);
+
+    // If average or custom reduction operator is used, perform a summation instead
+    ncclRedOp_t const tempOp = (collArgs.options.redOp >= ncclAvg ? ncclSum : collArgs.options.redOp);
+
+    PtrUnion scalarsPerRank;
+    scalarsPerRank.Attach((void*)collArgs.options.scalarTransport.ptr);
+
+    PtrUnion tempInputCpu;
+    CHECK_CALL(period.AllocateCpuMem(numBytes));
+    CHECK_CALL(tempInputCpu.AllocateCpuMem(numBytes));
+    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
+    {
+      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, PatternPeriod, rank, false));
+
+      // Scale the temporary input by local scalar for this rank
+      // (Used by custom reduction ops)
+      if (collArgs.options.scalarMode >= 0)
+      {
+        CHECK_CALL(tempInputCpu.Scale(collArgs.dataType, PatternPeriod, scalarsPerRank, rank));
+      }
+
+      if (rank == 0)
+      {
+        memcpy(period.ptr, tempInputCpu.ptr, numBytes);
+      }
+      else
+      {
+        CHECK_CALL(period.Reduce(collArgs.dataType, PatternPeriod, tempInputCpu, tempOp));
+      }
+    }
+    CHECK_CALL(tempInputCpu.FreeCpuMem());
+
+    // Perform averaging if necessary
+    if (collArgs.options.redOp == ncclAvg)
+    {
+      CHECK_CALL(period.DivideByInt(collArgs.dataType, PatternPeriod, collArgs.totalRanks));
+    }
+    return TEST_SUCCESS;
+  }
+
   ErrCode DefaultPrepareDataFunc(CollectiveArgs &collArgs)
   {
     switch (collArgs.funcType)
@@ -91,60 +143,22 @@ namespace RcclUnitTesting
     // Clear output for all ranks (done before filling input in case of in-place)
     CHECK_CALL(collArgs.outputGpu.ClearGpuMem(numBytes));
 
-    // Clear expected buffer for holding reduction
-    PtrUnion result;
-    CHECK_CALL(result.Attach(collArgs.expected));
-    CHECK_CALL(result.ClearCpuMem(numBytes));
-
-    // If average or custom reduction operator is used, perform a summation instead
-    ncclRedOp_t const tempOp = (collArgs.options.redOp >= ncclAvg ? ncclSum : collArgs.options.redOp);
-
-    // Loop over each rank and generate their input into a temp buffer, then reduce
-    PtrUnion scalarsPerRank;
-    scalarsPerRank.Attach(collArgs.options.scalarTransport.ptr);
-
+    // Generate input for this rank
     PtrUnion tempInputCpu;
     CHECK_CALL(tempInputCpu.Attach(collArgs.outputCpu));
-    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
-    {
-      // Generate temporary input for this rank
-      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, rank, false));
+    CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.globalRank, false));
+    CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numBytes, hipMemcpyHostToDevice));
 
-      // Copy the pre-scaled input into GPU memory for the correct rank
-      if (rank == collArgs.globalRank)
-      {
-        CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numBytes, hipMemcpyHostToDevice));
-      }
-
-      // Scale the temporary input by local scalar for this rank
-      // (Used by custom reduction ops)
-      if (collArgs.options.scalarMode >= 0)
-      {
-        CHECK_CALL(tempInputCpu.Scale(collArgs.dataType, collArgs.numInputElements,
-                                      scalarsPerRank, rank));
-      }
-
-      // Any rank that requires output reduces the scaled-inputs
-      if (isAllReduce || collArgs.options.root == collArgs.globalRank)
-      {
-        if (rank == 0)
-        {
-          memcpy(result.ptr, tempInputCpu.ptr, numBytes);
-        }
-        else
-        {
-          CHECK_CALL(result.Reduce(collArgs.dataType, collArgs.numInputElements,
-                                   tempInputCpu, tempOp));
-        }
-      }
-    }
-
-    // Perform averaging if necessary
-    if (collArgs.options.redOp == ncclAvg && (isAllReduce || collArgs.options.root == collArgs.globalRank))
+    // Any rank that requires output tiles the reduction of one pattern period
+    if (isAllReduce || collArgs.options.root == collArgs.globalRank)
     {
-      CHECK_CALL(result.DivideByInt(collArgs.dataType, collArgs.numInputElements, collArgs.totalRanks));
+      PtrUnion period;
+      CHECK_CALL(ComputeReducedPeriod(collArgs, period));
+      ErrCode status = collArgs.expected.Tile(collArgs.dataType, collArgs.numInputElements, period, 0);
+      CHECK_CALL(period.FreeCpuMem());
+      return status;
     }
-    return TEST_SUCCESS;
+    return collArgs.expected.ClearCpuMem(numBytes);
   }
 
   ErrCode DefaultPrepData_Gather(CollectiveArgs &collArgs, bool const isAllGather)
@@ -162,25 +176,21 @@ namespace RcclUnitTesting
     CHECK_CALL(collArgs.inputGpu.ClearGpuMem(numInputBytes));
     CHECK_CALL(collArgs.outputGpu.ClearGpuMem(numOutputBytes));
 
-    PtrUnion result;
-    CHECK_CALL(result.Attach(collArgs.expected.ptr));
-    CHECK_CALL(result.ClearCpuMem(numOutputBytes));
-
     // Use outputCpu buffer to store temporary input
     PtrUnion tempInputCpu;
     CHECK_CALL(tempInputCpu.Attach(collArgs.outputCpu.ptr));
+    CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.globalRank, false));
+    CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numInputBytes, hipMemcpyHostToDevice));
+
+    if (!isAllGather && collArgs.options.root != collArgs.globalRank)
+      return collArgs.expected.ClearCpuMem(numOutputBytes);
 
+    // Block r of the result is the input of rank r
     for (int rank = 0; rank < collArgs.totalRanks; ++rank)
     {
-      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, rank, false));
-      if (rank == collArgs.globalRank)
-      {
-        CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numInputBytes, hipMemcpyHostToDevice));
-      }
-      if (isAllGather || collArgs.options.root == collArgs.globalRank)
-      {
-        memcpy(result.I1 + (rank * numInputBytes), tempInputCpu.ptr, numInputBytes);
-      }
+      PtrUnion result;
+      CHECK_CALL(result.Attach(collArgs.expected.I1 + (rank * numInputBytes)));
+      CHECK_CALL(result.FillPattern(collArgs.dataType, collArgs.numInputElements, rank, false));
     }
     return TEST_SUCCESS;
   }
@@ -200,66 +210,25 @@ namespace RcclUnitTesting
     // Clear output for all ranks (done before filling input in case of in-place)
     CHECK_CALL(collArgs.outputGpu.ClearGpuMem(numOutputBytes));
 
+    // Generate input for this rank
     PtrUnion tempInputCpu;
-    PtrUnion tempResultCpu;
-
     CHECK_CALL(tempInputCpu.AllocateCpuMem(numInputBytes));
-    CHECK_CALL(tempResultCpu.AllocateCpuMem(numInputBytes));
-    CHECK_CALL(tempResultCpu.ClearCpuMem(numInputBytes));
-
-    // If average or custom reduction operator is used, perform a summation instead
-    ncclRedOp_t const tempOp = (collArgs.options.redOp >= ncclAvg ? ncclSum : collArgs.options.redOp);
-
-    // Loop over each rank and generate the input / scale / reduce
-    PtrUnion scalarsPerRank;
-    scalarsPerRank.Attach(collArgs.options.scalarTransport.ptr);
-    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
-    {
-      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, rank, false));
-
-      if (rank == collArgs.globalRank)
-      {
-        if (hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numInputBytes, hipMemcpyHostToDevice) != hipSuccess)
-        {
-          ERROR("hipMemcpy to input failed\n");
-          CHECK_CALL(tempInputCpu.FreeCpuMem());
-          CHECK_CALL(tempResultCpu.FreeCpuMem());
-          return TEST_FAIL;
-        }
-      }
-
-      // Scale the temporary input by local scalar for this rank
-      // (Used by custom reduction ops)
-      if (collArgs.options.scalarMode >= 0)
-      {
-        CHECK_CALL(tempInputCpu.Scale(collArgs.dataType, collArgs.numInputElements,
-                                      scalarsPerRank, rank));
-      }
-
-      if (rank == 0)
-      {
-        memcpy(tempResultCpu.ptr, tempInputCpu.ptr, numInputBytes);
-      }
-      else
-      {
-        CHECK_CALL(tempResultCpu.Reduce(collArgs.dataType, collArgs.numInputElements,
-                                        tempInputCpu, tempOp));
-      }
-    }
-
-    // Perform averaging if necessary
-    if (collArgs.options.redOp == ncclAvg)
+    CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.globalRank, false));
+    if (hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numInputBytes, hipMemcpyHostToDevice) != hipSuccess)
     {
-      CHECK_CALL(tempResultCpu.DivideByInt(collArgs.dataType, collArgs.numInputElements, collArgs.totalRanks));
+      ERROR("hipMemcpy to input failed\n");
+      CHECK_CALL(tempInputCpu.FreeCpuMem());
+      return TEST_FAIL;
     }
-
-    // Copy over portion of result
-    memcpy(collArgs.expected.I1,
-           tempResultCpu.I1 + collArgs.globalRank * numOutputBytes,
-           numOutputBytes);
     CHECK_CALL(tempInputCpu.FreeCpuMem());
-    CHECK_CALL(tempResultCpu.FreeCpuMem());
-    return TEST_SUCCESS;
+
+    // This rank receives its portion of the reduction of one pattern period, tiled
+    PtrUnion period;
+    CHECK_CALL(ComputeReducedPeriod(collArgs, period));
+    ErrCode status = collArgs.expected.Tile(collArgs.dataType, collArgs.numOutputElements, period,
+                                            PatternOffset(0, collArgs.globalRank * collArgs.numOutputElements));
+    CHECK_CALL(period.FreeCpuMem());
+    return status;
   }
 
   ErrCode DefaultPrepData_Scatter(CollectiveArgs &collArgs)
@@ -277,20 +246,10 @@ namespace RcclUnitTesting
     // Clear outputs on all ranks (prior to input in case of in-place)
     collArgs.outputGpu.ClearGpuMem(numOutputBytes);
 
-    // Generate input as if on root rank - each rank will receive a portion
-    PtrUnion tempInput;
-    tempInput.AllocateCpuMem(numInputBytes);
-    tempInput.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.options.root, false);
-
     // Copy input to root rank
     if (collArgs.globalRank == collArgs.options.root)
     {
-      if (hipMemcpy(collArgs.inputGpu.ptr, tempInput.ptr, numInputBytes, hipMemcpyHostToDevice) != hipSuccess)
-      {
-        ERROR("hipMemcpy to input failed\n");
-        tempInput.FreeCpuMem();
-        return TEST_FAIL;
-      }
+      CHECK_CALL(collArgs.inputGpu.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.options.root, true));
     }
     else
     {
@@ -298,10 +257,9 @@ namespace RcclUnitTesting
     }
 
     // Each rank receive a portion of the input
-    memcpy(collArgs.expected.U1, tempInput.U1 + (collArgs.globalRank * numOutputBytes), numOutputBytes);
-
-    tempInput.FreeCpuMem();
-    return TEST_SUCCESS;
+    return collArgs.expected.FillPattern(collArgs.dataType, collArgs.numOutputElements,
+                                         PatternOffset(collArgs.options.root, collArgs.globalRank * collArgs.numOutputElements),
+                                         false);
   }
 
   ErrCode DefaultPrepData_AllToAll(CollectiveArgs &collArgs)
@@ -320,24 +278,24 @@ namespace RcclUnitTesting
     size_t const numInputBytes = collArgs.numInputElements * DataTypeToBytes(collArgs.dataType);
     size_t const numOutputBytes = collArgs.numOutputElements * DataTypeToBytes(collArgs.dataType);
     size_t const numBytes = numInputBytes / collArgs.totalRanks;
+    size_t const numElements = collArgs.numInputElements / collArgs.totalRanks;
 
     // Clear outputs on all ranks (prior to input in case of in-place)
     collArgs.outputGpu.ClearGpuMem(numOutputBytes);
 
-    // Generate input on root rank - each rank will receive a portion
+    // Copy input
     PtrUnion tempInput;
     tempInput.Attach(collArgs.outputCpu);
+    CHECK_CALL(tempInput.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.globalRank, false));
+    CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInput.ptr, numInputBytes, hipMemcpyHostToDevice));
 
+    // Block r of the output is block globalRank of the input of rank r
     for (int rank = 0; rank < collArgs.totalRanks; ++rank)
     {
-      tempInput.FillPattern(collArgs.dataType, collArgs.numInputElements, rank, false);
-
-      // Copy input
-      if (rank == collArgs.globalRank)
-      {
-        CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInput.ptr, numInputBytes, hipMemcpyHostToDevice));
-      }
-      memcpy(collArgs.expected.U1 + (numBytes * rank), tempInput.U1 + (numBytes * collArgs.globalRank), numBytes);
+      PtrUnion result;
+      CHECK_CALL(result.Attach(collArgs.expected.U1 + (numBytes * rank)));
+      CHECK_CALL(result.FillPattern(collArgs.dataType, numElements,
+                                    PatternOffset(rank, numElements * collArgs.globalRank), false));
     }
     return TEST_SUCCESS;
   }
@@ -349,30 +307,22 @@ namespace RcclUnitTesting
     size_t const numInputBytes = collArgs.numInputElements * DataTypeToBytes(collArgs.dataType);
     size_t const numOutputBytes = collArgs.numOutputElements * DataTypeToBytes(collArgs.dataType);
 
-    // calculating maxNumElements  as the maximum number of input bytes out of all the ranks
-    size_t maxNumElements  = 0;
-    for (int sendRank = 0; sendRank < collArgs.totalRanks; ++sendRank)
-    for (int recvRank = 0; recvRank < collArgs.totalRanks; ++recvRank)
-    {
-      size_t rankSendCount = collArgs.options.sdispls[(sendRank)*collArgs.totalRanks+recvRank] + collArgs.options.sendcounts[(sendRank)*collArgs.totalRanks+recvRank];
-      maxNumElements = std::max(maxNumElements, rankSendCount);
-    }
-
     // Clear outputs on all ranks (prior to input in case of in-place)
     collArgs.outputGpu.ClearGpuMem(numOutputBytes);
 
-    // Generate input on root rank - each rank will receive a portion
-    PtrUnion tempInput;
-    tempInput.AllocateCpuMem(maxNumElements*DataTypeToBytes(collArgs.dataType));
-
+    // Each block received is a slice of the input of the sending rank
     for (int sendRank = 0; sendRank < collArgs.totalRanks; ++sendRank)
     {
-      tempInput.FillPattern(collArgs.dataType, maxNumElements, sendRank, false);
       size_t recvDspls = collArgs.options.rdispls[collArgs.globalRank*collArgs.totalRanks + sendRank] * DataTypeToBytes(collArgs.dataType);
-      size_t sendDspls = collArgs.options.sdispls[sendRank*collArgs.totalRanks + collArgs.globalRank] * DataTypeToBytes(collArgs.dataType);
-      size_t numBytes = collArgs.options.recvcounts[collArgs.globalRank*collArgs.totalRanks + sendRank] * DataTypeToBytes(collArgs.dataType);
-      memcpy(collArgs.expected.U1 + recvDspls, tempInput.U1 + sendDspls, numBytes);
+      size_t sendDspls = collArgs.options.sdispls[sendRank*collArgs.totalRanks + collArgs.globalRank];
+      size_t numElements = collArgs.options.recvcounts[collArgs.globalRank*collArgs.totalRanks + sendRank];
+      PtrUnion result;
+      CHECK_CALL(result.Attach(collArgs.expected.U1 + recvDspls));
+      CHECK_CALL(result.FillPattern(collArgs.dataType, numElements, PatternOffset(sendRank, sendDspls), false));
     }
+
+    PtrUnion tempInput;
+    CHECK_CALL(tempInput.AllocateCpuMem(numInputBytes));
     tempInput.FillPattern(collArgs.dataType, collArgs.numInputElements, collArgs.globalRank, false);
 
     CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInput.ptr, numInputBytes, hipMemcpyHostToDevice));
@@ -1,4 +1,8 @@
 #include "PtrUnion.hpp"
+#include "ThreadPool.hpp"
+#include "host/host_reduce.h"
+#include <atomic>
+#include <vector>
 
 namespace RcclUnitTesting
 {
@@ -123,12 +127,18 @@ namespace RcclUnitTesting
     else
       temp.Attach(this->ptr);
 
-    for (int i = 0; i < numElements; i++)
+    // Generate one period of the pattern, then tile it
+    PtrUnion period;
+    CHECK_CALL(period.AllocateCpuMem(PatternPeriod * DataTypeToBytes(dataType)));
+    for (int i = 0; i < (int)PatternPeriod; i++)
     {
-      int    valueI = (globalRank + i) % 256;
+      int    valueI = i;
       double valueF = 1.0L/((double)valueI+1.0L);
-      temp.Set(dataType, i, valueI, valueF);
+      period.Set(dataType, i, valueI, valueF);
     }
+    ErrCode status = temp.Tile(dataType, numElements, period, globalRank % PatternPeriod);
+    period.FreeCpuMem();
+    CHECK_CALL(status);
 
     // If this is GPU memory, copy from CPU temp buffer
     if (isGpuMem)
@@ -144,6 +154,30 @@ namespace RcclUnitTesting
     return TEST_SUCCESS;
   }
 
+  ErrCode PtrUnion::Tile(ncclDataType_t const  dataType,
+                         size_t         const  numElements,
+                         PtrUnion       const& period,
+                         size_t         const  offset)
+  {
+    // Repeat the period into a larger window so that each chunk takes a few large copies
+    size_t const elemBytes      = DataTypeToBytes(dataType);
+    size_t const windowElements = 64 * PatternPeriod;
+    std::vector<uint8_t> window(windowElements * elemBytes + PatternPeriod * elemBytes);
+    for (size_t pos = 0; pos < window.size(); pos += PatternPeriod * elemBytes)
+      memcpy(window.data() + pos, period.ptr, PatternPeriod * elemBytes);
+
+    return ParallelFor(numElements, 1 << 20, [&](size_t const start, size_t const count)
+    {
+      for (size_t pos = start; pos < start + count; pos += windowElements)
+      {
+        size_t const phase = (offset + pos) % PatternPeriod;
+        size_t const len   = std::min(windowElements, start + count - pos);
+        memcpy(U1 + pos * elemBytes, window.data() + phase * elemBytes, len * elemBytes);
+      }
+      return TEST_SUCCESS;
+    });
+  }
+
   ErrCode PtrUnion::Set(ncclDataType_t const dataType, int const idx, int valueI, double valueF)
   {
     switch (dataType)
@@ -195,24 +229,12 @@ namespace RcclUnitTesting
     // If no scalars are provided do nothing
     if (scalarsPerRank.ptr == nullptr) return TEST_SUCCESS;
 
-    for (size_t idx = 0; idx < numElements; ++idx)
+    // Runs the SIMD loops of src/collectives/host/host_reduce.cc
+    uint8_t const* scalar = scalarsPerRank.U1 + rank * DataTypeToBytes(dataType);
+    if (ncclHostScale(this->ptr, numElements, dataType, scalar) != ncclSuccess)
     {
-      switch (dataType)
-      {
-      case ncclInt8:     I1[idx] *= scalarsPerRank.I1[rank]; break;
-      case ncclUint8:    U1[idx] *= scalarsPerRank.U1[rank]; break;
-      case ncclInt32:    I4[idx] *= scalarsPerRank.I4[rank]; break;
-      case ncclUint32:   U4[idx] *= scalarsPerRank.U4[rank]; break;
-      case ncclInt64:    I8[idx] *= scalarsPerRank.I8[rank]; break;
-      case ncclUint64:   U8[idx] *= scalarsPerRank.U8[rank]; break;
-      case ncclFloat16:  F2[idx]  = __float2half(__half2float(F2[idx]) * __half2float(scalarsPerRank.F2[rank])); break;
-      case ncclFloat32:  F4[idx] *= scalarsPerRank.F4[rank]; break;
-      case ncclFloat64:  F8[idx] *= scalarsPerRank.F8[rank]; break;
-      case ncclBfloat16: B2[idx] *= scalarsPerRank.B2[rank]; break;
-      default:
-        ERROR("Unsupported datatype\n");
-        return TEST_FAIL;
-      }
+      ERROR("Unsupported datatype\n");
+      return TEST_FAIL;
     }
     return TEST_SUCCESS;
   }
@@ -228,83 +250,81 @@ namespace RcclUnitTesting
       return TEST_FAIL;
     }
 
-    for (size_t idx = 0; idx < numElements; ++idx)
+    if (ncclHostReduce(this->ptr, this->ptr, inputCpu.ptr, numElements, dataType, op) != ncclSuccess)
     {
-      switch (dataType)
-      {
-      case ncclInt8:     I1[idx] = ReduceOp(op, I1[idx], inputCpu.I1[idx]); break;
-      case ncclUint8:    U1[idx] = ReduceOp(op, U1[idx], inputCpu.U1[idx]); break;
-      case ncclInt32:    I4[idx] = ReduceOp(op, I4[idx], inputCpu.I4[idx]); break;
-      case ncclUint32:   U4[idx] = ReduceOp(op, U4[idx], inputCpu.U4[idx]); break;
-      case ncclInt64:    I8[idx] = ReduceOp(op, I8[idx], inputCpu.I8[idx]); break;
-      case ncclUint64:   U8[idx] = ReduceOp(op, U8[idx], inputCpu.U8[idx]); break;
-      case ncclFloat16:  F2[idx] = __float2half(ReduceOp(op, __half2float(F2[idx]), __half2float(inputCpu.F2[idx]))); break;
-      case ncclFloat32:  F4[idx] = ReduceOp(op, F4[idx], inputCpu.F4[idx]); break;
-      case ncclFloat64:  F8[idx] = ReduceOp(op, F8[idx], inputCpu.F8[idx]); break;
-      case ncclBfloat16: B2[idx] = ReduceOp(op, B2[idx], inputCpu.B2[idx]); break;
-      default:
-        ERROR("Unsupported datatype\n");
-        return TEST_FAIL;
-      }
+      ERROR("Unsupported datatype (%d) or reduction operator (%d)\n", dataType, op);
+      return TEST_FAIL;
     }
     return TEST_SUCCESS;
   }
 
-
   ErrCode PtrUnion::DivideByInt(ncclDataType_t const dataType,
                                 size_t         const numElements,
                                 int            const divisor)
   {
-    for (size_t idx = 0; idx < numElements; ++idx)
+    if (ncclHostDivide(this->ptr, numElements, dataType, divisor) != ncclSuccess)
     {
-      switch (dataType)
-      {
-      case ncclInt8:     I1[idx] /= divisor; break;
-      case ncclUint8:    U1[idx] /= divisor; break;
-      case ncclInt32:    I4[idx] /= divisor; break;
-      case ncclUint32:   U4[idx] /= divisor; break;
-      case ncclInt64:    I8[idx] /= divisor; break;
-      case ncclUint64:   U8[idx] /= divisor; break;
-      case ncclFloat16:  F2[idx]  = __float2half(__half2float(F2[idx])/divisor); break;
-      case ncclFloat32:  F4[idx] /= divisor; break;
-      case ncclFloat64:  F8[idx] /= divisor; break;
-      case ncclBfloat16: B2[idx] = (rccl_bfloat16((float)(B2[idx]) / divisor)); break;
-      default:
-        ERROR("Unsupported datatype\n");
-        return TEST_FAIL;
-      }
+      ERROR("Unsupported datatype (%d) or divisor (%d)\n", dataType, divisor);
+      return TEST_FAIL;
     }
     return TEST_SUCCESS;
   }
 
+  // Returns the index of the first element of [start, start + count) where isEqual fails,
+  // or SIZE_MAX.  Blocks are first checked with a branch-free (vectorizable) count
+  template <typename T, typename F>
+  static size_t FindMismatch(T const* actual, T const* expected, size_t const start,
+                             size_t const count, F const isEqual)
+  {
+    size_t const blockSize = 4096;
+    for (size_t blockStart = start; blockStart < start + count; blockStart += blockSize)
+    {
+      size_t const blockEnd = std::min(blockStart + blockSize, start + count);
+      int numMismatches = 0;
+      for (size_t idx = blockStart; idx < blockEnd; ++idx)
+        numMismatches += !isEqual(actual[idx], expected[idx]);
+      if (numMismatches == 0) continue;
+      for (size_t idx = blockStart; idx < blockEnd; ++idx)
+        if (!isEqual(actual[idx], expected[idx])) return idx;
+    }
+    return SIZE_MAX;
+  }
+
   ErrCode PtrUnion::IsEqual(ncclDataType_t const  dataType,
                             size_t         const  numElements,
                             PtrUnion       const& expected,
                             bool           const  verbose,
                             bool&                 isMatch)
   {
-    isMatch = true;
-    size_t idx = 0;
-    for (idx = 0; idx < numElements; ++idx)
+    // Find the first mismatch, in parallel over chunks
+    std::atomic<size_t> firstMismatch(numElements);
+    auto checkChunk = [&](size_t const start, size_t const count)
     {
+      size_t mismatch = numElements;
       switch (dataType)
       {
-      case ncclInt8:    isMatch = (I1[idx] == expected.I1[idx]); break;
-      case ncclUint8:   isMatch = (U1[idx] == expected.U1[idx]); break;
-      case ncclInt32:   isMatch = (I4[idx] == expected.I4[idx]); break;
-      case ncclUint32:  isMatch = (U4[idx] == expected.U4[idx]); break;
-      case ncclInt64:   isMatch = (I8[idx] == expected.I8[idx]); break;
-      case ncclUint64:  isMatch = (U8[idx] == expected.U8[idx]); break;
-      case ncclFloat16: isMatch = (fabs(__half2float(F2[idx]) - __half2float(expected.F2[idx])) < 9e-2); break;
-      case ncclFloat32: isMatch = (fabs(F4[idx] - expected.F4[idx]) < 1e-5); break;
-      case ncclFloat64: isMatch = (fabs(F8[idx] - expected.F8[idx]) < 1e-12); break;
-      case ncclBfloat16: isMatch = (fabs((float)B2[idx] - (float)expected.B2[idx]) < 9e-2); break;
+      case ncclInt8:    mismatch = FindMismatch(I1, expected.I1, start, count, [](int8_t a, int8_t b) { return a == b; }); break;
+      case ncclUint8:   mismatch = FindMismatch(U1, expected.U1, start, count, [](uint8_t a, uint8_t b) { return a == b; }); break;
+      case ncclInt32:   mismatch = FindMismatch(I4, expected.I4, start, count, [](int32_t a, int32_t b) { return a == b; }); break;
+      case ncclUint32:  mismatch = FindMismatch(U4, expected.U4, start, count, [](uint32_t a, uint32_t b) { return a == b; }); break;
+      case ncclInt64:   mismatch = FindMismatch(I8, expected.I8, start, count, [](int64_t a, int64_t b) { return a == b; }); break;
+      case ncclUint64:  mismatch = FindMismatch(U8, expected.U8, start, count, [](uint64_t a, uint64_t b) { return a == b; }); break;
+      case ncclFloat16: mismatch = FindMismatch(F2, expected.F2, start, count, [](__half a, __half b) { return fabs(__half2float(a) - __half2float(b)) < 9e-2; }); break;
+      case ncclFloat32: mismatch = FindMismatch(F4, expected.F4, start, count, [](float a, float b) { return fabs(a - b) < 1e-5; }); break;
+      case ncclFloat64: mismatch = FindMismatch(F8, expected.F8, start, count, [](double a, double b) { return fabs(a - b) < 1e-12; }); break;
+      case ncclBfloat16: mismatch = FindMismatch(B2, expected.B2, start, count, [](rccl_bfloat16 a, rccl_bfloat16 b) { return fabs((float)a - (float)b) < 9e-2; }); break;
       default:
         ERROR("Unsupported datatype\n");
         return TEST_FAIL;
       }
-      if (!isMatch) break;
-    }
+      size_t current = firstMismatch.load();
+      while (mismatch < current && !firstMismatch.compare_exchange_weak(current, mismatch));
+      return TEST_SUCCESS;
+    };
+    CHECK_CALL(ParallelFor(numElements, 1 << 18, checkChunk));
+
+    size_t const idx = firstMismatch.load();
+    isMatch = (idx == numElements);
 
     if (verbose && !isMatch)
     {
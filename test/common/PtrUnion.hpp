@@ -6,24 +6,11 @@
 
 namespace RcclUnitTesting
 {
-  // Performs the various basic reduction operations
-  template <typename T>
-  T ReduceOp(ncclRedOp_t const op, T const A, T const B)
-  {
-    switch (op)
-    {
-    case ncclSum:  return A + B;
-    case ncclProd: return A * B;
-    case ncclMax:  return std::max(A, B);
-    case ncclMin:  return std::min(A, B);
-    default:
-      ERROR("Unsupported reduction operator (%d)\n", op);
-      exit(0);
-    }
-  }
-
   size_t DataTypeToBytes(ncclDataType_t const dataType);
 
+  // Input patterns repeat every PatternPeriod elements (see PtrUnion::FillPattern)
+  size_t const PatternPeriod = 256;
+
   // PtrUnion encapsulates a pointer of all the different supported datatypes
   // NOTE: Currently half-precision float tests are unsupported due to half
   //       being supported on GPU only and not host
@@ -53,11 +40,20 @@ namespace RcclUnitTesting
     ErrCode ClearGpuMem(size_t const numBytes);
     ErrCode ClearCpuMem(size_t const numBytes);
 
+    // Element i gets pattern value (globalRank + i) % PatternPeriod.  As values only depend on
+    // that sum, the slice of a rank's input starting at element s is the pattern of
+    // globalRank + s, and any element-wise reduction of the inputs of all ranks is periodic
     ErrCode FillPattern(ncclDataType_t const dataType,
                         size_t         const numElements,
                         int            const globalRank,
                         bool           const isGpuMem);
 
+    // Repeats PatternPeriod elements of period: element i gets period[(offset + i) % PatternPeriod]
+    ErrCode Tile(ncclDataType_t const  dataType,
+                 size_t         const  numElements,
+                 PtrUnion       const& period,
+                 size_t         const  offset);
+
     ErrCode Set(ncclDataType_t const dataType, int const idx, int valueI, double valueF);
     ErrCode Get(ncclDataType_t const dataType, int const idx, int& valueI, double& valueF) const;
 
@@ -0,0 +1,135 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace RcclUnitTesting
+{
+  class ThreadPool
+  {
+  public:
+    ThreadPool(int const numThreads)
+    {
+      for (int i = 1; i < numThreads; ++i)
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+
+    int NumThreads() const { return workers.size() + 1; }
+
+    // Calls task(chunkIdx) for each chunk, returns once all chunks are done
+    ErrCode Run(size_t const numChunks, std::function<ErrCode(size_t)> const& task)
+    {
+      std::lock_guard<std::mutex> runLock(runMutex);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task      = &task;
+        this->numChunks = numChunks;
+        nextChunk       = 0;
+        status          = TEST_SUCCESS;
+        numBusy         = workers.size();
+        ++generation;
+      }
+      workCv.notify_all();
+      RunChunks();
+
+      std::unique_lock<std::mutex> lock(mutex);
+      doneCv.wait(lock, [&] { return numBusy == 0; });
+      this->task = nullptr;
+      return (ErrCode)status.load();
+    }
+
+  private:
+    void RunChunks()
+    {
+      size_t chunkIdx;
+      while ((chunkIdx = nextChunk++) < numChunks)
+      {
+        if ((*task)(chunkIdx) != TEST_SUCCESS)
+          status = TEST_FAIL;
+      }
+    }
+
+    void WorkerLoop()
+    {
+      uint64_t seen = 0;
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          workCv.wait(lock, [&] { return generation != seen; });
+          seen = generation;
+        }
+        RunChunks();
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          --numBusy;
+        }
+        doneCv.notify_one();
+      }
+    }
+
+    std::vector<std::thread>                    workers;
+    std::mutex                                  runMutex;  // One Run() at a time
+    std::mutex                                  mutex;
+    std::condition_variable                     workCv;
+    std::condition_variable                     doneCv;
+    std::function<ErrCode(size_t)> const*       task = nullptr;
+    size_t                                      numChunks = 0;
+    std::atomic<size_t>                         nextChunk{0};
+    std::atomic<int>                            status{TEST_SUCCESS};
+    size_t                                      numBusy = 0;
+    uint64_t                                    generation = 0;
+  };
+
+  static ThreadPool* GetThreadPool()
+  {
+    // Threads do not survive fork(): a child process builds its own pool and leaks the
+    // (thread-less) copy inherited from its parent
+    static ThreadPool* pool = nullptr;
+    static pid_t       poolPid = 0;
+    static std::mutex  poolMutex;
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (pool == nullptr || poolPid != getpid())
+    {
+      int numThreads = std::min(16, (int)std::thread::hardware_concurrency());
+      if (getenv("UT_NUM_THREADS")) numThreads = atoi(getenv("UT_NUM_THREADS"));
+      pool    = new ThreadPool(std::max(1, numThreads));
+      poolPid = getpid();
+    }
+    return pool;
+  }
+
+  int GetNumWorkerThreads()
+  {
+    return GetThreadPool()->NumThreads();
+  }
+
+  ErrCode ParallelFor(size_t const numElements,
+                      size_t const chunkSize,
+                      std::function<ErrCode(size_t, size_t)> const& func)
+  {
+    if (numElements == 0) return TEST_SUCCESS;
+    size_t const numChunks = (numElements + chunkSize - 1) / chunkSize;
+
+    // Not worth waking up the pool for a single chunk
+    if (numChunks == 1) return func(0, numElements);
+
+    return GetThreadPool()->Run(numChunks, [&](size_t chunkIdx)
+    {
+      size_t const start = chunkIdx * chunkSize;
+      return func(start, std::min(chunkSize, numElements - start));
+    });
+  }
+}
@@ -0,0 +1,23 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#pragma once
+#include <cstddef>
+#include <functional>
+#include "ErrCode.hpp"
+
+namespace RcclUnitTesting
+{
+  // Splits [0, numElements) into chunks of chunkSize elements and calls func(start, count)
+  // for each chunk, from a pool of worker threads plus the calling thread.  Returns TEST_FAIL
+  // if any chunk fails.  The pool is created on first use in each process (TestBedChild
+  // processes are forked) and has UT_NUM_THREADS threads (default: # of cores, up to 16)
+  ErrCode ParallelFor(size_t const numElements,
+                      size_t const chunkSize,
+                      std::function<ErrCode(size_t, size_t)> const& func);
+
+  // Number of threads used by ParallelFor, including the calling thread
+  int GetNumWorkerThreads();
+}
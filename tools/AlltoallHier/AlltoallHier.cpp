@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host only checker for the hierarchical AllToAll plan (src/misc/alltoall_hier.cc).
+// Builds the plan of every rank, then moves bytes between emulated buffers
+// stage after stage, matching the k-th send from a rank to a peer with the
+// k-th receive of that peer from the rank, as ncclSend/ncclRecv do within a
+// group. Checks that sizes match, that staging buffers are large enough and
+// that every rank ends up with the right data. Also counts the inter-node
+// messages, compared with a flat AllToAll.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include "alltoall_hier.h"
+
+struct Options {
+  int nNodes = 4;
+  int localRanks = 8;
+  int oddNodes = 0;   // one rank less on odd nodes
+  int nicShare = 1;   // number of GPUs sharing a NIC (relay is the first one)
+  int interleave = 0; // ranks of a node are not contiguous
+  size_t bytes = 1024;
+  int matrix = 0;
+  int seed = 1;
+};
+
+static inline uint8_t pattern(int src, int dst, size_t i) {
+  return (uint8_t)(src*131 + dst*71 + i*7 + (i>>8));
+}
+
+struct Rank {
+  std::vector<uint8_t> buff[ncclA2aHierNumBuffers];
+  std::vector<ncclA2aHierOp> ops;
+};
+
+int main(int argc, char** argv) {
+  Options o;
+  int opt;
+  while ((opt = getopt(argc, argv, "N:L:oS:ib:ms:h")) != -1) {
+    switch (opt) {
+      case 'N': o.nNodes = atoi(optarg); break;
+      case 'L': o.localRanks = atoi(optarg); break;
+      case 'o': o.oddNodes = 1; break;
+      case 'S': o.nicShare = atoi(optarg); break;
+      case 'i': o.interleave = 1; break;
+      case 'b': o.bytes = strtoull(optarg, NULL, 0); break;
+      case 'm': o.matrix = 1; break;
+      case 's': o.seed = atoi(optarg); break;
+      default:
+        printf("Usage: %s [-N nodes] [-L localRanks] [-o (odd nodes have one rank less)] [-S gpusPerNic] [-i (interleave ranks)] [-b bytes] [-m (random matrix)] [-s seed]\n", argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  // Topology
+  std::vector<int> nodeLocalRanks(o.nNodes);
+  int nRanks = 0;
+  for (int n=0; n<o.nNodes; n++) nRanks += (nodeLocalRanks[n] = o.localRanks - (o.oddNodes && (n & 1) && o.localRanks > 1));
+  std::vector<int> rankToNode(nRanks), rankToLocalRank(nRanks), relay(nRanks);
+  std::vector<std::vector<int>> nodeRanks(o.nNodes);
+  for (int r=0, n=0; r<nRanks; r++) {
+    if (o.interleave) {
+      while (nodeRanks[n].size() == (size_t)nodeLocalRanks[n]) n = (n+1)%o.nNodes;
+    } else if (nodeRanks[n].size() == (size_t)nodeLocalRanks[n]) n++;
+    rankToNode[r] = n;
+    rankToLocalRank[r] = nodeRanks[n].size();
+    nodeRanks[n].push_back(r);
+    if (o.interleave) n = (n+1)%o.nNodes;
+  }
+  std::vector<int const*> localRankToRank(o.nNodes);
+  for (int n=0; n<o.nNodes; n++) localRankToRank[n] = nodeRanks[n].data();
+  for (int r=0; r<nRanks; r++) relay[r] = nodeRanks[rankToNode[r]][rankToLocalRank[r] / o.nicShare * o.nicShare];
+  ncclA2aHierTopo topo = { nRanks, o.nNodes, rankToNode.data(), rankToLocalRank.data(), nodeLocalRanks.data(), localRankToRank.data(), relay.data() };
+
+  // Sizes and displacements
+  std::mt19937_64 rng(o.seed);
+  std::vector<size_t> matrix;
+  if (o.matrix) {
+    matrix.resize((size_t)nRanks*nRanks);
+    std::uniform_int_distribution<size_t> dist(0, 2*o.bytes);
+    for (auto& b : matrix) b = dist(rng) & 1 ? dist(rng) : 0;
+  }
+  auto pairBytes = [&](int s, int d) { return o.matrix ? matrix[(size_t)s*nRanks+d] : o.bytes; };
+  std::vector<std::vector<size_t>> sendDispls(nRanks), recvDispls(nRanks);
+  std::vector<Rank> ranks(nRanks);
+  for (int r=0; r<nRanks; r++) {
+    // With a matrix, blocks are laid out in a random order with gaps
+    std::vector<int> order(nRanks);
+    for (int p=0; p<nRanks; p++) order[p] = p;
+    if (o.matrix) std::shuffle(order.begin(), order.end(), rng);
+    for (int dir=0; dir<2; dir++) {
+      std::vector<size_t>& displs = dir ? recvDispls[r] : sendDispls[r];
+      displs.resize(nRanks);
+      size_t offset = 0;
+      for (int p : order) {
+        displs[p] = offset;
+        offset += (dir ? pairBytes(p, r) : pairBytes(r, p)) + (o.matrix ? 64 : 0);
+      }
+      ranks[r].buff[dir ? ncclA2aHierRecvBuff : ncclA2aHierSendBuff].assign(offset, 0);
+    }
+    for (int d=0; d<nRanks; d++) {
+      for (size_t i=0; i<pairBytes(r, d); i++) ranks[r].buff[ncclA2aHierSendBuff][sendDispls[r][d]+i] = pattern(r, d, i);
+    }
+  }
+
+  // Plans
+  int errors = 0, netOps = 0;
+  size_t netOpsFlat = 0, netBytes = 0, stageBytes = 0;
+  for (int r=0; r<nRanks; r++) {
+    ncclA2aHierPlan plan;
+    ranks[r].ops.resize(ncclA2aHierMaxOps(&topo, r));
+    plan.ops = ranks[r].ops.data();
+    if (ncclA2aHierSchedule(&topo, r, o.matrix ? matrix.data() : NULL, o.bytes, sendDispls[r].data(), recvDispls[r].data(), &plan) != ncclSuccess) {
+      printf("Rank %d : ncclA2aHierSchedule failed\n", r);
+      return 1;
+    }
+    ranks[r].ops.resize(plan.nOps);
+    ranks[r].buff[ncclA2aHierStageSend].assign(plan.stageBytes[0], 0);
+    ranks[r].buff[ncclA2aHierStageRecv].assign(plan.stageBytes[1], 0);
+    stageBytes = std::max(stageBytes, plan.stageBytes[0] + plan.stageBytes[1]);
+    netOps += plan.nNetOps;
+    for (auto const& op : ranks[r].ops) {
+      if (op.stage == 1 && op.isSend) netBytes += op.bytes;
+      if (op.stage == 1 && rankToNode[op.peer] == rankToNode[r]) { printf("Rank %d : stage 1 op with local rank %d\n", r, op.peer); errors++; }
+      if (op.stage != 1 && rankToNode[op.peer] != rankToNode[r]) { printf("Rank %d : stage %d op with remote rank %d\n", r, op.stage, op.peer); errors++; }
+    }
+    for (int d=0; d<nRanks; d++) netOpsFlat += rankToNode[d] != rankToNode[r] && pairBytes(r, d);
+  }
+
+  // Execute stage after stage
+  for (int stage=0; stage<3; stage++) {
+    for (int s=0; s<nRanks; s++) {
+      for (int d=0; d<nRanks; d++) {
+        std::vector<ncclA2aHierOp const*> sends, recvs;
+        for (auto const& op : ranks[s].ops) if (op.stage == stage && op.isSend && op.peer == d) sends.push_back(&op);
+        for (auto const& op : ranks[d].ops) if (op.stage == stage && !op.isSend && op.peer == s) recvs.push_back(&op);
+        if (sends.size() != recvs.size()) {
+          printf("Stage %d : %d sends %zu ops to %d which receives %zu\n", stage, s, sends.size(), d, recvs.size());
+          errors++;
+          continue;
+        }
+        for (size_t k=0; k<sends.size(); k++) {
+          ncclA2aHierOp const* so = sends[k];
+          ncclA2aHierOp const* ro = recvs[k];
+          std::vector<uint8_t>& src = ranks[s].buff[so->buffer];
+          std::vector<uint8_t>& dst = ranks[d].buff[ro->buffer];
+          if (so->bytes != ro->bytes || so->offset + so->bytes > src.size() || ro->offset + ro->bytes > dst.size()) {
+            printf("Stage %d : %d -> %d op %zu, sending %zu bytes at %zu/%zu, receiving %zu bytes at %zu/%zu\n", stage, s, d, k,
+                   so->bytes, so->offset, src.size(), ro->bytes, ro->offset, dst.size());
+            errors++;
+            continue;
+          }
+          memcpy(dst.data()+ro->offset, src.data()+so->offset, so->bytes);
+        }
+      }
+    }
+  }
+
+  // Check
+  for (int r=0; r<nRanks; r++) {
+    for (int s=0; s<nRanks; s++) {
+      for (size_t i=0; i<pairBytes(s, r); i++) {
+        if (ranks[r].buff[ncclA2aHierRecvBuff][recvDispls[r][s]+i] != pattern(s, r, i)) {
+          printf("Rank %d : wrong data from rank %d at byte %zu\n", r, s, i);
+          errors++;
+          break;
+        }
+      }
+    }
+  }
+  size_t maxOps = 0;
+  for (int r=0; r<nRanks; r++) maxOps = std::max(maxOps, ranks[r].ops.size());
+  printf("%d nodes, %d ranks : inter-node messages %zu flat / %d hierarchical (avg %zu bytes), max ops per rank %zu, staging %zu bytes\n",
+         o.nNodes, nRanks, netOpsFlat, netOps, netOps ? netBytes/netOps : 0, maxOps, stageBytes);
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
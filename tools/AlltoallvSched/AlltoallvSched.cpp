@@ -0,0 +1,228 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host only checker for the AllToAllv scheduler (src/misc/alltoallv.cc).
+// Generates skewed, Mixture-of-Experts like count matrices, schedules every
+// rank and verifies that:
+//  - each send op has a matching recv op on the peer (same channel, offset, size),
+//  - the ops of a pair cover the whole block exchanged,
+//  - on every channel, each rank goes through the phases in increasing order.
+// It then compares a simple cost model of the schedule with the one of the
+// previous group of per-peer ncclSend/ncclRecv.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include "alltoallv.h"
+
+struct Options {
+  int nRanks = 64;
+  int nChannels = 32;
+  int maxChannelsPerPeer = 8;
+  size_t bytesPerRank = 64 << 20;
+  size_t chunkBytes = 1 << 19;
+  size_t smallBytes = 1 << 17;
+  double zipf = 1.2;
+  int iters = 5;
+  double channelGBs = 12.0;
+  double linkGBs = 100.0;
+  double latencyUs = 5.0;
+};
+
+static void usage(char const* exe) {
+  printf("Usage: %s [-n nRanks] [-c nChannels] [-p maxChannelsPerPeer] [-b bytesPerRank] [-z zipfExponent] [-i iters]\n", exe);
+}
+
+// matrix[s*n+d]: bytes sent by s to d. Expert popularity follows a Zipf law,
+// the same for every sender, with some noise per sender.
+static void genMatrix(Options const& o, std::mt19937_64& rng, std::vector<size_t>& matrix) {
+  int n = o.nRanks;
+  std::vector<int> perm(n);
+  for (int i=0; i<n; i++) perm[i] = i;
+  std::shuffle(perm.begin(), perm.end(), rng);
+  std::vector<double> weight(n);
+  for (int i=0; i<n; i++) weight[perm[i]] = 1.0/pow(i+1, o.zipf);
+  std::uniform_real_distribution<double> noise(0.5, 1.5);
+  matrix.assign((size_t)n*n, 0);
+  for (int s=0; s<n; s++) {
+    std::vector<double> w(n);
+    double sum = 0;
+    for (int d=0; d<n; d++) sum += (w[d] = weight[d]*noise(rng));
+    for (int d=0; d<n; d++) matrix[(size_t)s*n+d] = (size_t)(o.bytesPerRank*w[d]/sum) & ~(size_t)3; // float elements
+  }
+}
+
+struct Cost {
+  double seconds;
+  int maxOpsPerChannel;
+};
+
+// Per rank and channel, ops are serialized: bytes at channel bandwidth plus a
+// fixed cost per op. Sends and recvs of a channel run in parallel. A rank can't
+// go faster than its link either.
+static Cost evalCost(Options const& o, std::vector<std::vector<ncclA2avOp>> const& ops) {
+  Cost cost = { 0, 0 };
+  for (int r=0; r<o.nRanks; r++) {
+    std::vector<double> chTime[2];
+    std::vector<int> chOps[2];
+    double total[2] = { 0, 0 };
+    for (int d=0; d<2; d++) { chTime[d].assign(o.nChannels, 0); chOps[d].assign(o.nChannels, 0); }
+    for (auto const& op : ops[r]) {
+      chTime[op.isSend][op.channel] += op.bytes/(o.channelGBs*1e9) + o.latencyUs*1e-6;
+      chOps[op.isSend][op.channel]++;
+      total[op.isSend] += op.bytes;
+    }
+    double t = std::max(total[0], total[1])/(o.linkGBs*1e9);
+    for (int d=0; d<2; d++) for (int c=0; c<o.nChannels; c++) {
+      t = std::max(t, chTime[d][c]);
+      cost.maxOpsPerChannel = std::max(cost.maxOpsPerChannel, chOps[d][c]);
+    }
+    cost.seconds = std::max(cost.seconds, t);
+  }
+  return cost;
+}
+
+// Model of the previous implementation: a group of ncclSend/ncclRecv, each
+// peer split in chunks over p2pnChannelsPerPeer channels starting at a base
+// channel derived from the distance to the peer (see scheduleP2pTasksToPlan).
+static void baselineOps(Options const& o, std::vector<size_t> const& matrix, std::vector<std::vector<ncclA2avOp>>& ops) {
+  int n = o.nRanks;
+  int nChannelsMax = o.maxChannelsPerPeer, nChannelsMin = nChannelsMax;
+  while (nChannelsMin*n > o.nChannels && nChannelsMin > 1) nChannelsMin /= 2;
+  while (nChannelsMax*n > o.nChannels*4 && nChannelsMax > 1) nChannelsMax /= 2;
+  size_t minSize = o.smallBytes/8, maxSize = o.chunkBytes;
+  for (int r=0; r<n; r++) {
+    ops[r].clear();
+    for (int p=0; p<n; p++) {
+      for (int isSend=0; isSend<2; isSend++) {
+        int peer = isSend ? (r+p)%n : (r-p+n)%n;
+        size_t bytes = isSend ? matrix[(size_t)r*n+peer] : matrix[(size_t)peer*n+r];
+        size_t chunk = std::max(minSize, (bytes+nChannelsMin-1)/nChannelsMin);
+        int nc = nChannelsMin;
+        while (chunk > maxSize && nc <= nChannelsMax/2) { nc *= 2; chunk = (bytes+nc-1)/nc; }
+        chunk = (chunk+minSize-1)/minSize*minSize;
+        size_t offset = 0;
+        for (int j=0; offset < bytes; j++) {
+          ncclA2avOp op = { peer, isSend, (p*o.maxChannelsPerPeer+j)%o.nChannels, p, offset, std::min(chunk, bytes-offset) };
+          ops[r].push_back(op);
+          offset += op.bytes;
+        }
+      }
+    }
+  }
+}
+
+static int schedule(Options const& o, std::vector<size_t> const& matrix, bool global, std::vector<std::vector<ncclA2avOp>>& ops) {
+  int n = o.nRanks;
+  std::vector<size_t> sendBytes(n), recvBytes(n);
+  for (int r=0; r<n; r++) {
+    ncclA2avConfig config = { n, r, o.nChannels, o.maxChannelsPerPeer, o.chunkBytes, o.smallBytes, 4 };
+    for (int p=0; p<n; p++) {
+      sendBytes[p] = matrix[(size_t)r*n+p];
+      recvBytes[p] = matrix[(size_t)p*n+r];
+    }
+    ops[r].resize(ncclA2avMaxOps(&config));
+    int nOps;
+    ncclResult_t res = ncclA2avSchedule(&config, sendBytes.data(), recvBytes.data(), global ? matrix.data() : NULL, ops[r].data(), &nOps);
+    if (res != ncclSuccess) {
+      printf("Rank %d : ncclA2avSchedule failed with %d\n", r, res);
+      return 1;
+    }
+    ops[r].resize(nOps);
+  }
+  return 0;
+}
+
+static int verify(Options const& o, std::vector<size_t> const& matrix, std::vector<std::vector<ncclA2avOp>> const& ops) {
+  int n = o.nRanks, errors = 0;
+  // (src, dst, channel, offset) -> (bytes, phase)
+  std::map<std::tuple<int,int,int,size_t>, std::pair<size_t,int>> sends, recvs;
+  std::vector<size_t> covered[2];
+  covered[0].assign((size_t)n*n, 0);
+  covered[1].assign((size_t)n*n, 0);
+  for (int r=0; r<n; r++) {
+    std::vector<int> lastPhase(o.nChannels, -1);
+    for (auto const& op : ops[r]) {
+      if (op.channel < 0 || op.channel >= o.nChannels) { printf("Rank %d : invalid channel %d\n", r, op.channel); errors++; }
+      else if (op.phase < lastPhase[op.channel]) { printf("Rank %d : channel %d goes back to phase %d\n", r, op.channel, op.phase); errors++; }
+      else lastPhase[op.channel] = op.phase;
+      int src = op.isSend ? r : op.peer, dst = op.isSend ? op.peer : r;
+      auto& m = op.isSend ? sends : recvs;
+      m[std::make_tuple(src, dst, op.channel, op.offset)] = std::make_pair(op.bytes, op.phase);
+      covered[op.isSend][(size_t)src*n+dst] += op.bytes;
+    }
+  }
+  if (sends != recvs) { printf("Send and receive ops do not match\n"); errors++; }
+  for (size_t i=0; i<(size_t)n*n; i++) {
+    if (covered[0][i] != matrix[i] || covered[1][i] != matrix[i]) {
+      printf("Pair %zu->%zu : %zu bytes, sent %zu received %zu\n", i/n, i%n, matrix[i], covered[1][i], covered[0][i]);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:p:b:z:i:h")) != -1) {
+    switch (opt) {
+      case 'n': o.nRanks = atoi(optarg); break;
+      case 'c': o.nChannels = atoi(optarg); break;
+      case 'p': o.maxChannelsPerPeer = atoi(optarg); break;
+      case 'b': o.bytesPerRank = strtoull(optarg, NULL, 0); break;
+      case 'z': o.zipf = atof(optarg); break;
+      case 'i': o.iters = atoi(optarg); break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  printf("%d ranks, %d channels, up to %d channels per peer, %zu bytes per rank, zipf %.2f\n",
+         o.nRanks, o.nChannels, o.maxChannelsPerPeer, o.bytesPerRank, o.zipf);
+  printf("%6s %12s %12s %12s %10s %10s %10s\n", "iter", "previous(us)", "local(us)", "matrix(us)", "prevOps", "localOps", "matrixOps");
+
+  std::mt19937_64 rng(1234);
+  std::vector<size_t> matrix;
+  std::vector<std::vector<ncclA2avOp>> ops(o.nRanks);
+  int errors = 0;
+  for (int it=0; it<o.iters; it++) {
+    genMatrix(o, rng, matrix);
+    baselineOps(o, matrix, ops);
+    Cost prev = evalCost(o, ops);
+    if (schedule(o, matrix, false, ops)) return 1;
+    errors += verify(o, matrix, ops);
+    Cost local = evalCost(o, ops);
+    if (schedule(o, matrix, true, ops)) return 1;
+    errors += verify(o, matrix, ops);
+    Cost global = evalCost(o, ops);
+    printf("%6d %12.1f %12.1f %12.1f %10d %10d %10d\n", it, prev.seconds*1e6, local.seconds*1e6, global.seconds*1e6,
+           prev.maxOpsPerChannel, local.maxOpsPerChannel, global.maxOpsPerChannel);
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
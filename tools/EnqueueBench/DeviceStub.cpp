@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Device side of RCCL for the HIP stub: the kernels and ROCm SMI queries that
+// the host code links against. Kernels run on the host when they are
+// launched, and only consume their work: each channel acknowledges the
+// work FIFO slots it was given, as the real kernel does once it is done,
+// without moving any data. The collectives, which need peers to make
+// progress, complete immediately.
+//
+// With deviceStubSetKernelTime(), kernels are instead queued and run by a
+// consumer thread, which simulates a device busy with each kernel. The
+// consumer checks that every channel acknowledges increasing slots, which
+// would not be the case if the host overwrote slots before they were read.
+//
+// ROCm SMI reports a single hop XGMI link between every pair of devices of
+// the same hive of 8, the other pairs only share PCIe.
+#include <hip/hip_runtime.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include "devcomm.h"
+#include "collectives.h"
+#include "rocm_smi_wrap.h"
+#include "DeviceStub.h"
+
+#define STUB_HIVE_SIZE 8
+
+typedef void (*ncclKern_t)(struct ncclDevComm*, uint64_t, struct ncclWork*);
+
+struct Launch {
+  ncclKern_t func;
+  struct ncclDevComm* comm;
+  uint64_t channelMask;
+  struct ncclWork* workHead;
+};
+
+static std::mutex queueMutex;
+static std::condition_variable queueCond;
+static std::deque<Launch> queue;
+static int kernelUs;
+static std::thread consumer;
+static uint64_t nLaunched, nConsumed;
+static int nErrors;
+static std::map<uint32_t*, uint32_t> lastAcks; // by workFifoDone, consumer thread only
+
+static void runKernel(struct ncclDevComm* comm, uint64_t channelMask, struct ncclWork* workHead) {
+  // Block b runs the b-th channel of channelMask, starting at workHead[b]
+  int blockIdx = 0;
+  for (int c=0; c<MAXCHANNELS; c++) {
+    if ((channelMask & (1ull<<c)) == 0) continue;
+    struct ncclWork* work = workHead+blockIdx++;
+    while (!work->header.isLast) work = workHead+work->header.workNext;
+    if (!work->header.inFifo) continue;
+    uint32_t* done = comm->channels[c].workFifoDone;
+    if (kernelUs) {
+      auto last = lastAcks.find(done);
+      if (last != lastAcks.end() && int32_t(work->header.doneAcks - last->second) <= 0) {
+        fprintf(stderr, "DeviceStub : channel %d acknowledged slot %u after slot %u\n", c, work->header.doneAcks, last->second);
+        nErrors++;
+      }
+      lastAcks[done] = work->header.doneAcks;
+    }
+    __atomic_store_n(done, work->header.doneAcks, __ATOMIC_RELEASE);
+  }
+}
+
+__global__ void NCCL_KERN_NAME(SendRecv, RING, SIMPLE, Sum, int8_t)(struct ncclDevComm* comm, uint64_t channelMask, struct ncclWork* workHead) {
+  runKernel(comm, channelMask, workHead);
+}
+__global__ void NCCL_KERN_NAME_DEBUG(SendRecv, RING, SIMPLE, Sum, int8_t)(struct ncclDevComm* comm, uint64_t channelMask, struct ncclWork* workHead) {
+  runKernel(comm, channelMask, workHead);
+}
+__global__ void NCCL_KERN_NAME_LL128(SendRecv, RING, SIMPLE, Sum, int8_t)(struct ncclDevComm* comm, uint64_t channelMask, struct ncclWork* workHead) {
+  runKernel(comm, channelMask, workHead);
+}
+__global__ void NCCL_KERN_NAME_LL128_DEBUG(SendRecv, RING, SIMPLE, Sum, int8_t)(struct ncclDevComm* comm, uint64_t channelMask, struct ncclWork* workHead) {
+  runKernel(comm, channelMask, workHead);
+}
+
+static void consumerMain() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true) {
+    queueCond.wait(lock, [] { return !queue.empty() || kernelUs == 0; });
+    if (queue.empty()) return;
+    Launch launch = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    // Like the real kernels, consume the work first and then run for a while
+    launch.func(launch.comm, launch.channelMask, launch.workHead);
+    struct timespec ts = { kernelUs/1000000, (kernelUs%1000000)*1000L };
+    nanosleep(&ts, NULL);
+    lock.lock();
+    nConsumed++;
+    queueCond.notify_all();
+  }
+}
+
+static void launchHook(const void* func, dim3 grid, dim3 block, void** args, hipStream_t stream) {
+  Launch launch = { (ncclKern_t)func, *(struct ncclDevComm**)args[0], *(uint64_t*)args[1], *(struct ncclWork**)args[2] };
+  std::lock_guard<std::mutex> lock(queueMutex);
+  nLaunched++;
+  if (kernelUs == 0) {
+    launch.func(launch.comm, launch.channelMask, launch.workHead);
+    nConsumed++;
+    return;
+  }
+  queue.push_back(launch);
+  queueCond.notify_all();
+}
+
+void deviceStubSetKernelTime(int us) {
+  deviceStubSynchronize();
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    kernelUs = us;
+    lastAcks.clear();
+    queueCond.notify_all();
+  }
+  if (us == 0 && consumer.joinable()) consumer.join();
+  if (us && !consumer.joinable()) consumer = std::thread(consumerMain);
+}
+
+void deviceStubSynchronize() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  queueCond.wait(lock, [] { return nConsumed == nLaunched; });
+}
+
+uint64_t deviceStubKernelCount() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return nConsumed;
+}
+
+int deviceStubErrors() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return nErrors;
+}
+
+static struct launchHookInit {
+  launchHookInit() { hipStubSetLaunchHook(launchHook); }
+} launchHookInit;
+
+ncclResult_t rocm_smi_init() {
+  return ncclSuccess;
+}
+
+ncclResult_t rocm_smi_getDeviceIndexByPciBusId(const char* pciBusId, uint32_t* deviceIndex) {
+  int dev;
+  if (hipDeviceGetByPCIBusId(&dev, pciBusId) != hipSuccess) return ncclInvalidArgument;
+  *deviceIndex = dev;
+  return ncclSuccess;
+}
+
+ncclResult_t rocm_smi_getLinkInfo(int srcDev, int dstDev, RSMI_IO_LINK_TYPE* rsmi_type, int *hops, int *count) {
+  int nDevs;
+  hipGetDeviceCount(&nDevs);
+  if (srcDev < 0 || srcDev >= nDevs || dstDev < 0 || dstDev >= nDevs || srcDev == dstDev) return ncclInvalidArgument;
+  bool xgmi = srcDev/STUB_HIVE_SIZE == dstDev/STUB_HIVE_SIZE;
+  *rsmi_type = xgmi ? RSMI_IOLINK_TYPE_XGMI : RSMI_IOLINK_TYPE_PCIE;
+  *hops = xgmi ? 1 : 2;
+  *count = 1;
+  return ncclSuccess;
+}
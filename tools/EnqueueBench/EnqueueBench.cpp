@@ -0,0 +1,472 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the host side cost of enqueuing RCCL operations: argument checks,
+// task accumulation, plan preparation, work FIFO upload, proxy operations and
+// kernel launch. It is built together with the host code of RCCL against a
+// HIP stub (see HipStub.cpp and DeviceStub.cpp), so that no GPU is needed and
+// the kernels complete as soon as they are launched; what is measured is only
+// the time spent in the RCCL calls.
+//
+// All ranks of the communicator are virtual devices of this process. Every
+// measurement is done by rank 0 alone, after a warmup with all ranks that
+// connects the peers:
+// - coll: each collective, called one at a time or by groups of -g calls,
+// - fanout: a group of ncclSend from rank 0 to 1, 2, 4, ... peers.
+// Results can be appended to a CSV file (-o) to follow them over time, and
+// the medians compared with the last results of an earlier run (-c).
+//
+// With -d, kernels instead take some time to run on a consumer thread and
+// only the work FIFO is exercised:
+// - fifo: AllReduce called faster than the kernels complete, which fills
+//   the work FIFO of rank 0. Its final depth, high water mark and stalls are
+//   reported, and the order in which its slots were consumed is checked.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <unistd.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+#include "comm.h"
+#include "DeviceStub.h"
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(1);                                                          \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess)                   \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(1);                                                          \
+    }                                                                   \
+  } while (0)
+
+// Linked with the host code of RCCL
+extern const char* rcclGitHash;
+
+typedef std::chrono::steady_clock Clock;
+
+static double usSince(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+enum Coll { AllReduce, Broadcast, Reduce, AllGather, ReduceScatter, AllToAll, SendRecv, NumColls };
+static char const* collNames[NumColls] = { "AllReduce", "Broadcast", "Reduce", "AllGather", "ReduceScatter", "AllToAll", "SendRecv" };
+
+struct Rank
+{
+  ncclComm_t   comm;
+  hipStream_t  stream;
+  float*       sendBuff;
+  float*       recvBuff;
+};
+
+// Enqueues one operation of `bytes` output bytes per rank. SendRecv is a
+// ring: send to the next rank, receive from the previous one.
+static void enqueue(Coll coll, std::vector<Rank>& ranks, int r, size_t bytes)
+{
+  int    nRanks = ranks.size();
+  Rank&  rank   = ranks[r];
+  size_t count  = std::max(bytes / sizeof(float), (size_t)1);
+  size_t perRank = std::max(count / nRanks, (size_t)1);
+  switch (coll)
+  {
+  case AllReduce:     NCCL_CALL(ncclAllReduce(rank.sendBuff, rank.recvBuff, count, ncclFloat, ncclSum, rank.comm, rank.stream)); break;
+  case Broadcast:     NCCL_CALL(ncclBroadcast(rank.sendBuff, rank.recvBuff, count, ncclFloat, 0, rank.comm, rank.stream)); break;
+  case Reduce:        NCCL_CALL(ncclReduce(rank.sendBuff, rank.recvBuff, count, ncclFloat, ncclSum, 0, rank.comm, rank.stream)); break;
+  case AllGather:     NCCL_CALL(ncclAllGather(rank.sendBuff, rank.recvBuff, perRank, ncclFloat, rank.comm, rank.stream)); break;
+  case ReduceScatter: NCCL_CALL(ncclReduceScatter(rank.sendBuff, rank.recvBuff, perRank, ncclFloat, ncclSum, rank.comm, rank.stream)); break;
+  case AllToAll:      NCCL_CALL(ncclAllToAll(rank.sendBuff, rank.recvBuff, perRank, ncclFloat, rank.comm, rank.stream)); break;
+  case SendRecv:
+    NCCL_CALL(ncclGroupStart());
+    NCCL_CALL(ncclSend(rank.sendBuff, count, ncclFloat, (r + 1) % nRanks, rank.comm, rank.stream));
+    NCCL_CALL(ncclRecv(rank.recvBuff, count, ncclFloat, (r + nRanks - 1) % nRanks, rank.comm, rank.stream));
+    NCCL_CALL(ncclGroupEnd());
+    break;
+  default: break;
+  }
+}
+
+// Rank 0 sends to peers 1..nPeers, which receive from it
+static void fanout(std::vector<Rank>& ranks, int r, int nPeers, size_t bytes)
+{
+  Rank&  rank  = ranks[r];
+  size_t count = std::max(bytes / sizeof(float), (size_t)1);
+  if (r == 0)
+  {
+    for (int p = 1; p <= nPeers; p++)
+      NCCL_CALL(ncclSend(rank.sendBuff, count, ncclFloat, p, rank.comm, rank.stream));
+  }
+  else if (r <= nPeers)
+  {
+    NCCL_CALL(ncclRecv(rank.recvBuff, count, ncclFloat, 0, rank.comm, rank.stream));
+  }
+}
+
+struct Result
+{
+  std::string bench;
+  std::string op;
+  int         nRanks;
+  size_t      bytes;
+  int         group;      // calls per group, 0 for ungrouped calls
+  double      meanUs;     // per call
+  double      p50Us;
+  double      p99Us;
+  double      callsPerSec;
+};
+
+typedef std::tuple<std::string, std::string, int, size_t, int> ResultKey;
+
+static ResultKey key(Result const& r)
+{
+  return ResultKey(r.bench, r.op, r.nRanks, r.bytes, r.group);
+}
+
+// samples are the durations of iterations of callsPerSample calls each
+static Result summarize(char const* bench, std::string const& op, int nRanks, size_t bytes, int group,
+                        std::vector<double>& samples, int callsPerSample, double totalUs)
+{
+  std::sort(samples.begin(), samples.end());
+  Result res;
+  res.bench       = bench;
+  res.op          = op;
+  res.nRanks      = nRanks;
+  res.bytes       = bytes;
+  res.group       = group;
+  res.meanUs      = totalUs / (samples.size() * callsPerSample);
+  res.p50Us       = samples[samples.size() / 2] / callsPerSample;
+  res.p99Us       = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)] / callsPerSample;
+  res.callsPerSec = 1e6 / res.meanUs;
+  printf("%-8s %-14s %6d %10lu %6d %10.3f %10.3f %10.3f %12.0f\n", res.bench.c_str(), res.op.c_str(),
+         res.nRanks, res.bytes, res.group, res.meanUs, res.p50Us, res.p99Us, res.callsPerSec);
+  return res;
+}
+
+static void usage(char const* exe)
+{
+  printf("Usage: %s [-n nRanks[,nRanks...]] [-i iterations] [-w warmups] [-b minBytes] [-e maxBytes] [-f stepFactor]\n"
+         "       [-g groupSize] [-p maxFanout] [-o results.csv] [-l label] [-c baseline.csv] [-t tolerancePercent]\n"
+         "       [-d kernelUs]\n", exe);
+}
+
+static size_t parseSize(char const* str)
+{
+  char* end;
+  size_t value = strtoull(str, &end, 0);
+  switch (*end)
+  {
+  case 'G': case 'g': value <<= 10;  // fall through
+  case 'M': case 'm': value <<= 10;  // fall through
+  case 'K': case 'k': value <<= 10;
+  }
+  return value;
+}
+
+static bool readCsv(char const* fileName, std::map<ResultKey, Result>& results)
+{
+  std::ifstream file(fileName);
+  if (!file) return false;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || line[0] == '#') continue;
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) fields.push_back(field);
+    if (fields.size() != 11) continue;
+    Result res;
+    res.bench       = fields[2];
+    res.op          = fields[3];
+    res.nRanks      = atoi(fields[4].c_str());
+    res.bytes       = strtoull(fields[5].c_str(), NULL, 10);
+    res.group       = atoi(fields[6].c_str());
+    res.meanUs      = atof(fields[7].c_str());
+    res.p50Us       = atof(fields[8].c_str());
+    res.p99Us       = atof(fields[9].c_str());
+    res.callsPerSec = atof(fields[10].c_str());
+    results[key(res)] = res; // Keep the last run
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<int> rankCounts = {8};
+  int numIterations = 1000;
+  int numWarmups    = 20;
+  size_t minBytes   = 8;
+  size_t maxBytes   = 8;
+  int stepFactor    = 64;
+  int groupSize     = 8;
+  int maxFanout     = 0;
+  char const* csvName      = NULL;
+  char const* baselineName = NULL;
+  std::string label        = rcclGitHash;
+  double tolerance         = 10;
+  int kernelUs             = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:i:w:b:e:f:g:p:o:l:c:t:d:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+    {
+      rankCounts.clear();
+      std::stringstream ss(optarg);
+      std::string n;
+      while (std::getline(ss, n, ',')) rankCounts.push_back(atoi(n.c_str()));
+      break;
+    }
+    case 'i': numIterations = atoi(optarg); break;
+    case 'w': numWarmups    = atoi(optarg); break;
+    case 'b': minBytes      = parseSize(optarg); break;
+    case 'e': maxBytes      = parseSize(optarg); break;
+    case 'f': stepFactor    = atoi(optarg); break;
+    case 'g': groupSize     = atoi(optarg); break;
+    case 'p': maxFanout     = atoi(optarg); break;
+    case 'o': csvName       = optarg; break;
+    case 'l': label         = optarg; break;
+    case 'c': baselineName  = optarg; break;
+    case 't': tolerance     = atof(optarg); break;
+    case 'd': kernelUs      = atoi(optarg); break;
+    default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (maxBytes < minBytes) maxBytes = minBytes;
+  if (numIterations < 1 || groupSize < 1 || stepFactor < 2 || kernelUs < 0 || rankCounts.empty())
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  int maxRanks = *std::max_element(rankCounts.begin(), rankCounts.end());
+  if (*std::min_element(rankCounts.begin(), rankCounts.end()) < 2)
+  {
+    printf("At least 2 ranks are required\n");
+    return 1;
+  }
+  hipStubSetDeviceCount(maxRanks);
+  int numDevices;
+  HIP_CALL(hipGetDeviceCount(&numDevices));
+  if (numDevices < maxRanks)
+  {
+    printf("The HIP stub supports at most %d devices\n", numDevices);
+    return 1;
+  }
+
+  std::map<ResultKey, Result> baseline;
+  if (baselineName && !readCsv(baselineName, baseline))
+  {
+    printf("Could not read %s\n", baselineName);
+    return 1;
+  }
+
+  std::vector<Result> results;
+  int errors = 0;
+  printf("# RCCL %s, %d iterations, %d warmups, groups of %d\n", label.c_str(), numIterations, numWarmups, groupSize);
+  printf("%-8s %-14s %6s %10s %6s %10s %10s %10s %12s\n", "#bench", "op", "ranks", "bytes", "group", "meanUs", "p50Us", "p99Us", "calls/s");
+  for (int nRanks : rankCounts)
+  {
+    std::vector<Rank> ranks(nRanks);
+    std::vector<ncclComm_t> comms(nRanks);
+    NCCL_CALL(ncclCommInitAll(comms.data(), nRanks, NULL));
+    for (int r = 0; r < nRanks; r++)
+    {
+      ranks[r].comm = comms[r];
+      HIP_CALL(hipSetDevice(r));
+      HIP_CALL(hipStreamCreate(&ranks[r].stream));
+      HIP_CALL(hipMalloc((void **)&ranks[r].sendBuff, std::max(maxBytes, sizeof(float))));
+      HIP_CALL(hipMalloc((void **)&ranks[r].recvBuff, std::max(maxBytes, sizeof(float))));
+    }
+    HIP_CALL(hipSetDevice(0));
+    deviceStubSetKernelTime(kernelUs);
+
+    std::vector<double> samples;
+    for (size_t bytes = minBytes; bytes <= maxBytes && kernelUs; bytes *= stepFactor)
+    {
+      for (int w = 0; w < numWarmups; w++)
+      {
+        NCCL_CALL(ncclGroupStart());
+        for (int r = 0; r < nRanks; r++) enqueue(AllReduce, ranks, r, bytes);
+        NCCL_CALL(ncclGroupEnd());
+      }
+      deviceStubSynchronize();
+      ncclComm* comm = ranks[0].comm;
+      int depth = comm->workFifoDepth;
+      comm->workFifoHighWater = 0;
+      comm->workFifoStalls = comm->workFifoStallTime = 0;
+      uint64_t kernels = deviceStubKernelCount();
+      samples.resize(numIterations);
+      auto start = Clock::now();
+      for (int i = 0; i < numIterations; i++)
+      {
+        auto t0 = Clock::now();
+        enqueue(AllReduce, ranks, 0, bytes);
+        samples[i] = usSince(t0);
+      }
+      double totalUs = usSince(start);
+      deviceStubSynchronize();
+      results.push_back(summarize("fifo", collNames[AllReduce], nRanks, bytes, 0, samples, 1, totalUs));
+      printf("#   work fifo depth %d -> %d (max %d), high water mark %u, %lu stalls, %.3f ms stalled\n", depth,
+             comm->workFifoDepth, comm->workFifoMaxDepth, comm->workFifoHighWater, comm->workFifoStalls, comm->workFifoStallTime / 1e6);
+      if (deviceStubKernelCount() - kernels != (uint64_t)numIterations || comm->workFifoHighWater > (uint32_t)comm->workFifoDepth)
+      {
+        printf("Error: %lu kernels run for %d calls, high water mark %u with depth %d\n",
+               deviceStubKernelCount() - kernels, numIterations, comm->workFifoHighWater, comm->workFifoDepth);
+        errors++;
+      }
+    }
+
+    for (size_t bytes = minBytes; bytes <= maxBytes && !kernelUs; bytes *= stepFactor)
+    {
+      for (int c = 0; c < NumColls; c++)
+      {
+        Coll coll = (Coll)c;
+        // Connect all the ranks
+        for (int w = 0; w < numWarmups; w++)
+        {
+          NCCL_CALL(ncclGroupStart());
+          for (int r = 0; r < nRanks; r++) enqueue(coll, ranks, r, bytes);
+          NCCL_CALL(ncclGroupEnd());
+        }
+        for (int group : {0, groupSize})
+        {
+          int callsPerSample = std::max(group, 1);
+          samples.resize(numIterations);
+          auto start = Clock::now();
+          for (int i = 0; i < numIterations; i++)
+          {
+            auto t0 = Clock::now();
+            if (group) NCCL_CALL(ncclGroupStart());
+            for (int g = 0; g < callsPerSample; g++) enqueue(coll, ranks, 0, bytes);
+            if (group) NCCL_CALL(ncclGroupEnd());
+            samples[i] = usSince(t0);
+          }
+          results.push_back(summarize("coll", collNames[c], nRanks, bytes, group, samples, callsPerSample, usSince(start)));
+        }
+      }
+
+      int fanoutLimit = maxFanout > 0 ? std::min(maxFanout, nRanks - 1) : nRanks - 1;
+      for (int nPeers = 1; ; nPeers = std::min(2 * nPeers, fanoutLimit))
+      {
+        for (int w = 0; w < numWarmups; w++)
+        {
+          NCCL_CALL(ncclGroupStart());
+          for (int r = 0; r < nRanks; r++) fanout(ranks, r, nPeers, bytes);
+          NCCL_CALL(ncclGroupEnd());
+        }
+        samples.resize(numIterations);
+        auto start = Clock::now();
+        for (int i = 0; i < numIterations; i++)
+        {
+          auto t0 = Clock::now();
+          NCCL_CALL(ncclGroupStart());
+          fanout(ranks, 0, nPeers, bytes);
+          NCCL_CALL(ncclGroupEnd());
+          samples[i] = usSince(t0);
+        }
+        results.push_back(summarize("fanout", "Send x" + std::to_string(nPeers), nRanks, bytes, nPeers, samples, nPeers, usSince(start)));
+        if (nPeers == fanoutLimit) break;
+      }
+    }
+
+    deviceStubSetKernelTime(0);
+    for (int r = 0; r < nRanks; r++)
+    {
+      NCCL_CALL(ncclCommDestroy(ranks[r].comm));
+      HIP_CALL(hipFree(ranks[r].sendBuff));
+      HIP_CALL(hipFree(ranks[r].recvBuff));
+      HIP_CALL(hipStreamDestroy(ranks[r].stream));
+    }
+  }
+
+  if (csvName)
+  {
+    bool header = access(csvName, F_OK) != 0;
+    FILE* csv = fopen(csvName, "a");
+    if (csv == NULL)
+    {
+      printf("Could not open %s\n", csvName);
+      return 1;
+    }
+    if (header) fprintf(csv, "#time,label,bench,op,ranks,bytes,group,meanUs,p50Us,p99Us,callsPerSec\n");
+    time_t now = time(NULL);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    for (Result const& res : results)
+      fprintf(csv, "%s,%s,%s,%s,%d,%lu,%d,%.3f,%.3f,%.3f,%.0f\n", date, label.c_str(), res.bench.c_str(), res.op.c_str(),
+              res.nRanks, res.bytes, res.group, res.meanUs, res.p50Us, res.p99Us, res.callsPerSec);
+    fclose(csv);
+  }
+
+  int regressions = 0;
+  if (baselineName)
+  {
+    int compared = 0;
+    for (Result const& res : results)
+    {
+      auto it = baseline.find(key(res));
+      if (it == baseline.end()) continue;
+      compared++;
+      // The median is less sensitive to the noise of the other threads than the mean
+      double change = 100 * (res.p50Us / it->second.p50Us - 1);
+      if (change > tolerance)
+      {
+        printf("Regression: %s %s %d ranks %lu bytes group %d: median %.3f us per call, was %.3f (+%.1f%%)\n",
+               res.bench.c_str(), res.op.c_str(), res.nRanks, res.bytes, res.group, res.p50Us, it->second.p50Us, change);
+        regressions++;
+      }
+    }
+    printf("%d of %d results compared with %s are more than %.1f%% slower\n", regressions, compared, baselineName, tolerance);
+  }
+  if (deviceStubErrors())
+  {
+    printf("Error: %d work FIFO slots were consumed out of order\n", deviceStubErrors());
+    errors++;
+  }
+  if (regressions || errors) return 1;
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,455 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only implementation of the HIP runtime declared in
+// hipstub/hip/hip_runtime.h. It lets the host code of RCCL run without a GPU:
+// - devices are virtual, with PCI bus ids 0000:<dev+1>:00.0 and all peers
+//   accessible,
+// - device, managed and pinned host allocations are zeroed host memory, so
+//   that the host can read what "the device" wrote, and IPC handles carry the
+//   pointer itself since all ranks live in the same process,
+// - copies and memsets are done synchronously, streams and events are always
+//   complete, and host functions run when they are enqueued,
+// - kernel launches only call the hook set by hipStubSetLaunchHook.
+#include <hip/hip_runtime.h>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define STUB_MAX_DEVICES 256
+// Allocations from this size on are mmapped, so that large buffers which are
+// never touched do not cost any memory.
+#define STUB_MMAP_SIZE (1<<20)
+
+struct ihipStream_t { int device; unsigned flags; };
+struct ihipEvent_t { unsigned flags; };
+
+struct stubAlloc {
+  size_t size;
+  int device;
+  bool host;
+  bool mapped;
+};
+
+static int numDevices = -1;
+static thread_local int currentDevice = 0;
+static thread_local hipStreamCaptureMode captureMode = 0;
+static thread_local hipError_t lastError = hipSuccess;
+static hipStubLaunchHook_t launchHook = NULL;
+static std::mutex allocLock;
+static std::map<uintptr_t, stubAlloc> allocs;
+static uint32_t hdpRegs[STUB_MAX_DEVICES];
+
+void hipStubSetDeviceCount(int count) {
+  numDevices = std::min(std::max(count, 1), STUB_MAX_DEVICES);
+}
+
+void hipStubSetLaunchHook(hipStubLaunchHook_t hook) {
+  launchHook = hook;
+}
+
+static int deviceCount() {
+  if (numDevices == -1) {
+    const char* env = getenv("HIPSTUB_NUM_DEVICES");
+    hipStubSetDeviceCount(env ? atoi(env) : 8);
+  }
+  return numDevices;
+}
+
+static hipError_t setError(hipError_t err) {
+  if (err != hipSuccess) lastError = err;
+  return err;
+}
+
+#define CHECK_DEVICE(dev) do { \
+  if ((dev) < 0 || (dev) >= deviceCount()) return setError(hipErrorInvalidDevice); \
+} while (0)
+
+// Devices
+
+hipError_t hipGetDevice(int* dev) { *dev = currentDevice; return hipSuccess; }
+hipError_t hipSetDevice(int dev) { CHECK_DEVICE(dev); currentDevice = dev; return hipSuccess; }
+hipError_t hipGetDeviceCount(int* count) { *count = deviceCount(); return hipSuccess; }
+
+hipError_t hipGetDeviceProperties(hipDeviceProp_t* prop, int dev) {
+  CHECK_DEVICE(dev);
+  memset(prop, 0, sizeof(*prop));
+  snprintf(prop->name, sizeof(prop->name), "HIP stub device %d", dev);
+  strcpy(prop->gcnArchName, "gfx90a:sramecc+:xnack-");
+  prop->gcnArch = 910;
+  prop->major = 9;
+  prop->minor = 0;
+  prop->totalGlobalMem = 64UL<<30;
+  prop->multiProcessorCount = 110;
+  prop->maxThreadsPerBlock = 1024;
+  prop->warpSize = 64;
+  prop->pciDomainID = 0;
+  prop->pciBusID = dev+1;
+  prop->pciDeviceID = 0;
+  prop->arch.hasGlobalInt64Atomics = 1;
+  prop->arch.hasSharedInt64Atomics = 1;
+  prop->arch.hasFloatAtomicAdd = 1;
+  prop->arch.hasDoubles = 1;
+  return hipSuccess;
+}
+
+hipError_t hipDeviceGetAttribute(int* value, hipDeviceAttribute_t attr, int dev) {
+  CHECK_DEVICE(dev);
+  switch (attr) {
+  case hipDeviceAttributeComputeCapabilityMajor: *value = 9; break;
+  case hipDeviceAttributeComputeCapabilityMinor: *value = 0; break;
+  case hipDeviceAttributeMultiprocessorCount: *value = 110; break;
+  case hipDeviceAttributeMaxThreadsPerBlock: *value = 1024; break;
+  case hipDeviceAttributeWarpSize: *value = 64; break;
+  case hipDeviceAttributeHdpMemFlushCntl: {
+    // Returns a pointer, like HIP does
+    uint32_t* reg = hdpRegs+dev;
+    memcpy(value, &reg, sizeof(reg));
+    break;
+  }
+  default: return setError(hipErrorInvalidValue);
+  }
+  return hipSuccess;
+}
+
+hipError_t hipDeviceGetPCIBusId(char* busId, int len, int dev) {
+  CHECK_DEVICE(dev);
+  snprintf(busId, len, "0000:%02x:00.0", dev+1);
+  return hipSuccess;
+}
+
+hipError_t hipDeviceGetByPCIBusId(int* dev, const char* busId) {
+  unsigned domain, bus, device, function;
+  if (sscanf(busId, "%x:%x:%x.%x", &domain, &bus, &device, &function) != 4 ||
+      domain != 0 || device != 0 || function != 0 || bus < 1 || (int)bus > deviceCount()) {
+    return setError(hipErrorInvalidDevice);
+  }
+  *dev = bus-1;
+  return hipSuccess;
+}
+
+hipError_t hipDeviceCanAccessPeer(int* canAccess, int dev, int peer) {
+  CHECK_DEVICE(dev);
+  CHECK_DEVICE(peer);
+  *canAccess = dev != peer;
+  return hipSuccess;
+}
+
+hipError_t hipDeviceEnablePeerAccess(int peer, unsigned flags) { CHECK_DEVICE(peer); return hipSuccess; }
+hipError_t hipDeviceSynchronize() { return hipSuccess; }
+hipError_t hipDeviceGetLimit(size_t* value, int limit) { *value = 0; return hipSuccess; }
+hipError_t hipDeviceSetLimit(int limit, size_t value) { return hipSuccess; }
+hipError_t hipDriverGetVersion(int* version) { *version = 50200000; return hipSuccess; }
+hipError_t hipRuntimeGetVersion(int* version) { *version = 50200000; return hipSuccess; }
+hipError_t hipCtxGetCurrent(hipCtx_t* ctx) { *ctx = (hipCtx_t)(uintptr_t)(currentDevice+1); return hipSuccess; }
+hipError_t hipCtxSetCurrent(hipCtx_t ctx) { return hipSetDevice(ctx ? (int)(uintptr_t)ctx-1 : 0); }
+
+const char* hipGetErrorName(hipError_t err) {
+  switch (err) {
+  case hipSuccess: return "hipSuccess";
+  case hipErrorInvalidValue: return "hipErrorInvalidValue";
+  case hipErrorOutOfMemory: return "hipErrorOutOfMemory";
+  case hipErrorInvalidDevice: return "hipErrorInvalidDevice";
+  case hipErrorNotReady: return "hipErrorNotReady";
+  case hipErrorPeerAccessAlreadyEnabled: return "hipErrorPeerAccessAlreadyEnabled";
+  case hipErrorNotSupported: return "hipErrorNotSupported";
+  default: return "hipErrorUnknown";
+  }
+}
+const char* hipGetErrorString(hipError_t err) { return hipGetErrorName(err); }
+hipError_t hipGetLastError() { hipError_t err = lastError; lastError = hipSuccess; return err; }
+hipError_t hipPeekAtLastError() { return lastError; }
+
+// Memory
+
+static hipError_t stubMalloc(void** ptr, size_t size, bool host) {
+  if (size == 0) { *ptr = NULL; return hipSuccess; }
+  bool mapped = size >= STUB_MMAP_SIZE;
+  void* p;
+  if (mapped) {
+    p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) p = NULL;
+  } else {
+    if (posix_memalign(&p, 256, size) != 0) p = NULL;
+    if (p) memset(p, 0, size);
+  }
+  if (p == NULL) return setError(hipErrorOutOfMemory);
+  std::lock_guard<std::mutex> lock(allocLock);
+  allocs[(uintptr_t)p] = { size, currentDevice, host, mapped };
+  *ptr = p;
+  return hipSuccess;
+}
+
+static hipError_t stubFree(void* ptr) {
+  if (ptr == NULL) return hipSuccess;
+  stubAlloc alloc;
+  {
+    std::lock_guard<std::mutex> lock(allocLock);
+    auto it = allocs.find((uintptr_t)ptr);
+    if (it == allocs.end()) return setError(hipErrorInvalidValue);
+    alloc = it->second;
+    allocs.erase(it);
+  }
+  if (alloc.mapped) munmap(ptr, alloc.size);
+  else free(ptr);
+  return hipSuccess;
+}
+
+// Returns the allocation containing ptr, with its base address
+static bool stubFind(const void* ptr, uintptr_t* base, stubAlloc* alloc) {
+  std::lock_guard<std::mutex> lock(allocLock);
+  auto it = allocs.upper_bound((uintptr_t)ptr);
+  if (it == allocs.begin()) return false;
+  --it;
+  if ((uintptr_t)ptr >= it->first + it->second.size) return false;
+  *base = it->first;
+  *alloc = it->second;
+  return true;
+}
+
+hipError_t hipMalloc(void** ptr, size_t size) { return stubMalloc(ptr, size, false); }
+hipError_t hipExtMallocWithFlags(void** ptr, size_t size, unsigned flags) { return stubMalloc(ptr, size, false); }
+hipError_t hipMallocManaged(void** ptr, size_t size, unsigned flags) { return stubMalloc(ptr, size, false); }
+hipError_t hipFree(void* ptr) { return stubFree(ptr); }
+hipError_t hipHostMalloc(void** ptr, size_t size, unsigned flags) { return stubMalloc(ptr, size, true); }
+hipError_t hipHostFree(void* ptr) { return stubFree(ptr); }
+hipError_t hipHostGetDevicePointer(void** devPtr, void* hostPtr, unsigned flags) { *devPtr = hostPtr; return hipSuccess; }
+hipError_t hipHostRegister(void* ptr, size_t size, unsigned flags) { return hipSuccess; }
+hipError_t hipHostUnregister(void* ptr) { return hipSuccess; }
+// Clearing large buffers gives their pages back instead of touching them
+static void stubMemset(void* dst, int value, size_t size) {
+  uintptr_t base;
+  stubAlloc alloc;
+  if (value == 0 && size >= STUB_MMAP_SIZE && stubFind(dst, &base, &alloc) && alloc.mapped) {
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)dst+pageSize-1) & ~(pageSize-1);
+    uintptr_t end = ((uintptr_t)dst+size) & ~(pageSize-1);
+    if (madvise((void*)begin, end-begin, MADV_DONTNEED) == 0) {
+      memset(dst, 0, begin-(uintptr_t)dst);
+      memset((void*)end, 0, (uintptr_t)dst+size-end);
+      return;
+    }
+  }
+  memset(dst, value, size);
+}
+
+hipError_t hipMemset(void* dst, int value, size_t size) { stubMemset(dst, value, size); return hipSuccess; }
+hipError_t hipMemsetAsync(void* dst, int value, size_t size, hipStream_t stream) { stubMemset(dst, value, size); return hipSuccess; }
+hipError_t hipMemcpy(void* dst, const void* src, size_t size, hipMemcpyKind kind) { memmove(dst, src, size); return hipSuccess; }
+hipError_t hipMemcpyAsync(void* dst, const void* src, size_t size, hipMemcpyKind kind, hipStream_t stream) {
+  memmove(dst, src, size);
+  return hipSuccess;
+}
+hipError_t hipMemcpy2DAsync(void* dst, size_t dpitch, const void* src, size_t spitch, size_t width, size_t height,
+    hipMemcpyKind kind, hipStream_t stream) {
+  for (size_t h=0; h<height; h++) memmove((char*)dst+h*dpitch, (const char*)src+h*spitch, width);
+  return hipSuccess;
+}
+
+hipError_t hipMemGetAddressRange(hipDeviceptr_t* base, size_t* size, hipDeviceptr_t ptr) {
+  uintptr_t b;
+  stubAlloc alloc;
+  if (!stubFind((const void*)ptr, &b, &alloc)) return setError(hipErrorInvalidValue);
+  if (base) *base = b;
+  if (size) *size = alloc.size;
+  return hipSuccess;
+}
+
+hipError_t hipMemAdvise(const void* ptr, size_t size, int advice, int dev) { return hipSuccess; }
+
+hipError_t hipPointerGetAttributes(hipPointerAttribute_t* attr, const void* ptr) {
+  uintptr_t base;
+  stubAlloc alloc;
+  if (!stubFind(ptr, &base, &alloc)) return setError(hipErrorInvalidValue);
+  memset(attr, 0, sizeof(*attr));
+  attr->memoryType = alloc.host ? hipMemoryTypeHost : hipMemoryTypeDevice;
+  attr->device = alloc.device;
+  attr->devicePointer = (void*)ptr;
+  attr->hostPointer = (void*)ptr;
+  return hipSuccess;
+}
+
+hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t* handle, void* ptr) {
+  uintptr_t base;
+  stubAlloc alloc;
+  if (!stubFind(ptr, &base, &alloc)) return setError(hipErrorInvalidValue);
+  memset(handle, 0, sizeof(*handle));
+  memcpy(handle->reserved, &base, sizeof(base));
+  return hipSuccess;
+}
+
+hipError_t hipIpcOpenMemHandle(void** ptr, hipIpcMemHandle_t handle, unsigned flags) {
+  memcpy(ptr, handle.reserved, sizeof(*ptr));
+  return hipSuccess;
+}
+
+hipError_t hipIpcCloseMemHandle(void* ptr) { return hipSuccess; }
+
+// Streams and events
+
+hipError_t hipStreamCreateWithFlags(hipStream_t* stream, unsigned flags) {
+  *stream = new ihipStream_t{ currentDevice, flags };
+  return hipSuccess;
+}
+hipError_t hipStreamCreate(hipStream_t* stream) { return hipStreamCreateWithFlags(stream, 0); }
+hipError_t hipStreamDestroy(hipStream_t stream) { delete stream; return hipSuccess; }
+hipError_t hipStreamSynchronize(hipStream_t stream) { return hipSuccess; }
+hipError_t hipStreamQuery(hipStream_t stream) { return hipSuccess; }
+hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned flags) { return hipSuccess; }
+
+hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t fn, void* arg, unsigned flags) {
+  fn(stream, hipSuccess, arg);
+  return hipSuccess;
+}
+
+hipError_t hipLaunchHostFunc(hipStream_t stream, hipHostFn_t fn, void* arg) {
+  fn(arg);
+  return hipSuccess;
+}
+
+hipError_t hipStreamGetCaptureInfo(hipStream_t stream, hipStreamCaptureStatus* status, unsigned long long* id) {
+  *status = hipStreamCaptureStatusNone;
+  if (id) *id = 0;
+  return hipSuccess;
+}
+
+hipError_t hipStreamGetCaptureInfo_v2(hipStream_t stream, hipStreamCaptureStatus* status, unsigned long long* id,
+    hipGraph_t* graph, const hipGraphNode_t** deps, size_t* nDeps) {
+  *status = hipStreamCaptureStatusNone;
+  if (id) *id = 0;
+  if (graph) *graph = NULL;
+  if (deps) *deps = NULL;
+  if (nDeps) *nDeps = 0;
+  return hipSuccess;
+}
+
+hipError_t hipStreamUpdateCaptureDependencies(hipStream_t, hipGraphNode_t*, size_t, unsigned) { return setError(hipErrorNotSupported); }
+hipError_t hipStreamBeginCapture(hipStream_t, hipStreamCaptureMode) { return setError(hipErrorNotSupported); }
+hipError_t hipStreamEndCapture(hipStream_t, hipGraph_t*) { return setError(hipErrorNotSupported); }
+
+hipError_t hipThreadExchangeStreamCaptureMode(hipStreamCaptureMode* mode) {
+  std::swap(*mode, captureMode);
+  return hipSuccess;
+}
+
+hipError_t hipEventCreateWithFlags(hipEvent_t* event, unsigned flags) { *event = new ihipEvent_t{ flags }; return hipSuccess; }
+hipError_t hipEventCreate(hipEvent_t* event) { return hipEventCreateWithFlags(event, hipEventDefault); }
+hipError_t hipEventDestroy(hipEvent_t event) { delete event; return hipSuccess; }
+hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream) { return hipSuccess; }
+hipError_t hipEventQuery(hipEvent_t event) { return hipSuccess; }
+hipError_t hipEventSynchronize(hipEvent_t event) { return hipSuccess; }
+hipError_t hipEventElapsedTime(float* ms, hipEvent_t start, hipEvent_t stop) { *ms = 0; return hipSuccess; }
+
+// Kernels
+
+hipError_t hipLaunchKernel(const void* func, dim3 grid, dim3 block, void** args, size_t sharedMem, hipStream_t stream) {
+  if (launchHook) launchHook(func, grid, block, args, stream);
+  return hipSuccess;
+}
+
+hipError_t hipExtLaunchKernel(const void* func, dim3 grid, dim3 block, void** args, size_t sharedMem, hipStream_t stream,
+    hipEvent_t start, hipEvent_t stop, int flags) {
+  return hipLaunchKernel(func, grid, block, args, sharedMem, stream);
+}
+
+hipError_t hipExtLaunchMultiKernelMultiDevice(hipLaunchParams* params, int n, unsigned flags) {
+  for (int i=0; i<n; i++) hipLaunchKernel(params[i].func, params[i].gridDim, params[i].blockDim, params[i].args, params[i].sharedMem, params[i].stream);
+  return hipSuccess;
+}
+
+hipError_t hipLaunchCooperativeKernelMultiDevice(hipLaunchParams* params, int n, unsigned flags) {
+  return hipExtLaunchMultiKernelMultiDevice(params, n, flags);
+}
+
+hipError_t hipFuncSetAttribute(const void* func, int attr, int value) { return hipSuccess; }
+hipError_t hipFuncGetAttributes(hipFuncAttributes* attr, const void* func) { memset(attr, 0, sizeof(*attr)); return hipSuccess; }
+hipError_t hipModuleGetGlobal(hipDeviceptr_t*, size_t*, void*, const char*) { return setError(hipErrorNotSupported); }
+
+hipError_t hipMemcpyToSymbol(const void* symbol, const void* src, size_t size, size_t offset, hipMemcpyKind kind) {
+  memcpy((char*)symbol+offset, src, size);
+  return hipSuccess;
+}
+
+hipError_t hipGetSymbolAddress(void** ptr, const void* symbol) { *ptr = (void*)symbol; return hipSuccess; }
+
+// Graphs
+
+hipError_t hipGraphAddHostNode(hipGraphNode_t*, hipGraph_t, const hipGraphNode_t*, size_t, const hipHostNodeParams*) { return setError(hipErrorNotSupported); }
+hipError_t hipGraphAddKernelNode(hipGraphNode_t*, hipGraph_t, const hipGraphNode_t*, size_t, const hipKernelNodeParams*) { return setError(hipErrorNotSupported); }
+hipError_t hipGraphAddEventRecordNode(hipGraphNode_t*, hipGraph_t, const hipGraphNode_t*, size_t, hipEvent_t) { return setError(hipErrorNotSupported); }
+hipError_t hipGraphRetainUserObject(hipGraph_t, void*, unsigned, unsigned) { return setError(hipErrorNotSupported); }
+hipError_t hipUserObjectCreate(void**, void*, void(*)(void*), unsigned, unsigned) { return setError(hipErrorNotSupported); }
+
+// Half precision conversions, round to nearest even
+
+half __float2half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (x >> 16) & 0x8000;
+  int32_t exp = ((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+  half h;
+  if (((x >> 23) & 0xff) == 0xff) {
+    h.x = sign | 0x7c00 | (mant ? 0x200 : 0);
+  } else if (exp >= 0x1f) {
+    h.x = sign | 0x7c00;
+  } else if (exp <= 0) {
+    if (exp < -10) { h.x = sign; return h; }
+    mant |= 0x800000;
+    int shift = 14 - exp;
+    uint32_t m = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1), halfway = 1u << (shift-1);
+    if (rem > halfway || (rem == halfway && (m & 1))) m++;
+    h.x = sign | m;
+  } else {
+    uint32_t m = mant >> 13;
+    uint32_t rem = mant & 0x1fff;
+    uint32_t v = (exp << 10) | m;
+    if (rem > 0x1000 || (rem == 0x1000 && (m & 1))) v++;
+    h.x = sign | v;
+  }
+  return h;
+}
+
+float __half2float(half h) {
+  uint32_t sign = (uint32_t)(h.x & 0x8000) << 16;
+  uint32_t exp = (h.x >> 10) & 0x1f;
+  uint32_t mant = h.x & 0x3ff;
+  uint32_t x;
+  if (exp == 0x1f) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else if (exp == 0) {
+    if (mant == 0) {
+      x = sign;
+    } else {
+      exp = 127 - 15 + 1;
+      while ((mant & 0x400) == 0) { mant <<= 1; exp--; }
+      x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+  } else {
+    x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
@@ -0,0 +1,209 @@
+/*************************************************************************
+ * Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+// Host-only stand-in for the HIP runtime, used to build the host code of RCCL
+// with a plain C++ compiler for EnqueueBench. Only the subset of the API used
+// by src/ is declared, see HipStub.cpp for the implementation: devices are
+// virtual, device memory is host memory, streams and events are always idle
+// and kernel launches are forwarded to a hook instead of running.
+
+#pragma once
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <dlfcn.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef __HIP_PLATFORM_HCC__
+#define __HIP_PLATFORM_HCC__ 1
+#endif
+#define __host__
+#define __device__
+#define __global__
+#define __shared__
+#define __forceinline__ inline
+
+// Errors
+typedef int hipError_t;
+#define hipSuccess 0
+#define hipErrorInvalidValue 1
+#define hipErrorOutOfMemory 2
+#define hipErrorInvalidDevice 101
+#define hipErrorNotSupported 801
+#define hipErrorNotReady 600
+#define hipErrorPeerAccessAlreadyEnabled 704
+
+// Handles
+typedef struct ihipStream_t* hipStream_t;
+typedef struct ihipEvent_t* hipEvent_t;
+typedef struct ihipCtx_t* hipCtx_t;
+typedef struct ihipGraph* hipGraph_t;
+typedef struct ihipGraphExec* hipGraphExec_t;
+typedef struct ihipGraphNode* hipGraphNode_t;
+typedef unsigned long long hipDeviceptr_t;
+typedef void (*hipHostFn_t)(void*);
+typedef void (*hipStreamCallback_t)(hipStream_t, hipError_t, void*);
+
+// Vector types
+struct dim3 { unsigned x,y,z; dim3(unsigned a=1,unsigned b=1,unsigned c=1):x(a),y(b),z(c){} };
+struct int2 { int x,y; };
+struct uint2 { unsigned x,y; };
+struct int4 { int x,y,z,w; };
+struct uint4 { unsigned x,y,z,w; };
+struct half { unsigned short x; };
+half __float2half(float);
+float __half2float(half);
+
+// Devices
+typedef struct {
+  unsigned hasGlobalInt32Atomics:1; unsigned hasGlobalFloatAtomicExch:1; unsigned hasSharedInt32Atomics:1;
+  unsigned hasSharedFloatAtomicExch:1; unsigned hasFloatAtomicAdd:1; unsigned hasGlobalInt64Atomics:1;
+  unsigned hasSharedInt64Atomics:1; unsigned hasDoubles:1; unsigned hasWarpVote:1; unsigned hasWarpBallot:1;
+  unsigned hasWarpShuffle:1; unsigned hasFunnelShift:1; unsigned hasThreadFenceSystem:1; unsigned hasSyncThreadsExt:1;
+  unsigned hasSurfaceFuncs:1; unsigned has3dGrid:1; unsigned hasDynamicParallelism:1;
+} hipDeviceArch_t;
+typedef struct {
+  char name[256]; size_t totalGlobalMem; int major; int minor; int multiProcessorCount; int gcnArch;
+  char gcnArchName[256]; int pciBusID; int pciDeviceID; int pciDomainID; hipDeviceArch_t arch;
+  int maxThreadsPerBlock; int warpSize;
+} hipDeviceProp_t;
+typedef int hipDeviceAttribute_t;
+#define hipDeviceAttributeComputeCapabilityMajor 1
+#define hipDeviceAttributeComputeCapabilityMinor 2
+#define hipDeviceAttributeMultiprocessorCount 3
+#define hipDeviceAttributeMaxThreadsPerBlock 4
+#define hipDeviceAttributeWarpSize 10
+#define hipDeviceAttributeHdpMemFlushCntl 11
+#define hipLimitStackSize 0
+hipError_t hipGetDevice(int*);
+hipError_t hipSetDevice(int);
+hipError_t hipGetDeviceCount(int*);
+hipError_t hipGetDeviceProperties(hipDeviceProp_t*, int);
+hipError_t hipDeviceGetAttribute(int*, hipDeviceAttribute_t, int);
+hipError_t hipDeviceGetPCIBusId(char*, int, int);
+hipError_t hipDeviceGetByPCIBusId(int*, const char*);
+hipError_t hipDeviceCanAccessPeer(int*, int, int);
+hipError_t hipDeviceEnablePeerAccess(int, unsigned);
+hipError_t hipDeviceSynchronize();
+hipError_t hipDeviceGetLimit(size_t*, int);
+hipError_t hipDeviceSetLimit(int, size_t);
+hipError_t hipDriverGetVersion(int*);
+hipError_t hipRuntimeGetVersion(int*);
+hipError_t hipCtxGetCurrent(hipCtx_t*);
+hipError_t hipCtxSetCurrent(hipCtx_t);
+const char* hipGetErrorString(hipError_t);
+const char* hipGetErrorName(hipError_t);
+hipError_t hipGetLastError();
+hipError_t hipPeekAtLastError();
+
+// Memory
+typedef enum { hipMemcpyHostToHost, hipMemcpyHostToDevice, hipMemcpyDeviceToHost, hipMemcpyDeviceToDevice, hipMemcpyDefault } hipMemcpyKind;
+typedef enum { hipMemoryTypeHost, hipMemoryTypeDevice } hipMemoryType;
+typedef struct { void* devicePointer; void* hostPointer; int memoryType; int device; int isManaged; unsigned allocationFlags; } hipPointerAttribute_t;
+typedef struct hipIpcMemHandle_st { char reserved[64]; } hipIpcMemHandle_t;
+#define hipHostMallocDefault 0
+#define hipHostMallocMapped 2
+#define hipHostMallocCoherent 0x40000000
+#define hipHostMallocNumaUser 0x20000000
+#define hipDeviceMallocFinegrained 1
+#define hipDeviceMallocUncached 3
+#define hipHostRegisterMapped 2
+#define hipIpcMemLazyEnablePeerAccess 1
+#define hipMemAdviseSetCoarseGrain 100
+hipError_t hipMalloc(void**, size_t);
+template<class T> hipError_t hipMalloc(T** p, size_t s) { return hipMalloc((void**)p, s); }
+hipError_t hipExtMallocWithFlags(void**, size_t, unsigned);
+hipError_t hipMallocManaged(void**, size_t, unsigned=1);
+hipError_t hipFree(void*);
+hipError_t hipHostMalloc(void**, size_t, unsigned);
+template<class T> hipError_t hipHostMalloc(T** p, size_t s, unsigned f) { return hipHostMalloc((void**)p, s, f); }
+hipError_t hipHostFree(void*);
+hipError_t hipHostGetDevicePointer(void**, void*, unsigned);
+hipError_t hipHostRegister(void*, size_t, unsigned);
+hipError_t hipHostUnregister(void*);
+hipError_t hipMemset(void*, int, size_t);
+hipError_t hipMemsetAsync(void*, int, size_t, hipStream_t);
+hipError_t hipMemcpy(void*, const void*, size_t, hipMemcpyKind);
+hipError_t hipMemcpyAsync(void*, const void*, size_t, hipMemcpyKind, hipStream_t);
+hipError_t hipMemcpy2DAsync(void*, size_t, const void*, size_t, size_t, size_t, hipMemcpyKind, hipStream_t);
+hipError_t hipMemGetAddressRange(hipDeviceptr_t*, size_t*, hipDeviceptr_t);
+hipError_t hipMemAdvise(const void*, size_t, int, int);
+hipError_t hipPointerGetAttributes(hipPointerAttribute_t*, const void*);
+hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t*, void*);
+hipError_t hipIpcOpenMemHandle(void**, hipIpcMemHandle_t, unsigned);
+hipError_t hipIpcCloseMemHandle(void*);
+
+// Streams and events
+typedef int hipStreamCaptureStatus;
+typedef int hipStreamCaptureMode;
+#define hipStreamNonBlocking 1
+#define hipStreamCaptureStatusNone 0
+#define hipStreamCaptureStatusActive 1
+#define hipStreamCaptureModeRelaxed 2
+#define hipEventDefault 0
+#define hipEventBlockingSync 1
+#define hipEventDisableTiming 2
+hipError_t hipStreamCreate(hipStream_t*);
+hipError_t hipStreamCreateWithFlags(hipStream_t*, unsigned);
+hipError_t hipStreamDestroy(hipStream_t);
+hipError_t hipStreamSynchronize(hipStream_t);
+hipError_t hipStreamQuery(hipStream_t);
+hipError_t hipStreamWaitEvent(hipStream_t, hipEvent_t, unsigned);
+hipError_t hipStreamAddCallback(hipStream_t, hipStreamCallback_t, void*, unsigned);
+hipError_t hipStreamGetCaptureInfo(hipStream_t, hipStreamCaptureStatus*, unsigned long long*);
+hipError_t hipStreamGetCaptureInfo_v2(hipStream_t, hipStreamCaptureStatus*, unsigned long long*, hipGraph_t*, const hipGraphNode_t**, size_t*);
+hipError_t hipStreamUpdateCaptureDependencies(hipStream_t, hipGraphNode_t*, size_t, unsigned);
+hipError_t hipStreamBeginCapture(hipStream_t, hipStreamCaptureMode);
+hipError_t hipStreamEndCapture(hipStream_t, hipGraph_t*);
+hipError_t hipThreadExchangeStreamCaptureMode(hipStreamCaptureMode*);
+hipError_t hipEventCreate(hipEvent_t*);
+hipError_t hipEventCreateWithFlags(hipEvent_t*, unsigned);
+hipError_t hipEventDestroy(hipEvent_t);
+hipError_t hipEventRecord(hipEvent_t, hipStream_t=0);
+hipError_t hipEventQuery(hipEvent_t);
+hipError_t hipEventSynchronize(hipEvent_t);
+hipError_t hipEventElapsedTime(float*, hipEvent_t, hipEvent_t);
+hipError_t hipLaunchHostFunc(hipStream_t, hipHostFn_t, void*);
+
+// Kernels
+typedef int hipFuncCache_t;
+typedef struct { size_t sharedSizeBytes; int maxThreadsPerBlock; int numRegs; size_t localSizeBytes; } hipFuncAttributes;
+typedef struct { void* func; dim3 gridDim; dim3 blockDim; void** args; size_t sharedMem; hipStream_t stream; } hipLaunchParams;
+#define hipFuncAttributePreferredSharedMemoryCarveout 9
+#define HIP_SYMBOL(x) (&x)
+#define hipLaunchKernelGGL(...)
+hipError_t hipLaunchKernel(const void*, dim3, dim3, void**, size_t, hipStream_t);
+hipError_t hipExtLaunchKernel(const void*, dim3, dim3, void**, size_t, hipStream_t, hipEvent_t, hipEvent_t, int);
+hipError_t hipExtLaunchMultiKernelMultiDevice(hipLaunchParams*, int, unsigned);
+hipError_t hipLaunchCooperativeKernelMultiDevice(hipLaunchParams*, int, unsigned);
+hipError_t hipFuncSetAttribute(const void*, int, int);
+hipError_t hipFuncGetAttributes(hipFuncAttributes*, const void*);
+hipError_t hipModuleGetGlobal(hipDeviceptr_t*, size_t*, void*, const char*);
+hipError_t hipMemcpyToSymbol(const void*, const void*, size_t, size_t=0, hipMemcpyKind=hipMemcpyHostToDevice);
+hipError_t hipGetSymbolAddress(void**, const void*);
+
+// Graphs, not supported: stream capture is never active
+typedef struct { void* fn; void* userData; } hipHostNodeParams;
+typedef struct { void* func; dim3 gridDim; dim3 blockDim; void** kernelParams; void** extra; unsigned sharedMemBytes; } hipKernelNodeParams;
+hipError_t hipGraphAddHostNode(hipGraphNode_t*, hipGraph_t, const hipGraphNode_t*, size_t, const hipHostNodeParams*);
+hipError_t hipGraphAddKernelNode(hipGraphNode_t*, hipGraph_t, const hipGraphNode_t*, size_t, const hipKernelNodeParams*);
+hipError_t hipGraphAddEventRecordNode(hipGraphNode_t*, hipGraph_t, const hipGraphNode_t*, size_t, hipEvent_t);
+hipError_t hipGraphRetainUserObject(hipGraph_t, void*, unsigned, unsigned);
+hipError_t hipUserObjectCreate(void**, void*, void(*)(void*), unsigned, unsigned);
+
+// Controls of the stub, not part of HIP.
+// Number of virtual devices, 8 by default or HIPSTUB_NUM_DEVICES. Must be
+// set before the first call to the runtime.
+void hipStubSetDeviceCount(int count);
+// Called synchronously by every kernel launch, with the arguments of the
+// launch. The default is to do nothing.
+typedef void (*hipStubLaunchHook_t)(const void* func, dim3 grid, dim3 block, void** args, hipStream_t stream);
+void hipStubSetLaunchHook(hipStubLaunchHook_t hook);
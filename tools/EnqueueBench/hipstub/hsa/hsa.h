@@ -0,0 +1,8 @@
+// HSA types used by src/include/rocmwrap.h. The HSA runtime itself is never
+// loaded with the HIP stub.
+#pragma once
+typedef int hsa_status_t;
+typedef int hsa_system_info_t;
+#define HSA_STATUS_SUCCESS 0
+#define HSA_SYSTEM_INFO_VERSION_MAJOR 0
+#define HSA_SYSTEM_INFO_VERSION_MINOR 1
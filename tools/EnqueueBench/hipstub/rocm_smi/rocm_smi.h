@@ -0,0 +1,7 @@
+// ROCm SMI types used by src/include/rocm_smi_wrap.h. The wrappers are
+// implemented by DeviceStub.cpp instead of the library.
+#pragma once
+typedef int rsmi_status_t;
+typedef int RSMI_IO_LINK_TYPE;
+#define RSMI_IOLINK_TYPE_PCIE 1
+#define RSMI_IOLINK_TYPE_XGMI 2
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the latency of ncclGroupEnd for a single process driving several
+// GPUs, as a function of the number of communicators in the group. Each
+// communicator gets a batch of AllReduce of different sizes and a ring of
+// ncclSend/ncclRecv, so that plan preparation has some work to do.
+// Compare with RCCL_PARALLEL_LAUNCH_PREPARE=1, which prepares the plans of
+// the communicators concurrently.
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess)                   \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+static void usage(char const* exe)
+{
+  printf("Usage: %s [-i iterations] [-c collectivesPerComm] [-m maxDevices]\n", exe);
+}
+
+int main(int argc, char **argv)
+{
+  int numIterations = 200;
+  int numColls      = 16;
+  int maxDevices    = 0;
+  int numWarmups    = 10;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:c:m:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 'i': numIterations = atoi(optarg); break;
+    case 'c': numColls      = atoi(optarg); break;
+    case 'm': maxDevices    = atoi(optarg); break;
+    default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  int numDevices;
+  HIP_CALL(hipGetDeviceCount(&numDevices));
+  if (maxDevices > 0 && maxDevices < numDevices) numDevices = maxDevices;
+  if (numDevices < 2)
+  {
+    printf("At least 2 devices are required\n");
+    return 1;
+  }
+  char const* parallel = getenv("RCCL_PARALLEL_LAUNCH_PREPARE");
+  printf("RCCL_PARALLEL_LAUNCH_PREPARE=%s, %d collectives per communicator\n", parallel ? parallel : "<unset>", numColls);
+
+  size_t const maxCount = 1<<20;
+  std::vector<hipStream_t> stream(numDevices);
+  std::vector<float*> buff(numDevices), sendBuff(numDevices), recvBuff(numDevices);
+  for (int d = 0; d < numDevices; d++)
+  {
+    HIP_CALL(hipSetDevice(d));
+    HIP_CALL(hipStreamCreate(&stream[d]));
+    HIP_CALL(hipMalloc((void **)&buff[d], maxCount * sizeof(float)));
+    HIP_CALL(hipMalloc((void **)&sendBuff[d], maxCount * sizeof(float)));
+    HIP_CALL(hipMalloc((void **)&recvBuff[d], maxCount * sizeof(float)));
+    HIP_CALL(hipMemset(buff[d], 0, maxCount * sizeof(float)));
+    HIP_CALL(hipMemset(sendBuff[d], 0, maxCount * sizeof(float)));
+  }
+
+  printf("%8s %16s %16s\n", "NumComms", "GroupEndUs", "PerCommUs");
+  for (int nComms = 2; nComms <= numDevices; nComms++)
+  {
+    std::vector<ncclComm_t> comm(nComms);
+    NCCL_CALL(ncclCommInitAll(comm.data(), nComms, NULL));
+
+    double total = 0;
+    for (int iteration = -numWarmups; iteration < numIterations; ++iteration)
+    {
+      NCCL_CALL(ncclGroupStart());
+      for (int r = 0; r < nComms; ++r)
+      {
+        for (int c = 0; c < numColls; c++)
+        {
+          size_t count = (size_t)1024 << (c % 11);
+          NCCL_CALL(ncclAllReduce(buff[r], buff[r], count, ncclFloat, ncclSum, comm[r], stream[r]));
+        }
+        NCCL_CALL(ncclSend(sendBuff[r], maxCount, ncclFloat, (r+1) % nComms, comm[r], stream[r]));
+        NCCL_CALL(ncclRecv(recvBuff[r], maxCount, ncclFloat, (r+nComms-1) % nComms, comm[r], stream[r]));
+      }
+      auto start = std::chrono::high_resolution_clock::now();
+      NCCL_CALL(ncclGroupEnd());
+      auto delta = std::chrono::high_resolution_clock::now() - start;
+      if (iteration >= 0)
+        total += std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(delta).count();
+
+      for (int r = 0; r < nComms; r++)
+      {
+        HIP_CALL(hipSetDevice(r));
+        HIP_CALL(hipStreamSynchronize(stream[r]));
+      }
+    }
+    printf("%8d %16.3f %16.3f\n", nComms, total / numIterations, total / numIterations / nComms);
+
+    for (int r = 0; r < nComms; r++)
+      NCCL_CALL(ncclCommDestroy(comm[r]));
+  }
+
+  for (int d = 0; d < numDevices; d++)
+  {
+    HIP_CALL(hipSetDevice(d));
+    HIP_CALL(hipFree(buff[d]));
+    HIP_CALL(hipFree(sendBuff[d]));
+    HIP_CALL(hipFree(recvBuff[d]));
+    HIP_CALL(hipStreamDestroy(stream[d]));
+  }
+  printf("PASSED\n");
+  return 0;
+}
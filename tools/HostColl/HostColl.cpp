@@ -0,0 +1,345 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Functional and performance test of the CPU execution backend
+// (src/collectives/host). Runs the device AllReduce (ring and tree),
+// AllGather and ReduceScatter algorithms for every protocol on host threads,
+// with one thread per rank or one process per rank (-P), and checks the
+// results against a reference computed on the host. Reports the time and bus
+// bandwidth of each configuration, as measured by rank 0.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <pthread.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "nccl.h"
+#include "devcomm.h"
+#include "debug.h"
+#include "../../src/collectives/host/host_comm.h"
+#include "../../src/collectives/host/reduce_host.h"
+
+struct Options {
+  int nRanks = 4;
+  int nChannels = 2;
+  int nWarps = 4;
+  size_t minBytes = 4;
+  size_t maxBytes = 4<<20;
+  int factor = 8;
+  int iters = 5;
+  int processes = 0;
+  int inPlace = 0;
+  int timeoutMs = 60000;
+  ncclDataType_t datatype = ncclFloat32;
+  ncclRedOp_t op = ncclSum;
+  const char* typeName = "float";
+  const char* opName = "sum";
+  int buffSize = 0; // SIMPLE, 0 for the default
+  std::string colls = "allreduce,allgather,reducescatter";
+};
+
+struct Test {
+  ncclFunc_t coll;
+  int algorithm;
+  int protocol;
+  int treeSplit;
+};
+
+static const char* collName(ncclFunc_t coll) {
+  return coll == ncclFuncAllReduce ? "AllReduce" : coll == ncclFuncAllGather ? "AllGather" : "ReduceScatter";
+}
+static const char* algoNames[] = { "TREE", "RING" };
+static const char* protoNames[] = { "LL", "LL128", "SIMPLE" };
+
+static std::vector<Test> buildTests(Options const& o) {
+  std::vector<Test> tests;
+  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    if (o.colls.find("allreduce") != std::string::npos) {
+      tests.push_back({ncclFuncAllReduce, NCCL_ALGO_RING, p, 0});
+      tests.push_back({ncclFuncAllReduce, NCCL_ALGO_TREE, p, 0});
+      // Only LL looks at the split flag, LL128 always splits and SIMPLE never does
+      if (p == NCCL_PROTO_LL) tests.push_back({ncclFuncAllReduce, NCCL_ALGO_TREE, p, 1});
+    }
+    if (o.colls.find("allgather") != std::string::npos) tests.push_back({ncclFuncAllGather, NCCL_ALGO_RING, p, 0});
+    if (o.colls.find("reducescatter") != std::string::npos) tests.push_back({ncclFuncReduceScatter, NCCL_ALGO_RING, p, 0});
+  }
+  return tests;
+}
+
+// Small integers, so that sums and products are exact in every type
+template<typename T>
+static T inputValue(ncclRedOp_t op, int rank, size_t i) {
+  if (op == ncclProd) return T(float(1 + ((rank + i) % 5 == 0)));
+  return T(float((rank*3 + i*7 + (i>>10)) % 5));
+}
+
+template<typename T>
+static double toDouble(T x) { return (double)(float)x; }
+
+template<typename T>
+static double reference(ncclRedOp_t op, int nRanks, size_t i) {
+  T acc = inputValue<T>(op, 0, i);
+  for (int r=1; r<nRanks; r++) {
+    T x = inputValue<T>(op, r, i);
+    switch (op) {
+      case ncclProd: acc = FuncProd<T>()(acc, x); break;
+      case ncclMax: acc = FuncMax<T>()(acc, x); break;
+      case ncclMin: acc = FuncMin<T>()(acc, x); break;
+      default: acc = FuncSum<T>()(acc, x); break;
+    }
+  }
+  if (op == ncclAvg) return std::is_integral<T>::value ? toDouble(T(acc/nRanks)) : toDouble(acc)/nRanks;
+  return toDouble(acc);
+}
+
+struct RankContext {
+  Options const* o;
+  struct ncclHostComm* comm;
+  int rank;
+  int errors;
+};
+
+template<typename T>
+static int runTest(RankContext* ctx, Test const& t, size_t bytes) {
+  Options const& o = *ctx->o;
+  int n = o.nRanks, rank = ctx->rank;
+  size_t count = bytes/sizeof(T); // per rank for AllGather and ReduceScatter
+  if (count == 0) return 0;
+  size_t sendCount = t.coll == ncclFuncReduceScatter ? count*n : count;
+  size_t recvCount = t.coll == ncclFuncAllGather ? count*n : count;
+  std::vector<T> recv(std::max(sendCount, recvCount));
+  std::vector<T> send(o.inPlace ? 0 : sendCount);
+  // In place: input at the output, or at the rank's block of it for AllGather
+  T* sendbuff = o.inPlace ? recv.data() + (t.coll == ncclFuncAllGather ? rank*count : 0) : send.data();
+  // In place ReduceScatter writes the rank's block of the input
+  T* recvbuff = recv.data() + (o.inPlace && t.coll == ncclFuncReduceScatter ? rank*count : 0);
+  // AllGather ignores the op, keep the values small anyway
+  ncclRedOp_t dataOp = t.coll == ncclFuncAllGather ? ncclSum : o.op;
+  size_t inputOffset = t.coll == ncclFuncAllGather ? rank*count : 0;
+
+  struct ncclHostCollArgs args;
+  args.coll = t.coll;
+  args.datatype = o.datatype;
+  args.op = o.op;
+  args.algorithm = t.algorithm;
+  args.protocol = t.protocol;
+  args.nWarps = o.nWarps;
+  args.treeSplit = t.treeSplit;
+  args.sendbuff = sendbuff;
+  args.recvbuff = recvbuff;
+  args.count = count;
+
+  int errors = 0;
+  double time = 0;
+  for (int iter=0; iter<=o.iters; iter++) {
+    for (size_t i=0; i<sendCount; i++) sendbuff[i] = inputValue<T>(dataOp, rank, t.coll == ncclFuncAllGather ? i : i+inputOffset);
+    auto start = std::chrono::steady_clock::now();
+    ncclResult_t res = ncclHostRunColl(ctx->comm, rank, &args);
+    auto end = std::chrono::steady_clock::now();
+    if (res != ncclSuccess) {
+      printf("[%d] %s %s %s bytes %zu : error %d\n", rank, collName(t.coll), algoNames[t.algorithm], protoNames[t.protocol], bytes, res);
+      return 1;
+    }
+    if (iter > 0) time += std::chrono::duration<double>(end-start).count(); // first one is a warmup
+
+    // Check the output, on the first and last iteration
+    if (iter != 0 && iter != o.iters) continue;
+    double tolerance = o.op == ncclAvg && !std::is_integral<T>::value ? (sizeof(T) == 2 ? 2e-2 : 1e-5) : 0;
+    for (size_t i=0; i<recvCount && errors < 10; i++) {
+      double expected;
+      if (t.coll == ncclFuncAllGather) expected = toDouble(inputValue<T>(dataOp, i/count, i%count));
+      else if (t.coll == ncclFuncReduceScatter) expected = reference<T>(o.op, n, i+rank*count);
+      else expected = reference<T>(o.op, n, i);
+      double got = toDouble(recvbuff[i]);
+      if (fabs(got-expected) > tolerance*fabs(expected)) {
+        printf("[%d] %s %s %s%s bytes %zu : element %zu is %g, expected %g\n", rank, collName(t.coll), algoNames[t.algorithm],
+            protoNames[t.protocol], t.treeSplit ? "/split" : "", bytes, i, got, expected);
+        errors++;
+      }
+    }
+  }
+  if (rank == 0) {
+    time /= o.iters;
+    size_t totalBytes = t.coll == ncclFuncAllReduce ? count*sizeof(T) : count*sizeof(T)*n;
+    double algBw = totalBytes/time/1e9;
+    double factor = t.coll == ncclFuncAllReduce ? 2.0*(n-1)/n : (double)(n-1)/n;
+    printf("%-14s %-5s %-6s%-6s %12zu %12.1f %8.3f %8.3f %6s\n", collName(t.coll), algoNames[t.algorithm], protoNames[t.protocol],
+        t.treeSplit ? "/split" : "", totalBytes, time*1e6, algBw, algBw*factor, errors ? "FAIL" : "OK");
+  }
+  return errors;
+}
+
+template<typename T>
+static int runAll(RankContext* ctx) {
+  Options const& o = *ctx->o;
+  int errors = 0;
+  for (Test const& t : buildTests(o)) {
+    for (size_t bytes=o.minBytes; bytes<=o.maxBytes; bytes*=o.factor) {
+      errors += runTest<T>(ctx, t, bytes);
+      if (o.factor <= 1) break;
+    }
+  }
+  return errors;
+}
+
+static void* rankMain(void* arg) {
+  RankContext* ctx = (RankContext*)arg;
+  switch (ctx->o->datatype) {
+    case ncclInt8: ctx->errors = runAll<int8_t>(ctx); break;
+    case ncclUint8: ctx->errors = runAll<uint8_t>(ctx); break;
+    case ncclInt32: ctx->errors = runAll<int32_t>(ctx); break;
+    case ncclUint32: ctx->errors = runAll<uint32_t>(ctx); break;
+    case ncclInt64: ctx->errors = runAll<int64_t>(ctx); break;
+    case ncclUint64: ctx->errors = runAll<uint64_t>(ctx); break;
+    case ncclFloat64: ctx->errors = runAll<double>(ctx); break;
+    case ncclBfloat16: ctx->errors = runAll<rccl_bfloat16>(ctx); break;
+    default: ctx->errors = runAll<float>(ctx); break;
+  }
+  return NULL;
+}
+
+// NCCL_DEBUG=WARN (default) or INFO
+int ncclDebugLevel = -1;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+static int parseType(const char* s, Options* o) {
+  const char* names[] = { "int8", "uint8", "int32", "uint32", "int64", "uint64", "half", "float", "double", "bfloat16" };
+  for (int t=0; t<ncclNumTypes; t++) {
+    if (strcmp(s, names[t]) == 0 && t != ncclFloat16) {
+      o->datatype = (ncclDataType_t)t;
+      o->typeName = s;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int parseOp(const char* s, Options* o) {
+  const char* names[] = { "sum", "prod", "max", "min", "avg" };
+  for (int i=0; i<5; i++) {
+    if (strcmp(s, names[i]) == 0) {
+      o->op = (ncclRedOp_t)i;
+      o->opName = s;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  int opt, bad = 0;
+  while ((opt = getopt(argc, argv, "n:c:w:b:e:f:i:Pxt:d:o:B:C:h")) != -1) {
+    switch (opt) {
+      case 'n': o.nRanks = atoi(optarg); break;
+      case 'c': o.nChannels = atoi(optarg); break;
+      case 'w': o.nWarps = atoi(optarg); break;
+      case 'b': o.minBytes = strtoull(optarg, NULL, 0); break;
+      case 'e': o.maxBytes = strtoull(optarg, NULL, 0); break;
+      case 'f': o.factor = atoi(optarg); break;
+      case 'i': o.iters = atoi(optarg); break;
+      case 'P': o.processes = 1; break;
+      case 'x': o.inPlace = 1; break;
+      case 't': o.timeoutMs = atoi(optarg); break;
+      case 'd': bad |= parseType(optarg, &o); break;
+      case 'o': bad |= parseOp(optarg, &o); break;
+      case 'B': o.buffSize = atoi(optarg); break;
+      case 'C': o.colls = optarg; break;
+      default: bad = 1; break;
+    }
+  }
+  if (bad || o.iters < 1) {
+    printf("Usage: %s [-n ranks] [-c channels] [-w warps] [-b minBytes] [-e maxBytes] [-f factor] [-i iters]\n"
+           "  [-P (one process per rank)] [-x (in place)] [-t timeoutMs] [-d int8|uint8|int32|uint32|int64|uint64|float|double|bfloat16]\n"
+           "  [-o sum|prod|max|min|avg] [-B simpleBuffSize] [-C allreduce,allgather,reducescatter]\n", argv[0]);
+    return opt == 'h' ? 0 : 1;
+  }
+
+  int buffSizes[NCCL_NUM_PROTOCOLS] = { 0, 0, o.buffSize };
+  struct ncclHostComm* comm;
+  if (ncclHostCommInit(&comm, o.nRanks, o.nChannels, buffSizes) != ncclSuccess) {
+    printf("FAILED\n");
+    return 1;
+  }
+  comm->timeoutMs = o.timeoutMs;
+  printf("# %d ranks (%s), %d channels, %d warps, %s %s%s\n", o.nRanks, o.processes ? "processes" : "threads",
+      o.nChannels, o.nWarps, o.typeName, o.opName, o.inPlace ? ", in place" : "");
+  printf("# %-12s %-5s %-12s %12s %12s %8s %8s %6s\n", "coll", "algo", "proto", "bytes", "time(us)", "algbw", "busbw", "check");
+  fflush(stdout);
+
+  std::vector<RankContext> ctx(o.nRanks);
+  int errors = 0;
+  if (o.processes) {
+    std::vector<pid_t> pids(o.nRanks);
+    for (int r=0; r<o.nRanks; r++) {
+      ctx[r] = { &o, comm, r, 0 };
+      pids[r] = fork();
+      if (pids[r] == 0) {
+        rankMain(&ctx[r]);
+        fflush(stdout);
+        _exit(ctx[r].errors ? 1 : 0);
+      }
+      if (pids[r] < 0) {
+        printf("fork failed\n");
+        errors++;
+      }
+    }
+    for (int r=0; r<o.nRanks; r++) {
+      int status;
+      if (pids[r] > 0 && (waitpid(pids[r], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) errors++;
+    }
+  } else {
+    std::vector<pthread_t> threads(o.nRanks);
+    for (int r=0; r<o.nRanks; r++) {
+      ctx[r] = { &o, comm, r, 0 };
+      pthread_create(&threads[r], NULL, rankMain, &ctx[r]);
+    }
+    for (int r=0; r<o.nRanks; r++) {
+      pthread_join(threads[r], NULL);
+      errors += ctx[r].errors;
+    }
+  }
+  ncclHostCommDestroy(comm);
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Benchmark of the host reduction library (src/collectives/host/host_reduce.h)
+// against the scalar loops the unit tests used to validate reductions
+// (test/common/PtrUnion.cpp): one switch on the datatype per element. For each
+// datatype and operation, runs the scalar loops and every instruction set the
+// CPU supports, checks that all of them give the same bits and reports their
+// bandwidth, counting two reads and one write per element (one read and one
+// write for scale and div).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "nccl.h"
+#include "rccl_bfloat16.h"
+#include "hip/hip_fp16.h"
+#include "../../src/collectives/host/host_reduce.h"
+
+// Reduction operations plus the two element-wise updates of the library
+enum BenchOp { OpSum, OpProd, OpMax, OpMin, OpScale, OpDiv, OpNum };
+static const char* opNames[OpNum] = { "sum", "prod", "max", "min", "scale", "div" };
+static const ncclRedOp_t redOps[] = { ncclSum, ncclProd, ncclMax, ncclMin };
+
+static const char* typeNames[ncclNumTypes] = { "int8", "uint8", "int32", "uint32", "int64", "uint64", "half", "float", "double", "bfloat16" };
+static const size_t typeBytes[ncclNumTypes] = { 1, 1, 4, 4, 8, 8, 2, 4, 8, 2 };
+
+template <typename T>
+static T scalarOp(ncclRedOp_t op, T a, T b) {
+  switch (op) {
+    case ncclSum: return a + b;
+    case ncclProd: return a * b;
+    case ncclMax: return std::max(a, b);
+    default: return std::min(a, b);
+  }
+}
+
+// The unit test loops, kept as they were
+static void scalarReduce(ncclDataType_t type, ncclRedOp_t op, void* dstPtr, void const* srcPtr, size_t n) {
+  for (size_t idx = 0; idx < n; ++idx) {
+    switch (type) {
+      case ncclInt8: ((int8_t*)dstPtr)[idx] = scalarOp(op, ((int8_t*)dstPtr)[idx], ((int8_t const*)srcPtr)[idx]); break;
+      case ncclUint8: ((uint8_t*)dstPtr)[idx] = scalarOp(op, ((uint8_t*)dstPtr)[idx], ((uint8_t const*)srcPtr)[idx]); break;
+      case ncclInt32: ((int32_t*)dstPtr)[idx] = scalarOp(op, ((int32_t*)dstPtr)[idx], ((int32_t const*)srcPtr)[idx]); break;
+      case ncclUint32: ((uint32_t*)dstPtr)[idx] = scalarOp(op, ((uint32_t*)dstPtr)[idx], ((uint32_t const*)srcPtr)[idx]); break;
+      case ncclInt64: ((int64_t*)dstPtr)[idx] = scalarOp(op, ((int64_t*)dstPtr)[idx], ((int64_t const*)srcPtr)[idx]); break;
+      case ncclUint64: ((uint64_t*)dstPtr)[idx] = scalarOp(op, ((uint64_t*)dstPtr)[idx], ((uint64_t const*)srcPtr)[idx]); break;
+      case ncclFloat16: ((__half*)dstPtr)[idx] = __float2half(scalarOp(op, __half2float(((__half*)dstPtr)[idx]), __half2float(((__half const*)srcPtr)[idx]))); break;
+      case ncclFloat32: ((float*)dstPtr)[idx] = scalarOp(op, ((float*)dstPtr)[idx], ((float const*)srcPtr)[idx]); break;
+      case ncclFloat64: ((double*)dstPtr)[idx] = scalarOp(op, ((double*)dstPtr)[idx], ((double const*)srcPtr)[idx]); break;
+      case ncclBfloat16: ((rccl_bfloat16*)dstPtr)[idx] = scalarOp(op, ((rccl_bfloat16*)dstPtr)[idx], ((rccl_bfloat16 const*)srcPtr)[idx]); break;
+      default: break;
+    }
+  }
+}
+
+static void scalarScale(ncclDataType_t type, void* dstPtr, void const* scalar, size_t n) {
+  for (size_t idx = 0; idx < n; ++idx) {
+    switch (type) {
+      case ncclInt8: ((int8_t*)dstPtr)[idx] *= *(int8_t const*)scalar; break;
+      case ncclUint8: ((uint8_t*)dstPtr)[idx] *= *(uint8_t const*)scalar; break;
+      case ncclInt32: ((int32_t*)dstPtr)[idx] *= *(int32_t const*)scalar; break;
+      case ncclUint32: ((uint32_t*)dstPtr)[idx] *= *(uint32_t const*)scalar; break;
+      case ncclInt64: ((int64_t*)dstPtr)[idx] *= *(int64_t const*)scalar; break;
+      case ncclUint64: ((uint64_t*)dstPtr)[idx] *= *(uint64_t const*)scalar; break;
+      case ncclFloat16: ((__half*)dstPtr)[idx] = __float2half(__half2float(((__half*)dstPtr)[idx]) * __half2float(*(__half const*)scalar)); break;
+      case ncclFloat32: ((float*)dstPtr)[idx] *= *(float const*)scalar; break;
+      case ncclFloat64: ((double*)dstPtr)[idx] *= *(double const*)scalar; break;
+      case ncclBfloat16: ((rccl_bfloat16*)dstPtr)[idx] *= *(rccl_bfloat16 const*)scalar; break;
+      default: break;
+    }
+  }
+}
+
+static void scalarDivide(ncclDataType_t type, void* dstPtr, int divisor, size_t n) {
+  for (size_t idx = 0; idx < n; ++idx) {
+    switch (type) {
+      case ncclInt8: ((int8_t*)dstPtr)[idx] /= divisor; break;
+      case ncclUint8: ((uint8_t*)dstPtr)[idx] /= divisor; break;
+      case ncclInt32: ((int32_t*)dstPtr)[idx] /= divisor; break;
+      case ncclUint32: ((uint32_t*)dstPtr)[idx] /= divisor; break;
+      case ncclInt64: ((int64_t*)dstPtr)[idx] /= divisor; break;
+      case ncclUint64: ((uint64_t*)dstPtr)[idx] /= divisor; break;
+      case ncclFloat16: ((__half*)dstPtr)[idx] = __float2half(__half2float(((__half*)dstPtr)[idx]) / divisor); break;
+      case ncclFloat32: ((float*)dstPtr)[idx] /= divisor; break;
+      case ncclFloat64: ((double*)dstPtr)[idx] /= divisor; break;
+      case ncclBfloat16: ((rccl_bfloat16*)dstPtr)[idx] = rccl_bfloat16((float)((rccl_bfloat16*)dstPtr)[idx] / divisor); break;
+      default: break;
+    }
+  }
+}
+
+// Random values in [-4, 4) for floating point types (any bits for integers),
+// with some exact ties and subnormals for the half and bfloat16 rounding
+static void fill(ncclDataType_t type, void* ptr, size_t n, uint64_t seed) {
+  uint64_t x = seed * 0x9e3779b97f4a7c15ull + 1;
+  for (size_t i = 0; i < n; i++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    float f = (int64_t)(x >> 40) / (float)(1 << 21) - 4.0f;
+    if (i % 97 == 0) f = ldexpf(f, -20);
+    switch (type) {
+      case ncclFloat16: ((__half*)ptr)[i] = __float2half(f); break;
+      case ncclFloat32: ((float*)ptr)[i] = f; break;
+      case ncclFloat64: ((double*)ptr)[i] = (double)f + (double)(x & 0xffff) * 1e-12; break;
+      case ncclBfloat16: ((rccl_bfloat16*)ptr)[i] = rccl_bfloat16(f); break;
+      default: memcpy((char*)ptr + i*typeBytes[type], &x, typeBytes[type]); break;
+    }
+  }
+}
+
+struct Options {
+  size_t minBytes = 1<<10;
+  size_t maxBytes = 64<<20;
+  int factor = 8;
+  int iters = 5;
+  int divisor = 3;
+  std::string types = "all";
+  std::string ops = "all";
+};
+
+static bool selected(std::string const& list, const char* name) {
+  if (list == "all") return true;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+    if (list.compare(start, end-start, name) == 0) return true;
+    start = end+1;
+  }
+  return false;
+}
+
+// Runs one operation on dst (reset from init first) and returns the best time in seconds
+template <typename F>
+static double timeIt(int iters, std::vector<char>& dst, std::vector<char> const& init, F f) {
+  double best = 1e30;
+  for (int i = 0; i < iters; i++) {
+    memcpy(dst.data(), init.data(), init.size());
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    best = std::min(best, d.count());
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  int opt, bad = 0;
+  while ((opt = getopt(argc, argv, "b:e:f:i:v:d:o:h")) != -1) {
+    switch (opt) {
+      case 'b': o.minBytes = strtoull(optarg, NULL, 0); break;
+      case 'e': o.maxBytes = strtoull(optarg, NULL, 0); break;
+      case 'f': o.factor = atoi(optarg); break;
+      case 'i': o.iters = atoi(optarg); break;
+      case 'v': o.divisor = atoi(optarg); break;
+      case 'd': o.types = optarg; break;
+      case 'o': o.ops = optarg; break;
+      default: bad = 1; break;
+    }
+  }
+  if (bad || o.iters < 1 || o.factor < 2 || o.minBytes > o.maxBytes || o.divisor == 0) {
+    printf("Usage: %s [-b minBytes] [-e maxBytes] [-f factor] [-i iters] [-v divisor]\n"
+           "  [-d all|int8,uint8,int32,uint32,int64,uint64,half,float,double,bfloat16] [-o all|sum,prod,max,min,scale,div]\n", argv[0]);
+    return opt == 'h' ? 0 : 1;
+  }
+
+  int nIsa = ncclHostIsaDetect() + 1;
+  printf("# Host reductions, best of %d iterations, bandwidth in GB/s, detected %s\n", o.iters, ncclHostIsaName(ncclHostIsaDetect()));
+  printf("# %-9s %-5s %12s %9s", "type", "op", "bytes", "loops");
+  for (int isa = 0; isa < nIsa; isa++) printf(" %9s", ncclHostIsaName((ncclHostIsa)isa));
+  printf(" %8s %6s\n", "speedup", "check");
+
+  int errors = 0;
+  for (int t = 0; t < ncclNumTypes; t++) {
+    ncclDataType_t type = (ncclDataType_t)t;
+    if (!selected(o.types, typeNames[t])) continue;
+    for (int op = 0; op < OpNum; op++) {
+      if (!selected(o.ops, opNames[op])) continue;
+      for (size_t bytes = o.minBytes; bytes <= o.maxBytes; bytes *= o.factor) {
+        size_t n = bytes / typeBytes[t];
+        size_t size = n * typeBytes[t];
+        std::vector<char> init(size), src(size), dst(size), expected(size);
+        fill(type, init.data(), n, 1);
+        fill(type, src.data(), n, 2);
+        char const* scalar = src.data() + (n/2)*typeBytes[t]; // any element of src
+        double traffic = (op < OpScale ? 3.0 : 2.0) * size;
+
+        double tLoops = timeIt(o.iters, expected, init, [&]() {
+          if (op < OpScale) scalarReduce(type, redOps[op], expected.data(), src.data(), n);
+          else if (op == OpScale) scalarScale(type, expected.data(), scalar, n);
+          else scalarDivide(type, expected.data(), o.divisor, n);
+        });
+        printf("  %-9s %-5s %12zu %9.2f", typeNames[t], opNames[op], size, traffic / tLoops / 1e9);
+
+        bool match = true;
+        double tBest = 1e30;
+        for (int isa = 0; isa < nIsa; isa++) {
+          ncclResult_t res = ncclHostReduceSetIsa((ncclHostIsa)isa);
+          double tIsa = timeIt(o.iters, dst, init, [&]() {
+            if (res != ncclSuccess) return;
+            if (op < OpScale) res = ncclHostReduce(dst.data(), dst.data(), src.data(), n, type, redOps[op]);
+            else if (op == OpScale) res = ncclHostScale(dst.data(), n, type, scalar);
+            else res = ncclHostDivide(dst.data(), n, type, o.divisor);
+          });
+          if (res != ncclSuccess || memcmp(dst.data(), expected.data(), size) != 0) match = false;
+          tBest = std::min(tBest, tIsa);
+          printf(" %9.2f", traffic / tIsa / 1e9);
+        }
+        printf(" %7.1fx %6s\n", tLoops / tBest, match ? "OK" : "ERROR");
+        if (!match) errors++;
+        fflush(stdout);
+      }
+    }
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Cost of the TLB misses on the large host buffers of the proxy and shm
+// transport, depending on their huge page backing (src/misc/hugepage.cc,
+// RCCL_HUGEPAGES). For each mode of -m, two buffers of -n bytes are
+// allocated with ncclHugePagesAlloc and measured with:
+//  - a random walk touching one line per 4K page, as the flag polling and
+//    step headers of many connections do (latency per access);
+//  - a copy of one buffer to the other, as the proxy copies of the shm
+//    transport do (GB/s).
+// The data TLB read misses of each are counted with perf_event_open when the
+// kernel lets us ("n/a" otherwise), along with the kB found on huge pages in
+// /proc/self/smaps. Explicit pages need hugetlb pages reserved beforehand
+// (vm.nr_hugepages); the mode falls back to transparent huge pages otherwise.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <unistd.h>
+#include <getopt.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "hugepage.h"
+#include "debug.h"
+
+#define LINE_SIZE 64
+#define SMALL_PAGE_SIZE 4096
+
+// Stub of the RCCL logger. NCCL_DEBUG=WARN (default) or INFO
+int ncclDebugLevel = -1;
+uint64_t ncclDebugMask = NCCL_ALL;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+static const char* modeNames[] = { "regular", "transparent", "explicit" };
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+// Sizes such as 256M or 1G
+static size_t parseSize(const char* str) {
+  char* end;
+  size_t size = strtoull(str, &end, 0);
+  switch (*end) {
+  case 'G': case 'g': size <<= 10;  // fall through
+  case 'M': case 'm': size <<= 10;  // fall through
+  case 'K': case 'k': size <<= 10;
+  }
+  return size;
+}
+
+// Data TLB read misses of the calling thread, -1 when not available
+static int tlbCounterOpen() {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void tlbCounterStart(int fd) {
+  if (fd < 0) return;
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static int64_t tlbCounterStop(int fd) {
+  if (fd < 0) return -1;
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  int64_t count;
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+  return count;
+}
+
+static void printCount(int64_t count) {
+  if (count < 0) printf(" %12s", "n/a");
+  else printf(" %12ld", count);
+}
+
+// One line per 4K page, linked in a random cycle so that every access needs
+// a translation the hardware cannot prefetch
+static void buildWalk(char* buffer, size_t size, unsigned seed) {
+  size_t nPages = size / SMALL_PAGE_SIZE;
+  std::vector<size_t> order(nPages);
+  for (size_t i = 0; i < nPages; i++) order[i] = i;
+  std::shuffle(order.begin()+1, order.end(), std::mt19937(seed));
+  for (size_t i = 0; i < nPages; i++) {
+    size_t line = (order[i] * 7) % (SMALL_PAGE_SIZE / LINE_SIZE);
+    size_t nextLine = (order[(i+1)%nPages] * 7) % (SMALL_PAGE_SIZE / LINE_SIZE);
+    *(char**)(buffer + order[i]*SMALL_PAGE_SIZE + line*LINE_SIZE) = buffer + order[(i+1)%nPages]*SMALL_PAGE_SIZE + nextLine*LINE_SIZE;
+  }
+}
+
+static char* runWalk(char* start, size_t nAccesses) {
+  char* p = start;
+  for (size_t i = 0; i < nAccesses; i++) p = *(char* volatile*)p;
+  return p;
+}
+
+int main(int argc, char **argv)
+{
+  size_t size = 256 << 20;
+  int nIters = 5;
+  std::vector<int> modes = { NCCL_HUGEPAGES_NONE, NCCL_HUGEPAGES_TRANSPARENT, NCCL_HUGEPAGES_EXPLICIT };
+  int opt;
+  while ((opt = getopt(argc, argv, "n:m:i:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n': size = parseSize(optarg); break;
+    case 'm':
+    {
+      modes.clear();
+      std::stringstream ss(optarg);
+      std::string m;
+      while (std::getline(ss, m, ',')) modes.push_back(atoi(m.c_str()));
+      break;
+    }
+    case 'i': nIters = atoi(optarg); break;
+    default:
+      printf("Usage: %s [-n bytes[K|M|G]] [-m mode[,mode...]] [-i iterations]\n", argv[0]);
+      printf("  modes: 0 regular pages, 1 transparent huge pages, 2 explicit huge pages\n");
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (size < SMALL_PAGE_SIZE || nIters <= 0 || modes.empty())
+  {
+    printf("Invalid arguments\n");
+    return 1;
+  }
+  for (int mode : modes)
+  {
+    if (mode < NCCL_HUGEPAGES_NONE || mode > NCCL_HUGEPAGES_EXPLICIT)
+    {
+      printf("Invalid mode %d\n", mode);
+      return 1;
+    }
+  }
+  size = size / SMALL_PAGE_SIZE * SMALL_PAGE_SIZE;
+
+  int tlbFd = tlbCounterOpen();
+  size_t nAccesses = size / SMALL_PAGE_SIZE * nIters;
+  printf("# 2 x %ld MB buffers, %d iterations, explicit page size %ld kB\n", size >> 20, nIters, ncclHugePageSize() >> 10);
+  printf("%-12s %10s %10s %10s %12s %10s %12s\n", "#mode", "hugeKB", "pageKB", "walkNs", "walkTlbMiss", "copyGB/s", "copyTlbMiss");
+  int errors = 0;
+  for (int mode : modes)
+  {
+    void* src, *dst;
+    size_t srcMapSize, dstMapSize;
+    if (ncclHugePagesAlloc(&src, size, mode, &srcMapSize) != ncclSuccess ||
+        ncclHugePagesAlloc(&dst, size, mode, &dstMapSize) != ncclSuccess)
+    {
+      printf("Allocation failed for mode %d\n", mode);
+      return 1;
+    }
+    memset(src, 1, size);
+    memset(dst, 0, size);
+    size_t hugeBytes, pageSize;
+    if (ncclHugePagesUsed(src, size, &hugeBytes, &pageSize) != ncclSuccess)
+    {
+      printf("Cannot read /proc/self/smaps\n");
+      return 1;
+    }
+
+    buildWalk((char*)src, size, 1234);
+    runWalk((char*)src, size / SMALL_PAGE_SIZE);
+    tlbCounterStart(tlbFd);
+    uint64_t start = nowNs();
+    char* end = runWalk((char*)src, nAccesses);
+    double walkNs = (double)(nowNs()-start) / nAccesses;
+    int64_t walkMisses = tlbCounterStop(tlbFd);
+    // The cycle visits every page once per iteration and ends where it began
+    if (end != (char*)src)
+    {
+      printf("Walk on %s pages ended at %p instead of %p\n", modeNames[mode], end, src);
+      errors++;
+    }
+
+    memcpy(dst, src, size);
+    tlbCounterStart(tlbFd);
+    start = nowNs();
+    for (int i = 0; i < nIters; i++) memcpy(dst, src, size);
+    double copyGBs = (double)size * nIters / (nowNs()-start);
+    int64_t copyMisses = tlbCounterStop(tlbFd);
+    if (memcmp(dst, src, size) != 0)
+    {
+      printf("Copy on %s pages differs\n", modeNames[mode]);
+      errors++;
+    }
+
+    printf("%-12s %10ld %10ld %10.1f", modeNames[mode], hugeBytes >> 10, pageSize >> 10, walkNs);
+    printCount(walkMisses);
+    printf(" %10.2f", copyGBs);
+    printCount(copyMisses);
+    printf("\n");
+    if (ncclHugePagesFree(src, srcMapSize) != ncclSuccess || ncclHugePagesFree(dst, dstMapSize) != ncclSuccess) return 1;
+  }
+  if (tlbFd < 0) printf("# TLB misses n/a : perf_event_open not permitted or not supported\n");
+  else close(tlbFd);
+  if (errors)
+  {
+    printf("%d errors\n", errors);
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the time to create many communicators at once.
+// With NCCL_COMM_BLOCKING=0 all ranks of all communicators are started without a group
+// and initialize in the background; otherwise each communicator is created by a group.
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess && error != ncclInProgress) \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+int main(int argc, char **argv)
+{
+  int nranks;
+  HIP_CALL(hipGetDeviceCount(&nranks));
+  int numComms = (argc > 1 ? atoi(argv[1]) : 64);
+
+  char const* blockingStr = getenv("NCCL_COMM_BLOCKING");
+  bool const blocking = (blockingStr == NULL || atoi(blockingStr) != 0);
+
+  std::vector<ncclUniqueId> ids(numComms);
+  for (int c = 0; c < numComms; c++)
+    NCCL_CALL(ncclGetUniqueId(&ids[c]));
+
+  std::vector<ncclComm_t> comms(numComms * nranks);
+  auto start = std::chrono::high_resolution_clock::now();
+  if (blocking)
+  {
+    for (int c = 0; c < numComms; c++)
+    {
+      NCCL_CALL(ncclGroupStart());
+      for (int r = 0; r < nranks; r++)
+      {
+        HIP_CALL(hipSetDevice(r));
+        NCCL_CALL(ncclCommInitRank(&comms[c * nranks + r], nranks, ids[c], r));
+      }
+      NCCL_CALL(ncclGroupEnd());
+    }
+  }
+  else
+  {
+    for (int c = 0; c < numComms; c++)
+    {
+      for (int r = 0; r < nranks; r++)
+      {
+        HIP_CALL(hipSetDevice(r));
+        NCCL_CALL(ncclCommInitRank(&comms[c * nranks + r], nranks, ids[c], r));
+      }
+    }
+    // Poll until every communicator is ready
+    for (size_t i = 0; i < comms.size(); i++)
+    {
+      ncclResult_t state;
+      do
+      {
+        NCCL_CALL(ncclCommGetAsyncError(comms[i], &state));
+      } while (state == ncclInProgress);
+    }
+  }
+  auto delta = std::chrono::high_resolution_clock::now() - start;
+  double initTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(delta).count();
+
+  printf("%s init of %d communicators x %d ranks: %.3f ms (%.3f ms per communicator)\n",
+         blocking ? "Blocking" : "Non-blocking", numComms, nranks, initTime, initTime / numComms);
+
+  for (auto comm : comms)
+    NCCL_CALL(ncclCommDestroy(comm));
+  return 0;
+}
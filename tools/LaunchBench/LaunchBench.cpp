@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the host side cost of enqueueing and launching collectives, from the
+// ncclAllReduce call until the kernel has been launched. The same shapes are
+// issued every iteration, as in a training loop.
+// Compare with RCCL_COLL_CACHE_SIZE=0 to disable the collective cache.
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess)                   \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+int main(int argc, char **argv)
+{
+  int nranks;
+  HIP_CALL(hipGetDeviceCount(&nranks));
+  int numIterations = (argc > 1 ? atoi(argv[1]) : 1000);
+  int numWarmups    = 10;
+
+  std::vector<ncclComm_t> comm(nranks);
+  NCCL_CALL(ncclCommInitAll(comm.data(), nranks, NULL));
+
+  // A few shapes, like the gradient buckets of a model
+  std::vector<size_t> const counts = {1024, 65536, 1<<20};
+  size_t const maxCount = 1<<20;
+
+  std::vector<hipStream_t> stream(nranks);
+  std::vector<float*> buff(nranks);
+  for (int r = 0; r < nranks; r++)
+  {
+    HIP_CALL(hipSetDevice(r));
+    HIP_CALL(hipStreamCreate(&stream[r]));
+    HIP_CALL(hipMalloc((void **)&buff[r], maxCount * sizeof(float)));
+    HIP_CALL(hipMemset(buff[r], 0, maxCount * sizeof(float)));
+  }
+
+  printf("%12s %16s\n", "NumBytes", "EnqueueUs");
+  for (size_t count : counts)
+  {
+    double total = 0;
+    for (int iteration = -numWarmups; iteration < numIterations; ++iteration)
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+      NCCL_CALL(ncclGroupStart());
+      for (int r = 0; r < nranks; ++r)
+        NCCL_CALL(ncclAllReduce(buff[r], buff[r], count, ncclFloat, ncclSum, comm[r], stream[r]));
+      NCCL_CALL(ncclGroupEnd());
+      auto delta = std::chrono::high_resolution_clock::now() - start;
+      if (iteration >= 0)
+        total += std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(delta).count();
+
+      for (int r = 0; r < nranks; r++)
+        HIP_CALL(hipStreamSynchronize(stream[r]));
+    }
+    printf("%12lu %16.3f\n", count * sizeof(float), total / numIterations / nranks);
+  }
+
+  for (int r = 0; r < nranks; r++)
+  {
+    HIP_CALL(hipFree(buff[r]));
+    HIP_CALL(hipStreamDestroy(stream[r]));
+    NCCL_CALL(ncclCommDestroy(comm[r]));
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Loopback benchmark of the device bonding of src/transport/net_bond.cc. A
+// sender and a receiver thread stream messages through one device of a net
+// plugin (by default the emulation plugin of ext-net/emul, whose devices are
+// capped to the speed of its profile), then through a bond of several of its
+// devices, and report the throughput of both. The receiver checks the content
+// of every message.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <vector>
+#include <thread>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "net.h"
+#include "utils.h"
+
+// Stubs of the RCCL logger
+int ncclDebugLevel = -1;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+#define DEPTH 4
+
+static unsigned char pattern(int msg, size_t offset) { return (unsigned char)(msg*131 + offset/4096 + offset); }
+
+static void sender(ncclNet_t* net, void* comm, int size, int iters, double* time, int* errors) {
+  std::vector<char> buffs((size_t)size*DEPTH);
+  void* mhandle;
+  if (net->regMr(comm, buffs.data(), buffs.size(), NCCL_PTR_HOST, &mhandle) != ncclSuccess) { (*errors)++; return; }
+  void* requests[DEPTH];
+  int posted = 0, completed = 0;
+  uint64_t start = clockNano();
+  while (completed < iters) {
+    if (posted < iters && posted-completed < DEPTH) {
+      char* buff = buffs.data() + (size_t)(posted%DEPTH)*size;
+      for (size_t o=0; o<(size_t)size; o+=4096) buff[o] = pattern(posted, o);
+      if (size) buff[size-1] = pattern(posted, size-1);
+      if (net->isend(comm, buff, size, 0, mhandle, requests+posted%DEPTH) != ncclSuccess) { (*errors)++; return; }
+      if (requests[posted%DEPTH]) posted++;
+    }
+    if (completed < posted) {
+      int done;
+      if (net->test(requests[completed%DEPTH], &done, NULL) != ncclSuccess) { (*errors)++; return; }
+      if (done) completed++;
+    }
+  }
+  *time = (clockNano() - start) * 1e-9;
+  net->deregMr(comm, mhandle);
+}
+
+static void receiver(ncclNet_t* net, void* comm, int size, int iters, int* errors) {
+  std::vector<char> buffs((size_t)size*DEPTH);
+  void* mhandle;
+  if (net->regMr(comm, buffs.data(), buffs.size(), NCCL_PTR_HOST, &mhandle) != ncclSuccess) { (*errors)++; return; }
+  void* requests[DEPTH];
+  int posted = 0, completed = 0;
+  while (completed < iters) {
+    if (posted < iters && posted-completed < DEPTH) {
+      void* buff = buffs.data() + (size_t)(posted%DEPTH)*size;
+      int tag = 0;
+      if (net->irecv(comm, 1, &buff, &size, &tag, &mhandle, requests+posted%DEPTH) != ncclSuccess) { (*errors)++; return; }
+      if (requests[posted%DEPTH]) posted++;
+    }
+    if (completed < posted) {
+      int done, received;
+      if (net->test(requests[completed%DEPTH], &done, &received) != ncclSuccess) { (*errors)++; return; }
+      if (done) {
+        char* buff = buffs.data() + (size_t)(completed%DEPTH)*size;
+        if (received != size) (*errors)++;
+        for (size_t o=0; o<(size_t)size; o+=4096) if ((unsigned char)buff[o] != pattern(completed, o)) { (*errors)++; break; }
+        if (size && (unsigned char)buff[size-1] != pattern(completed, size-1)) (*errors)++;
+        completed++;
+      }
+    }
+  }
+  net->deregMr(comm, mhandle);
+}
+
+// Returns the throughput in GB/s of iters messages of size bytes on dev
+static int run(ncclNet_t* net, int dev, int size, int iters, double* bw) {
+  ncclNetHandle_t handle;
+  void *listenComm, *sendComm = NULL, *recvComm = NULL;
+  if (net->listen(dev, handle, &listenComm) != ncclSuccess) return 1;
+  while (sendComm == NULL || recvComm == NULL) {
+    if (sendComm == NULL && net->connect(dev, handle, &sendComm) != ncclSuccess) return 1;
+    if (recvComm == NULL && net->accept(listenComm, &recvComm) != ncclSuccess) return 1;
+  }
+  int sendErrors = 0, recvErrors = 0;
+  double time = 0;
+  std::thread recvThread(receiver, net, recvComm, size, iters, &recvErrors);
+  sender(net, sendComm, size, iters, &time, &sendErrors);
+  recvThread.join();
+  *bw = time > 0 ? (double)size*iters/time*1e-9 : 0;
+  net->closeSend(sendComm);
+  net->closeRecv(recvComm);
+  net->closeListen(listenComm);
+  return sendErrors + recvErrors;
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s [-l plugin.so] [-B bond] [-b minBytes] [-e maxBytes] [-n iters]\n", name);
+  printf("  -B: RCCL_NET_BOND value, devices per bond or groups like 0+1 (default 2)\n");
+}
+
+int main(int argc, char* argv[]) {
+  const char* pluginPath = "../../ext-net/emul/librccl-net-emul.so";
+  const char* bondConfig = "2";
+  int minBytes = 64*1024, maxBytes = 8*1024*1024, iters = 64;
+  int opt;
+  while ((opt = getopt(argc, argv, "l:B:b:e:n:h")) != -1) {
+    switch (opt) {
+      case 'l': pluginPath = optarg; break;
+      case 'B': bondConfig = optarg; break;
+      case 'b': minBytes = atoi(optarg); break;
+      case 'e': maxBytes = atoi(optarg); break;
+      case 'n': iters = atoi(optarg); break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (minBytes < 0 || maxBytes < minBytes || iters < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  void* lib = dlopen(pluginPath, RTLD_NOW | RTLD_LOCAL);
+  ncclNet_t* base = lib ? (ncclNet_t*)dlsym(lib, "ncclNetPlugin_v6") : NULL;
+  if (base == NULL) {
+    printf("Could not load ncclNetPlugin_v6 from %s: %s\nFAILED\n", pluginPath, dlerror());
+    return 1;
+  }
+  int nDevs;
+  if (base->init(ncclDebugLog) != ncclSuccess || base->devices(&nDevs) != ncclSuccess) {
+    printf("FAILED\n");
+    return 1;
+  }
+  ncclNet_t* bond;
+  if (ncclNetBondInit(base, bondConfig, &bond) != ncclSuccess) {
+    printf("FAILED\n");
+    return 1;
+  }
+  ncclNetProperties_t baseProps, bondProps;
+  base->getProperties(0, &baseProps);
+  bond->getProperties(0, &bondProps);
+  printf("NET/%s device %s (%d Mb/s) vs NET/%s device %s (%d Mb/s)\n", base->name, baseProps.name, baseProps.speed,
+      bond->name, bondProps.name, bondProps.speed);
+  printf("%12s %14s %14s %10s\n", "bytes", "single (GB/s)", "bond (GB/s)", "ratio");
+  int errors = 0;
+  for (int size=minBytes; size<=maxBytes; size = size ? size*2 : 1) {
+    double single, bonded;
+    errors += run(base, 0, size, iters, &single);
+    errors += run(bond, 0, size, iters, &bonded);
+    printf("%12d %14.3f %14.3f %9.2fx\n", size, single, bonded, single > 0 ? bonded/single : 0);
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
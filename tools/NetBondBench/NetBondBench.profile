@@ -0,0 +1,4 @@
+# Two devices capped at 4 Gb/s each, on the same link
+device emul0 speed=4000
+device emul1 speed=4000
+link * * latency=5
@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host only simulator of the send/recv chunking of scheduleP2pTasksToPlan
+// (src/misc/p2p_sched.cc). For synthetic traffic matrices, it splits every
+// send and recv of every rank like the planner does, places chunk c on the
+// channel of ncclChannelCompute(peer, c % p2pnChannelsPerPeer), and checks
+// that each send chunk has a matching recv chunk on the peer (same channel,
+// offset and size) and that chunks cover the whole operation. It then reports,
+// for the legacy and balanced splits, the channel imbalance (busiest channel
+// over the average channel of a rank), the busiest channel of any rank and
+// the number of work elements per channel.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include "p2p_sched.h"
+
+#define NCCL_STEPS 8
+#define SENDRECV_SLICEFACTOR 4
+#define P2P_GROUP_SIZE 1 // NCCL_MAX_WORK_ELEMENTS_P2P/2
+
+struct Options {
+  int nRanks = 64;
+  int nNodes = 8;
+  int nChannels = 32;
+  int channelsPerPeer = 4;
+  size_t bytesPerRank = 256 << 20;
+  size_t buffSize = 4 << 20;
+  double zipf = 1.2;
+  double hot = 0.5;
+  int sparse = 4;
+  int iters = 3;
+  double channelGBs = 12.0;
+  double latencyUs = 5.0;
+};
+
+static void usage(char const* exe) {
+  printf("Usage: %s [-n nRanks] [-N nNodes] [-c p2pnChannels] [-p p2pnChannelsPerPeer] [-b bytesPerRank]\n"
+         "          [-z zipfExponent] [-H hotPeerFraction] [-s sparsePeers] [-i iters]\n", exe);
+}
+
+struct Chunk {
+  int peer;
+  int isSend;
+  int channel;
+  size_t offset;
+  size_t bytes;
+};
+
+// Same as ncclChannelComputeBase/ncclChannelComputeFromBase, with ranks
+// numbered node by node
+static int channelOf(Options const& o, std::vector<int> const& p2pChannels, int rank, int peer, int isSend, int channelInc) {
+  int localRanks = o.nRanks/o.nNodes;
+  int node = rank/localRanks, peerNode = peer/localRanks;
+  int rankIndex = rank%localRanks, peerIndex = peer%localRanks;
+  int nsteps = localRanks;
+  int step, delta;
+  if (isSend) {
+    step = (nsteps + peerIndex - rankIndex)%nsteps;
+    delta = (o.nNodes + peerNode - node) % o.nNodes;
+  } else {
+    step = (nsteps + rankIndex - peerIndex)%nsteps;
+    delta = (o.nNodes + node - peerNode) % o.nNodes;
+  }
+  int base = o.nNodes > 1 ? delta+(step/P2P_GROUP_SIZE) : step;
+  return (p2pChannels[base%o.nChannels]+channelInc) % o.nChannels;
+}
+
+// matrix[s*n+d]: bytes sent by s to d
+enum Pattern { Uniform, Zipf, Hot, Sparse, NumPatterns };
+static char const* patternNames[NumPatterns] = { "uniform", "zipf", "hot", "sparse" };
+
+static void genMatrix(Options const& o, Pattern pattern, std::mt19937_64& rng, std::vector<size_t>& matrix) {
+  int n = o.nRanks;
+  matrix.assign((size_t)n*n, 0);
+  std::uniform_real_distribution<double> noise(0.5, 1.5);
+  for (int s=0; s<n; s++) {
+    std::vector<double> w(n, 0);
+    std::vector<int> perm(n);
+    for (int i=0; i<n; i++) perm[i] = i;
+    std::shuffle(perm.begin(), perm.end(), rng);
+    switch (pattern) {
+      case Uniform: for (int d=0; d<n; d++) w[d] = 1; break;
+      case Zipf: for (int i=0; i<n; i++) w[perm[i]] = noise(rng)/pow(i+1, o.zipf); break;
+      case Hot:
+        // One peer gets a fraction hot of the bytes, the others share the rest
+        for (int i=0; i<n; i++) w[perm[i]] = i == 0 ? o.hot*(n-1)/(1-o.hot) : 1;
+        break;
+      case Sparse: for (int i=0; i<std::min(o.sparse, n); i++) w[perm[i]] = noise(rng); break;
+      default: break;
+    }
+    double sum = 0;
+    for (int d=0; d<n; d++) sum += w[d];
+    for (int d=0; d<n; d++) matrix[(size_t)s*n+d] = (size_t)(o.bytesPerRank*w[d]/sum) & ~(size_t)3; // float elements
+  }
+}
+
+// Chunks of every rank, in the order of scheduleP2pTasksToPlan
+static void schedule(Options const& o, std::vector<int> const& p2pChannels, std::vector<size_t> const& matrix, int balance,
+    std::vector<std::vector<Chunk>>& chunks) {
+  int n = o.nRanks;
+  ssize_t stepSize = o.buffSize/NCCL_STEPS;
+  if (o.nNodes > 1) stepSize /= SENDRECV_SLICEFACTOR;
+  ncclP2pSchedConfig config;
+  ncclP2pSchedInit(&config, n, o.nNodes, o.nChannels, o.channelsPerPeer, stepSize, balance);
+  for (int r=0; r<n; r++) {
+    chunks[r].clear();
+    for (int p=0; p<n; p++) {
+      for (int isSend=0; isSend<2; isSend++) {
+        int peer = isSend ? (r+p)%n : (r-p+n)%n;
+        size_t bytes = isSend ? matrix[(size_t)r*n+peer] : matrix[(size_t)peer*n+r];
+        if (bytes == 0) continue;
+        size_t chunkBytes = ncclP2pChunkSize(&config, bytes);
+        size_t offset = 0;
+        for (int c=0; offset < bytes; c++) {
+          Chunk chunk = { peer, isSend, channelOf(o, p2pChannels, r, peer, isSend, c%o.channelsPerPeer), offset,
+                          std::min(chunkBytes, bytes-offset) };
+          chunks[r].push_back(chunk);
+          offset += chunk.bytes;
+        }
+      }
+    }
+  }
+}
+
+static int verify(Options const& o, std::vector<size_t> const& matrix, std::vector<std::vector<Chunk>> const& chunks) {
+  int n = o.nRanks, errors = 0;
+  // (src, dst, channel, offset) -> bytes
+  std::map<std::tuple<int,int,int,size_t>, size_t> sends, recvs;
+  std::vector<size_t> covered[2];
+  covered[0].assign((size_t)n*n, 0);
+  covered[1].assign((size_t)n*n, 0);
+  for (int r=0; r<n; r++) {
+    for (auto const& chunk : chunks[r]) {
+      int src = chunk.isSend ? r : chunk.peer, dst = chunk.isSend ? chunk.peer : r;
+      (chunk.isSend ? sends : recvs)[std::make_tuple(src, dst, chunk.channel, chunk.offset)] = chunk.bytes;
+      covered[chunk.isSend][(size_t)src*n+dst] += chunk.bytes;
+    }
+  }
+  if (sends != recvs) { printf("Send and receive chunks do not match\n"); errors++; }
+  for (size_t i=0; i<(size_t)n*n; i++) {
+    if (covered[0][i] != matrix[i] || covered[1][i] != matrix[i]) {
+      printf("Pair %zu->%zu : %zu bytes, sent %zu received %zu\n", i/n, i%n, matrix[i], covered[1][i], covered[0][i]);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+struct Stats {
+  double imbalance; // busiest channel / average channel, worst rank
+  double seconds;   // busiest channel of any rank
+  int maxOpsPerChannel;
+};
+
+// Sends and recvs of a channel run in parallel, the chunks of each direction
+// one after the other: bytes at channel bandwidth plus a fixed cost per chunk.
+static Stats evalStats(Options const& o, std::vector<std::vector<Chunk>> const& chunks) {
+  Stats stats = { 0, 0, 0 };
+  for (int r=0; r<o.nRanks; r++) {
+    std::vector<double> chTime[2];
+    std::vector<int> chOps[2];
+    for (int d=0; d<2; d++) { chTime[d].assign(o.nChannels, 0); chOps[d].assign(o.nChannels, 0); }
+    for (auto const& chunk : chunks[r]) {
+      chTime[chunk.isSend][chunk.channel] += chunk.bytes/(o.channelGBs*1e9) + o.latencyUs*1e-6;
+      chOps[chunk.isSend][chunk.channel]++;
+    }
+    double maxTime = 0, sumTime = 0;
+    for (int c=0; c<o.nChannels; c++) {
+      double t = std::max(chTime[0][c], chTime[1][c]);
+      maxTime = std::max(maxTime, t);
+      sumTime += t;
+      stats.maxOpsPerChannel = std::max(stats.maxOpsPerChannel, std::max(chOps[0][c], chOps[1][c]));
+    }
+    if (sumTime > 0) stats.imbalance = std::max(stats.imbalance, maxTime*o.nChannels/sumTime);
+    stats.seconds = std::max(stats.seconds, maxTime);
+  }
+  return stats;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:N:c:p:b:z:H:s:i:h")) != -1) {
+    switch (opt) {
+      case 'n': o.nRanks = atoi(optarg); break;
+      case 'N': o.nNodes = atoi(optarg); break;
+      case 'c': o.nChannels = atoi(optarg); break;
+      case 'p': o.channelsPerPeer = atoi(optarg); break;
+      case 'b': o.bytesPerRank = strtoull(optarg, NULL, 0); break;
+      case 'z': o.zipf = atof(optarg); break;
+      case 'H': o.hot = atof(optarg); break;
+      case 's': o.sparse = atoi(optarg); break;
+      case 'i': o.iters = atoi(optarg); break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (o.nRanks <= 0 || o.nNodes <= 0 || o.nRanks % o.nNodes || o.nChannels <= 0 || o.channelsPerPeer <= 0 ||
+      o.hot <= 0 || o.hot >= 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  printf("%d ranks on %d nodes, %d p2p channels, %d channels per peer, %zu bytes per rank\n",
+         o.nRanks, o.nNodes, o.nChannels, o.channelsPerPeer, o.bytesPerRank);
+  printf("%-8s %6s %10s %10s %12s %12s %8s %8s\n", "pattern", "iter", "legacyImb", "balanceImb",
+         "legacy(us)", "balance(us)", "legOps", "balOps");
+
+  // Same mirrored channel order as ncclTopoComputeP2pChannels
+  std::vector<int> p2pChannels(o.nChannels);
+  for (int c=0; c<o.nChannels; c++) {
+    int mirror = 0;
+    for (int b=1, mb=(o.nChannels>>1); b<o.nChannels; b<<=1, mb>>=1) if (c & b) mirror |= mb;
+    p2pChannels[c] = mirror;
+  }
+
+  std::mt19937_64 rng(1234);
+  std::vector<size_t> matrix;
+  std::vector<std::vector<Chunk>> chunks(o.nRanks);
+  int errors = 0;
+  for (int pattern=0; pattern<NumPatterns; pattern++) {
+    for (int it=0; it<o.iters; it++) {
+      genMatrix(o, (Pattern)pattern, rng, matrix);
+      schedule(o, p2pChannels, matrix, 0, chunks);
+      errors += verify(o, matrix, chunks);
+      Stats legacy = evalStats(o, chunks);
+      schedule(o, p2pChannels, matrix, 1, chunks);
+      errors += verify(o, matrix, chunks);
+      Stats balance = evalStats(o, chunks);
+      printf("%-8s %6d %10.2f %10.2f %12.1f %12.1f %8d %8d\n", patternNames[pattern], it, legacy.imbalance, balance.imbalance,
+             legacy.seconds*1e6, balance.seconds*1e6, legacy.maxOpsPerChannel, balance.maxOpsPerChannel);
+    }
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
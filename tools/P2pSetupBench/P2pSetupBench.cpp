@@ -0,0 +1,394 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host benchmark of the connect info exchange of ncclTransportP2pSetup
+// (src/transport.cc) over the socket bootstrap (src/bootstrap.cc). Each rank is
+// a thread of this process with its own bootstrap; transports are not involved,
+// a connection costs a configurable delay instead (-c). For each rank count,
+// all ranks connect to the same peers through
+//  - serial:  the former exchange, one offset at a time: send to rank+i and
+//             rank-i, receive from both, then connect
+//  - batched: the current exchange: infos of all offsets are posted (up to a
+//             window), received in arrival order through bootstrapRecvAny,
+//             send connections are made as infos arrive, receive ones last
+// and the tool reports the slowest rank. Every rank checks that each connection
+// received the infos its peer sent for it.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "comm.h"
+#include "bootstrap.h"
+#include "utils.h"
+
+// Stubs of the RCCL logger and of the pieces of bootstrapInit this tool does not need
+int ncclDebugLevel = -1;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+void ncclSetThreadName(pthread_t thread, const char *fmt, ...) {}
+ncclResult_t ncclProxyInit(struct ncclComm* comm, struct ncclSocket* sock, union ncclSocketAddress* peerAddresses) {
+  close(sock->fd);
+  free(sock);
+  return ncclSuccess;
+}
+void RegisterSignalHandlers() {}
+
+#define MAX_CHANNELS 32
+
+enum Pattern { Ring, AllToAll };
+enum Mode { Serial, Batched, NumModes };
+static const char* modeNames[NumModes] = { "serial", "batched" };
+
+struct Options {
+  Pattern pattern;
+  int nChannels;
+  int connectUs;   // cost of a connection
+};
+
+// Connect info of rank -> peer on channel c, send or receive side
+struct Info {
+  int rank, peer, channel, send;
+  char pad[128 - 4*sizeof(int)]; // sizeof(struct ncclConnect)
+};
+
+struct Rank {
+  struct ncclComm* comm;
+  Options* opts;
+  std::vector<uint32_t> sendMask, recvMask;
+  Mode mode;
+  double time;
+  int errors;
+};
+
+static pthread_barrier_t barrier;
+
+static void fillInfo(Rank* r, Info* info, int peer, int c, int send) {
+  memset(info, 0, sizeof(Info));
+  info->rank = r->comm->rank;
+  info->peer = peer;
+  info->channel = c;
+  info->send = send;
+}
+
+// Info received for our send (send=1) or receive connection with peer on channel c
+static void connect(Rank* r, Info* info, int peer, int c, int send) {
+  if (info->rank != peer || info->peer != r->comm->rank || info->channel != c || info->send == send) r->errors++;
+  if (r->opts->connectUs) usleep(r->opts->connectUs);
+}
+
+static int fillData(Rank* r, Info* data, int peer, uint32_t mask, int send) {
+  int n = 0;
+  for (int c=0; c<MAX_CHANNELS; c++) if (mask & (1<<c)) fillInfo(r, data+n++, peer, c, send);
+  return n;
+}
+
+static void connectAll(Rank* r, Info* data, int peer, uint32_t mask, int send) {
+  for (int c=0; c<MAX_CHANNELS; c++) if (mask & (1<<c)) connect(r, data++, peer, c, send);
+}
+
+static ncclResult_t setupSerial(Rank* r) {
+  int rank = r->comm->rank, nRanks = r->comm->nRanks;
+  void* bs = r->comm->bootstrap;
+  Info data[2*MAX_CHANNELS];
+  for (int i=1; i<nRanks; i++) {
+    int tag = i<<8;
+    int recvPeer = (rank - i + nRanks) % nRanks;
+    int sendPeer = (rank + i) % nRanks;
+    uint32_t recvMask = r->recvMask[recvPeer], sendMask = r->sendMask[sendPeer];
+    Info* recvData = data;
+    int recvChannels = fillData(r, recvData, recvPeer, recvMask, 0);
+    Info* sendData = recvData+recvChannels;
+    int sendChannels = fillData(r, sendData, sendPeer, sendMask, 1);
+    if (sendPeer == recvPeer) {
+      if (recvChannels+sendChannels) {
+        NCCLCHECK(bootstrapSend(bs, recvPeer, tag, data, sizeof(Info)*(recvChannels+sendChannels)));
+        NCCLCHECK(bootstrapRecv(bs, recvPeer, tag, data, sizeof(Info)*(recvChannels+sendChannels)));
+        sendData = data;
+        recvData = data+sendChannels;
+      }
+    } else {
+      if (recvChannels) NCCLCHECK(bootstrapSend(bs, recvPeer, tag, recvData, sizeof(Info)*recvChannels));
+      if (sendChannels) NCCLCHECK(bootstrapSend(bs, sendPeer, tag, sendData, sizeof(Info)*sendChannels));
+      if (sendChannels) NCCLCHECK(bootstrapRecv(bs, sendPeer, tag, sendData, sizeof(Info)*sendChannels));
+      if (recvChannels) NCCLCHECK(bootstrapRecv(bs, recvPeer, tag, recvData, sizeof(Info)*recvChannels));
+    }
+    connectAll(r, sendData, sendPeer, sendMask, 1);
+    connectAll(r, recvData, recvPeer, recvMask, 0);
+  }
+  return ncclSuccess;
+}
+
+// Same exchange as ncclTransportP2pSetup
+#define WINDOW 64
+#define FROM_SEND 1
+#define FROM_RECV 2
+struct Offset {
+  int recvPeer, sendPeer;
+  uint32_t recvMask, sendMask;
+  int recvChannels, sendChannels;
+  Info* data;
+  int pending;
+};
+struct MatchState {
+  Offset* offsets;
+  int nRanks;
+};
+
+static int match(void* ctx, int peer, int tag, void** data, int* size) {
+  MatchState* state = (MatchState*)ctx;
+  int i = tag >> 8;
+  if ((tag & 0xff) != 0 || i < 1 || i >= state->nRanks) return 0;
+  Offset* o = state->offsets+i;
+  if (o->sendPeer == o->recvPeer) {
+    if (peer != o->sendPeer || o->pending == 0) return 0;
+    *data = o->data;
+    *size = sizeof(Info)*(o->sendChannels+o->recvChannels);
+    return 1;
+  }
+  if (peer == o->sendPeer && (o->pending & FROM_SEND)) {
+    *data = o->data;
+    *size = sizeof(Info)*o->sendChannels;
+    return 1;
+  }
+  if (peer == o->recvPeer && (o->pending & FROM_RECV)) {
+    *data = o->data+o->sendChannels;
+    *size = sizeof(Info)*o->recvChannels;
+    return 1;
+  }
+  return 0;
+}
+
+static ncclResult_t setupBatched(Rank* r) {
+  int rank = r->comm->rank, nRanks = r->comm->nRanks;
+  void* bs = r->comm->bootstrap;
+  std::vector<Offset> offsets(nRanks);
+  int nData = 0;
+  for (int i=1; i<nRanks; i++) {
+    Offset* o = &offsets[i];
+    o->recvPeer = (rank - i + nRanks) % nRanks;
+    o->sendPeer = (rank + i) % nRanks;
+    o->recvMask = r->recvMask[o->recvPeer];
+    o->sendMask = r->sendMask[o->sendPeer];
+    o->recvChannels = o->sendChannels = o->pending = 0;
+    nData += __builtin_popcount(o->recvMask) + __builtin_popcount(o->sendMask);
+  }
+  std::vector<Info> data(nData+1);
+  for (int i=1, d=0; i<nRanks; i++) {
+    offsets[i].data = data.data()+d;
+    d += __builtin_popcount(offsets[i].recvMask) + __builtin_popcount(offsets[i].sendMask);
+  }
+  MatchState state = { offsets.data(), nRanks };
+  int posted = 1, received = 0;
+  while (received < nRanks-1) {
+    for (; posted < nRanks && posted <= received+WINDOW; posted++) {
+      Offset* o = &offsets[posted];
+      Info out[2*MAX_CHANNELS];
+      o->recvChannels = fillData(r, out, o->recvPeer, o->recvMask, 0);
+      o->sendChannels = fillData(r, out+o->recvChannels, o->sendPeer, o->sendMask, 1);
+      int tag = posted<<8;
+      if (o->sendPeer == o->recvPeer) {
+        if (o->recvChannels+o->sendChannels) {
+          NCCLCHECK(bootstrapSend(bs, o->recvPeer, tag, out, sizeof(Info)*(o->recvChannels+o->sendChannels)));
+          o->pending = FROM_SEND|FROM_RECV;
+        }
+      } else {
+        if (o->recvChannels) {
+          NCCLCHECK(bootstrapSend(bs, o->recvPeer, tag, out, sizeof(Info)*o->recvChannels));
+          o->pending |= FROM_RECV;
+        }
+        if (o->sendChannels) {
+          NCCLCHECK(bootstrapSend(bs, o->sendPeer, tag, out+o->recvChannels, sizeof(Info)*o->sendChannels));
+          o->pending |= FROM_SEND;
+        }
+      }
+      if (o->pending == 0) received++;
+    }
+    if (received == nRanks-1) break;
+    int peer, tag;
+    NCCLCHECK(bootstrapRecvAny(bs, match, &state, &peer, &tag));
+    Offset* o = &offsets[tag>>8];
+    int from = (o->sendPeer == o->recvPeer) ? FROM_SEND|FROM_RECV : (peer == o->sendPeer) ? FROM_SEND : FROM_RECV;
+    if (from & FROM_SEND) connectAll(r, o->data, o->sendPeer, o->sendMask, 1);
+    o->pending &= ~from;
+    if (o->pending == 0) received++;
+  }
+  for (int i=1; i<nRanks; i++) {
+    Offset* o = &offsets[i];
+    connectAll(r, o->data+o->sendChannels, o->recvPeer, o->recvMask, 0);
+  }
+  return ncclSuccess;
+}
+
+static void* rankThread(void* args) {
+  Rank* r = (Rank*)args;
+  pthread_barrier_wait(&barrier);
+  uint64_t start = clockNano();
+  ncclResult_t res = r->mode == Serial ? setupSerial(r) : setupBatched(r);
+  r->time = (clockNano() - start) * 1e-9;
+  if (res != ncclSuccess) r->errors++;
+  return NULL;
+}
+
+struct InitArgs {
+  ncclUniqueId* id;
+  struct ncclComm* comm;
+  ncclResult_t res;
+};
+
+static void* initThread(void* args) {
+  InitArgs* a = (InitArgs*)args;
+  a->res = bootstrapInit(a->id, a->comm);
+  return NULL;
+}
+
+// Runs one exchange with nRanks ranks, returns the time of the slowest rank
+static int run(int nRanks, Options* opts, Mode mode, double* time) {
+  ncclUniqueId id;
+  if (bootstrapGetUniqueId(&id) != ncclSuccess) return 1;
+  std::vector<struct ncclComm*> comms(nRanks);
+  std::vector<InitArgs> initArgs(nRanks);
+  std::vector<pthread_t> threads(nRanks);
+  for (int r=0; r<nRanks; r++) {
+    comms[r] = (struct ncclComm*)calloc(1, sizeof(struct ncclComm));
+    comms[r]->rank = r;
+    comms[r]->nRanks = nRanks;
+    comms[r]->virtualId = -1;
+    initArgs[r] = { &id, comms[r], ncclSuccess };
+    pthread_create(&threads[r], NULL, initThread, &initArgs[r]);
+  }
+  int errors = 0;
+  for (int r=0; r<nRanks; r++) {
+    pthread_join(threads[r], NULL);
+    if (initArgs[r].res != ncclSuccess) errors++;
+  }
+  if (errors) return errors;
+
+  // Same connection requests as ncclTransportP2pConnect would record
+  std::vector<Rank> ranks(nRanks);
+  for (int r=0; r<nRanks; r++) {
+    Rank* rk = &ranks[r];
+    rk->comm = comms[r];
+    rk->opts = opts;
+    rk->mode = mode;
+    rk->errors = 0;
+    rk->sendMask.assign(nRanks, 0);
+    rk->recvMask.assign(nRanks, 0);
+    for (int c=0; c<opts->nChannels; c++) {
+      if (opts->pattern == Ring) {
+        rk->sendMask[(r+1)%nRanks] |= 1<<c;
+        rk->recvMask[(r+nRanks-1)%nRanks] |= 1<<c;
+      } else {
+        for (int p=0; p<nRanks; p++) {
+          if (p == r) continue;
+          rk->sendMask[p] |= 1<<c;
+          rk->recvMask[p] |= 1<<c;
+        }
+      }
+    }
+  }
+  pthread_barrier_init(&barrier, NULL, nRanks);
+  for (int r=0; r<nRanks; r++) pthread_create(&threads[r], NULL, rankThread, &ranks[r]);
+  *time = 0;
+  for (int r=0; r<nRanks; r++) {
+    pthread_join(threads[r], NULL);
+    errors += ranks[r].errors;
+    *time = std::max(*time, ranks[r].time);
+  }
+  pthread_barrier_destroy(&barrier);
+  for (int r=0; r<nRanks; r++) {
+    if (bootstrapClose(comms[r]->bootstrap) != ncclSuccess) errors++;
+    free(comms[r]);
+  }
+  return errors;
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s [-b minRanks] [-e maxRanks] [-p ring|alltoall] [-C nChannels] [-c connectUs] [-r rounds]\n", name);
+}
+
+int main(int argc, char* argv[]) {
+  int minRanks = 8, maxRanks = 64, rounds = 3;
+  Options opts = { AllToAll, 2, 20 };
+  int opt;
+  while ((opt = getopt(argc, argv, "b:e:p:C:c:r:h")) != -1) {
+    switch (opt) {
+      case 'b': minRanks = atoi(optarg); break;
+      case 'e': maxRanks = atoi(optarg); break;
+      case 'p':
+        if (strcmp(optarg, "ring") == 0) opts.pattern = Ring;
+        else if (strcmp(optarg, "alltoall") == 0) opts.pattern = AllToAll;
+        else { usage(argv[0]); return 1; }
+        break;
+      case 'C': opts.nChannels = atoi(optarg); break;
+      case 'c': opts.connectUs = atoi(optarg); break;
+      case 'r': rounds = atoi(optarg); break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (minRanks < 2 || maxRanks < minRanks || opts.nChannels < 1 || opts.nChannels > MAX_CHANNELS || rounds < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  // Bootstrap and accepted sockets of all ranks
+  struct rlimit filesLimit;
+  getrlimit(RLIMIT_NOFILE, &filesLimit);
+  filesLimit.rlim_cur = filesLimit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &filesLimit);
+  if (bootstrapNetInit() != ncclSuccess) return 1;
+
+  printf("%s pattern, %d channels, %d us per connection, best of %d\n",
+      opts.pattern == Ring ? "ring" : "alltoall", opts.nChannels, opts.connectUs, rounds);
+  printf("%8s %14s %14s %10s\n", "ranks", "serial (ms)", "batched (ms)", "speedup");
+  int errors = 0;
+  for (int n=minRanks; n<=maxRanks; n*=2) {
+    double best[NumModes];
+    for (int m=0; m<NumModes; m++) {
+      best[m] = 1e30;
+      for (int i=0; i<rounds; i++) {
+        double t = 0;
+        errors += run(n, &opts, (Mode)m, &t);
+        best[m] = std::min(best[m], t);
+      }
+    }
+    printf("%8d %14.2f %14.2f %9.2fx\n", n, best[Serial]*1e3, best[Batched]*1e3, best[Serial]/best[Batched]);
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
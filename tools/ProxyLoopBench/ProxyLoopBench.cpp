@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Latency of the proxy progress loop depending on the NUMA node of the host
+// memory it polls (src/misc/numa.cc, RCCL_NUMA_POLICY). A "device" thread
+// plays the GPU of a send connection: it waits for a credit in sendMem->head,
+// writes the size of the step in recvMem->sizesFifo then bumps recvMem->tail.
+// A "proxy" thread polls tail, reads the size and the first line of the step
+// buffer, and returns the credit, as the net proxy does for host buffers.
+//
+// The connection memory is placed on each node of -m in turn with
+// ncclNumaBind, while both threads run on the CPUs of node -c. Reported are
+// the round trip of a single step (ping-pong) and the step rate with
+// NCCL_STEPS steps in flight (stream).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "numa.h"
+#include "debug.h"
+
+#define NCCL_STEPS 8
+#define STEP_SIZE (64 << 10)
+#define SPINS_BEFORE_YIELD 1000
+
+// Stub of the RCCL logger. NCCL_DEBUG=WARN (default) or INFO
+int ncclDebugLevel = -1;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+// Same layout as ncclSendMem/ncclRecvMem: head and tail on their own lines
+struct Connection {
+  alignas(4096) uint64_t head;
+  alignas(4096) uint64_t tail;
+  int sizesFifo[NCCL_STEPS];
+  alignas(4096) char buffer[NCCL_STEPS][STEP_SIZE];
+};
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+// Spins, then yields so that the threads can share a CPU
+static inline void waitFor(volatile uint64_t* ptr, uint64_t value) {
+  for (int spins = 0; *ptr < value; spins++) {
+    if (spins >= SPINS_BEFORE_YIELD) sched_yield();
+  }
+}
+
+// Nodes with CPUs or memory, from lists such as "0-1" or "0,2-3"
+static std::vector<int> parseList(FILE* file) {
+  std::vector<int> list;
+  int first, last;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-' && fscanf(file, "%d", &last) == 1) c = fgetc(file);
+    for (int i = first; i <= last; i++) list.push_back(i);
+    if (c != ',') break;
+  }
+  return list;
+}
+
+static std::vector<int> sysfsList(char const* path) {
+  std::vector<int> list;
+  FILE* file = fopen(path, "r");
+  if (file) {
+    list = parseList(file);
+    fclose(file);
+  }
+  return list;
+}
+
+// Steps exchanged between the device and proxy threads. With inFlight == 1
+// each step is timed from its post to the return of its credit.
+static void runLoop(Connection* conn, int nSteps, int inFlight, cpu_set_t* cpus, std::vector<uint64_t>* times)
+{
+  conn->head = conn->tail = 0;
+  std::thread proxy([=]() {
+    sched_setaffinity(0, sizeof(cpu_set_t), cpus);
+    volatile Connection* c = conn;
+    uint64_t sum = 0;
+    for (uint64_t step = 0; step < (uint64_t)nSteps; step++) {
+      waitFor(&c->tail, step+1);
+      int slot = step % NCCL_STEPS;
+      sum += c->sizesFifo[slot] + c->buffer[slot][0];
+      __atomic_store_n(&conn->head, step+1, __ATOMIC_RELEASE);
+    }
+    if (sum == 0) printf("No data\n");
+  });
+  sched_setaffinity(0, sizeof(cpu_set_t), cpus);
+  volatile Connection* c = conn;
+  for (uint64_t step = 0; step < (uint64_t)nSteps; step++) {
+    if (step >= (uint64_t)inFlight) waitFor(&c->head, step+1-inFlight);
+    int slot = step % NCCL_STEPS;
+    uint64_t start = nowNs();
+    conn->buffer[slot][0] = 1;
+    conn->sizesFifo[slot] = STEP_SIZE;
+    __atomic_store_n(&conn->tail, step+1, __ATOMIC_RELEASE);
+    if (inFlight == 1) {
+      waitFor(&c->head, step+1);
+      (*times)[step] = nowNs()-start;
+    }
+  }
+  waitFor(&c->head, nSteps);
+  proxy.join();
+}
+
+int main(int argc, char **argv)
+{
+  int cpuNode = 0, nSteps = 100000, nWarmup = 1000;
+  std::vector<int> memNodes = sysfsList("/sys/devices/system/node/has_memory");
+  if (memNodes.empty()) memNodes.push_back(0);
+  int opt;
+  while ((opt = getopt(argc, argv, "c:m:i:w:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c': cpuNode = atoi(optarg); break;
+    case 'm':
+    {
+      memNodes.clear();
+      std::stringstream ss(optarg);
+      std::string n;
+      while (std::getline(ss, n, ',')) memNodes.push_back(atoi(n.c_str()));
+      break;
+    }
+    case 'i': nSteps  = atoi(optarg); break;
+    case 'w': nWarmup = atoi(optarg); break;
+    default:
+      printf("Usage: %s [-c cpuNode] [-m memNode[,memNode...]] [-i steps] [-w warmupSteps]\n", argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (nSteps <= 0 || nWarmup < 0 || memNodes.empty())
+  {
+    printf("Invalid arguments\n");
+    return 1;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", cpuNode);
+  for (int cpu : sysfsList(path)) CPU_SET(cpu, &cpus);
+  if (CPU_COUNT(&cpus) == 0)
+  {
+    if (cpuNode != 0)
+    {
+      printf("No CPUs on node %d\n", cpuNode);
+      return 1;
+    }
+    sched_getaffinity(0, sizeof(cpu_set_t), &cpus);
+  }
+
+  printf("# Proxy and device threads on node %d (%d CPUs), %d steps\n", cpuNode, CPU_COUNT(&cpus), nSteps);
+  printf("%-8s %8s %10s %10s %10s %12s\n", "#memNode", "placed", "meanNs", "p50Ns", "p99Ns", "Msteps/s");
+  int errors = 0;
+  std::vector<uint64_t> times(std::max(nSteps, nWarmup));
+  for (int memNode : memNodes)
+  {
+    // Placed before the pages are first touched, as for ncclShmOpen
+    Connection* conn = (Connection*)mmap(NULL, sizeof(Connection), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (conn == MAP_FAILED)
+    {
+      perror("mmap");
+      return 1;
+    }
+    int bound = ncclNumaUsableNode(memNode) >= 0;
+    if (ncclNumaBind(conn, sizeof(Connection), memNode) != ncclSuccess) return 1;
+    memset(conn, 0, sizeof(Connection));
+    int placed = ncclNumaNodeOf(&conn->tail);
+    if (bound && placed != memNode)
+    {
+      printf("Memory for node %d placed on node %d\n", memNode, placed);
+      errors++;
+    }
+
+    runLoop(conn, nWarmup, 1, &cpus, &times);
+    runLoop(conn, nSteps, 1, &cpus, &times);
+    std::vector<uint64_t> sorted(times.begin(), times.begin()+nSteps);
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0;
+    for (uint64_t t : sorted) mean += t;
+    mean /= nSteps;
+    uint64_t start = nowNs();
+    runLoop(conn, nSteps, NCCL_STEPS, &cpus, &times);
+    double rate = nSteps / ((nowNs()-start) * 1e-9) / 1e6;
+
+    char placedStr[32];
+    snprintf(placedStr, sizeof(placedStr), bound ? "%d" : "%d*", placed);
+    printf("%-8d %8s %10.0f %10lu %10lu %12.3f\n", memNode, placedStr, mean, sorted[nSteps/2], sorted[(nSteps*99)/100], rate);
+    munmap(conn, sizeof(Connection));
+  }
+  printf("# * first touch placement (single node system or RCCL_NUMA_POLICY=0)\n");
+  if (errors)
+  {
+    printf("%d errors\n", errors);
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,566 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Replays API call traces recorded with RCCL_RECORD_FILE (src/misc/recorder.cc)
+// to measure the host side cost of a real workload without running it.
+// Each trace file holds the calls of one process; the calls of each recording
+// thread are split into units, a single call or an outermost group. Replay
+// issues, in lockstep, unit k of every thread of every file in one group, all
+// ranks being driven by this thread on the local GPUs, and reports the host
+// latency of the units per kind. Buffers and streams are allocated once, sized
+// by the largest call of each rank.
+//
+// Every rank of a communicator must be in the traces, unless -r is given: the
+// calls of each recorded rank are then replicated to all ranks of its
+// communicators, peers being rotated with the rank.
+// -d prints the records and -s the summary only, neither needs a GPU.
+//
+// By default the replayer is built like EnqueueBench, with the host code of
+// RCCL against the HIP stub of tools/EnqueueBench (RCCL_REPLAY_STUB): ranks
+// are virtual devices and kernels complete as soon as they are launched, so
+// only the host path (ncclLaunchPrepare, work and proxy op upload, launch) is
+// measured, without a GPU. `make hip` builds it against librccl instead.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+#include "recorder.h"
+#ifdef RCCL_REPLAY_STUB
+#include "DeviceStub.h"
+#endif
+
+#define HIPCHECK(cmd) do {                                      \
+  hipError_t err = (cmd);                                       \
+  if (err != hipSuccess) {                                      \
+    printf("%s:%d HIP error '%s'\n", __FILE__, __LINE__, hipGetErrorString(err)); \
+    exit(1);                                                    \
+  }                                                             \
+} while (0)
+
+#define NCCLCHECK(cmd) do {                                     \
+  ncclResult_t res = (cmd);                                     \
+  if (res != ncclSuccess) {                                     \
+    printf("%s:%d NCCL error '%s'\n", __FILE__, __LINE__, ncclGetErrorString(res)); \
+    exit(1);                                                    \
+  }                                                             \
+} while (0)
+
+static const char* funcNames[] = { "Broadcast", "Reduce", "AllGather", "ReduceScatter", "AllReduce",
+  "SendRecv", "Send", "Recv", "AllToAllPivot", "AllToAllv" };
+static const char* typeNames[] = { "int8", "uint8", "int32", "uint32", "int64", "uint64", "half", "float", "double", "bf16" };
+static const size_t typeSizes[] = { 1, 1, 4, 4, 8, 8, 2, 4, 8, 2 };
+static const char* opNames[] = { "sum", "prod", "max", "min", "avg" };
+
+struct Event {
+  struct rcclRecord rec;
+  std::vector<uint64_t> payload;
+};
+
+struct CommRecord {
+  uint64_t hash;
+  int rank;
+  int nRanks;
+};
+
+struct Trace {
+  const char* name;
+  std::vector<Event> events;
+  std::vector<CommRecord> comms;
+};
+
+// Calls of one thread of a trace, replayed on ranks shifted by `shift`
+struct Source {
+  Trace* trace;
+  int thread;
+  int shift;
+  std::vector<const Event*> calls;
+  std::vector<size_t> units; // first call of each unit, plus the end
+  std::vector<bool> grouped; // unit is a group
+};
+
+struct Rank {
+  ncclComm_t comm = NULL;
+  int dev;
+  bool used = false;
+  size_t sendBytes = 0, recvBytes = 0;
+  char* sendbuff = NULL;
+  char* recvbuff = NULL;
+  std::vector<hipStream_t> streams;
+  std::map<int, ncclRedOp_t> userOps;
+};
+
+struct Comm {
+  int nRanks;
+  std::vector<Rank> ranks;
+};
+
+static bool readTrace(const char* name, Trace* trace) {
+  FILE* f = fopen(name, "r");
+  if (f == NULL) {
+    printf("Could not open %s\n", name);
+    return false;
+  }
+  trace->name = name;
+  struct rcclRecordHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, RCCL_RECORD_MAGIC, sizeof(RCCL_RECORD_MAGIC)) != 0 ||
+      header.version != RCCL_RECORD_VERSION || header.recordSize != sizeof(struct rcclRecord)) {
+    printf("%s is not a version %d RCCL record file\n", name, RCCL_RECORD_VERSION);
+    fclose(f);
+    return false;
+  }
+  Event e;
+  while (fread(&e.rec, sizeof(e.rec), 1, f) == 1) {
+    e.payload.clear();
+    if (e.rec.type == rcclRecordComm) {
+      if (e.rec.comm >= trace->comms.size()) trace->comms.resize(e.rec.comm+1, CommRecord{0, -1, 0});
+      trace->comms[e.rec.comm] = CommRecord{e.rec.count, e.rec.root, e.rec.stream};
+    } else if (e.rec.type == rcclRecordCall) {
+      if (e.rec.func >= rcclRecordNumFuncs || e.rec.datatype >= ncclNumTypes || e.rec.comm >= trace->comms.size() ||
+          trace->comms[e.rec.comm].rank == -1) {
+        printf("%s: invalid record at offset %ld\n", name, ftell(f)-(long)sizeof(e.rec));
+        fclose(f);
+        return false;
+      }
+      if (e.rec.func == rcclRecordAllToAllv) {
+        e.payload.resize(e.rec.count);
+        if (fread(e.payload.data(), sizeof(uint64_t), e.rec.count, f) != e.rec.count) break;
+      }
+    }
+    trace->events.push_back(e);
+  }
+  fclose(f);
+  return true;
+}
+
+static void dumpTrace(Trace* trace) {
+  printf("# %s\n", trace->name);
+  for (const Event& e : trace->events) {
+    const struct rcclRecord& r = e.rec;
+    printf("%14.3f T%-3d ", r.time/1e3, r.thread);
+    if (r.type == rcclRecordComm) {
+      printf("Comm %d hash %lx rank %d/%d\n", r.comm, r.count, r.root, r.stream);
+    } else if (r.type == rcclRecordGroupStart) {
+      printf("GroupStart\n");
+    } else if (r.type == rcclRecordGroupEnd) {
+      printf("GroupEnd\n");
+    } else if (r.func == rcclRecordAllToAllv) {
+      int nRanks = trace->comms[r.comm].nRanks;
+      uint64_t sendCount = 0, recvCount = 0;
+      for (int p=0; p<nRanks; p++) {
+        sendCount += e.payload[p];
+        recvCount += e.payload[nRanks+p];
+      }
+      printf("%-13s comm %d stream %d sendcount %lu recvcount %lu %s%s%s\n", funcNames[r.func], r.comm, r.stream, sendCount, recvCount,
+          typeNames[r.datatype], r.flags & RCCL_RECORD_FLAG_MATRIX ? " matrix" : "", r.flags & RCCL_RECORD_FLAG_INPLACE ? " inplace" : "");
+    } else {
+      printf("%-13s comm %d stream %d count %lu %s %s %s %d%s\n", funcNames[r.func], r.comm, r.stream, r.count, typeNames[r.datatype],
+          r.op < ncclNumOps ? opNames[r.op] : "user", r.func == rcclRecordSend || r.func == rcclRecordRecv ? "peer" : "root", r.root,
+          r.flags & RCCL_RECORD_FLAG_INPLACE ? " inplace" : "");
+    }
+  }
+}
+
+// Bytes of the send and receive buffers of a call
+static void callBytes(const Event& e, int nRanks, size_t* sendBytes, size_t* recvBytes) {
+  size_t bytes = e.rec.count*typeSizes[e.rec.datatype];
+  *sendBytes = *recvBytes = bytes;
+  switch (e.rec.func) {
+    case rcclRecordAllGather: *recvBytes = bytes*nRanks; break;
+    case rcclRecordReduceScatter: *sendBytes = bytes*nRanks; break;
+    case rcclRecordAllToAllPivot: *sendBytes = *recvBytes = bytes*nRanks; break;
+    case rcclRecordSend: *recvBytes = 0; break;
+    case rcclRecordRecv: *sendBytes = 0; break;
+    case rcclRecordAllToAllv:
+      *sendBytes = *recvBytes = 0;
+      for (int p=0; p<nRanks; p++) {
+        *sendBytes += e.payload[p]*typeSizes[e.rec.datatype];
+        *recvBytes += e.payload[nRanks+p]*typeSizes[e.rec.datatype];
+      }
+      break;
+  }
+}
+
+static void summary(std::vector<Source>& sources, std::map<uint64_t, Comm>& comms) {
+  uint64_t calls[rcclRecordNumFuncs] = {0}, bytes[rcclRecordNumFuncs] = {0};
+  size_t nUnits = 0, nGroups = 0, maxGroup = 0;
+  for (Source& s : sources) {
+    for (const Event* e : s.calls) {
+      size_t sendBytes, recvBytes;
+      callBytes(*e, s.trace->comms[e->rec.comm].nRanks, &sendBytes, &recvBytes);
+      calls[e->rec.func]++;
+      bytes[e->rec.func] += std::max(sendBytes, recvBytes);
+    }
+    nUnits += s.units.size()-1;
+    for (size_t u=0; u+1<s.units.size(); u++) {
+      if (!s.grouped[u]) continue;
+      nGroups++;
+      maxGroup = std::max(maxGroup, s.units[u+1]-s.units[u]);
+    }
+  }
+  printf("# %lu communicators, %lu sources, %lu units, %lu groups of up to %lu calls\n",
+      comms.size(), sources.size(), nUnits, nGroups, maxGroup);
+  printf("# %14s %12s %16s\n", "Func", "Calls", "Bytes");
+  for (int f=0; f<rcclRecordNumFuncs; f++) {
+    if (calls[f]) printf("  %14s %12lu %16lu\n", funcNames[f], calls[f], bytes[f]);
+  }
+}
+
+static Rank& sourceRank(std::map<uint64_t, Comm>& comms, Source& s, int comm) {
+  CommRecord& c = s.trace->comms[comm];
+  return comms[c.hash].ranks[(c.rank+s.shift)%c.nRanks];
+}
+
+static void issue(std::map<uint64_t, Comm>& comms, Source& s, const Event& e) {
+  const struct rcclRecord& r = e.rec;
+  int nRanks = s.trace->comms[r.comm].nRanks;
+  Rank& rank = sourceRank(comms, s, r.comm);
+  int myRank = (s.trace->comms[r.comm].rank+s.shift)%nRanks;
+  hipStream_t stream = rank.streams[r.stream];
+  ncclDataType_t type = (ncclDataType_t)r.datatype;
+  size_t bytes = r.count*typeSizes[type];
+  char* recvbuff = rank.recvbuff;
+  char* sendbuff = rank.sendbuff;
+  if (r.flags & RCCL_RECORD_FLAG_INPLACE) {
+    sendbuff = r.func == rcclRecordAllGather ? recvbuff+myRank*bytes : recvbuff;
+    if (r.func == rcclRecordReduceScatter) {
+      sendbuff = rank.recvbuff;
+      recvbuff = sendbuff+myRank*bytes;
+    }
+  }
+  ncclRedOp_t op = (ncclRedOp_t)r.op;
+  if (r.op == RCCL_RECORD_USER_OP) {
+    auto it = rank.userOps.find(r.datatype);
+    if (it == rank.userOps.end()) {
+      // Same path as any premultiplied sum, the value does not matter
+      uint64_t scalar = 0;
+      NCCLCHECK(ncclRedOpCreatePreMulSum(&op, &scalar, type, ncclScalarHostImmediate, rank.comm));
+      rank.userOps[r.datatype] = op;
+    } else {
+      op = it->second;
+    }
+  }
+  int peer = (r.root+s.shift)%nRanks;
+  switch (r.func) {
+    case rcclRecordBroadcast: NCCLCHECK(ncclBroadcast(sendbuff, recvbuff, r.count, type, r.root, rank.comm, stream)); break;
+    case rcclRecordReduce: NCCLCHECK(ncclReduce(sendbuff, recvbuff, r.count, type, op, r.root, rank.comm, stream)); break;
+    case rcclRecordAllGather: NCCLCHECK(ncclAllGather(sendbuff, recvbuff, r.count, type, rank.comm, stream)); break;
+    case rcclRecordReduceScatter: NCCLCHECK(ncclReduceScatter(sendbuff, recvbuff, r.count, type, op, rank.comm, stream)); break;
+    case rcclRecordAllReduce: NCCLCHECK(ncclAllReduce(sendbuff, recvbuff, r.count, type, op, rank.comm, stream)); break;
+    case rcclRecordSend: NCCLCHECK(ncclSend(sendbuff, r.count, type, peer, rank.comm, stream)); break;
+    case rcclRecordRecv: NCCLCHECK(ncclRecv(recvbuff, r.count, type, peer, rank.comm, stream)); break;
+    case rcclRecordAllToAllPivot: NCCLCHECK(ncclAllToAll(sendbuff, recvbuff, r.count, type, rank.comm, stream)); break;
+    case rcclRecordAllToAllv: {
+      std::vector<size_t> sendcounts(nRanks), recvcounts(nRanks), sdispls(nRanks), rdispls(nRanks);
+      for (int p=0; p<nRanks; p++) {
+        sendcounts[(p+s.shift)%nRanks] = e.payload[p];
+        recvcounts[(p+s.shift)%nRanks] = e.payload[nRanks+p];
+      }
+      for (int p=1; p<nRanks; p++) {
+        sdispls[p] = sdispls[p-1]+sendcounts[p-1];
+        rdispls[p] = rdispls[p-1]+recvcounts[p-1];
+      }
+      if ((r.flags & RCCL_RECORD_FLAG_MATRIX) && s.shift == 0) {
+        std::vector<size_t> matrix(e.payload.begin()+2*nRanks, e.payload.end());
+        NCCLCHECK(ncclAllToAllvMatrix(sendbuff, sdispls.data(), recvbuff, rdispls.data(), matrix.data(), type, rank.comm, stream));
+      } else {
+        NCCLCHECK(ncclAllToAllv(sendbuff, sendcounts.data(), sdispls.data(), recvbuff, recvcounts.data(), rdispls.data(), type, rank.comm, stream));
+      }
+      break;
+    }
+    default:
+      printf("%s: cannot replay %s\n", s.trace->name, funcNames[r.func]);
+      exit(1);
+  }
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s [-d] [-s] [-r] [-i iterations] [-w warmup] trace [trace...]\n", name);
+  printf("  -d  print the records\n");
+  printf("  -s  print the summary only\n");
+  printf("  -r  replicate traces to the ranks missing from them\n");
+  printf("  -i  number of replays of the traces (default 1)\n");
+  printf("  -w  number of replays before measurements (default 0)\n");
+}
+
+int main(int argc, char** argv) {
+  bool dump = false, summaryOnly = false, replicate = false;
+  int iters = 1, warmup = 0;
+  int c;
+  while ((c = getopt(argc, argv, "dsri:w:h")) != -1) {
+    switch (c) {
+      case 'd': dump = true; break;
+      case 's': summaryOnly = true; break;
+      case 'r': replicate = true; break;
+      case 'i': iters = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      default: usage(argv[0]); return c == 'h' ? 0 : 1;
+    }
+  }
+  if (optind == argc || iters < 1 || warmup < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<Trace> traces(argc-optind);
+  for (size_t t=0; t<traces.size(); t++) {
+    if (!readTrace(argv[optind+t], &traces[t])) return 1;
+    if (dump) dumpTrace(&traces[t]);
+  }
+
+  // Split the calls of each thread into units
+  std::vector<Source> sources;
+  for (Trace& trace : traces) {
+    std::map<int, size_t> threadSource;
+    std::map<int, int> depth;
+    for (const Event& e : trace.events) {
+      if (e.rec.type == rcclRecordComm) continue;
+      auto it = threadSource.find(e.rec.thread);
+      if (it == threadSource.end()) {
+        it = threadSource.emplace(e.rec.thread, sources.size()).first;
+        sources.push_back(Source{&trace, e.rec.thread, 0});
+      }
+      Source& s = sources[it->second];
+      int& d = depth[e.rec.thread];
+      if (e.rec.type == rcclRecordGroupStart) {
+        if (d++ == 0) {
+          s.units.push_back(s.calls.size());
+          s.grouped.push_back(true);
+        }
+      } else if (e.rec.type == rcclRecordGroupEnd) {
+        if (d > 0) d--;
+      } else {
+        if (d == 0) {
+          s.units.push_back(s.calls.size());
+          s.grouped.push_back(false);
+        }
+        s.calls.push_back(&e);
+      }
+    }
+  }
+  // Drop empty units, i.e. groups without calls
+  for (Source& s : sources) {
+    std::vector<size_t> units;
+    std::vector<bool> grouped;
+    for (size_t u=0; u<s.units.size(); u++) {
+      size_t end = u+1 < s.units.size() ? s.units[u+1] : s.calls.size();
+      if (end == s.units[u]) continue;
+      units.push_back(s.units[u]);
+      grouped.push_back(s.grouped[u]);
+    }
+    units.push_back(s.calls.size());
+    s.units.swap(units);
+    s.grouped.swap(grouped);
+  }
+
+  // Ranks of every communicator
+  std::map<uint64_t, Comm> comms;
+  for (Source& s : sources) {
+    for (const Event* e : s.calls) {
+      CommRecord& c = s.trace->comms[e->rec.comm];
+      Comm& comm = comms[c.hash];
+      if (comm.ranks.empty()) {
+        comm.nRanks = c.nRanks;
+        comm.ranks.resize(c.nRanks);
+      }
+    }
+  }
+  if (replicate) {
+    // Only the threads of communicators with missing ranks are replicated
+    std::map<uint64_t, std::set<int>> recorded;
+    for (Source& s : sources) {
+      for (const Event* e : s.calls) recorded[s.trace->comms[e->rec.comm].hash].insert(s.trace->comms[e->rec.comm].rank);
+    }
+    std::vector<Source> replicas;
+    for (Source& s : sources) {
+      int nRanks = 0, nComplete = 0, nCalls = 0;
+      for (const Event* e : s.calls) {
+        CommRecord& c = s.trace->comms[e->rec.comm];
+        if ((int)recorded[c.hash].size() == c.nRanks) nComplete++;
+        if (nRanks && c.nRanks != nRanks) nRanks = -1;
+        if (nRanks != -1) nRanks = c.nRanks;
+        nCalls++;
+      }
+      if (nComplete == nCalls) {
+        replicas.push_back(s);
+        continue;
+      }
+      if (nComplete || nRanks == -1) {
+        printf("%s: -r needs all communicators of thread %d to have the same size and missing ranks\n", s.trace->name, s.thread);
+        return 1;
+      }
+      for (int shift=0; shift<nRanks; shift++) {
+        replicas.push_back(s);
+        replicas.back().shift = shift;
+      }
+    }
+    sources.swap(replicas);
+  }
+  // Mark the ranks used by each source and size their buffers
+  std::map<std::pair<uint64_t, int>, const Source*> owner;
+  for (Source& s : sources) {
+    for (const Event* e : s.calls) {
+      CommRecord& c = s.trace->comms[e->rec.comm];
+      int rank = (c.rank+s.shift)%c.nRanks;
+      auto o = owner.emplace(std::make_pair(c.hash, rank), &s).first;
+      if (o->second != &s) {
+        printf("Rank %d of communicator %lx is in %s and %s\n", rank, c.hash, o->second->trace->name, s.trace->name);
+        return 1;
+      }
+      Rank& r = comms[c.hash].ranks[rank];
+      r.used = true;
+      size_t sendBytes, recvBytes;
+      callBytes(*e, c.nRanks, &sendBytes, &recvBytes);
+      if (e->rec.flags & RCCL_RECORD_FLAG_INPLACE) recvBytes = sendBytes = std::max(sendBytes, recvBytes);
+      r.sendBytes = std::max(r.sendBytes, sendBytes);
+      r.recvBytes = std::max(r.recvBytes, recvBytes);
+      if ((int)r.streams.size() <= e->rec.stream) r.streams.resize(e->rec.stream+1);
+    }
+  }
+  size_t nUnits = 0;
+  for (Source& s : sources) nUnits = std::max(nUnits, s.units.size()-1);
+  for (Source& s : sources) {
+    if (s.units.size()-1 != nUnits) {
+      printf("Warning: %s thread %d has %lu units, others up to %lu\n", s.trace->name, s.thread, s.units.size()-1, nUnits);
+    }
+  }
+  summary(sources, comms);
+  if (dump || summaryOnly) return 0;
+  for (auto& it : comms) {
+    for (int r=0; r<it.second.nRanks; r++) {
+      if (it.second.ranks[r].used) continue;
+      printf("Rank %d of communicator %lx is not in the traces, use -r to replicate them\n", r, it.first);
+      return 1;
+    }
+  }
+
+  // One communicator per recorded one, rank r on device r
+#ifdef RCCL_REPLAY_STUB
+  int maxRanks = 0;
+  for (auto& it : comms) maxRanks = std::max(maxRanks, it.second.nRanks);
+  hipStubSetDeviceCount(maxRanks);
+#endif
+  int nDevs;
+  HIPCHECK(hipGetDeviceCount(&nDevs));
+  for (auto& it : comms) {
+    Comm& comm = it.second;
+    if (comm.nRanks > nDevs) {
+      printf("Communicator %lx has %d ranks, only %d devices\n", it.first, comm.nRanks, nDevs);
+      return 1;
+    }
+    std::vector<ncclComm_t> handles(comm.nRanks);
+    NCCLCHECK(ncclCommInitAll(handles.data(), comm.nRanks, NULL));
+    for (int r=0; r<comm.nRanks; r++) {
+      Rank& rank = comm.ranks[r];
+      rank.comm = handles[r];
+      rank.dev = r;
+      HIPCHECK(hipSetDevice(r));
+      if (rank.sendBytes) HIPCHECK(hipMalloc((void**)&rank.sendbuff, rank.sendBytes));
+      if (rank.recvBytes) HIPCHECK(hipMalloc((void**)&rank.recvbuff, rank.recvBytes));
+      for (hipStream_t& s : rank.streams) HIPCHECK(hipStreamCreateWithFlags(&s, hipStreamNonBlocking));
+    }
+  }
+
+  // Units are named after their calls
+  std::map<std::string, std::vector<double>> latency;
+  std::map<std::string, uint64_t> nameCalls;
+  std::vector<std::string> unitName(nUnits);
+  std::vector<size_t> unitCalls(nUnits, 0); // calls of all sources
+  size_t nCalls = 0;
+  for (size_t u=0; u<nUnits; u++) {
+    for (Source& s : sources) {
+      if (u+1 >= s.units.size()) continue;
+      unitCalls[u] += s.units[u+1]-s.units[u];
+      if (!unitName[u].empty()) continue;
+      std::string name = s.grouped[u] ? "Group:" : "";
+      for (size_t i=s.units[u]; i<s.units[u+1]; i++) {
+        const char* f = funcNames[s.calls[i]->rec.func];
+        if (name.find(f) == std::string::npos) name += std::string(i == s.units[u] ? "" : "+") + f;
+      }
+      unitName[u] = name;
+    }
+    nCalls += unitCalls[u];
+  }
+
+  double total = 0;
+  for (int iter=-warmup; iter<iters; iter++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t u=0; u<nUnits; u++) {
+      auto t0 = std::chrono::high_resolution_clock::now();
+      NCCLCHECK(ncclGroupStart());
+      for (Source& s : sources) {
+        if (u+1 >= s.units.size()) continue;
+        for (size_t i=s.units[u]; i<s.units[u+1]; i++) issue(comms, s, *s.calls[i]);
+      }
+      NCCLCHECK(ncclGroupEnd());
+      auto t1 = std::chrono::high_resolution_clock::now();
+      if (iter >= 0) {
+        latency[unitName[u]].push_back(std::chrono::duration<double, std::micro>(t1-t0).count());
+        nameCalls[unitName[u]] += unitCalls[u];
+      }
+    }
+#ifdef RCCL_REPLAY_STUB
+    deviceStubSynchronize();
+#else
+    for (auto& it : comms) {
+      for (Rank& rank : it.second.ranks) {
+        for (hipStream_t s : rank.streams) HIPCHECK(hipStreamSynchronize(s));
+      }
+    }
+#endif
+    if (iter >= 0) total += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now()-start).count();
+  }
+
+  printf("# Host latency per unit, all ranks (us), and per call of the units\n");
+  printf("# %-40s %10s %10s %10s %10s %10s %10s\n", "Unit", "Count", "Mean", "p50", "p99", "Max", "PerCall");
+  for (auto& it : latency) {
+    std::vector<double>& v = it.second;
+    std::sort(v.begin(), v.end());
+    double sum = 0;
+    for (double d : v) sum += d;
+    printf("  %-40s %10lu %10.2f %10.2f %10.2f %10.2f %10.3f\n", it.first.c_str(), v.size(), sum/v.size(),
+        v[v.size()/2], v[std::min(v.size()-1, v.size()*99/100)], v.back(), sum/nameCalls[it.first]);
+  }
+  printf("# %d replays of %lu units (%lu calls) in %.3f ms, %.1f units/s, %.1f calls/s\n", iters, nUnits, nCalls, total,
+      nUnits*iters/(total/1e3), nCalls*iters/(total/1e3));
+
+  for (auto& it : comms) {
+    for (Rank& rank : it.second.ranks) {
+      HIPCHECK(hipSetDevice(rank.dev));
+      for (auto& op : rank.userOps) NCCLCHECK(ncclRedOpDestroy(op.second, rank.comm));
+      for (hipStream_t s : rank.streams) HIPCHECK(hipStreamDestroy(s));
+      if (rank.sendbuff) HIPCHECK(hipFree(rank.sendbuff));
+      if (rank.recvbuff) HIPCHECK(hipFree(rank.recvbuff));
+      NCCLCHECK(ncclCommDestroy(rank.comm));
+    }
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,320 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Bandwidth of the CPU copies of the SHM transport (src/misc/cpucopy.cc,
+// RCCL_SHM_CPU_COPY_THREADS) between two processes, which can be bound to
+// different NUMA nodes. The sender copies steps from a local buffer to the
+// NCCL_STEPS slots of a shared ring, the receiver copies them out to its own
+// buffer, and each side keeps up to NCCL_STEPS copies in flight with the same
+// protocol as the proxy: a step is published with sizesFifo and tail once
+// its copy completes, and freed with head once the receiver is done with it.
+// The ring is first touched by the receiver (-l 2, as SHM_LOCALITY) or the
+// sender (-l 1), which places it on that side's node.
+//
+// Each run reports the bandwidth seen by the receiver for a number of copy
+// threads per process (-t) with non-temporal stores and/or memcpy (-m).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <strings.h>
+#include <algorithm>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "cpucopy.h"
+#include "debug.h"
+
+#define NCCL_STEPS 8
+
+// Stub of the RCCL logger. NCCL_DEBUG=WARN (default) or INFO
+int ncclDebugLevel = -1;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+void ncclSetThreadName(pthread_t thread, const char *fmt, ...) {}
+
+// Shared between the processes, followed by the ring
+struct Ctrl {
+  uint64_t tail;              // steps published by the sender
+  uint64_t head;              // steps released by the receiver
+  int sizesFifo[NCCL_STEPS];
+  int ready;                  // ring touched, the run can start
+  int errors;
+  uint64_t startNs, endNs;
+};
+
+struct Config {
+  size_t stepSize, chunkSize, bytes, bufferSize;
+  int nThreads, nonTemporal, locality, verify;
+};
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+// CPUs of a NUMA node, or all the CPUs when sysfs has no node information
+static int nodeCpus(int node, cpu_set_t* cpus) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  FILE* file = fopen(path, "r");
+  CPU_ZERO(cpus);
+  if (file == NULL) {
+    if (node != 0) return 1;
+    return sched_getaffinity(0, sizeof(cpu_set_t), cpus);
+  }
+  int first, last;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-' && fscanf(file, "%d", &last) == 1) c = fgetc(file);
+    for (int cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+    if (c != ',') break;
+  }
+  fclose(file);
+  return CPU_COUNT(cpus) ? 0 : 1;
+}
+
+static inline uint64_t pattern(size_t offset) { return offset * 0x9E3779B97F4A7C15ull + 1; }
+
+// One side of the transfer, in its own process. Steps are copied in
+// order; step s uses ring slot s % NCCL_STEPS.
+static int runSide(bool sender, Config const& cfg, Ctrl* ctrl, char* ring, cpu_set_t* cpus)
+{
+  sched_setaffinity(0, sizeof(cpu_set_t), cpus);
+  char* buffer = (char*)aligned_alloc(4096, cfg.bufferSize);
+  if (buffer == NULL) return 1;
+  if (sender)
+    for (size_t o = 0; o < cfg.bufferSize; o += sizeof(uint64_t)) *(uint64_t*)(buffer + o) = pattern(o);
+  else
+    memset(buffer, 0, cfg.bufferSize);
+  if (sender == (cfg.locality == 1))
+  {
+    memset(ring, 0, NCCL_STEPS * cfg.stepSize);
+    __atomic_store_n(&ctrl->ready, 1, __ATOMIC_RELEASE);
+  }
+  while (__atomic_load_n(&ctrl->ready, __ATOMIC_ACQUIRE) == 0) sched_yield();
+
+  struct ncclCpuCopyPool* pool;
+  if (ncclCpuCopyPoolCreate(&pool, cfg.nThreads, cfg.chunkSize, cfg.nonTemporal, cpus) != ncclSuccess) return 1;
+  uint32_t pending[NCCL_STEPS] = {};
+  uint64_t nSteps = (cfg.bytes + cfg.stepSize - 1) / cfg.stepSize;
+  uint64_t transmitted = 0, done = 0;
+  if (sender) ctrl->startNs = nowNs();
+  while (done < nSteps)
+  {
+    if (transmitted < done + NCCL_STEPS && transmitted < nSteps)
+    {
+      int slot = transmitted % NCCL_STEPS;
+      size_t offset = (transmitted * cfg.stepSize) % cfg.bufferSize;
+      char* slotBuff = ring + slot * cfg.stepSize;
+      if (sender && __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE) + NCCL_STEPS > transmitted)
+      {
+        int size = std::min(cfg.stepSize, cfg.bytes - transmitted * cfg.stepSize);
+        if (ncclCpuCopyPoolSubmit(pool, slotBuff, buffer + offset, size, pending + slot) != ncclSuccess) return 1;
+        ctrl->sizesFifo[slot] = size;
+        transmitted++;
+        continue;
+      }
+      if (!sender && __atomic_load_n(&ctrl->tail, __ATOMIC_ACQUIRE) > transmitted)
+      {
+        if (ncclCpuCopyPoolSubmit(pool, buffer + offset, slotBuff, ctrl->sizesFifo[slot], pending + slot) != ncclSuccess) return 1;
+        transmitted++;
+        continue;
+      }
+    }
+    if (done < transmitted && __atomic_load_n(pending + done % NCCL_STEPS, __ATOMIC_ACQUIRE) == 0)
+    {
+      if (!sender && cfg.verify)
+      {
+        size_t offset = (done * cfg.stepSize) % cfg.bufferSize;
+        int size = ctrl->sizesFifo[done % NCCL_STEPS];
+        for (int o = 0; o + sizeof(uint64_t) <= (size_t)size; o += sizeof(uint64_t))
+        {
+          if (*(uint64_t*)(buffer + offset + o) != pattern(offset + o))
+          {
+            if (ctrl->errors++ < 10) printf("Step %lu: wrong data at offset %d\n", done, o);
+            break;
+          }
+        }
+      }
+      done++;
+      __atomic_store_n(sender ? &ctrl->tail : &ctrl->head, done, __ATOMIC_RELEASE);
+      continue;
+    }
+    sched_yield();
+  }
+  if (!sender) ctrl->endNs = nowNs();
+  ncclCpuCopyPoolDestroy(pool);
+  free(buffer);
+  return 0;
+}
+
+static size_t parseSize(char const* str)
+{
+  char* end;
+  size_t value = strtoull(str, &end, 0);
+  switch (*end)
+  {
+  case 'G': case 'g': value <<= 10;  // fall through
+  case 'M': case 'm': value <<= 10;  // fall through
+  case 'K': case 'k': value <<= 10;
+  }
+  return value;
+}
+
+static void usage(char const* exe)
+{
+  printf("Usage: %s [-s sendNode] [-r recvNode] [-t nThreads[,nThreads...]] [-m nt|memcpy|both] [-S stepSize]\n"
+         "       [-c chunkSize] [-n bytes] [-B bufferSize] [-l 1|2] [-v]\n", exe);
+}
+
+int main(int argc, char **argv)
+{
+  int sendNode = 0, recvNode = 0;
+  std::vector<int> threadCounts = {1, 2, 4};
+  std::string modes = "both";
+  Config cfg;
+  cfg.stepSize   = 512 << 10; // SIMPLE buffer of 4MB over NCCL_STEPS
+  cfg.chunkSize  = 128 << 10;
+  cfg.bytes      = 1 << 30;
+  cfg.bufferSize = 64 << 20;
+  cfg.locality   = 2;
+  cfg.verify     = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:t:m:S:c:n:B:l:vh")) != -1)
+  {
+    switch (opt)
+    {
+    case 's': sendNode       = atoi(optarg); break;
+    case 'r': recvNode       = atoi(optarg); break;
+    case 't':
+    {
+      threadCounts.clear();
+      std::stringstream ss(optarg);
+      std::string n;
+      while (std::getline(ss, n, ',')) threadCounts.push_back(atoi(n.c_str()));
+      break;
+    }
+    case 'm': modes          = optarg; break;
+    case 'S': cfg.stepSize   = parseSize(optarg); break;
+    case 'c': cfg.chunkSize  = parseSize(optarg); break;
+    case 'n': cfg.bytes      = parseSize(optarg); break;
+    case 'B': cfg.bufferSize = parseSize(optarg); break;
+    case 'l': cfg.locality   = atoi(optarg); break;
+    case 'v': cfg.verify     = 1; break;
+    default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (cfg.stepSize == 0 || cfg.stepSize % sizeof(uint64_t) || cfg.bytes == 0 || cfg.chunkSize == 0 ||
+      cfg.bufferSize < cfg.stepSize || cfg.bufferSize % cfg.stepSize || (cfg.locality != 1 && cfg.locality != 2) ||
+      (modes != "nt" && modes != "memcpy" && modes != "both") || threadCounts.empty() ||
+      *std::min_element(threadCounts.begin(), threadCounts.end()) < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  cpu_set_t sendCpus, recvCpus;
+  if (nodeCpus(sendNode, &sendCpus) || nodeCpus(recvNode, &recvCpus))
+  {
+    printf("Could not find the CPUs of NUMA nodes %d and %d\n", sendNode, recvNode);
+    return 1;
+  }
+
+  // Control block on its own page, so that the ring pages stay untouched until a run
+  size_t shmSize = 4096 + NCCL_STEPS * cfg.stepSize;
+  void* shm = mmap(NULL, shmSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shm == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  Ctrl* ctrl = (Ctrl*)shm;
+  char* ring = (char*)shm + 4096;
+
+  printf("# %lu MB, sender on node %d, receiver on node %d, ring on the %s side, %lu bytes steps, %lu bytes chunks\n",
+         cfg.bytes >> 20, sendNode, recvNode, cfg.locality == 1 ? "sender" : "receiver", cfg.stepSize, cfg.chunkSize);
+  printf("%-8s %8s %10s\n", "#mode", "threads", "GB/s");
+  int errors = 0;
+  for (int nt = 1; nt >= 0; nt--)
+  {
+    if ((nt && modes == "memcpy") || (!nt && modes == "nt")) continue;
+    for (int nThreads : threadCounts)
+    {
+      cfg.nThreads    = nThreads;
+      cfg.nonTemporal = nt;
+      memset(ctrl, 0, sizeof(Ctrl));
+      // Give the pages of the ring back, so that the next run places them again
+      madvise(ring, NCCL_STEPS * cfg.stepSize, MADV_REMOVE);
+      pid_t pids[2];
+      for (int side = 0; side < 2; side++)
+      {
+        pids[side] = fork();
+        if (pids[side] == 0) _exit(runSide(side == 0, cfg, ctrl, ring, side == 0 ? &sendCpus : &recvCpus));
+        if (pids[side] < 0)
+        {
+          perror("fork");
+          return 1;
+        }
+      }
+      for (int side = 0; side < 2; side++)
+      {
+        int status;
+        if (waitpid(pids[side], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+          printf("The %s process failed\n", side == 0 ? "sender" : "receiver");
+          errors++;
+        }
+      }
+      errors += ctrl->errors;
+      double seconds = (ctrl->endNs - ctrl->startNs) * 1e-9;
+      printf("%-8s %8d %10.2f\n", nt ? "nt" : "memcpy", nThreads, cfg.bytes / seconds / 1e9);
+    }
+  }
+  munmap(shm, shmSize);
+  if (errors)
+  {
+    printf("%d errors\n", errors);
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,267 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Loopback stress test of the socket connection manager (src/misc/socket.cc).
+// It creates nPeers sockets bound to 127.0.0.1 which only start listening
+// after a random delay, so that connections are refused for a while, like
+// ranks connecting to peers which have not finished their initialization.
+// All peers are then connected with:
+//  - legacy: blocking connect() retried every SLEEP_INT usec, one peer at a time
+//  - serial: ncclSocketConnect, one peer at a time
+//  - many:   ncclSocketConnectMany, all peers at once
+// Each connection sends its peer index, which the accepting thread checks.
+// The tool reports the time and the number of connect() calls of each mode.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include "socket.h"
+#include "utils.h"
+
+// Stub of the RCCL logger. NCCL_DEBUG=WARN (default) or INFO
+int ncclDebugLevel = -1;
+thread_local int ncclDebugNoWarn = 0;
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  if (ncclDebugLevel == -1) {
+    const char* env = getenv("NCCL_DEBUG");
+    ncclDebugLevel = env && strcasecmp(env, "INFO") == 0 ? NCCL_LOG_INFO : NCCL_LOG_WARN;
+  }
+  if (level > ncclDebugLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s ", level == NCCL_LOG_WARN ? "WARN" : "INFO");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+// Interface matching of src/misc/utils.cc (which needs the HIP runtime), only
+// used by ncclFindInterfaces
+int parseStringList(const char* string, struct netIf* ifList, int maxList) { return 0; }
+bool matchIfList(const char* string, int port, struct netIf* ifList, int listSize, bool matchExact) { return false; }
+
+// connect() calls, counted for all modes by interposing the libc symbol
+#include <dlfcn.h>
+static int nConnectCalls = 0;
+extern "C" int connect(int fd, const struct sockaddr* addr, socklen_t len) {
+  typedef int (*connect_t)(int, const struct sockaddr*, socklen_t);
+  static connect_t realConnect = (connect_t)dlsym(RTLD_NEXT, "connect");
+  __atomic_fetch_add(&nConnectCalls, 1, __ATOMIC_RELAXED);
+  return realConnect(fd, addr, len);
+}
+
+struct Peers {
+  int nPeers;
+  std::vector<int> fds;          // bound, listening after delays[i]
+  std::vector<double> delays;    // sec
+  std::vector<ncclSocketAddress> addrs;
+  int errors;
+};
+
+static double now() { return clockNano() * 1e-9; }
+
+static int createPeers(Peers* p, int nPeers, double maxDelay, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dist(0, maxDelay);
+  p->nPeers = nPeers;
+  p->errors = 0;
+  p->fds.resize(nPeers);
+  p->delays.resize(nPeers);
+  p->addrs.resize(nPeers);
+  for (int i=0; i<nPeers; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) { perror("socket"); return 1; }
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port = 0;
+    socklen_t len = sizeof(sin);
+    if (bind(fd, (struct sockaddr*)&sin, len) || getsockname(fd, (struct sockaddr*)&sin, &len)) { perror("bind"); return 1; }
+    memset(&p->addrs[i], 0, sizeof(ncclSocketAddress));
+    memcpy(&p->addrs[i].sin, &sin, sizeof(sin));
+    p->fds[i] = fd;
+    p->delays[i] = dist(gen);
+  }
+  return 0;
+}
+
+// Starts listening on each peer after its delay and accepts one connection per
+// peer, checking the index received on it
+static void* acceptThread(void* args) {
+  Peers* p = (Peers*)args;
+  std::vector<int> order(p->nPeers);
+  for (int i=0; i<p->nPeers; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](int a, int b) { return p->delays[a] < p->delays[b]; });
+  std::vector<struct pollfd> pfds;
+  std::vector<int> peerOf;
+  std::vector<int> conns(p->nPeers, -1);
+  double start = now();
+  int next = 0, accepted = 0;
+  while (accepted < p->nPeers) {
+    double t = now() - start;
+    while (next < p->nPeers && p->delays[order[next]] <= t) {
+      int i = order[next++];
+      if (listen(p->fds[i], 16)) { perror("listen"); p->errors++; return NULL; }
+      pfds.push_back({p->fds[i], POLLIN, 0});
+      peerOf.push_back(i);
+    }
+    int timeout = next < p->nPeers ? std::max(0, (int)((p->delays[order[next]] - t) * 1000)) : 1000;
+    if (poll(pfds.data(), pfds.size(), timeout) < 0) { perror("poll"); p->errors++; return NULL; }
+    for (size_t k=0; k<pfds.size(); k++) {
+      if (!(pfds[k].revents & POLLIN) || pfds[k].fd < 0) continue;
+      int fd = accept(pfds[k].fd, NULL, NULL);
+      if (fd == -1) { perror("accept"); p->errors++; return NULL; }
+      conns[peerOf[k]] = fd;
+      pfds[k].fd = -1; // one connection per peer
+      accepted++;
+    }
+  }
+  // Indices are sent once all peers are connected
+  for (int i=0; i<p->nPeers; i++) {
+    int idx = -1;
+    if (read(conns[i], &idx, sizeof(idx)) != sizeof(idx) || idx != i) {
+      fprintf(stderr, "Peer %d received index %d\n", i, idx);
+      p->errors++;
+    }
+    close(conns[i]);
+  }
+  return NULL;
+}
+
+static int connectLegacy(ncclSocket* sock) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) return 1;
+  for (int retries = 0; connect(fd, &sock->addr.sa, sizeof(struct sockaddr_in)); retries++) {
+    if ((errno != ECONNREFUSED && errno != EAGAIN) || retries == RETRY_REFUSED_TIMES) { close(fd); return 1; }
+    usleep(SLEEP_INT);
+  }
+  sock->fd = fd;
+  return 0;
+}
+
+enum Mode { Legacy, Serial, Many, NumModes };
+static const char* modeNames[NumModes] = { "legacy", "serial", "many" };
+
+static int runMode(Mode mode, int nPeers, double maxDelay, unsigned seed, double* time, int* calls) {
+  Peers p;
+  if (createPeers(&p, nPeers, maxDelay, seed)) return 1;
+  std::vector<ncclSocket> socks(nPeers);
+  std::vector<ncclSocket*> sockPtrs(nPeers);
+  for (int i=0; i<nPeers; i++) {
+    memset(&socks[i], 0, sizeof(ncclSocket));
+    socks[i].addr = p.addrs[i];
+    socks[i].fd = -1;
+    sockPtrs[i] = &socks[i];
+  }
+  pthread_t thread;
+  pthread_create(&thread, NULL, acceptThread, &p);
+  int calls0 = __atomic_load_n(&nConnectCalls, __ATOMIC_RELAXED);
+  double start = now();
+  int err = 0;
+  if (mode == Many) {
+    err = ncclSocketConnectMany(sockPtrs.data(), nPeers) != ncclSuccess;
+  } else {
+    for (int i=0; i<nPeers && !err; i++)
+      err = mode == Legacy ? connectLegacy(&socks[i]) : ncclSocketConnect(&socks[i]) != ncclSuccess;
+  }
+  *time = now() - start;
+  *calls = __atomic_load_n(&nConnectCalls, __ATOMIC_RELAXED) - calls0;
+  for (int i=0; i<nPeers && !err; i++) {
+    if (write(socks[i].fd, &i, sizeof(i)) != sizeof(i)) err = 1;
+  }
+  if (err) {
+    fprintf(stderr, "Connection failed in mode %s\n", modeNames[mode]);
+    exit(1); // the accept thread waits for all peers
+  }
+  pthread_join(thread, NULL);
+  for (int i=0; i<nPeers; i++) {
+    close(socks[i].fd);
+    close(p.fds[i]);
+  }
+  return p.errors;
+}
+
+static void usage(const char* name) {
+  printf("Usage: %s [-n nPeers] [-d maxDelayMs] [-r rounds] [-s seed] [-m legacy|serial|many|all]\n", name);
+}
+
+int main(int argc, char* argv[]) {
+  int nPeers = 256, rounds = 3, modeMask = (1<<NumModes)-1;
+  double maxDelay = 0.2;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:r:s:m:h")) != -1) {
+    switch (opt) {
+      case 'n': nPeers = atoi(optarg); break;
+      case 'd': maxDelay = atof(optarg) * 1e-3; break;
+      case 'r': rounds = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'm':
+        modeMask = 0;
+        for (int m=0; m<NumModes; m++) if (strcmp(optarg, modeNames[m]) == 0) modeMask = 1<<m;
+        if (strcmp(optarg, "all") == 0) modeMask = (1<<NumModes)-1;
+        if (modeMask == 0) { usage(argv[0]); return 1; }
+        break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (nPeers < 1 || rounds < 1) { usage(argv[0]); return 1; }
+
+  // Two sockets per peer
+  struct rlimit filesLimit;
+  getrlimit(RLIMIT_NOFILE, &filesLimit);
+  filesLimit.rlim_cur = filesLimit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &filesLimit);
+  if (filesLimit.rlim_cur < (rlim_t)(2*nPeers + 64)) {
+    fprintf(stderr, "Too many peers for RLIMIT_NOFILE %lu\n", (unsigned long)filesLimit.rlim_cur);
+    return 1;
+  }
+
+  printf("%d peers listening after 0-%.0f ms, %d rounds\n", nPeers, maxDelay*1e3, rounds);
+  printf("%8s %12s %12s %14s\n", "mode", "avg (ms)", "max (ms)", "connect calls");
+  int errors = 0;
+  for (int m=0; m<NumModes; m++) {
+    if (!(modeMask & (1<<m))) continue;
+    double sum = 0, max = 0;
+    long calls = 0;
+    for (int r=0; r<rounds; r++) {
+      double t = 0;
+      int c = 0;
+      errors += runMode((Mode)m, nPeers, maxDelay, seed+r, &t, &c);
+      sum += t;
+      max = std::max(max, t);
+      calls += c;
+    }
+    printf("%8s %12.2f %12.2f %14.1f\n", modeNames[m], sum/rounds*1e3, max*1e3, (double)calls/rounds);
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host only simulator for the switch locality ordering of nodes
+// (src/graph/locality.cc). Builds a fat tree cluster (nodes under leaf
+// switches, leaf switches under spine switches), numbers nodes in an order
+// which does not follow the switches, as job schedulers often do, and counts
+// for each channel the inter-node ring and tree hops which leave a leaf switch
+// or a spine switch, in rank order (as before) and in switch order. Checks that
+// switch order is optimal for rings: each switch group is entered only once.
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include "nccl.h"
+#include "trees.h"
+#include "locality.h"
+
+struct Options {
+  int nSpines = 4;
+  int leavesPerSpine = 4;
+  int nodesPerLeaf = 8;
+  int mode = 0;       // 0 : random node numbering, 1 : round robin over leaves, 2 : switch order
+  int unknown = 0;    // number of nodes with unknown switches
+  int nChannels = 4;
+  int seed = 1;
+};
+
+struct Counts {
+  int hops[2]; // leaving a leaf, leaving a spine
+};
+
+static Counts treeCrossings(int nNodes, uint64_t const* paths, int const* order, int tree) {
+  Counts c = { { 0, 0 } };
+  for (int n=0; n<nNodes; n++) {
+    int u, d[NCCL_TREE_MAX_CHILDREN], nd, childType;
+    ncclGetMultiTree(NCCL_TREE_TYPE_BTREE, 2, 2, tree, nNodes, n, &u, d, &nd, &childType);
+    if (u == -1) continue;
+    for (int l=0; l<2; l++) c.hops[l] += !ncclTopoSameSwitch(paths, order[n], order[u], l);
+  }
+  return c;
+}
+
+static int countGroups(int nNodes, uint64_t const* paths, int level) {
+  int groups = 0;
+  for (int n=0; n<nNodes; n++) {
+    int m = 0;
+    while (m < n && !ncclTopoSameSwitch(paths, m, n, level)) m++;
+    if (m == n) groups++;
+  }
+  return groups;
+}
+
+int main(int argc, char* argv[]) {
+  Options o;
+  int opt;
+  while ((opt = getopt(argc, argv, "S:L:n:m:u:c:s:h")) != -1) {
+    switch (opt) {
+      case 'S': o.nSpines = atoi(optarg); break;
+      case 'L': o.leavesPerSpine = atoi(optarg); break;
+      case 'n': o.nodesPerLeaf = atoi(optarg); break;
+      case 'm': o.mode = atoi(optarg); break;
+      case 'u': o.unknown = atoi(optarg); break;
+      case 'c': o.nChannels = atoi(optarg); break;
+      case 's': o.seed = atoi(optarg); break;
+      default:
+        printf("Usage: %s [-S spines] [-L leavesPerSpine] [-n nodesPerLeaf] [-m mode (0 random, 1 round robin over leaves, 2 switch order)] [-u unknownNodes] [-c channels] [-s seed]\n", argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  int nLeaves = o.nSpines*o.leavesPerSpine;
+  int nNodes = nLeaves*o.nodesPerLeaf;
+  if (nNodes < 2 || o.unknown > nNodes) {
+    printf("Invalid cluster size\n");
+    return 1;
+  }
+
+  // Physical node p is under leaf p/nodesPerLeaf; node numbers (i.e. order of
+  // first ranks) are a permutation of physical nodes.
+  std::vector<int> phys(nNodes);
+  for (int p=0; p<nNodes; p++) phys[p] = p;
+  if (o.mode == 0) {
+    std::mt19937 rng(o.seed);
+    std::shuffle(phys.begin(), phys.end(), rng);
+  } else if (o.mode == 1) {
+    for (int n=0; n<nNodes; n++) phys[n] = (n%nLeaves)*o.nodesPerLeaf + n/nLeaves;
+  }
+  std::vector<uint64_t> paths(nNodes*NCCL_TOPO_MAX_SWITCH_LEVELS, 0);
+  for (int n=0; n<nNodes-o.unknown; n++) {
+    int leaf = phys[n]/o.nodesPerLeaf;
+    paths[n*NCCL_TOPO_MAX_SWITCH_LEVELS+0] = 1000+leaf;
+    paths[n*NCCL_TOPO_MAX_SWITCH_LEVELS+1] = 2000+leaf/o.leavesPerSpine;
+  }
+
+  std::vector<int> identity(nNodes), order(nNodes);
+  for (int n=0; n<nNodes; n++) identity[n] = n;
+  if (ncclTopoOrderNodes(nNodes, paths.data(), order.data()) != ncclSuccess) {
+    printf("ncclTopoOrderNodes failed\n");
+    return 1;
+  }
+  int errors = 0;
+  std::vector<int> sorted(order);
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted != identity) {
+    printf("Switch order is not a permutation of nodes\n");
+    errors++;
+  }
+
+  printf("%d nodes, %d leaf switches, %d spine switches, %s numbering, %d nodes with unknown switches\n", nNodes, nLeaves,
+      o.nSpines, o.mode == 0 ? "random" : o.mode == 1 ? "round robin" : "switch", o.unknown);
+  printf("%-8s %-5s | %21s | %21s\n", "channel", "algo", "rank order leaf/spine", "switch order leaf/spine");
+  Counts total[2] = { { { 0, 0 } }, { { 0, 0 } } };
+  // Inter-node rings are the same on every channel; channel c uses tree 0,
+  // channel c+nChannels tree 1.
+  for (int c=0; c<2*o.nChannels; c++) {
+    int tree = c < o.nChannels ? 0 : 1;
+    Counts ring[2], tr[2];
+    int const* orders[2] = { identity.data(), order.data() };
+    for (int i=0; i<2; i++) {
+      for (int l=0; l<2; l++) ring[i].hops[l] = ncclTopoRingCrossings(nNodes, paths.data(), orders[i], l);
+      tr[i] = treeCrossings(nNodes, paths.data(), orders[i], tree);
+      for (int l=0; l<2; l++) total[i].hops[l] += ring[i].hops[l] + tr[i].hops[l];
+    }
+    printf("%-8d %-5s | %10d/%-10d | %10d/%-10d\n", c, "ring", ring[0].hops[0], ring[0].hops[1], ring[1].hops[0], ring[1].hops[1]);
+    printf("%-8d %-5s | %10d/%-10d | %10d/%-10d\n", c, tree ? "tree1" : "tree0", tr[0].hops[0], tr[0].hops[1], tr[1].hops[0], tr[1].hops[1]);
+  }
+  printf("%-8s %-5s | %10d/%-10d | %10d/%-10d\n", "total", "", total[0].hops[0], total[0].hops[1], total[1].hops[0], total[1].hops[1]);
+
+  for (int l=0; l<2; l++) {
+    int groups = countGroups(nNodes, paths.data(), l);
+    int expected = groups > 1 ? groups : 0;
+    int got = ncclTopoRingCrossings(nNodes, paths.data(), order.data(), l);
+    if (got != expected) {
+      printf("Level %d : ring leaves switches %d times, %d switch groups\n", l, got, groups);
+      errors++;
+    }
+  }
+  // Without locality information, the order must not change
+  std::vector<uint64_t> none(nNodes*NCCL_TOPO_MAX_SWITCH_LEVELS, 0);
+  ncclTopoOrderNodes(nNodes, none.data(), order.data());
+  if (order != identity) {
+    printf("Order changed without switch information\n");
+    errors++;
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
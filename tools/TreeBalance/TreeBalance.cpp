@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host only checker for the inter-node trees of src/graph/trees.cc. For each
+// tree type, arity and number of trees, builds the trees for 2 to 1024 nodes
+// and checks that each of them spans all nodes exactly once, with parents and
+// children agreeing on each other and on the child slots. Then reports how
+// balanced the trees are: tree links per node (max/avg over nodes), how many
+// trees share the same node pair, and the depth, compared with the double
+// binary tree.
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include "nccl.h"
+#include "trees.h"
+
+struct Config {
+  int type;
+  int arity;
+  int nTrees;
+};
+
+struct Result {
+  int depth;
+  int maxChildren;
+  float maxLinks;
+  float avgLinks;
+  int maxShare; // largest number of trees using the same node pair
+  int errors;
+};
+
+static const char* typeNames[] = NCCL_TREE_TYPE_NAMES;
+
+static int checkTree(Config const& cfg, int t, int n, std::vector<int>& links, std::map<std::pair<int,int>, int>& pairs,
+    int* depth, int* maxChildren) {
+  std::vector<int> up(n), childType(n), depths(n, -1);
+  std::vector<std::vector<int>> down(n);
+  int errors = 0, roots = 0;
+  for (int r=0; r<n; r++) {
+    int d[NCCL_TREE_MAX_CHILDREN], nd;
+    if (ncclGetMultiTree(cfg.type, cfg.arity, cfg.nTrees, t, n, r, &up[r], d, &nd, &childType[r]) != ncclSuccess) {
+      printf("%s k=%d x%d, %d nodes : tree %d rank %d failed\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, n, t, r);
+      return 1;
+    }
+    if (nd != ncclTreeSlots(cfg.type, cfg.arity, n)) errors++;
+    down[r].assign(d, d+nd);
+    if (up[r] == -1) roots++;
+  }
+  if (roots != 1) {
+    printf("%s k=%d x%d, %d nodes : tree %d has %d roots\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, n, t, roots);
+    errors++;
+  }
+  for (int r=0; r<n; r++) {
+    int nChildren = 0;
+    for (int i=0; i<(int)down[r].size(); i++) {
+      int c = down[r][i];
+      if (c == -1) continue;
+      nChildren++;
+      if (c < 0 || c >= n || up[c] != r || childType[c] != i) {
+        printf("%s k=%d x%d, %d nodes : tree %d rank %d child %d in slot %d does not match\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, n, t, r, c, i);
+        errors++;
+        continue;
+      }
+      links[r]++;
+      links[c]++;
+      pairs[std::make_pair(std::min(r, c), std::max(r, c))]++;
+    }
+    if (up[r] != -1 && (up[r] < 0 || up[r] >= n ||
+          std::count(down[up[r]].begin(), down[up[r]].end(), r) != 1)) {
+      printf("%s k=%d x%d, %d nodes : tree %d rank %d is not a child of its parent %d\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, n, t, r, up[r]);
+      errors++;
+    }
+    *maxChildren = std::max(*maxChildren, nChildren);
+  }
+  if (errors) return errors;
+  // Every rank must reach the root, without loops
+  for (int r=0; r<n; r++) {
+    int x = r, len = 0;
+    while (up[x] != -1 && len <= n) { x = up[x]; len++; }
+    if (len > n) {
+      printf("%s k=%d x%d, %d nodes : tree %d has a loop through rank %d\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, n, t, r);
+      return errors+1;
+    }
+    *depth = std::max(*depth, len);
+  }
+  return errors;
+}
+
+// Trees 0 and 1 of binary trees must be the double binary tree
+static int checkDtree(int n) {
+  int errors = 0;
+  for (int r=0; r<n; r++) {
+    int u[2], d0[2], d1[2], ct[2];
+    ncclGetDtree(n, r, u, d0, d1, ct, u+1, d0+1, d1+1, ct+1);
+    for (int t=0; t<2; t++) {
+      int mu, md[NCCL_TREE_MAX_CHILDREN], nd, mct;
+      ncclGetMultiTree(NCCL_TREE_TYPE_BTREE, 2, 2, t, n, r, &mu, md, &nd, &mct);
+      if (mu != u[t] || md[0] != d0[t] || md[1] != d1[t] || (mu != -1 && mct != ct[t])) {
+        printf("%d nodes : tree %d of rank %d differs from ncclGetDtree\n", n, t, r);
+        errors++;
+      }
+    }
+  }
+  return errors;
+}
+
+static Result evaluate(Config const& cfg, int n) {
+  Result res = {};
+  std::vector<int> links(n, 0);
+  std::map<std::pair<int,int>, int> pairs;
+  for (int t=0; t<cfg.nTrees; t++) res.errors += checkTree(cfg, t, n, links, pairs, &res.depth, &res.maxChildren);
+  long total = 0;
+  for (int r=0; r<n; r++) {
+    res.maxLinks = std::max(res.maxLinks, (float)links[r]/cfg.nTrees);
+    total += links[r];
+  }
+  res.avgLinks = (float)total/n/cfg.nTrees;
+  for (auto const& p : pairs) res.maxShare = std::max(res.maxShare, p.second);
+  if (res.errors) return res;
+  // The tuning model uses ncclGetTreeStats, which must agree
+  struct ncclTreeStats stats;
+  if (ncclGetTreeStats(cfg.type, cfg.arity, cfg.nTrees, n, &stats) != ncclSuccess ||
+      stats.depth != res.depth || stats.maxChildren != res.maxChildren || stats.maxLinks != res.maxLinks) {
+    printf("%s k=%d x%d, %d nodes : ncclGetTreeStats mismatch\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, n);
+    res.errors++;
+  }
+  return res;
+}
+
+int main(int argc, char* argv[]) {
+  int minNodes = 2, maxNodes = 1024, verbose = 0;
+  std::vector<Config> configs;
+  Config custom = { -1, 2, 2 };
+  int opt;
+  while ((opt = getopt(argc, argv, "t:k:T:n:N:vh")) != -1) {
+    switch (opt) {
+      case 't': custom.type = atoi(optarg); break;
+      case 'k': custom.arity = atoi(optarg); break;
+      case 'T': custom.nTrees = atoi(optarg); break;
+      case 'n': minNodes = atoi(optarg); break;
+      case 'N': maxNodes = atoi(optarg); break;
+      case 'v': verbose = 1; break;
+      default:
+        printf("Usage: %s [-t type (0 btree, 1 kary, 2 knomial, default: a set of configs)] [-k arity] [-T trees] [-n minNodes] [-N maxNodes] [-v (print every size)]\n", argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (custom.type >= 0) {
+    configs.push_back(custom);
+  } else {
+    configs = {
+      { NCCL_TREE_TYPE_BTREE, 2, 2 }, { NCCL_TREE_TYPE_BTREE, 2, 4 }, { NCCL_TREE_TYPE_BTREE, 2, 8 },
+      { NCCL_TREE_TYPE_KARY, 1, 2 }, { NCCL_TREE_TYPE_KARY, 2, 2 }, { NCCL_TREE_TYPE_KARY, 2, 4 },
+      { NCCL_TREE_TYPE_KARY, 4, 4 }, { NCCL_TREE_TYPE_KNOMIAL, 2, 2 }, { NCCL_TREE_TYPE_KNOMIAL, 4, 4 },
+      { NCCL_TREE_TYPE_KNOMIAL, 8, 2 }
+    };
+  }
+
+  int errors = 0;
+  for (int n=minNodes; n<=maxNodes; n++) errors += checkDtree(n);
+  printf("%-8s %5s %5s | %9s %9s %9s %9s | %s\n", "type", "arity", "trees", "maxDepth", "maxLinks", "avgLinks",
+      "maxChild", "depth/maxLinks/maxShare at 16, 128, 1024 nodes (double binary tree)");
+  for (auto const& cfg : configs) {
+    Result worst = {};
+    char sample[256] = "";
+    int len = 0;
+    for (int n=minNodes; n<=maxNodes; n++) {
+      Result res = evaluate(cfg, n);
+      errors += res.errors;
+      worst.depth = std::max(worst.depth, res.depth);
+      worst.maxLinks = std::max(worst.maxLinks, res.maxLinks);
+      worst.avgLinks = std::max(worst.avgLinks, res.avgLinks);
+      worst.maxChildren = std::max(worst.maxChildren, res.maxChildren);
+      if (verbose) printf("  %s k=%d x%d, %4d nodes : depth %d, links max %.2f avg %.2f, pair shared by %d trees, max %d children\n",
+          typeNames[cfg.type], cfg.arity, cfg.nTrees, n, res.depth, res.maxLinks, res.avgLinks, res.maxShare, res.maxChildren);
+      if ((n == 16 || n == 128 || n == 1024) && len < (int)sizeof(sample)) {
+        Result ref = evaluate({ NCCL_TREE_TYPE_BTREE, 2, 2 }, n);
+        len += snprintf(sample+len, sizeof(sample)-len, "%d/%.2f/%d (%d/%.2f/%d) ", res.depth, res.maxLinks, res.maxShare,
+            ref.depth, ref.maxLinks, ref.maxShare);
+      }
+    }
+    printf("%-8s %5d %5d | %9d %9.2f %9.2f %9d | %s\n", typeNames[cfg.type], cfg.arity, cfg.nTrees, worst.depth,
+        worst.maxLinks, worst.avgLinks, worst.maxChildren, sample);
+  }
+  printf("%s\n", errors ? "FAILED" : "PASSED");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Copyright (c) 2022 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+# Check that paths recomputed incrementally after trimming the system match a
+# full recomputation, for all topo_expl models.
+
+DIR="$(cd -P "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+TOPO_EXPL=$DIR/../topo_expl/topo_expl
+
+NUM_MODELS=$($TOPO_EXPL | grep -c "^  [0-9]*:")
+FAILED=0
+
+for ((i=0; i<NUM_MODELS; i++))
+do
+	if ! $TOPO_EXPL -m $i -p > "topo_paths_m$i.log" 2>&1
+	then
+		echo "Model $i: FAILED (see topo_paths_m$i.log)"
+		FAILED=1
+	elif grep -q "incremental paths differ" "topo_paths_m$i.log"
+	then
+		echo "Model $i: paths differ (see topo_paths_m$i.log)"
+		FAILED=1
+	fi
+done
+
+if [[ $FAILED -eq 0 ]]
+then
+	echo "Incremental paths verified on $NUM_MODELS models"
+fi
+exit $FAILED
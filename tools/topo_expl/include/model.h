@@ -50,12 +50,16 @@ public:
     };
     strcat(filename, "models/");
     strcat(filename, xml_file);
-    struct ncclTopoSystem* system;
-    ncclTopoGetSystem(filename, &system);
-    systems.push_back(system);
-    for (int i=0; i<getNumGpus()-1; i++) {
+    if (topoShared) {
+      ncclTopoGetSharedSystems(filename, systems);
+    } else {
+      struct ncclTopoSystem* system;
       ncclTopoGetSystem(filename, &system);
       systems.push_back(system);
+      for (int i=0; i<getNumGpus()-1; i++) {
+        ncclTopoGetSystem(filename, &system);
+        systems.push_back(system);
+      }
     }
     hostHash = ((uint64_t)rand() << 32) | rand();
     pidHash = ((uint64_t)rand() << 32) | rand();
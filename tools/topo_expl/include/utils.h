@@ -8,6 +8,8 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <vector>
+
 // AllGather3 - begin
 struct ncclGraphInfo {
   int pattern;
@@ -32,8 +34,13 @@ struct allGather3Data_t{
 
 void initCollNet();
 
+extern bool verifyPaths;
+extern bool topoShared;
+
 ncclResult_t ncclTopoGetSystem(const char* xmlTopoFile, struct ncclTopoSystem** system);
 
+ncclResult_t ncclTopoGetSharedSystems(const char* xmlTopoFile, std::vector<struct ncclTopoSystem*>& systems);
+
 ncclResult_t ncclTopoGetSystemFromXml(struct ncclXml* xml, struct ncclTopoSystem** topoSystem);
 
 ncclResult_t fillInfo(struct ncclComm* comm, struct ncclPeerInfo* info, uint64_t commHash);
@@ -159,7 +159,9 @@ int main(int argc,char* argv[])
   const int num_models = sizeof(model_descs) / sizeof(*model_descs);
 
   if (!cmdOptionExists(argv, argv + argc, "-m")) {
-    printf("Usage: ./topo_expl -m model_id\n");
+    printf("Usage: ./topo_expl -m model_id [-p] [-s]\n");
+    printf("  -p: verify incremental path recomputation\n");
+    printf("  -s: share the topology of each node through shared memory (RCCL_TOPO_SHARED=1)\n");
     printf("List of model_id:\n");
     for (int i = 0; i < num_models; i++)
       printf("  %d: %s\n", i, model_descs[i].description);
@@ -176,6 +178,9 @@ int main(int argc,char* argv[])
       exit(0);
   }
 
+  verifyPaths = cmdOptionExists(argv, argv + argc, "-p");
+  topoShared = cmdOptionExists(argv, argv + argc, "-s");
+
   NetworkModel network;
   NodeModel* node;
 
@@ -127,6 +127,47 @@ ncclResult_t ncclTopoGetSystem(const char* xmlTopoFile, struct ncclTopoSystem**
   return ncclSuccess;
 }
 
+bool topoShared = false;
+
+// Same as RCCL_TOPO_SHARED=1: the first GPU of the node parses the XML and
+// publishes it, the other GPUs restore it from the shared memory segment.
+ncclResult_t ncclTopoGetSharedSystems(const char* xmlTopoFile, std::vector<struct ncclTopoSystem*>& systems) {
+  struct ncclXml* xml;
+  struct ncclXmlNode* nodes;
+  int nNodes;
+  struct ncclTopoSystem* system;
+  NCCLCHECK(ncclCalloc(&xml, 1));
+  NCCLCHECK(ncclTopoGetXmlFromFile(xmlTopoFile, xml, 0));
+  NCCLCHECK(ncclTopoXmlSnapshot(xml, &nodes, &nNodes));
+  NCCLCHECK(ncclTopoGetSystemFromXml(xml, &system));
+  systems.push_back(system);
+  int nReaders = system->nodes[GPU].count-1;
+  if (nReaders > 0) {
+    struct ncclTopoXmlShmInfo info;
+    NCCLCHECK(ncclTopoXmlShmPublish(nodes, nNodes, nReaders, &info));
+    for (int r=0; r<nReaders; r++) {
+      NCCLCHECK(ncclTopoXmlShmRead(&info, xml));
+      NCCLCHECK(ncclTopoGetSystemFromXml(xml, &system));
+      systems.push_back(system);
+    }
+    if (access(info.shmPath, F_OK) == 0) {
+      WARN("Shared topology %s was not removed by the last reader", info.shmPath);
+      return ncclInternalError;
+    }
+  }
+  free(nodes);
+  free(xml);
+  return ncclSuccess;
+}
+
+// topo_expl builds the systems of the ranks from the models, ncclTopoGetSystem(comm) is never called
+ncclResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
+  return ncclInternalError;
+}
+ncclResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
+  return ncclInternalError;
+}
+
 
 void initCollNet() {
   if (ncclParamCollNetEnable() == 1 && ncclCollNet == 0)
@@ -461,6 +502,55 @@ ncclResult_t ncclTransportCollNetFree(struct ncclComm* comm) {
   return ncclSuccess;
 }
 
+bool verifyPaths = false;
+
+// Flatten all pre-computed paths into a vector, replacing link pointers by
+// (node type, node index, link index) so that two computations can be compared.
+static void getPathsSignature(struct ncclTopoSystem* system, std::vector<int64_t>& sig) {
+  sig.clear();
+  for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) {
+    for (int n=0; n<system->nodes[t].count; n++) {
+      struct ncclTopoNode* node = system->nodes[t].nodes+n;
+      for (int r=0; r<NCCL_TOPO_NODE_TYPES; r++) {
+        sig.push_back(node->paths[r] ? system->nodes[r].count : -1);
+        if (node->paths[r] == NULL) continue;
+        for (int p=0; p<system->nodes[r].count; p++) {
+          struct ncclTopoLinkList* path = node->paths[r]+p;
+          sig.push_back(path->count);
+          sig.push_back(path->type);
+          sig.push_back((int64_t)(path->width*1000));
+          for (int i=0; i<path->count; i++) {
+            for (int lt=0; lt<NCCL_TOPO_NODE_TYPES; lt++) {
+              struct ncclTopoNode* nodes = system->nodes[lt].nodes;
+              if ((char*)path->list[i] < (char*)nodes || (char*)path->list[i] >= (char*)(nodes+system->nodes[lt].count)) continue;
+              int ln = ((char*)path->list[i] - (char*)nodes) / sizeof(struct ncclTopoNode);
+              sig.push_back(lt);
+              sig.push_back(ln);
+              sig.push_back(path->list[i] - nodes[ln].links);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Check that paths maintained incrementally across ncclTopoTrimSystem are the
+// same as the ones computed from scratch.
+static ncclResult_t verifyIncrementalPaths(struct ncclComm* comm) {
+  std::vector<int64_t> incremental, full;
+  getPathsSignature(comm->topo, incremental);
+  comm->topo->pathsValid = 0;
+  NCCLCHECK(ncclTopoComputePaths(comm->topo, comm));
+  getPathsSignature(comm->topo, full);
+  if (incremental != full) {
+    WARN("Rank %d : incremental paths differ from full recomputation", comm->rank);
+    return ncclInternalError;
+  }
+  printf("Rank %d: incremental paths verified (%ld entries)\n", comm->rank, full.size());
+  return ncclSuccess;
+}
+
 RCCL_PARAM(P2pNetDisable, "P2P_NET_DISABLE", 0);
 RCCL_PARAM(PivotAlltoallEnable, "PIVOT_ALLTOALL_ENABLE", 0);
 
@@ -508,6 +598,7 @@ ncclResult_t initTransportsRank_1(struct ncclComm* comm, struct allGather3Data_t
   NCCLCHECK(ncclTopoTrimSystem(comm->topo, comm));
   // Recompute paths after trimming
   NCCLCHECK(ncclTopoComputePaths(comm->topo, comm));
+  if (verifyPaths) NCCLCHECK(verifyIncrementalPaths(comm));
   // Init search
   NCCLCHECK(ncclTopoSearchInit(comm->topo));
   // Print final topology